@@ -1,18 +1,450 @@
+const fs = require('fs');
+const path = require('path');
+const zlib = require('zlib');
+
+const UPLOAD_DIR = path.join(__dirname, '../uploads');
+const CHUNK_DIR = path.join(UPLOAD_DIR, '.chunks');
+
+const OP_END = 0;
+const OP_COPY = 1;
+const OP_DATA = 2;
+
+// Longest stored file name, directories included
+const MAX_NAME = 4096;
+
+let tempCounter = 0;
+
+// Stored file names: relative paths without empty, hidden, "." or ".." components (temporary files are hidden)
+function validName(name) {
+    if (typeof name !== 'string' || !name || Buffer.byteLength(name) > MAX_NAME || name.includes('\0')) {
+        return false;
+    }
+    return name.split('/').every((part) => part !== '' && !part.startsWith('.'));
+}
+
+// Create the directories of a valid name under the upload directory; an existing one must be a real directory, not a symlink
+function makeParents(name) {
+    let dir = UPLOAD_DIR;
+    for (const part of name.split('/').slice(0, -1)) {
+        dir = path.join(dir, part);
+        try {
+            fs.mkdirSync(dir, 0o755);
+        } catch (err) {
+            if (err.code !== 'EEXIST') {
+                throw err;
+            }
+        }
+        if (!fs.lstatSync(dir).isDirectory()) {
+            throw new Error(`${dir} is not a directory`);
+        }
+    }
+}
+
+// Remove the directories of a name under the upload directory that became empty
+function removeEmptyParents(name) {
+    for (let end = name.lastIndexOf('/'); end > 0; end = name.lastIndexOf('/', end - 1)) {
+        try {
+            fs.rmdirSync(path.join(UPLOAD_DIR, name.slice(0, end)));
+        } catch (err) {
+            return;
+        }
+    }
+}
+
+// Temporary file next to target: hidden, so it is never listed and no stored name can collide with it
+function tempPath(target, kind) {
+    return path.join(path.dirname(target), `.${kind}-${process.pid}-${tempCounter++}`);
+}
+
 class FileController {
+    // Multer stores the part under a temporary name (see fileRoutes.js); it is moved into place once its name is checked
     uploadFile(req, res) {
     console.log("Received POST /upload");
     if (!req.file) {
         console.log("No file received.");
         return res.status(400).json({ message: 'No file uploaded.' });
     }
-    console.log("File received:", req.file.originalname);
-    res.status(200).json({ message: 'File uploaded successfully.', file: req.file });
+    const filename = req.file.originalname;
+    if (!validName(filename)) {
+        fs.rmSync(req.file.path, { force: true });
+        return res.status(400).json({ message: 'Invalid filename.' });
+    }
+    try {
+        makeParents(filename);
+        fs.renameSync(req.file.path, path.join(UPLOAD_DIR, filename));
+    } catch (err) {
+        fs.rmSync(req.file.path, { force: true });
+        return res.status(500).json({ message: `Failed to store ${filename}.`, error: err.message });
+    }
+    console.log("File received:", filename);
+    res.status(200).json({ message: 'File uploaded successfully.', file: filename });
 }
 
 
+    // Rebuild a stored file from a delta produced by the client's DeltaSync (see deltaSync.h)
+    patchFile(req, res) {
+        const filename = req.params.filename;
+        if (!validName(filename)) {
+            return res.status(400).json({ message: 'Invalid filename.' });
+        }
+        const target = path.join(UPLOAD_DIR, filename);
+        const delta = req.body;
+
+        if (!Buffer.isBuffer(delta) || delta.length < 25 || delta.toString('latin1', 0, 4) !== 'FSD1') {
+            return res.status(400).json({ message: 'Malformed delta.' });
+        }
+
+        const blockSize = delta.readUInt32LE(4);
+        const baseSize = Number(delta.readBigUInt64LE(8));
+        const targetSize = Number(delta.readBigUInt64LE(16));
+
+        let base;
+        try {
+            base = fs.openSync(target, 'r');
+        } catch (err) {
+            return res.status(409).json({ message: `No stored copy of ${filename}.` });
+        }
+
+        const tmp = tempPath(target, 'patch');
+        let out;
+        try {
+            if (fs.fstatSync(base).size !== baseSize) {
+                return res.status(409).json({ message: `Stored copy of ${filename} does not match the delta base.` });
+            }
+
+            out = fs.openSync(tmp, 'w');
+            let offset = 24;
+            let written = 0;
+            for (;;) {
+                const op = delta.readUInt8(offset++);
+                if (op === OP_END) {
+                    break;
+                } else if (op === OP_COPY) {
+                    const first = Number(delta.readBigUInt64LE(offset));
+                    const count = delta.readUInt32LE(offset + 8);
+                    offset += 12;
+                    // A run past the end of the stored copy is malformed, not cut short; the last block may be partial
+                    const start = first * blockSize;
+                    if (start > baseSize || count > Math.ceil((baseSize - start) / blockSize)) {
+                        throw new Error('Delta references data beyond the stored copy');
+                    }
+                    const length = Math.min(count * blockSize, baseSize - start);
+                    const chunk = Buffer.allocUnsafe(Math.min(length, 1 << 20));
+                    for (let done = 0; done < length;) {
+                        const n = fs.readSync(base, chunk, 0, Math.min(chunk.length, length - done), start + done);
+                        if (n <= 0) {
+                            throw new Error('Delta references data beyond the stored copy');
+                        }
+                        fs.writeSync(out, chunk, 0, n);
+                        done += n;
+                    }
+                    written += length;
+                } else if (op === OP_DATA) {
+                    const length = delta.readUInt32LE(offset);
+                    offset += 4;
+                    fs.writeSync(out, delta, offset, length);
+                    offset += length;
+                    written += length;
+                } else {
+                    throw new Error(`Unknown delta operation ${op}`);
+                }
+            }
+
+            if (written !== targetSize) {
+                throw new Error(`Patched size ${written} does not match expected ${targetSize}`);
+            }
+
+            fs.closeSync(out);
+            out = undefined;
+            fs.renameSync(tmp, target);
+            console.log(`Patched ${filename}: ${delta.length} delta bytes -> ${targetSize} bytes`);
+            res.status(200).json({ message: `File ${filename} patched successfully.` });
+        } catch (err) {
+            if (out !== undefined) {
+                fs.closeSync(out);
+            }
+            fs.rmSync(tmp, { force: true });
+            res.status(400).json({ message: 'Failed to apply delta.', error: err.message });
+        } finally {
+            fs.closeSync(base);
+        }
+    }
+
+    // Chunked uploads: chunks are kept under uploads/.chunks/<uploadId>/<index> until commit,
+    // so an interrupted upload resumes by asking which chunks are already stored
+    chunkDir(req, res) {
+        const uploadId = req.params.uploadId;
+        if (!/^[A-Za-z0-9_-]{1,128}$/.test(uploadId)) {
+            res.status(400).json({ message: 'Invalid upload id.' });
+            return undefined;
+        }
+        return path.join(CHUNK_DIR, uploadId);
+    }
+
+    listChunks(req, res) {
+        const dir = this.chunkDir(req, res);
+        if (dir === undefined) {
+            return;
+        }
+        let chunks = [];
+        try {
+            chunks = fs.readdirSync(dir)
+                .filter((name) => /^\d+$/.test(name))
+                .map(Number)
+                .sort((a, b) => a - b);
+        } catch (err) {
+            // No chunks received yet
+        }
+        res.status(200).json({ uploadId: req.params.uploadId, chunks });
+    }
+
+    putChunk(req, res) {
+        const dir = this.chunkDir(req, res);
+        if (dir === undefined) {
+            return;
+        }
+        if (!/^\d+$/.test(req.params.index)) {
+            return res.status(400).json({ message: 'Invalid chunk index.' });
+        }
+
+        fs.mkdirSync(dir, { recursive: true });
+        const target = path.join(dir, String(Number(req.params.index)));
+        this.receiveFile(req, res, target, (received) => {
+            res.status(200).json({ message: `Chunk ${req.params.index} stored.`, bytes: received });
+        });
+    }
+
+    // Stream a raw request body into target; the file only appears once all of it arrived.
+    // A "Content-Encoding: gzip" body is inflated on the way, so target holds the decoded content
+    receiveFile(req, res, target, onStored) {
+        const encoding = (req.headers['content-encoding'] || 'identity').toLowerCase();
+        const gzip = encoding === 'gzip' || encoding === 'x-gzip';
+        if (!gzip && encoding !== 'identity') {
+            return res.status(415).json({ message: 'Unsupported Content-Encoding.' });
+        }
+
+        const tmp = tempPath(target, 'part');
+        const out = fs.createWriteStream(tmp);
+        const body = gzip ? zlib.createGunzip() : req;
+        let received = 0;
+        let stored = 0;
+        let failed = false;
+
+        const fail = (status, message) => {
+            if (failed) {
+                return;
+            }
+            failed = true;
+            out.destroy();
+            fs.rmSync(tmp, { force: true });
+            if (!res.headersSent) {
+                res.status(status).json({ message });
+            }
+        };
+
+        req.on('data', (data) => { received += data.length; });
+        body.on('data', (data) => { stored += data.length; });
+        req.on('aborted', () => fail(400, 'Upload aborted.'));
+        if (gzip) {
+            body.on('error', () => fail(400, 'Corrupt or truncated gzip body.'));
+        }
+        out.on('error', (err) => fail(500, err.message));
+        out.on('finish', () => {
+            const expected = Number(req.headers['content-length']);
+            if (failed) {
+                return;
+            }
+            if (!Number.isNaN(expected) && received !== expected) {
+                return fail(400, `Body truncated: ${received} of ${expected} bytes.`);
+            }
+            fs.renameSync(tmp, target);
+            onStored(stored);
+        });
+        if (gzip) {
+            req.pipe(body);
+        }
+        body.pipe(out);
+    }
+
+    // Raw upload: the request body is the file content (used by the client's zero-copy sender)
+    putRaw(req, res) {
+        const filename = req.params.filename;
+        if (!validName(filename)) {
+            return res.status(400).json({ message: 'Invalid filename.' });
+        }
+        try {
+            makeParents(filename);
+        } catch (err) {
+            return res.status(500).json({ message: `Failed to create ${filename}.`, error: err.message });
+        }
+        this.receiveFile(req, res, path.join(UPLOAD_DIR, filename), (received) => {
+            console.log(`Received raw upload ${filename} (${received} bytes)`);
+            res.status(200).json({ message: `File ${filename} uploaded successfully.`, bytes: received });
+        });
+    }
+
+    // Many small files in one body (format in the client's uploadBatcher.h): every file is
+    // validated and written aside first, then all are renamed into place, so a bad batch stores nothing
+    uploadBatch(req, res) {
+        const body = req.body;
+        if (!Buffer.isBuffer(body) || body.length < 16 || body.toString('latin1', 0, 4) !== 'FSB1') {
+            return res.status(400).json({ message: 'Not a batch.' });
+        }
+
+        const files = [];
+        let offset = 4;
+        for (;;) {
+            if (offset + 12 > body.length) {
+                return res.status(400).json({ message: 'Incomplete batch.' });
+            }
+            const nameLength = body.readUInt32LE(offset);
+            const size = Number(body.readBigUInt64LE(offset + 4));
+            offset += 12;
+            if (nameLength === 0) {
+                break;
+            }
+            if (offset + nameLength + size > body.length) {
+                return res.status(400).json({ message: 'Incomplete batch.' });
+            }
+            const name = body.toString('utf8', offset, offset + nameLength);
+            if (!validName(name)) {
+                return res.status(400).json({ message: 'Invalid filename.' });
+            }
+            files.push({ name, data: body.subarray(offset + nameLength, offset + nameLength + size) });
+            offset += nameLength + size;
+        }
+
+        const written = [];
+        try {
+            for (const file of files) {
+                const target = path.join(UPLOAD_DIR, file.name);
+                makeParents(file.name);
+                const tmp = tempPath(target, 'batch');
+                fs.writeFileSync(tmp, file.data);
+                written.push({ tmp, target });
+            }
+            for (const file of written) {
+                fs.renameSync(file.tmp, file.target);
+            }
+        } catch (err) {
+            written.forEach((file) => fs.rmSync(file.tmp, { force: true }));
+            return res.status(500).json({ message: err.message });
+        }
+
+        console.log(`Batch received: ${files.length} files`);
+        res.status(200).json({ message: 'Batch stored.', files: files.length });
+    }
+
+    commitChunks(req, res) {
+        const dir = this.chunkDir(req, res);
+        if (dir === undefined) {
+            return;
+        }
+        const filename = String((req.body && req.body.filename) || '');
+        const chunkCount = Number(req.body && req.body.chunkCount);
+        const size = Number(req.body && req.body.size);
+        if (!filename || !Number.isInteger(chunkCount) || chunkCount < 0 || !Number.isInteger(size)) {
+            return res.status(400).json({ message: 'Commit needs filename, chunkCount and size.' });
+        }
+        if (!validName(filename)) {
+            return res.status(400).json({ message: 'Invalid filename.' });
+        }
+
+        for (let i = 0; i < chunkCount; ++i) {
+            if (!fs.existsSync(path.join(dir, String(i)))) {
+                return res.status(409).json({ message: `Chunk ${i} is missing.` });
+            }
+        }
+
+        const target = path.join(UPLOAD_DIR, filename);
+        const tmp = tempPath(target, 'commit');
+        let out;
+        try {
+            makeParents(filename);
+            out = fs.openSync(tmp, 'w');
+        } catch (err) {
+            return res.status(500).json({ message: `Failed to create ${filename}.`, error: err.message });
+        }
+        try {
+            let written = 0;
+            for (let i = 0; i < chunkCount; ++i) {
+                const data = fs.readFileSync(path.join(dir, String(i)));
+                fs.writeSync(out, data);
+                written += data.length;
+            }
+            fs.closeSync(out);
+            if (written !== size) {
+                fs.rmSync(tmp, { force: true });
+                // Chunks do not add up: drop them so the client starts over
+                fs.rmSync(dir, { recursive: true, force: true });
+                return res.status(409).json({ message: `Assembled size ${written} does not match expected ${size}.` });
+            }
+            fs.renameSync(tmp, target);
+            fs.rmSync(dir, { recursive: true, force: true });
+            console.log(`Assembled ${filename} from ${chunkCount} chunks (${size} bytes)`);
+            res.status(200).json({ message: `File ${filename} uploaded successfully.` });
+        } catch (err) {
+            fs.rmSync(tmp, { force: true });
+            res.status(500).json({ message: 'Failed to assemble file.', error: err.message });
+        }
+    }
+
+    abortChunks(req, res) {
+        const dir = this.chunkDir(req, res);
+        if (dir === undefined) {
+            return;
+        }
+        fs.rmSync(dir, { recursive: true, force: true });
+        res.status(200).json({ message: `Upload ${req.params.uploadId} discarded.` });
+    }
+
+    // One "<size>\t<path>\n" line per stored file, subdirectories included, streamed so a huge tree is never
+    // buffered; the client diffs it against its tree at startup (RestApiMngr::Reconcile)
+    async listFiles(req, res) {
+        res.status(200).type('text/plain');
+        try {
+            await this.listTree(UPLOAD_DIR, '', res);
+        } catch (err) {
+            console.error('Failed to list files:', err.message);
+        }
+        res.end();
+    }
+
+    async listTree(dirPath, prefix, res) {
+        const dir = await fs.promises.opendir(dirPath);
+        for await (const entry of dir) {
+            // Hidden entries are temporary files and unfinished chunks; symlinks are not followed
+            if (entry.name.startsWith('.') || entry.name.includes('\n')) {
+                continue;
+            }
+            const entryPath = path.join(dirPath, entry.name);
+            if (entry.isDirectory()) {
+                await this.listTree(entryPath, `${prefix}${entry.name}/`, res)
+                    .catch((err) => console.error(`Failed to list ${entryPath}:`, err.message));
+                continue;
+            }
+            if (!entry.isFile()) {
+                continue;
+            }
+            const stat = await fs.promises.lstat(entryPath).catch(() => null);
+            if (stat && !res.write(`${stat.size}\t${prefix}${entry.name}\n`)) {
+                await new Promise((resolve) => res.once('drain', resolve));
+            }
+        }
+    }
+
     deleteFile(req, res) {
         const filename = req.params.filename;
-        // Logic to delete the file from the server would go here
+        if (!validName(filename)) {
+            return res.status(400).json({ message: 'Invalid filename.' });
+        }
+        try {
+            fs.unlinkSync(path.join(UPLOAD_DIR, filename));
+        } catch (err) {
+            return res.status(err.code === 'ENOENT' ? 404 : 500).json({ message: `Failed to delete ${filename}.`, error: err.message });
+        }
+        removeEmptyParents(filename);
+        console.log(`Deleted ${filename}`);
         res.status(200).json({ message: `File ${filename} deleted successfully.` });
     }
 }
@@ -10,15 +10,24 @@ const storage = multer.diskStorage({
         cb(null, path.join(__dirname, '../uploads/'));
     },
     filename: (req, file, cb) => {
-        cb(null, file.originalname); // שומר את השם המקורי
+        // Hidden temporary name; uploadFile checks the original name (a path below uploads/) and moves the file there
+        cb(null, `.upload-${process.pid}-${Date.now()}-${Math.random().toString(36).slice(2)}`);
     }
 });
 
-const upload = multer({ storage });
+const upload = multer({ storage, preservePath: true });
 
 
 // שימוש ב-upload.single כ-middleare לפני הפונקציה של הקונטרולר
+router.get('/list', (req, res) => fileController.listFiles(req, res));
 router.post('/upload', upload.single('file'), fileController.uploadFile);
+router.post('/batch', express.raw({ type: 'application/octet-stream', limit: '1gb' }), (req, res) => fileController.uploadBatch(req, res));
+router.post('/patch/:filename', express.raw({ type: 'application/octet-stream', limit: '1gb' }), fileController.patchFile);
+router.put('/raw/:filename', (req, res) => fileController.putRaw(req, res));
+router.get('/chunks/:uploadId', (req, res) => fileController.listChunks(req, res));
+router.put('/chunks/:uploadId/:index', (req, res) => fileController.putChunk(req, res));
+router.post('/chunks/:uploadId/commit', (req, res) => fileController.commitChunks(req, res));
+router.delete('/chunks/:uploadId', (req, res) => fileController.abortChunks(req, res));
 router.delete('/file/:filename', fileController.deleteFile);
 
 module.exports = router;
@@ -0,0 +1,256 @@
+#include "chunkedUpload.h"
+#include "../utilities/Logger.h"
+#include "compression.h"
+#include "../utilities/contentHash.h"
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+#include <sys/stat.h>
+
+// Attempts per chunk before the whole upload is given up
+static const int MAX_CHUNK_ATTEMPTS = 3;
+
+/**
+ * @brief State of one chunked upload (engine thread only).
+ */
+struct ChunkedUploader::Upload {
+    std::string                         path;
+    std::string                         remoteName;
+    uint64_t                            size = 0;
+    int64_t                             mtimeNs = 0;
+    std::string                         id;
+    uint64_t                            chunkCount = 0;
+    std::deque<uint64_t>                missing;        ///< Chunks still to send
+    std::unordered_map<uint64_t, int>   attempts;       ///< Failed attempts per chunk
+    size_t                              inFlight = 0;
+    uint64_t                            resumed = 0;    ///< Chunks the server already had
+    bool                                failed = false;
+    bool                                compress = false; ///< Chunks are sent gzip-encoded
+    std::chrono::steady_clock::time_point started;
+    std::function<void(bool, bool)>     onDone;
+};
+
+namespace {
+
+// Parse the "chunks" array of the server's chunk listing
+std::vector<uint64_t> parseChunkList(const std::string& body)
+{
+    std::vector<uint64_t> chunks;
+    size_t pos = body.find("\"chunks\"");
+    if (pos == std::string::npos || (pos = body.find('[', pos)) == std::string::npos) {
+        return chunks;
+    }
+    uint64_t value = 0;
+    bool inNumber = false;
+    for (++pos; pos < body.size() && body[pos] != ']'; ++pos) {
+        char c = body[pos];
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + static_cast<uint64_t>(c - '0');
+            inNumber = true;
+        } else if (inNumber) {
+            chunks.push_back(value);
+            value = 0;
+            inNumber = false;
+        }
+    }
+    if (inNumber) {
+        chunks.push_back(value);
+    }
+    return chunks;
+}
+
+std::string jsonEscape(const std::string& in)
+{
+    std::string out;
+    out.reserve(in.size());
+    for (unsigned char c : in) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(static_cast<char>(c));
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out.push_back(static_cast<char>(c));
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+ChunkedUploader::ChunkedUploader(TransferEngine* engine, const std::string& serverUrl,
+                                 uint64_t chunkSize, size_t parallelChunks)
+    : m_engine(engine),
+      m_serverUrl(serverUrl),
+      m_chunkSize(chunkSize ? chunkSize : 1),
+      m_parallelChunks(parallelChunks ? parallelChunks : 1),
+      m_compressionLevel(0)
+{
+}
+
+void ChunkedUploader::upload(const std::string& localFilePath, const std::string& remoteName,
+                             uint64_t size, int64_t mtimeNs, uint64_t contentHash,
+                             std::function<void(bool ok, bool retryable)> onDone)
+{
+    auto upload = std::make_shared<Upload>();
+    upload->path = localFilePath;
+    upload->remoteName = remoteName;
+    upload->size = size;
+    upload->mtimeNs = mtimeNs;
+    upload->compress = m_compressionLevel > 0 && GzipFileReader::worthCompressing(localFilePath, size);
+    upload->chunkCount = (size + m_chunkSize - 1) / m_chunkSize;
+    upload->started = std::chrono::steady_clock::now();
+    upload->onDone = std::move(onDone);
+
+    // Same name, content and chunking -> same id, which is what makes resuming possible
+    std::string key = remoteName + '\0' + std::to_string(size) + '\0' +
+                      std::to_string(contentHash) + '\0' + std::to_string(m_chunkSize);
+    char id[17];
+    snprintf(id, sizeof(id), "%016llx",
+             static_cast<unsigned long long>(contentHash::hash64(key.data(), key.size())));
+    upload->id = id;
+
+    TransferEngine::Request request;
+    request.method = "GET";
+    request.url = m_serverUrl + "/api/files/chunks/" + upload->id;
+    request.onDone = [this, upload](const TransferEngine::Result& result) {
+        if (!result.ok()) {
+            LOG_ERROR("Failed to query chunks of {} (HTTP {}) {}",
+                      upload->path, result.httpStatus, result.error);
+            fail(upload, false, result.retryable());
+            return;
+        }
+
+        std::vector<bool> stored(upload->chunkCount, false);
+        for (uint64_t index : parseChunkList(result.body)) {
+            if (index < upload->chunkCount && !stored[index]) {
+                stored[index] = true;
+                ++upload->resumed;
+            }
+        }
+        for (uint64_t index = 0; index < upload->chunkCount; ++index) {
+            if (!stored[index]) {
+                upload->missing.push_back(index);
+            }
+        }
+
+        LOG_INFO("Chunked upload {} of {}: {} chunks, {} already on the server",
+                 upload->id, upload->path, upload->chunkCount, upload->resumed);
+        pump(upload);
+    };
+    m_engine->submit(std::move(request));
+}
+
+void ChunkedUploader::pump(const std::shared_ptr<Upload>& upload)
+{
+    if (upload->failed) {
+        return;
+    }
+    while (upload->inFlight < m_parallelChunks && !upload->missing.empty()) {
+        uint64_t index = upload->missing.front();
+        upload->missing.pop_front();
+        sendChunk(upload, index);
+    }
+    if (upload->inFlight == 0 && upload->missing.empty()) {
+        commit(upload);
+    }
+}
+
+void ChunkedUploader::sendChunk(const std::shared_ptr<Upload>& upload, uint64_t index)
+{
+    TransferEngine::Request request;
+    request.method = "PUT";
+    request.url = m_serverUrl + "/api/files/chunks/" + upload->id + "/" + std::to_string(index);
+    request.headers = {"Content-Type: application/octet-stream", "Expect:"};
+    uint64_t offset = index * m_chunkSize;
+    uint64_t length = std::min(m_chunkSize, upload->size - offset);
+    if (upload->compress) {
+        // The server inflates the chunk before storing it, so chunk ids and the commit are unchanged
+        auto reader = std::make_shared<GzipFileReader>(upload->path, offset, length, m_compressionLevel);
+        request.headers.push_back("Content-Encoding: gzip");
+        request.bodySource = [reader](char* buffer, size_t len) { return reader->read(buffer, len); };
+    } else {
+        request.bodyFile = upload->path;
+        request.bodyOffset = offset;
+        request.bodyLength = length;
+    }
+    request.onDone = [this, upload, index](const TransferEngine::Result& result) {
+        --upload->inFlight;
+        if (upload->failed) {
+            return;
+        }
+        if (!result.ok()) {
+            int attempts = ++upload->attempts[index];
+            LOG_ERROR("Chunk {} of {} failed (HTTP {}) {}, attempt {}",
+                      index, upload->path, result.httpStatus, result.error, attempts);
+            if (attempts >= MAX_CHUNK_ATTEMPTS) {
+                // Keep the stored chunks: the next attempt resumes from them
+                fail(upload, false, result.retryable());
+                return;
+            }
+            upload->missing.push_back(index);
+        }
+        pump(upload);
+    };
+
+    ++upload->inFlight;
+    m_engine->submit(std::move(request));
+}
+
+void ChunkedUploader::commit(const std::shared_ptr<Upload>& upload)
+{
+    // Chunks read after a change mix two versions of the file under one id
+    struct stat st;
+    if (stat(upload->path.c_str(), &st) == -1 ||
+        static_cast<uint64_t>(st.st_size) != upload->size ||
+        static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec != upload->mtimeNs) {
+        LOG_WARN("File changed during chunked upload, discarding: {}", upload->path);
+        fail(upload, true, true);
+        return;
+    }
+
+    TransferEngine::Request request;
+    request.method = "POST";
+    request.url = m_serverUrl + "/api/files/chunks/" + upload->id + "/commit";
+    request.headers = {"Content-Type: application/json"};
+    request.body = "{\"filename\":\"" + jsonEscape(upload->remoteName) + "\",\"chunkCount\":" +
+                   std::to_string(upload->chunkCount) + ",\"size\":" + std::to_string(upload->size) + "}";
+    request.onDone = [this, upload](const TransferEngine::Result& result) {
+        if (!result.ok()) {
+            LOG_ERROR("Failed to commit chunked upload of {} (HTTP {}) {}",
+                      upload->path, result.httpStatus, result.error);
+            fail(upload, false, result.retryable());
+            return;
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - upload->started).count();
+        LOG_INFO("Chunked upload of {} committed: {} bytes in {} ms ({} of {} chunks sent)",
+                 upload->path, upload->size, seconds * 1000.0, upload->chunkCount - upload->resumed,
+                 upload->chunkCount);
+        if (upload->onDone) {
+            upload->onDone(true, false);
+        }
+    };
+    m_engine->submit(std::move(request));
+}
+
+void ChunkedUploader::fail(const std::shared_ptr<Upload>& upload, bool discardChunks, bool retryable)
+{
+    upload->failed = true;
+    upload->missing.clear();
+
+    if (discardChunks) {
+        TransferEngine::Request request;
+        request.method = "DELETE";
+        request.url = m_serverUrl + "/api/files/chunks/" + upload->id;
+        m_engine->submit(std::move(request));
+    }
+
+    if (upload->onDone) {
+        upload->onDone(false, retryable);
+    }
+}
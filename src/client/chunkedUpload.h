@@ -0,0 +1,106 @@
+/**
+ * @file chunkedUpload.h
+ * @brief Resumable uploads of large files as parallel fixed-size chunks.
+ */
+#ifndef CHUNKED_UPLOAD_H
+#define CHUNKED_UPLOAD_H
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include "transferEngine.h"
+
+/**
+ * @class ChunkedUploader
+ * @brief Splits large files into fixed-size chunks and uploads them in parallel.
+ *
+ * Each upload is identified by an id derived from the remote filename, the
+ * content hash, the size and the chunk size, so the same file version maps to
+ * the same id across retries and client restarts. An upload first asks the
+ * server which chunks of that id it already holds, sends the missing ones as
+ * raw PUT bodies read straight from the file (several at a time, each on its
+ * own connection of the TransferEngine), and finally asks the server to
+ * assemble them. A dropped connection therefore costs at most one chunk.
+ *
+ * Server protocol (relative to the server URL):
+ * @code
+ *   GET    /api/files/chunks/<id>          -> {"chunks":[indices already stored]}
+ *   PUT    /api/files/chunks/<id>/<index>  raw chunk bytes
+ *   POST   /api/files/chunks/<id>/commit   {"filename":..,"chunkCount":..,"size":..}
+ *   DELETE /api/files/chunks/<id>          discard stored chunks
+ * @endcode
+ *
+ * @note upload() may be called from any thread; all per-upload state lives on
+ *       the TransferEngine thread, where the completion callback also runs.
+ */
+class ChunkedUploader
+{
+public:
+    /**
+     * @brief Construct an uploader.
+     * @param engine Engine running the HTTP requests (not owned).
+     * @param serverUrl Base URL of the REST server.
+     * @param chunkSize Chunk size in bytes.
+     * @param parallelChunks Maximum number of chunks of one file in flight.
+     */
+    ChunkedUploader(TransferEngine* engine, const std::string& serverUrl,
+                    uint64_t chunkSize, size_t parallelChunks);
+
+    /**
+     * @brief Start a chunked upload.
+     * @param localFilePath Path of the file on disk.
+     * @param remoteName Filename used on the server.
+     * @param size File size in bytes.
+     * @param mtimeNs File modification time; the upload is abandoned if it changes.
+     * @param contentHash Content hash of the file, part of the upload id.
+     * @param onDone Called with true once the server assembled the file, false on failure,
+     *               and whether uploading the file again may succeed.
+     */
+    void upload(const std::string& localFilePath, const std::string& remoteName,
+                uint64_t size, int64_t mtimeNs, uint64_t contentHash,
+                std::function<void(bool ok, bool retryable)> onDone);
+
+    /**
+     * @brief Chunk size in bytes.
+     */
+    uint64_t chunkSize() const { return m_chunkSize; }
+
+    /**
+     * @brief Send the chunks of compressible files gzip-encoded.
+     * @param level zlib compression level; 0 sends chunks as they are.
+     */
+    void setCompression(int level) { m_compressionLevel = level; }
+
+private:
+    struct Upload;
+
+    /**
+     * @brief Queue the next missing chunks up to the parallelism limit.
+     */
+    void pump(const std::shared_ptr<Upload>& upload);
+
+    /**
+     * @brief Queue the PUT of one chunk.
+     */
+    void sendChunk(const std::shared_ptr<Upload>& upload, uint64_t index);
+
+    /**
+     * @brief Ask the server to assemble the uploaded chunks.
+     */
+    void commit(const std::shared_ptr<Upload>& upload);
+
+    /**
+     * @brief Give up on an upload; optionally discard its chunks on the server.
+     * @param retryable Reported to the caller: uploading the file again may succeed.
+     */
+    void fail(const std::shared_ptr<Upload>& upload, bool discardChunks, bool retryable);
+
+    TransferEngine* m_engine;           ///< Engine running the requests
+    std::string     m_serverUrl;        ///< Base REST server URL
+    uint64_t        m_chunkSize;        ///< Bytes per chunk (last one may be short)
+    size_t          m_parallelChunks;   ///< Chunks of one file in flight at once
+    int             m_compressionLevel; ///< gzip level for chunk bodies, 0 = uncompressed
+};
+
+#endif // CHUNKED_UPLOAD_H
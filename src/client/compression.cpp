@@ -0,0 +1,139 @@
+#include "compression.h"
+#include <algorithm>
+#include <cctype>
+#include <unordered_set>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+// File bytes read per refill of the compressor input
+const size_t READ_SIZE = 256 * 1024;
+
+// Already compressed: deflate would burn CPU for nothing
+const std::unordered_set<std::string> COMPRESSED_TYPES = {
+    "7z", "aac", "apk", "avi", "br", "bz2", "deb", "docx", "flac", "gif", "gz", "heic", "jar", "jpeg",
+    "jpg", "lz4", "lzma", "m4a", "m4v", "mkv", "mov", "mp3", "mp4", "mpeg", "ogg", "opus", "pdf", "png",
+    "pptx", "rar", "rpm", "tgz", "webm", "webp", "whl", "xlsx", "xz", "zip", "zst"
+};
+
+// Text: compresses well, no need to sample
+const std::unordered_set<std::string> TEXT_TYPES = {
+    "c", "cc", "cfg", "conf", "cpp", "css", "csv", "h", "hpp", "htm", "html", "ini", "java", "js", "json",
+    "log", "md", "py", "sh", "sql", "svg", "ts", "tsv", "txt", "xml", "yaml", "yml"
+};
+
+std::string extensionOf(const std::string& path)
+{
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return std::string();
+    }
+    std::string ext = path.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+} // namespace
+
+GzipFileReader::GzipFileReader(const std::string& path, uint64_t offset, uint64_t length, int level)
+    : m_fd(open(path.c_str(), O_RDONLY | O_CLOEXEC)),
+      m_stream(new z_stream()),
+      m_offset(offset),
+      m_left(length),
+      m_read(0),
+      m_produced(0),
+      m_finished(false)
+{
+    m_in.reserve(READ_SIZE);
+
+    // windowBits 15 + 16: gzip wrapper, as announced by "Content-Encoding: gzip"
+    if (deflateInit2(m_stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        delete m_stream;
+        m_stream = nullptr;
+    }
+    if (m_fd != -1) {
+        posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+    }
+}
+
+GzipFileReader::~GzipFileReader()
+{
+    if (m_stream) {
+        deflateEnd(m_stream);
+        delete m_stream;
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+long GzipFileReader::read(char* buffer, size_t len)
+{
+    if (!ok()) {
+        return -1;
+    }
+
+    m_stream->next_out = reinterpret_cast<Bytef*>(buffer);
+    m_stream->avail_out = static_cast<uInt>(len);
+    while (m_stream->avail_out > 0 && !m_finished) {
+        if (m_stream->avail_in == 0 && m_left > 0) {
+            m_in.resize(static_cast<size_t>(std::min<uint64_t>(m_left, READ_SIZE)));
+            ssize_t n = pread(m_fd, m_in.data(), m_in.size(), static_cast<off_t>(m_offset));
+            if (n <= 0) {
+                return -1;  // File shrank or became unreadable
+            }
+            m_offset += static_cast<uint64_t>(n);
+            m_left -= static_cast<uint64_t>(n);
+            m_read += static_cast<uint64_t>(n);
+            m_stream->next_in = reinterpret_cast<Bytef*>(m_in.data());
+            m_stream->avail_in = static_cast<uInt>(n);
+        }
+
+        int rc = deflate(m_stream, m_left == 0 ? Z_FINISH : Z_NO_FLUSH);
+        if (rc == Z_STREAM_END) {
+            m_finished = true;
+        } else if (rc != Z_OK && rc != Z_BUF_ERROR) {
+            return -1;
+        }
+    }
+
+    size_t produced = len - m_stream->avail_out;
+    m_produced += produced;
+    return static_cast<long>(produced);
+}
+
+bool GzipFileReader::worthCompressing(const std::string& path, uint64_t size)
+{
+    if (size < MIN_COMPRESS_SIZE) {
+        return false;
+    }
+    std::string ext = extensionOf(path);
+    if (COMPRESSED_TYPES.count(ext)) {
+        return false;
+    }
+    if (TEXT_TYPES.count(ext)) {
+        return true;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    std::vector<char> sample(static_cast<size_t>(std::min<uint64_t>(size, SAMPLE_SIZE)));
+    ssize_t n = pread(fd, sample.data(), sample.size(), 0);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+
+    uLongf packedSize = compressBound(static_cast<uLong>(n));
+    std::vector<Bytef> packed(packedSize);
+    if (compress2(packed.data(), &packedSize, reinterpret_cast<const Bytef*>(sample.data()),
+                  static_cast<uLong>(n), 1) != Z_OK) {
+        return false;
+    }
+    return static_cast<double>(packedSize) < MAX_RATIO * static_cast<double>(n);
+}
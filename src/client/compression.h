@@ -0,0 +1,96 @@
+/**
+ * @file compression.h
+ * @brief Streaming gzip compression of upload bodies and the policy deciding when to use it.
+ */
+#ifndef COMPRESSION_H
+#define COMPRESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct z_stream_s;
+
+/**
+ * @class GzipFileReader
+ * @brief Produces the gzip encoding of a byte range of a file, piece by piece.
+ *
+ * Meant as a TransferEngine::Request::bodySource: the file is read and
+ * deflated as curl asks for body bytes, so neither the file nor its
+ * compressed form is ever held in memory, and the compressed length does not
+ * have to be known up front (the body goes out chunked).
+ */
+class GzipFileReader
+{
+public:
+    /** Files smaller than this are sent as they are */
+    static constexpr uint64_t MIN_COMPRESS_SIZE = 4096;
+
+    /** Bytes deflated to estimate the ratio of a file of unknown type */
+    static constexpr size_t SAMPLE_SIZE = 64 * 1024;
+
+    /** Estimated ratio (compressed / original) above which a file is sent as it is */
+    static constexpr double MAX_RATIO = 0.9;
+
+    /**
+     * @brief Open the file and set up the compressor.
+     * @param path File to read.
+     * @param offset Start of the byte range.
+     * @param length Length of the byte range.
+     * @param level zlib compression level (1 = fastest, 9 = smallest).
+     */
+    GzipFileReader(const std::string& path, uint64_t offset, uint64_t length, int level);
+    ~GzipFileReader();
+
+    GzipFileReader(const GzipFileReader&) = delete;
+    GzipFileReader& operator=(const GzipFileReader&) = delete;
+
+    /**
+     * @brief false if the file could not be opened or zlib not initialized.
+     */
+    bool ok() const { return m_stream != nullptr && m_fd != -1; }
+
+    /**
+     * @brief Fill a buffer with the next compressed bytes.
+     * @return Bytes written; 0 once the stream is complete.
+     * @retval -1 The file shrank or could not be read.
+     */
+    long read(char* buffer, size_t len);
+
+    /**
+     * @brief File bytes consumed so far.
+     */
+    uint64_t bytesIn() const { return m_read; }
+
+    /**
+     * @brief Compressed bytes produced so far.
+     */
+    uint64_t bytesOut() const { return m_produced; }
+
+    /**
+     * @brief Decide whether a file is worth compressing.
+     *
+     * Known media and archive types (already compressed) are never
+     * compressed, known text types always are. For anything else, e.g. an
+     * executable without extension, the first SAMPLE_SIZE bytes are deflated
+     * at the fastest level and the file is compressed if that saves at least
+     * 1 - MAX_RATIO of the sample.
+     *
+     * @param path File to check.
+     * @param size File size in bytes.
+     */
+    static bool worthCompressing(const std::string& path, uint64_t size);
+
+private:
+    int                 m_fd;           ///< File being read, -1 if it failed to open
+    z_stream_s*         m_stream;       ///< Deflate state, null if it failed to initialize
+    uint64_t            m_offset;       ///< Next file offset to read
+    uint64_t            m_left;         ///< File bytes of the range still to read
+    uint64_t            m_read;         ///< File bytes consumed
+    uint64_t            m_produced;     ///< Compressed bytes produced
+    std::vector<char>   m_in;           ///< File bytes waiting for the compressor
+    bool                m_finished;     ///< Deflate reported the end of the stream
+};
+
+#endif // COMPRESSION_H
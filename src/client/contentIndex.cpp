@@ -0,0 +1,114 @@
+#include "contentIndex.h"
+#include "../utilities/contentHash.h"
+#include <sys/stat.h>
+
+static SyncJournal::Record toRecord(const ContentIndex::Fingerprint& fingerprint)
+{
+    SyncJournal::Record record;
+    record.size = fingerprint.size;
+    record.mtimeNs = fingerprint.mtimeNs;
+    record.inode = fingerprint.inode;
+    record.hash = fingerprint.hash;
+    return record;
+}
+
+bool ContentIndex::Open(const std::string& journalDir)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_journal.open(journalDir);
+}
+
+bool ContentIndex::find(const std::string& key, Fingerprint& out) const
+{
+    SyncJournal::Record record;
+    if (!m_journal.lookup(key, record)) {
+        return false;
+    }
+    out.size = record.size;
+    out.mtimeNs = record.mtimeNs;
+    out.inode = record.inode;
+    out.hash = record.hash;
+    return true;
+}
+
+bool ContentIndex::fingerprint(const std::string& key, const std::string& path, Fingerprint& out)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+
+    out.size = static_cast<uint64_t>(st.st_size);
+    out.mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    out.inode = static_cast<uint64_t>(st.st_ino);
+
+    // Cheap pre-check: identical metadata means the stored hash is still valid
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Fingerprint stored;
+        if (find(key, stored) &&
+            stored.size == out.size &&
+            stored.mtimeNs == out.mtimeNs &&
+            stored.inode == out.inode) {
+            out.hash = stored.hash;
+            return true;
+        }
+    }
+
+    return contentHash::hashFile(path, out.hash);
+}
+
+bool ContentIndex::isUnchanged(const std::string& key, const Fingerprint& current)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Fingerprint stored;
+    if (!find(key, stored) || stored.size != current.size || stored.hash != current.hash) {
+        return false;
+    }
+
+    // Same bytes under new metadata (touch, rewrite): refresh so the pre-check hits next time
+    if (stored.mtimeNs != current.mtimeNs || stored.inode != current.inode) {
+        m_journal.put(key, toRecord(current));
+    }
+    return true;
+}
+
+void ContentIndex::recordUploaded(const std::string& key, const Fingerprint& uploaded)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_journal.put(key, toRecord(uploaded));
+}
+
+void ContentIndex::forget(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_journal.erase(key);
+}
+
+void ContentIndex::beginReconcile()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_journal.clearMarks();
+}
+
+bool ContentIndex::reconcile(const std::string& key, uint64_t size, int64_t mtimeNs, uint64_t inode)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    SyncJournal::Record record;
+    return m_journal.mark(key, record) &&
+           record.size == size && record.mtimeNs == mtimeNs && record.inode == inode;
+}
+
+std::vector<std::string> ContentIndex::unreconciled()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<std::string> keys;
+    m_journal.forEachUnmarked([&keys](const std::string& path) { keys.push_back(path); });
+    return keys;
+}
+
+size_t ContentIndex::size()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_journal.size();
+}
@@ -0,0 +1,116 @@
+/**
+ * @file contentIndex.h
+ * @brief Index of the content last uploaded for each file.
+ */
+#ifndef CONTENT_INDEX_H
+#define CONTENT_INDEX_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "syncJournal.h"
+
+/**
+ * @class ContentIndex
+ * @brief Remembers what was uploaded for each path so unchanged files can be skipped.
+ *
+ * Each entry holds the file's (size, mtime, inode) together with a content
+ * hash. When the metadata of a file still matches its entry, the stored hash
+ * is reused without reading the file; otherwise the file is hashed and the
+ * digest decides whether the content really changed. A touch or chmod
+ * therefore costs at most one hash pass and never an upload.
+ *
+ * Entries live in a SyncJournal; after Open() they survive restarts, and
+ * beginReconcile()/reconcile()/unreconciled() compare them with the tree on
+ * disk at startup.
+ *
+ * @note All methods are thread-safe.
+ */
+class ContentIndex
+{
+public:
+    /**
+     * @struct Fingerprint
+     * @brief Identity of a file's content at one point in time.
+     */
+    struct Fingerprint {
+        uint64_t size = 0;      ///< File size in bytes
+        int64_t  mtimeNs = 0;   ///< Modification time in nanoseconds since the epoch
+        uint64_t inode = 0;     ///< Inode number
+        uint64_t hash = 0;      ///< XXH64 digest of the content
+    };
+
+    /**
+     * @brief Persist the index in a journal directory and load what it holds.
+     * @param journalDir Journal directory; created if missing.
+     * @return false if the journal cannot be opened; the index stays in memory.
+     */
+    bool Open(const std::string& journalDir);
+
+    /**
+     * @brief Compute the current fingerprint of a file.
+     * @param key Index key of the file (as used by recordUploaded()).
+     * @param path Path used to access the file on disk.
+     * @param out Receives the fingerprint.
+     * @return false if the file cannot be read.
+     */
+    bool fingerprint(const std::string& key, const std::string& path, Fingerprint& out);
+
+    /**
+     * @brief Check whether a fingerprint matches the last uploaded content.
+     * @param key Index key of the file.
+     * @param current Fingerprint returned by fingerprint().
+     * @return true if the same bytes were already uploaded.
+     */
+    bool isUnchanged(const std::string& key, const Fingerprint& current);
+
+    /**
+     * @brief Record that a file's content was uploaded.
+     * @param key Index key of the file.
+     * @param uploaded Fingerprint of the uploaded content.
+     */
+    void recordUploaded(const std::string& key, const Fingerprint& uploaded);
+
+    /**
+     * @brief Drop the entry of a file (e.g. after it was deleted).
+     * @param key Index key of the file.
+     */
+    void forget(const std::string& key);
+
+    /**
+     * @brief Start a reconciliation: no entry has been seen on disk yet.
+     */
+    void beginReconcile();
+
+    /**
+     * @brief Mark a file found on disk and compare it with its entry.
+     * @param key Index key of the file.
+     * @param size Current file size.
+     * @param mtimeNs Current modification time in nanoseconds.
+     * @param inode Current inode number.
+     * @return true if the entry's metadata matches, i.e. the file needs no upload.
+     */
+    bool reconcile(const std::string& key, uint64_t size, int64_t mtimeNs, uint64_t inode);
+
+    /**
+     * @brief Keys not seen since beginReconcile() (files deleted meanwhile).
+     */
+    std::vector<std::string> unreconciled();
+
+    /**
+     * @brief Number of entries.
+     */
+    size_t size();
+
+private:
+    /**
+     * @brief Look up the entry of a key; m_mutex must be held.
+     */
+    bool find(const std::string& key, Fingerprint& out) const;
+
+    std::mutex      m_mutex;    ///< Protects m_journal
+    SyncJournal     m_journal;  ///< Last uploaded fingerprint per key
+};
+
+#endif // CONTENT_INDEX_H
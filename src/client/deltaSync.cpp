@@ -0,0 +1,413 @@
+#include "deltaSync.h"
+#include "../utilities/contentHash.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const uint8_t OP_END  = 0;
+const uint8_t OP_COPY = 1;
+const uint8_t OP_DATA = 2;
+
+// Literal runs are flushed once they reach this size, bounding the read window
+const uint64_t LITERAL_FLUSH = 1 << 20;
+
+// Minimum size of the read window
+const size_t MIN_WINDOW = 4 << 20;
+
+/**
+ * @brief rsync rolling checksum over a window of fixed length.
+ */
+struct Rolling {
+    uint32_t a = 0;
+    uint32_t b = 0;
+    uint32_t len = 0;
+
+    void init(const uint8_t* p, uint32_t n)
+    {
+        a = b = 0;
+        len = n;
+        for (uint32_t i = 0; i < n; ++i) {
+            a += p[i];
+            b += (n - i) * p[i];
+        }
+    }
+
+    void roll(uint8_t out, uint8_t in)
+    {
+        a += in - out;
+        b += a - len * out;
+    }
+
+    uint32_t value() const
+    {
+        return (a & 0xffff) | (b << 16);
+    }
+};
+
+/**
+ * @brief Cuts a byte stream into aligned blocks and signs each one.
+ */
+class SignatureBuilder
+{
+public:
+    SignatureBuilder(uint32_t blockSize, DeltaSync::Signatures& out)
+        : m_out(out)
+    {
+        m_out.blockSize = blockSize;
+        m_out.fileSize = 0;
+        m_out.blocks.clear();
+        m_pending.reserve(blockSize);
+    }
+
+    void feed(const uint8_t* p, size_t n)
+    {
+        m_out.fileSize += n;
+        const uint32_t bs = m_out.blockSize;
+        while (n > 0) {
+            if (m_pending.empty() && n >= bs) {
+                sign(p, bs);
+                p += bs;
+                n -= bs;
+                continue;
+            }
+            size_t take = std::min<size_t>(n, bs - m_pending.size());
+            m_pending.insert(m_pending.end(), p, p + take);
+            p += take;
+            n -= take;
+            if (m_pending.size() == bs) {
+                sign(m_pending.data(), bs);
+                m_pending.clear();
+            }
+        }
+    }
+
+    void finish()
+    {
+        if (!m_pending.empty()) {
+            sign(m_pending.data(), static_cast<uint32_t>(m_pending.size()));
+            m_pending.clear();
+        }
+    }
+
+private:
+    void sign(const uint8_t* p, uint32_t n)
+    {
+        Rolling rolling;
+        rolling.init(p, n);
+        m_out.blocks.push_back({rolling.value(), contentHash::hash64(p, n)});
+    }
+
+    DeltaSync::Signatures& m_out;
+    std::vector<uint8_t>   m_pending;
+};
+
+void putU8(std::string& s, uint8_t v)
+{
+    s.push_back(static_cast<char>(v));
+}
+
+void putU32(std::string& s, uint32_t v)
+{
+    for (int i = 0; i < 4; ++i) {
+        s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+void putU64(std::string& s, uint64_t v)
+{
+    for (int i = 0; i < 8; ++i) {
+        s.push_back(static_cast<char>((v >> (8 * i)) & 0xff));
+    }
+}
+
+/**
+ * @brief Builds the delta payload, merging consecutive block copies into runs.
+ */
+class DeltaEncoder
+{
+public:
+    explicit DeltaEncoder(DeltaSync::Delta& out) : m_out(out) {}
+
+    void copy(uint64_t block, uint64_t bytes)
+    {
+        if (m_runCount > 0 && block == m_runFirst + m_runCount && m_runCount < UINT32_MAX) {
+            ++m_runCount;
+        } else {
+            flushCopy();
+            m_runFirst = block;
+            m_runCount = 1;
+        }
+        m_out.copiedBytes += bytes;
+    }
+
+    void literal(const uint8_t* p, uint64_t n)
+    {
+        if (n == 0) {
+            return;
+        }
+        flushCopy();
+        while (n > 0) {
+            uint32_t chunk = static_cast<uint32_t>(std::min<uint64_t>(n, UINT32_MAX));
+            putU8(m_out.payload, OP_DATA);
+            putU32(m_out.payload, chunk);
+            m_out.payload.append(reinterpret_cast<const char*>(p), chunk);
+            m_out.literalBytes += chunk;
+            p += chunk;
+            n -= chunk;
+        }
+    }
+
+    void finish()
+    {
+        flushCopy();
+        putU8(m_out.payload, OP_END);
+    }
+
+private:
+    void flushCopy()
+    {
+        if (m_runCount == 0) {
+            return;
+        }
+        putU8(m_out.payload, OP_COPY);
+        putU64(m_out.payload, m_runFirst);
+        putU32(m_out.payload, m_runCount);
+        m_runCount = 0;
+    }
+
+    DeltaSync::Delta& m_out;
+    uint64_t          m_runFirst = 0;
+    uint32_t          m_runCount = 0;
+};
+
+} // namespace
+
+bool DeltaSync::computeSignatures(const std::string& path, uint32_t blockSize, Signatures& out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    SignatureBuilder builder(blockSize, out);
+    std::vector<uint8_t> buffer(std::max<size_t>(blockSize, 1 << 20));
+    ssize_t n;
+    while ((n = read(fd, buffer.data(), buffer.size())) > 0) {
+        builder.feed(buffer.data(), static_cast<size_t>(n));
+    }
+    close(fd);
+
+    if (n < 0) {
+        return false;
+    }
+    builder.finish();
+    return true;
+}
+
+bool DeltaSync::computeDelta(const std::string& path, const Signatures& base,
+                             uint64_t maxLiteral, Delta& out)
+{
+    const uint32_t bs = base.blockSize;
+    if (bs == 0) {
+        return false;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return false;
+    }
+    const uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+
+    // Weak checksum -> candidate block indices, with a 16-bit tag table in front
+    // so most non-matching window positions cost one array lookup
+    std::unordered_map<uint32_t, std::vector<uint32_t>> index;
+    std::vector<uint8_t> tags(1 << 16, 0);
+    index.reserve(base.blocks.size());
+    for (uint32_t i = 0; i < base.blocks.size(); ++i) {
+        uint32_t weak = base.blocks[i].weak;
+        index[weak].push_back(i);
+        tags[(weak ^ (weak >> 16)) & 0xffff] = 1;
+    }
+    const uint64_t lastIndex = base.blocks.empty() ? 0 : base.blocks.size() - 1;
+    const uint64_t lastLen = base.blocks.empty() ? 0 : base.fileSize - lastIndex * bs;
+
+    out.payload.clear();
+    out.literalBytes = 0;
+    out.copiedBytes = 0;
+    out.payload.append("FSD1", 4);
+    putU32(out.payload, bs);
+    putU64(out.payload, base.fileSize);
+    putU64(out.payload, fileSize);
+
+    DeltaEncoder encoder(out);
+    SignatureBuilder target(bs, out.target);
+
+    // Read window: buffer[0] is file offset bufStart
+    std::vector<uint8_t> buffer(std::max<size_t>(MIN_WINDOW, 4 * static_cast<size_t>(bs)));
+    uint64_t bufStart = 0;
+    uint64_t bufEnd = 0;
+    uint64_t pos = 0;       // Start of the rolling window
+    uint64_t lit = 0;       // Start of pending literal bytes
+    bool ok = true;
+
+    // Make [min(lit, pos), need) resident; false on read error
+    auto fill = [&](uint64_t need) -> bool {
+        need = std::min(need, fileSize);
+        if (need <= bufEnd) {
+            return true;
+        }
+        uint64_t keep = std::min(lit, pos);
+        size_t shift = static_cast<size_t>(keep - bufStart);
+        memmove(buffer.data(), buffer.data() + shift, static_cast<size_t>(bufEnd - keep));
+        bufStart = keep;
+        while (bufEnd < need) {
+            size_t room = buffer.size() - static_cast<size_t>(bufEnd - bufStart);
+            size_t want = static_cast<size_t>(std::min<uint64_t>(room, fileSize - bufEnd));
+            ssize_t n = read(fd, buffer.data() + (bufEnd - bufStart), want);
+            if (n <= 0) {
+                return false;  // Error, or the file shrank while reading
+            }
+            target.feed(buffer.data() + (bufEnd - bufStart), static_cast<size_t>(n));
+            bufEnd += static_cast<uint64_t>(n);
+        }
+        return true;
+    };
+    auto at = [&](uint64_t offset) -> const uint8_t* {
+        return buffer.data() + (offset - bufStart);
+    };
+    auto flushLiteral = [&]() {
+        encoder.literal(at(lit), pos - lit);
+        lit = pos;
+    };
+    // Index of the base block equal to [pos, pos + len), or -1
+    auto findMatch = [&](const Rolling& rolling, uint64_t len) -> int64_t {
+        uint32_t weak = rolling.value();
+        if (!tags[(weak ^ (weak >> 16)) & 0xffff]) {
+            return -1;
+        }
+        auto it = index.find(weak);
+        if (it == index.end()) {
+            return -1;
+        }
+        uint64_t strong = contentHash::hash64(at(pos), static_cast<size_t>(len));
+        for (uint32_t candidate : it->second) {
+            uint64_t candidateLen = (candidate == lastIndex) ? lastLen : bs;
+            if (candidateLen == len && base.blocks[candidate].strong == strong) {
+                return candidate;
+            }
+        }
+        return -1;
+    };
+
+    Rolling rolling;
+    bool rollingValid = false;
+
+    while (ok && pos < fileSize) {
+        if (fileSize - pos < bs) {
+            // Tail shorter than a block: only the base's short last block can match, at the very end
+            if (lastLen > 0 && lastLen < bs && fileSize - lastLen >= pos) {
+                uint64_t tailPos = fileSize - lastLen;
+                ok = fill(fileSize);
+                if (!ok) {
+                    break;
+                }
+                pos = tailPos;
+                rolling.init(at(pos), static_cast<uint32_t>(lastLen));
+                int64_t match = findMatch(rolling, lastLen);
+                if (match >= 0) {
+                    flushLiteral();
+                    encoder.copy(static_cast<uint64_t>(match), lastLen);
+                    pos = lit = fileSize;
+                    break;
+                }
+            }
+            ok = fill(fileSize);
+            pos = fileSize;
+            if (ok) {
+                flushLiteral();
+            }
+            break;
+        }
+
+        if (!rollingValid) {
+            ok = fill(pos + bs);
+            if (!ok) {
+                break;
+            }
+            rolling.init(at(pos), bs);
+            rollingValid = true;
+        }
+
+        int64_t match = findMatch(rolling, bs);
+        if (match >= 0) {
+            flushLiteral();
+            encoder.copy(static_cast<uint64_t>(match), bs);
+            pos += bs;
+            lit = pos;
+            rollingValid = false;
+        } else {
+            if (pos - lit >= LITERAL_FLUSH) {
+                flushLiteral();
+            }
+            if (pos + bs < fileSize) {
+                ok = fill(pos + bs + 1);
+                if (!ok) {
+                    break;
+                }
+                rolling.roll(*at(pos), *at(pos + bs));
+            } else {
+                rollingValid = false;
+            }
+            ++pos;
+        }
+
+        if (out.literalBytes + (pos - lit) > maxLiteral) {
+            ok = false;
+        }
+    }
+
+    close(fd);
+    if (!ok) {
+        return false;
+    }
+
+    encoder.finish();
+    target.finish();
+    return true;
+}
+
+bool DeltaSync::lookup(const std::string& key, Signatures& out)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_signatures.find(key);
+    if (it == m_signatures.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+void DeltaSync::store(const std::string& key, Signatures signatures)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_signatures[key] = std::move(signatures);
+}
+
+void DeltaSync::forget(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_signatures.erase(key);
+}
@@ -0,0 +1,109 @@
+/**
+ * @file deltaSync.h
+ * @brief rsync-style block signatures and deltas for large modified files.
+ */
+#ifndef DELTA_SYNC_H
+#define DELTA_SYNC_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class DeltaSync
+ * @brief Computes and remembers block signatures so only changed blocks are sent.
+ *
+ * For each uploaded file the client keeps the signature of every fixed-size
+ * block of the copy held by the server: a rolling (Adler-style) checksum plus
+ * an XXH64 strong hash. When the file changes, a single pass with a rolling
+ * window finds blocks the server already has at any offset, and the result is
+ * encoded as a list of COPY (server block run) and DATA (literal bytes)
+ * operations. The server rebuilds the new file from its stored copy.
+ *
+ * Delta wire format (little-endian):
+ * @code
+ *   "FSD1" | u32 blockSize | u64 baseSize | u64 targetSize
+ *   { u8 1 | u64 firstBlock | u32 blockCount }   COPY
+ *   { u8 2 | u32 length | bytes }                DATA
+ *   u8 0                                         END
+ * @endcode
+ *
+ * @note Signature storage methods are thread-safe; the static helpers are reentrant.
+ */
+class DeltaSync
+{
+public:
+    /**
+     * @struct BlockSignature
+     * @brief Checksums of one block.
+     */
+    struct BlockSignature {
+        uint32_t weak;      ///< Rolling checksum
+        uint64_t strong;    ///< XXH64 of the block
+    };
+
+    /**
+     * @struct Signatures
+     * @brief Block signatures of one version of a file.
+     */
+    struct Signatures {
+        uint32_t blockSize = 0;             ///< Block size used to cut the file
+        uint64_t fileSize = 0;              ///< Size of the file version
+        std::vector<BlockSignature> blocks; ///< One entry per block, last one may be short
+    };
+
+    /**
+     * @struct Delta
+     * @brief Encoded delta and statistics.
+     */
+    struct Delta {
+        std::string payload;        ///< Encoded operations (see wire format)
+        uint64_t literalBytes = 0;  ///< Bytes sent as DATA
+        uint64_t copiedBytes = 0;   ///< Bytes reused from the server copy
+        Signatures target;          ///< Signatures of the file version the delta produces
+    };
+
+    /**
+     * @brief Compute the block signatures of a file.
+     * @param path Path of the file.
+     * @param blockSize Block size in bytes.
+     * @param out Receives the signatures.
+     * @return false if the file could not be read.
+     */
+    static bool computeSignatures(const std::string& path, uint32_t blockSize, Signatures& out);
+
+    /**
+     * @brief Compute the delta turning the server copy (described by base) into the file.
+     * @param path Path of the current file.
+     * @param base Signatures of the server copy.
+     * @param maxLiteral Give up once more literal bytes than this would be needed.
+     * @param out Receives the delta.
+     * @return false if the file could not be read or the delta would exceed maxLiteral.
+     */
+    static bool computeDelta(const std::string& path, const Signatures& base,
+                             uint64_t maxLiteral, Delta& out);
+
+    /**
+     * @brief Get the stored signatures of a file.
+     * @return false if none are stored.
+     */
+    bool lookup(const std::string& key, Signatures& out);
+
+    /**
+     * @brief Store the signatures of the copy now held by the server.
+     */
+    void store(const std::string& key, Signatures signatures);
+
+    /**
+     * @brief Drop stored signatures (e.g. the file was deleted).
+     */
+    void forget(const std::string& key);
+
+private:
+    std::mutex                                  m_mutex;        ///< Protects m_signatures
+    std::unordered_map<std::string, Signatures> m_signatures;   ///< Server-side signatures per key
+};
+
+#endif // DELTA_SYNC_H
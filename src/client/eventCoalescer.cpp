@@ -0,0 +1,150 @@
+#include "eventCoalescer.h"
+
+#include <utility>
+
+EventCoalescer::EventCoalescer(SettledHandler handler, Reactor& reactor)
+    : m_handler(std::move(handler)),
+      m_quiet_period(std::chrono::milliseconds(500)),
+      m_timers(reactor.timers()),
+      m_started(false)
+{
+}
+
+EventCoalescer::~EventCoalescer()
+{
+    Stop();
+}
+
+void EventCoalescer::Configure(std::chrono::milliseconds quiet_period)
+{
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_quiet_period = quiet_period;
+}
+
+void EventCoalescer::Start()
+{
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_started = true;
+
+    Clock::time_point now = Clock::now();
+    for (auto& entry : m_pending) {
+        if (entry.second.timer == 0) {
+            schedule(entry.first, entry.second, now);
+        }
+    }
+}
+
+void EventCoalescer::Stop()
+{
+    std::vector<TimerWheel::TimerId> timers;
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_started = false;
+        for (auto& entry : m_pending) {
+            if (entry.second.timer != 0) {
+                timers.push_back(entry.second.timer);
+                entry.second.timer = 0;
+            }
+        }
+    }
+
+    // Outside the lock: cancel() waits for a running onQuiet(), which takes it
+    for (TimerWheel::TimerId timer : timers) {
+        m_timers.cancel(timer);
+    }
+}
+
+void EventCoalescer::add(std::string_view filename, Change change)
+{
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+
+    Clock::time_point now = Clock::now();
+    m_lookup.assign(filename);
+    auto it = m_pending.find(m_lookup);
+    if (it != m_pending.end()) {
+        // Its timer re-checks the deadline when it fires
+        it->second.changes |= change;
+        it->second.deadline = now + m_quiet_period;
+        return;
+    }
+
+    it = m_pending.emplace(m_lookup, Pending{change, now + m_quiet_period, 0}).first;
+    if (m_started) {
+        schedule(it->first, it->second, now);
+    }
+}
+
+void EventCoalescer::closeWrite(std::string_view filename)
+{
+    decltype(m_pending)::node_type settled;
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_lookup.assign(filename);
+        auto it = m_pending.find(m_lookup);
+        if (it == m_pending.end()) {
+            return;  // Opened for writing but never changed
+        }
+        settled = m_pending.extract(it);
+    }
+
+    if (settled.mapped().timer != 0) {
+        m_timers.cancel(settled.mapped().timer);
+    }
+    m_handler(settled.key(), settled.mapped().changes);
+}
+
+void EventCoalescer::discard(std::string_view filename)
+{
+    decltype(m_pending)::node_type discarded;
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_lookup.assign(filename);
+        discarded = m_pending.extract(m_lookup);
+    }
+
+    if (discarded && discarded.mapped().timer != 0) {
+        m_timers.cancel(discarded.mapped().timer);
+    }
+}
+
+void EventCoalescer::flush()
+{
+    std::unordered_map<std::string, Pending> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        pending.swap(m_pending);
+    }
+
+    for (const auto& entry : pending) {
+        if (entry.second.timer != 0) {
+            m_timers.cancel(entry.second.timer);
+        }
+        m_handler(entry.first, entry.second.changes);
+    }
+}
+
+void EventCoalescer::schedule(const std::string& filename, Pending& pending, Clock::time_point now)
+{
+    pending.timer = m_timers.schedule(pending.deadline - now, [this, filename]() { onQuiet(filename); });
+}
+
+void EventCoalescer::onQuiet(const std::string& filename)
+{
+    decltype(m_pending)::node_type settled;
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        auto it = m_pending.find(filename);
+        if (it == m_pending.end() || !m_started) {
+            return;  // Settled, discarded or stopped while the timer was firing
+        }
+
+        Clock::time_point now = Clock::now();
+        if (it->second.deadline > now) {
+            schedule(filename, it->second, now);  // Changed again since the timer was armed
+            return;
+        }
+        settled = m_pending.extract(it);
+    }
+
+    m_handler(settled.key(), settled.mapped().changes);
+}
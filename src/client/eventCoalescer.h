@@ -0,0 +1,135 @@
+#ifndef EVENT_COALESCER_H
+#define EVENT_COALESCER_H
+
+#include "../utilities/Reactor.h"
+#include "../utilities/TimerWheel.h"
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class EventCoalescer
+ * @brief Merges bursts of changes to the same file into a single "settled" report
+ *
+ * Each file with pending changes carries a small state: the set of changes seen so
+ * far and the time of the last one. A file settles either when it is closed after
+ * writing (closeWrite()) or when no new change arrived for the quiet period.
+ * Each pending file has a one-shot timer on the reactor's TimerWheel, armed
+ * for its deadline; a change only moves the deadline, and the timer re-arms
+ * for the rest of it when it fires, so a busy file costs one timer per quiet
+ * period rather than one per change. Nothing ticks while no file is pending.
+ *
+ * @note add(), closeWrite() and discard() may be called from any thread; the
+ * settled handler runs on the reactor thread or on the caller of closeWrite()/flush().
+ */
+class EventCoalescer
+{
+public:
+    /**
+     * @enum Change
+     * @brief Change kinds accumulated for a file, combined as bit flags
+     */
+    enum Change : unsigned {
+        CHANGE_CREATED  = 1u << 0,   ///< File was created
+        CHANGE_MODIFIED = 1u << 1,   ///< File content was modified
+        CHANGE_ATTRIB   = 1u << 2    ///< File attributes were changed
+    };
+
+    /**
+     * @brief Callback receiving a settled file and the changes merged into it
+     */
+    using SettledHandler = std::function<void(const std::string& filename, unsigned changes)>;
+
+    /**
+     * @brief Constructs a coalescer
+     * @param handler Callback invoked once per settled file
+     * @param reactor Loop whose TimerWheel runs the quiet periods
+     */
+    explicit EventCoalescer(SettledHandler handler, Reactor& reactor = Reactor::getInstance());
+
+    /**
+     * @brief Destructor - cancels the timers, pending changes are dropped
+     */
+    ~EventCoalescer();
+
+    /**
+     * @brief Set the quiet period after which a file without new changes settles
+     * @param quiet_period Quiet period
+     * @note Must be called before Start()
+     */
+    void Configure(std::chrono::milliseconds quiet_period);
+
+    /**
+     * @brief Start settling files at the end of their quiet period
+     */
+    void Start();
+
+    /**
+     * @brief Stop settling files by timer; pending files wait for closeWrite() or flush()
+     * @note Once this returns, no timer callback is running (unless called from the reactor thread)
+     */
+    void Stop();
+
+    /**
+     * @brief Record a change for a file, restarting its quiet period
+     * @param filename File the change applies to
+     * @param change Kind of change (a Change flag)
+     */
+    void add(std::string_view filename, Change change);
+
+    /**
+     * @brief Settle a file immediately because its writer closed it
+     * @param filename File that was closed after writing
+     */
+    void closeWrite(std::string_view filename);
+
+    /**
+     * @brief Drop any pending changes for a file (e.g. it was deleted)
+     * @param filename File whose pending changes are discarded
+     */
+    void discard(std::string_view filename);
+
+    /**
+     * @brief Settle every pending file right away
+     */
+    void flush();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @struct Pending
+     * @brief Per-file state while changes are still arriving
+     */
+    struct Pending {
+        unsigned          changes;    ///< Accumulated Change flags
+        Clock::time_point deadline;   ///< When the file settles unless changed again
+        TimerWheel::TimerId timer;    ///< Timer armed for the deadline or earlier, 0 if none
+    };
+
+    /**
+     * @brief Arm a file's timer for its deadline
+     * @note m_state_mutex must be held
+     */
+    void schedule(const std::string& filename, Pending& pending, Clock::time_point now);
+
+    /**
+     * @brief Timer callback: settle a file, or re-arm if it changed since
+     */
+    void onQuiet(const std::string& filename);
+
+    SettledHandler             m_handler;        ///< Receiver of settled files
+    std::chrono::milliseconds  m_quiet_period;   ///< Quiet period before a file settles
+    TimerWheel&                m_timers;         ///< Timers of the reactor
+
+    std::mutex                                  m_state_mutex;   ///< Protects the members below
+    std::unordered_map<std::string, Pending>    m_pending;       ///< Files with unsettled changes
+    bool                                        m_started;       ///< Whether files get timers
+    std::string                                 m_lookup;        ///< Reused key for lookups, so known files allocate nothing
+};
+
+#endif /* EVENT_COALESCER_H */
@@ -0,0 +1,182 @@
+#include "fanotifyBackend.h"
+#include "../utilities/Logger.h"
+
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/fanotify.h>
+
+// Buffer for reading fanotify events
+static const size_t FAN_BUF_LEN = 64 * 1024;
+
+// Upper bound on cached directory handles before the cache is reset
+static const size_t DIR_CACHE_MAX = 1 << 16;
+
+// Marker stored in the cache for directories outside the monitored tree
+static const char OUTSIDE_TREE[] = "\n";
+
+FanotifyBackend::FanotifyBackend()
+    : m_fan_fd(-1),
+      m_mount_fd(-1),
+      m_recursive(false)
+{
+}
+
+FanotifyBackend::~FanotifyBackend()
+{
+    close();
+}
+
+bool FanotifyBackend::open(const std::string& dir_path, bool recursive)
+{
+    char resolved[PATH_MAX];
+    if (!realpath(dir_path.c_str(), resolved)) {
+        LOG_ERROR("Failed to resolve {}: {}", dir_path, strerror(errno));
+        return false;
+    }
+    m_root = resolved;
+    m_recursive = recursive;
+
+    m_fan_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK,
+                             O_RDONLY | O_LARGEFILE);
+    if (m_fan_fd == -1) {
+        LOG_ERROR("Failed to initialize fanotify: {}", strerror(errno));
+        return false;
+    }
+
+    uint64_t mask = FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_ATTRIB | FAN_CLOSE_WRITE |
+                    FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR;
+    if (fanotify_mark(m_fan_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, mask, AT_FDCWD, m_root.c_str()) == -1) {
+        LOG_ERROR("Failed to add fanotify mark on {}: {}", m_root, strerror(errno));
+        close();
+        return false;
+    }
+
+    m_mount_fd = ::open(m_root.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC);
+    if (m_mount_fd == -1) {
+        LOG_ERROR("Failed to open {}: {}", m_root, strerror(errno));
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void FanotifyBackend::close()
+{
+    if (m_mount_fd != -1) {
+        ::close(m_mount_fd);
+        m_mount_fd = -1;
+    }
+
+    if (m_fan_fd != -1) {
+        ::close(m_fan_fd);
+        m_fan_fd = -1;
+    }
+
+    m_dir_cache.clear();
+}
+
+bool FanotifyBackend::resolveDirectory(const std::string& handle_key, void* handle, std::string& out)
+{
+    auto it = m_dir_cache.find(handle_key);
+    if (it != m_dir_cache.end()) {
+        if (it->second == OUTSIDE_TREE) {
+            return false;
+        }
+        out = it->second;
+        return true;
+    }
+
+    int dir_fd = open_by_handle_at(m_mount_fd, static_cast<struct file_handle*>(handle), O_PATH);
+    if (dir_fd == -1) {
+        return false;  // Directory already removed (ESTALE) - nothing to report
+    }
+
+    char link[64];
+    char path[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", dir_fd);
+    ssize_t len = readlink(link, path, sizeof(path) - 1);
+    ::close(dir_fd);
+    if (len < 0) {
+        return false;
+    }
+    path[len] = '\0';
+
+    if (m_dir_cache.size() >= DIR_CACHE_MAX) {
+        m_dir_cache.clear();
+    }
+
+    std::string relative;
+    bool inside = false;
+    if (m_root.compare(path) == 0) {
+        inside = true;
+    }
+    else if (m_recursive && m_root.compare(0, m_root.size(), path, m_root.size()) == 0 &&
+             path[m_root.size()] == '/') {
+        relative.assign(path + m_root.size() + 1);
+        relative.push_back('/');
+        inside = true;
+    }
+
+    m_dir_cache.emplace(handle_key, inside ? relative : std::string(OUTSIDE_TREE));
+    if (inside) {
+        out = relative;
+    }
+    return inside;
+}
+
+bool FanotifyBackend::readEvents(const EventHandler& handler)
+{
+    alignas(struct fanotify_event_metadata) char buffer[FAN_BUF_LEN];
+    std::string dir;
+    std::string filename;
+
+    while (true) {
+        ssize_t length = read(m_fan_fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                return true;
+            }
+            LOG_ERROR("Error reading fanotify events: {}", strerror(errno));
+            return false;
+        }
+
+        auto* metadata = reinterpret_cast<struct fanotify_event_metadata*>(buffer);
+        while (FAN_EVENT_OK(metadata, length)) {
+            if (metadata->vers != FANOTIFY_METADATA_VERSION) {
+                LOG_WARN("Unexpected fanotify metadata version");
+                return false;
+            }
+
+            // Overflow notices carry no file information
+            if (metadata->mask & FAN_Q_OVERFLOW) {
+                handler(std::string(), "", metadata->mask);
+            }
+
+            auto* fid = reinterpret_cast<struct fanotify_event_info_fid*>(metadata + 1);
+            if (metadata->event_len > sizeof(*metadata) &&
+                fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                auto* handle = reinterpret_cast<struct file_handle*>(fid->handle);
+                const char* name = reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes);
+
+                // Renamed or removed directories invalidate cached paths below them
+                if ((metadata->mask & FAN_ONDIR) && (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO))) {
+                    m_dir_cache.clear();
+                }
+
+                std::string key(reinterpret_cast<const char*>(&handle->handle_type),
+                                sizeof(handle->handle_type) + handle->handle_bytes);
+                if (resolveDirectory(key, handle, dir)) {
+                    filename.assign(dir).append(name);
+                    handler(filename, name, metadata->mask);
+                }
+            }
+
+            metadata = FAN_EVENT_NEXT(metadata, length);
+        }
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef FANOTIFY_BACKEND_H
+#define FANOTIFY_BACKEND_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @class FanotifyBackend
+ * @brief Whole-filesystem event source based on fanotify
+ *
+ * A single FAN_MARK_FILESYSTEM mark covers the entire filesystem that holds the
+ * monitored directory, so no per-directory watches are needed and the
+ * max_user_watches limit does not apply. Events are reported with
+ * FAN_REPORT_DFID_NAME (parent directory handle + entry name); directory handles
+ * are resolved to paths once and cached, and events outside the monitored
+ * directory are discarded.
+ *
+ * @note Requires CAP_SYS_ADMIN and Linux 5.9 or newer. Used by filesMonitor,
+ * which falls back to inotify when open() fails.
+ */
+class FanotifyBackend
+{
+public:
+    /**
+     * @brief Callback receiving one event
+     * @param filename Path of the entry relative to the monitored directory
+     * @param name Entry name (last path component)
+     * @param mask fanotify event mask (FAN_CREATE, FAN_MODIFY, ... and FAN_ONDIR);
+     *        FAN_Q_OVERFLOW is reported with an empty filename
+     */
+    using EventHandler = std::function<void(const std::string& filename, const char* name, uint64_t mask)>;
+
+    FanotifyBackend();
+    ~FanotifyBackend();
+
+    FanotifyBackend(const FanotifyBackend&) = delete;
+    FanotifyBackend& operator=(const FanotifyBackend&) = delete;
+
+    /**
+     * @brief Create the fanotify group and mark the filesystem holding dir_path
+     * @param dir_path Directory whose events should be reported
+     * @param recursive Report events from subdirectories as well
+     * @return true on success, false if fanotify is unavailable or not permitted
+     */
+    bool open(const std::string& dir_path, bool recursive);
+
+    /**
+     * @brief Release the fanotify group and cached directory handles
+     */
+    void close();
+
+    /**
+     * @brief File descriptor to poll for readability
+     */
+    int fd() const { return m_fan_fd; }
+
+    /**
+     * @brief Read all pending events and pass the relevant ones to handler
+     * @return false on an unrecoverable read error
+     */
+    bool readEvents(const EventHandler& handler);
+
+private:
+    /**
+     * @brief Map a directory file handle to its path relative to the root
+     * @param handle_key Raw handle bytes (type + f_handle) used as cache key
+     * @param handle Pointer to the struct file_handle from the event
+     * @param out Receives the '/'-terminated relative path (empty for the root)
+     * @return false if the directory is outside the monitored tree or gone
+     */
+    bool resolveDirectory(const std::string& handle_key, void* handle, std::string& out);
+
+    int         m_fan_fd;       ///< fanotify group file descriptor
+    int         m_mount_fd;     ///< Descriptor on the root, used for open_by_handle_at
+    bool        m_recursive;    ///< Whether subdirectory events are reported
+    std::string m_root;         ///< Canonical path of the monitored directory
+
+    /// Directory handle -> relative path ('/'-terminated); "\n" marks directories outside the tree
+    std::unordered_map<std::string, std::string> m_dir_cache;
+};
+
+#endif /* FANOTIFY_BACKEND_H */
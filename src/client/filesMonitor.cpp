@@ -1,35 +1,81 @@
 #include "filesMonitor.h"
+#include "../utilities/Logger.h"
 
-#include <iostream>
+#include <fstream>
 #include <string>
 #include <vector>
 #include <sys/inotify.h>
 #include <unistd.h>
-#include <poll.h>
 #include <cstring>
 #include <algorithm>
 #include <fcntl.h>
 #include <errno.h>
+#include <chrono>
+#include <cstdint>
+#include <dirent.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/fanotify.h>
 
 // Buffer for reading inotify events
 static const size_t EVENT_BUF_LEN = 4096;
 
-filesMonitor::filesMonitor(const std::string& dir_path) 
+// Bytes per event assumed when sizing the batched read buffer (48-byte name)
+static const size_t BATCH_EVENT_LEN = sizeof(struct inotify_event) + 48;
+
+// Smallest batched read buffer: the kernel needs room for one event with the longest name
+static const size_t MIN_BATCH_BUF_LEN = sizeof(struct inotify_event) + NAME_MAX + 1;
+
+// Events watched on every directory; entries moved in or out count as created or deleted
+static const uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                   IN_MOVED_FROM | IN_MOVED_TO | IN_MOVE_SELF;
+
+// Watch flags of the directory tree in recursive mode: real directories only
+static const uint32_t TREE_MASK = IN_ONLYDIR | IN_DONT_FOLLOW;
+
+// Directories a rescan walks before letting the reactor handle other descriptors, so live events keep flowing
+static const size_t RESCAN_BATCH_DIRS = 64;
+
+filesMonitor::filesMonitor(const std::string& dir_path, bool recursive, Reactor& reactor)
     : m_dir_path(dir_path),
+      m_reactor(reactor),
       m_run_flag(false),
+      m_wake_fd(-1),
       m_inotify_fd(-1),
-      m_watch_fd(-1)
+      m_watch_fd(-1),
+      m_recursive(recursive),
+      m_backend(Backend::INOTIFY),
+      m_use_fanotify(false),
+      m_quiet_period(0),
+      m_coalescer([this](const std::string& filename, unsigned changes) { onSettled(filename, changes); }, reactor),
+      m_batch_events(0),
+      m_batch_open(false),
+      m_last_wd(-1),
+      m_rescan_requested(false),
+      m_filter(std::make_shared<const PathFilter>()),
+      m_events_received(MetricsRegistry::getInstance().counter(
+          "filesserver_events_received_total", "File events read from the kernel")),
+      m_events_filtered(MetricsRegistry::getInstance().counter(
+          "filesserver_events_filtered_total", "File events dropped by the filters"))
 {
     // Validate directory path
     if (m_dir_path.empty()) {
         throw std::invalid_argument("Directory path cannot be empty");
     }
+
+    // Lives as long as the monitor, so RequestRescan() may signal it at any time
+    m_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wake_fd == -1) {
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
 }
 
 filesMonitor::~filesMonitor()
 {
     Stop();
     cleanupInotify();
+    close(m_wake_fd);
 }
 
 bool filesMonitor::Start()
@@ -38,55 +84,181 @@ bool filesMonitor::Start()
         return false; // Already running
     }
     
-    if (!setupInotify()) {
+    m_use_fanotify = false;
+    if (m_backend == Backend::FANOTIFY) {
+        m_use_fanotify = m_fanotify.open(m_dir_path, m_recursive);
+        if (!m_use_fanotify) {
+            LOG_WARN("fanotify backend unavailable, falling back to inotify");
+        }
+    }
+
+    if (!m_use_fanotify && !setupInotify()) {
         return false;
     }
     
+    m_rescan_dirs.clear();
+    m_rescan_requested.store(false);
+
+    // One read per wakeup into a small buffer, or whole batches into a large one
+    size_t buffer_len = EVENT_BUF_LEN;
+    if (m_batch_events > 0) {
+        buffer_len = std::max(m_batch_events * BATCH_EVENT_LEN, MIN_BATCH_BUF_LEN);
+        m_batch.reserve(m_batch_events);
+    }
+    m_read_buffer.resize((buffer_len + sizeof(ReadBlock) - 1) / sizeof(ReadBlock));
+
+    if (m_quiet_period.count() > 0) {
+        m_coalescer.Configure(m_quiet_period);
+        m_coalescer.Start();
+    }
+
     m_run_flag.store(true);
-    
-    // Create and start the monitoring thread
-    start();
-    
+
+    // Hand the descriptors to the reactor; its thread handles them from now on
+    bool registered = m_use_fanotify
+        ? m_reactor.add(m_fanotify.fd(), EPOLLIN, [this](uint32_t) { onFanotifyReadable(); })
+        : m_reactor.add(m_inotify_fd, EPOLLIN, [this](uint32_t) { onInotifyReadable(); });
+    if (!registered || !m_reactor.add(m_wake_fd, EPOLLIN, [this](uint32_t) { onWake(); })) {
+        LOG_ERROR("Failed to register the monitor on the reactor: {}", strerror(errno));
+        Stop();
+        return false;
+    }
+
     return true;
 }
 
 void filesMonitor::Stop()
 {
-    stop();  // This already sets m_running to false and joins the thread
+    // Once removed, no handler is running or called again
+    if (m_use_fanotify) {
+        m_reactor.remove(m_fanotify.fd());
+    } else if (m_inotify_fd != -1) {
+        m_reactor.remove(m_inotify_fd);
+    }
+    m_reactor.remove(m_wake_fd);
+    m_run_flag.store(false);
+
     cleanupInotify();
+    m_fanotify.close();
+
+    // Report whatever was still settling
+    m_coalescer.Stop();
+    m_coalescer.flush();
 }
 
-void filesMonitor::AddFilter(const std::string& pattern)
+void filesMonitor::SetBackend(Backend backend)
 {
+    m_backend = backend;
+}
+
+void filesMonitor::SetCoalescing(std::chrono::milliseconds quiet_period)
+{
+    m_quiet_period = quiet_period;
+}
+
+void filesMonitor::SetBatching(size_t events)
+{
+    m_batch_events = events;
+}
+
+bool filesMonitor::AddFilter(const std::string& pattern)
+{
+    return addFilterRule(PathFilter::parse(pattern, PathFilter::Action::INCLUDE));
+}
+
+bool filesMonitor::AddExclude(const std::string& pattern)
+{
+    return addFilterRule(PathFilter::parse(pattern, PathFilter::Action::EXCLUDE));
+}
+
+bool filesMonitor::LoadIgnoreFile(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file) {
+        LOG_ERROR("Failed to read ignore file {}", path);
+        return false;
+    }
+
     std::lock_guard<std::mutex> lock(m_filter_mutex);
-    if (std::find(m_filters.begin(), m_filters.end(), pattern) == m_filters.end()) {
-        m_filters.push_back(pattern);
+    std::string line;
+    while (std::getline(file, line)) {
+        // Trailing blanks are not significant; '#' and '!' are escaped with a backslash
+        while (!line.empty() && (line.back() == ' ' || line.back() == '\t' || line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        PathFilter::Action action = PathFilter::Action::EXCLUDE;
+        if (line[0] == '!') {
+            action = PathFilter::Action::UNEXCLUDE;
+            line.erase(0, 1);
+        } else if (line[0] == '\\' && line.size() > 1 && (line[1] == '#' || line[1] == '!')) {
+            line.erase(0, 1);
+        }
+        m_filter_rules.push_back({line, PathFilter::Syntax::GLOB, action});
     }
+    return publishFilter();
 }
 
 void filesMonitor::RemoveFilter(const std::string& pattern)
 {
     std::lock_guard<std::mutex> lock(m_filter_mutex);
-    m_filters.erase(std::remove(m_filters.begin(), m_filters.end(), pattern), m_filters.end());
+    PathFilter::Rule removed = PathFilter::parse(pattern, PathFilter::Action::INCLUDE);
+    m_filter_rules.erase(std::remove_if(m_filter_rules.begin(), m_filter_rules.end(),
+                                        [&removed](const PathFilter::Rule& rule) {
+                                            return rule.syntax == removed.syntax && rule.pattern == removed.pattern;
+                                        }),
+                         m_filter_rules.end());
+    publishFilter();
 }
 
-bool filesMonitor::matchesFilter(const std::string& filename) const
+bool filesMonitor::addFilterRule(const PathFilter::Rule& rule)
 {
     std::lock_guard<std::mutex> lock(m_filter_mutex);
-    
-    // If no filters are defined, accept all files
-    if (m_filters.empty()) {
-        return true;
-    }
-    
-    // Check if the filename matches any of the filters
-    for (const auto& filter : m_filters) {
-        if (filename.find(filter) != std::string::npos) {
+    for (const auto& existing : m_filter_rules) {
+        if (existing.syntax == rule.syntax && existing.pattern == rule.pattern && existing.action == rule.action) {
             return true;
         }
     }
-    
-    return false;
+    m_filter_rules.push_back(rule);
+    if (!publishFilter()) {
+        m_filter_rules.pop_back();
+        return false;
+    }
+    return true;
+}
+
+bool filesMonitor::publishFilter()
+{
+    std::shared_ptr<const PathFilter> filter;
+    try {
+        filter = std::make_shared<const PathFilter>(m_filter_rules);
+    } catch (const std::regex_error& e) {
+        LOG_WARN("Invalid filter pattern: {}", e.what());
+        return false;
+    }
+    // Readers keep the snapshot they loaded; the old one is freed by its last reader
+    std::atomic_store(&m_filter, filter);
+    return true;
+}
+
+void filesMonitor::RequestRescan()
+{
+    m_rescan_requested.store(true);
+    wake();
+}
+
+void filesMonitor::wake()
+{
+    uint64_t one = 1;
+    while (write(m_wake_fd, &one, sizeof(one)) == -1 && errno == EINTR) {
+    }
+}
+
+bool filesMonitor::matchesFilter(const std::string& relPath) const
+{
+    return std::atomic_load(&m_filter)->matches(relPath);
 }
 
 bool filesMonitor::setupInotify()
@@ -94,24 +266,158 @@ bool filesMonitor::setupInotify()
     // Initialize inotify
     m_inotify_fd = inotify_init1(IN_NONBLOCK);
     if (m_inotify_fd == -1) {
-        std::cerr << "Failed to initialize inotify: " << strerror(errno) << std::endl;
+        LOG_ERROR("Failed to initialize inotify: {}", strerror(errno));
         return false;
     }
 
-    // Add watch for the directory
-    uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB;
-    m_watch_fd = inotify_add_watch(m_inotify_fd, m_dir_path.c_str(), mask);
+    if (!m_recursive) {
+        // Add watch for the directory
+        m_watch_fd = inotify_add_watch(m_inotify_fd, m_dir_path.c_str(), WATCH_MASK);
+        if (m_watch_fd == -1) {
+            LOG_ERROR("Failed to add watch on directory {}: {}", m_dir_path, strerror(errno));
+            close(m_inotify_fd);
+            m_inotify_fd = -1;
+            return false;
+        }
+        m_watches.add(m_watch_fd, -1, "");
+        return true;
+    }
+
+    // Walk the whole tree, reporting how long it took and what the table costs
+    auto walk_start = std::chrono::steady_clock::now();
+    size_t count = addWatchTree(-1, "", "", false);
+    auto walk_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - walk_start).count();
+
     if (m_watch_fd == -1) {
-        std::cerr << "Failed to add watch on directory " << m_dir_path << ": " 
-                  << strerror(errno) << std::endl;
         close(m_inotify_fd);
         m_inotify_fd = -1;
+        m_watches.clear();
         return false;
     }
 
+    LOG_INFO("Watching {} directories under {} (walk: {} ms, table: {} bytes, {} bytes/dir)",
+             count, m_dir_path, walk_ms, m_watches.memoryUsage(), m_watches.memoryUsage() / count);
+
     return true;
 }
 
+size_t filesMonitor::addWatchTree(int parent_wd, const std::string& name,
+                                  const std::string& rel_dir, bool notify_existing)
+{
+    std::vector<PendingDir> pending;
+    pending.push_back({parent_wd, name, rel_dir});
+    return walkTree(pending, notify_existing, false, SIZE_MAX);
+}
+
+size_t filesMonitor::walkTree(std::vector<PendingDir>& pending, bool notify_existing, bool rescan,
+                              size_t max_dirs)
+{
+    size_t added = 0;
+    size_t walked = 0;
+    bool limit_reported = false;
+
+    while (!pending.empty() && walked < max_dirs) {
+        PendingDir dir = std::move(pending.back());
+        pending.pop_back();
+        ++walked;
+
+        std::string full_path = m_dir_path;
+        if (!dir.rel_dir.empty()) {
+            full_path += "/" + dir.rel_dir;
+        }
+
+        // The fanotify backend needs no watches; a rescan there only reports files
+        int wd = -1;
+        if (m_inotify_fd != -1) {
+            wd = inotify_add_watch(m_inotify_fd, full_path.c_str(),
+                                   m_recursive ? WATCH_MASK | TREE_MASK : WATCH_MASK);
+            if (wd == -1) {
+                if (errno == ENOSPC && !limit_reported) {
+                    LOG_WARN("inotify watch limit reached at {} (see /proc/sys/fs/inotify/max_user_watches)",
+                             full_path);
+                    limit_reported = true;
+                } else if (errno != ENOSPC && errno != ENOENT) {
+                    // ENOENT: removed or moved away before it could be watched, its own events tell
+                    LOG_ERROR("Failed to add watch on directory {}: {}", full_path, strerror(errno));
+                }
+                continue;
+            }
+
+            if (dir.parent_wd == -1) {
+                m_watch_fd = wd;
+            }
+            m_watches.add(wd, dir.parent_wd, dir.name);
+            ++added;
+        }
+
+        DIR* handle = opendir(full_path.c_str());
+        if (!handle) {
+            continue;
+        }
+
+        while (struct dirent* entry = readdir(handle)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(dirfd(handle), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                    type = S_ISDIR(st.st_mode) ? DT_DIR : (S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN);
+                }
+            }
+
+            if (type == DT_DIR) {
+                if (m_recursive) {
+                    pending.push_back({wd, entry->d_name, dir.rel_dir + entry->d_name + "/"});
+                }
+            }
+            else if (type == DT_REG && notify_existing) {
+                // Files written before the watch existed (or while events were lost) would otherwise be missed
+                std::string filename = dir.rel_dir + entry->d_name;
+                if (!matchesFilter(filename)) {
+                    continue;
+                }
+                FileEvent fileEvent;
+                fileEvent.filename = filename;
+                fileEvent.eventType = EventType::CREATED;
+                fileEvent.settled = rescan;
+                fileEvent.rescan = rescan;
+                dispatch(fileEvent);
+            }
+        }
+
+        closedir(handle);
+    }
+
+    return added;
+}
+
+const std::string* filesMonitor::directoryOf(int wd)
+{
+    if (wd != m_last_wd) {
+        if (!m_watches.resolve(wd, m_last_dir)) {
+            m_last_wd = -1;
+            return nullptr;
+        }
+        m_last_wd = wd;
+    }
+    return &m_last_dir;
+}
+
+void filesMonitor::unwatchTree(int wd)
+{
+    std::vector<int> wds;
+    m_watches.subtree(wd, wds);
+    for (int dir_wd : wds) {
+        inotify_rm_watch(m_inotify_fd, dir_wd);
+        m_watches.remove(dir_wd);
+    }
+    m_last_wd = -1;
+}
+
 void filesMonitor::cleanupInotify()
 {
     if (m_watch_fd != -1) {
@@ -123,90 +429,280 @@ void filesMonitor::cleanupInotify()
         close(m_inotify_fd);
         m_inotify_fd = -1;
     }
+
+    m_watches.clear();
+    m_last_wd = -1;
 }
 
 void filesMonitor::processEvent(const struct inotify_event* event)
 {
-    std::cout << "Event received: mask=" << event->mask << std::endl;
+    LOG_DEBUG("Event received: mask={}", event->mask);
 
-    // Skip if no name is provided or it's a directory
-    if (!event->len || (event->mask & IN_ISDIR)) {
+    // The kernel dropped events; only a rescan can tell what changed
+    if (event->mask & IN_Q_OVERFLOW) {
+        LOG_WARN("inotify event queue overflowed, rescanning {}", m_dir_path);
+        RequestRescan();
+        return;
+    }
+
+    // The watch was removed (directory deleted or moved away)
+    if (event->mask & IN_IGNORED) {
+        m_watches.remove(event->wd);
+        m_last_wd = -1;
+        return;
+    }
+
+    // A directory still tracked moved: normally its parent's IN_MOVED_FROM already dropped it
+    if (event->mask & IN_MOVE_SELF) {
+        if (event->wd == m_watch_fd) {
+            LOG_WARN("Watched directory {} was moved; it is still watched at its new location", m_dir_path);
+        } else {
+            unwatchTree(event->wd);
+        }
+        return;
+    }
+
+    // Skip if no name is provided
+    if (!event->len) {
+        return;
+    }
+
+    // Follow new or moved-in subdirectories, drop moved-away ones, skip other directory events
+    if (event->mask & IN_ISDIR) {
+        if (m_recursive && (event->mask & (IN_CREATE | IN_MOVED_TO))) {
+            const std::string* dir = directoryOf(event->wd);
+            if (dir) {
+                std::string rel_dir = *dir + event->name + "/";
+                addWatchTree(event->wd, event->name, rel_dir, true);
+            }
+            m_last_wd = -1;
+        } else if (m_recursive && (event->mask & IN_MOVED_FROM)) {
+            // Its watches follow it, and would report its files under the old path
+            unwatchTree(m_watches.find(event->wd, event->name));
+        }
         return;
     }
     
-    std::string filename(event->name);
-    
+    // Build the path in a reused buffer: no allocation per event once it has grown
+    if (m_recursive) {
+        const std::string* dir = directoryOf(event->wd);
+        if (!dir) {
+            return;  // Event from a watch that is no longer tracked
+        }
+        m_event_path.assign(*dir).append(event->name);
+    } else {
+        m_event_path.assign(event->name);
+    }
+
     // Check if file matches filters
-    if (!matchesFilter(filename)) {
+    m_events_received.inc();
+    if (!matchesFilter(m_event_path)) {
+        m_events_filtered.inc();
         return;
     }
-    
+
     // Create appropriate event
     FileEvent fileEvent;
-    fileEvent.filename = filename;
-    
-    if (event->mask & IN_CREATE) {
+    fileEvent.filename = m_event_path;
+
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
         fileEvent.eventType = EventType::CREATED;
-        notify(&fileEvent);  // Pass pointer to the string
+        dispatch(fileEvent);
     }
-    else if (event->mask & IN_DELETE) {
+    else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
         fileEvent.eventType = EventType::DELETED;
-        notify(&fileEvent);
+        dispatch(fileEvent);
     }
     else if (event->mask & IN_MODIFY) {
         fileEvent.eventType = EventType::MODIFIED;
-        notify(&fileEvent);
+        dispatch(fileEvent);
     }
     else if (event->mask & IN_ATTRIB) {
         fileEvent.eventType = EventType::ATTRIB_CHANGED;
-        notify(&fileEvent);
+        dispatch(fileEvent);
+    }
+    else if (event->mask & IN_CLOSE_WRITE) {
+        dispatchCloseWrite(m_event_path);
     }
 }
 
-void filesMonitor::thread()
+void filesMonitor::processFanotifyEvent(const std::string& filename, uint64_t mask)
 {
-    char buffer[EVENT_BUF_LEN];
-    
-    // Set up polling
-    struct pollfd pfd = {
-        .fd = m_inotify_fd,
-        .events = POLLIN,
-        .revents = 0
-    };
-
-    while (m_running.load()) {
-        // Wait for events with timeout
-        int poll_ret = poll(&pfd, 1, 500);  // 500ms timeout
-        
-        if (poll_ret < 0) {
-            if (errno == EINTR) {
-                continue;  // Interrupted, just retry
-            }
-            std::cerr << "Poll error: " << strerror(errno) << std::endl;
+    if (mask & FAN_Q_OVERFLOW) {
+        LOG_WARN("fanotify event queue overflowed, rescanning {}", m_dir_path);
+        RequestRescan();
+        return;
+    }
+
+    // Directories need no watches with a filesystem mark
+    if (mask & FAN_ONDIR) {
+        return;
+    }
+
+    m_events_received.inc();
+    if (!matchesFilter(filename)) {
+        m_events_filtered.inc();
+        return;
+    }
+
+    FileEvent fileEvent;
+    fileEvent.filename = filename;
+
+    // fanotify merges consecutive events on the same entry, so report each one
+    if (mask & (FAN_CREATE | FAN_MOVED_TO)) {
+        fileEvent.eventType = EventType::CREATED;
+        dispatch(fileEvent);
+    }
+    if (mask & FAN_MODIFY) {
+        fileEvent.eventType = EventType::MODIFIED;
+        dispatch(fileEvent);
+    }
+    if (mask & FAN_ATTRIB) {
+        fileEvent.eventType = EventType::ATTRIB_CHANGED;
+        dispatch(fileEvent);
+    }
+    if (mask & FAN_CLOSE_WRITE) {
+        dispatchCloseWrite(filename);
+    }
+    if (mask & (FAN_DELETE | FAN_MOVED_FROM)) {
+        fileEvent.eventType = EventType::DELETED;
+        dispatch(fileEvent);
+    }
+}
+
+void filesMonitor::dispatch(FileEvent& fileEvent)
+{
+    // A rescan reports files found at rest; coalescing would also lose the rescan mark
+    if (m_quiet_period.count() == 0 || fileEvent.rescan) {
+        deliver(fileEvent);
+        return;
+    }
+
+    switch (fileEvent.eventType) {
+        case EventType::CREATED:
+            m_coalescer.add(fileEvent.filename, EventCoalescer::CHANGE_CREATED);
             break;
-        }
-        
-        // Timeout occurred, just loop again
-        if (poll_ret == 0) {
-            continue;
-        }
-        
-        // Check if we have inotify events
-        if (!(pfd.revents & POLLIN)) {
-            continue;
-        }
-        
-        // Read events
-        ssize_t length = read(m_inotify_fd, buffer, EVENT_BUF_LEN);
-        
+        case EventType::MODIFIED:
+            m_coalescer.add(fileEvent.filename, EventCoalescer::CHANGE_MODIFIED);
+            break;
+        case EventType::ATTRIB_CHANGED:
+            m_coalescer.add(fileEvent.filename, EventCoalescer::CHANGE_ATTRIB);
+            break;
+        case EventType::DELETED:
+            m_coalescer.discard(fileEvent.filename);
+            deliver(fileEvent);
+            break;
+    }
+}
+
+void filesMonitor::deliver(const FileEvent& fileEvent)
+{
+    if (m_batch_open) {
+        m_batch.push_back(fileEvent);
+    } else {
+        m_observers.publish(fileEvent);
+    }
+}
+
+void filesMonitor::flushBatch()
+{
+    if (!m_batch.empty()) {
+        m_observers.publishBatch(m_batch.data(), m_batch.size());
+        m_batch.clear();
+    }
+}
+
+void filesMonitor::dispatchCloseWrite(const std::string& filename)
+{
+    if (m_quiet_period.count() > 0) {
+        // The settled event is published right away: earlier events go first
+        flushBatch();
+        m_coalescer.closeWrite(filename);
+    }
+}
+
+void filesMonitor::onSettled(const std::string& filename, unsigned changes)
+{
+    FileEvent fileEvent;
+    fileEvent.filename = filename;
+    fileEvent.settled = true;
+
+    if (changes & EventCoalescer::CHANGE_CREATED) {
+        fileEvent.eventType = EventType::CREATED;
+    } else if (changes & EventCoalescer::CHANGE_MODIFIED) {
+        fileEvent.eventType = EventType::MODIFIED;
+    } else {
+        fileEvent.eventType = EventType::ATTRIB_CHANGED;
+    }
+
+    m_observers.publish(fileEvent);
+}
+
+void filesMonitor::onWake()
+{
+    uint64_t count;
+    while (read(m_wake_fd, &count, sizeof(count)) == -1 && errno == EINTR) {
+    }
+
+    if (m_rescan_requested.exchange(false)) {
+        // Start over: whatever was walked already may have changed again
+        m_rescan_dirs.clear();
+        m_rescan_dirs.push_back({-1, "", ""});
+    }
+    if (m_rescan_dirs.empty()) {
+        return;
+    }
+
+    m_batch_open = m_batch_events > 0;
+    walkTree(m_rescan_dirs, true, true, RESCAN_BATCH_DIRS);
+    flushBatch();
+    m_batch_open = false;
+    m_last_wd = -1;
+
+    if (m_rescan_dirs.empty()) {
+        LOG_INFO("Rescan of {} complete", m_dir_path);
+    } else {
+        // Continue after the descriptors that became ready meanwhile
+        wake();
+    }
+}
+
+void filesMonitor::onFanotifyReadable()
+{
+    FanotifyBackend::EventHandler fanotify_handler =
+        [this](const std::string& filename, const char*, uint64_t mask) {
+            processFanotifyEvent(filename, mask);
+        };
+
+    m_batch_open = m_batch_events > 0;
+    bool ok = m_fanotify.readEvents(fanotify_handler);
+    flushBatch();
+    m_batch_open = false;
+
+    if (!ok) {
+        m_reactor.remove(m_fanotify.fd());
+    }
+}
+
+void filesMonitor::onInotifyReadable()
+{
+    char* buffer = m_read_buffer.front().bytes;
+    const size_t buffer_len = m_read_buffer.size() * sizeof(ReadBlock);
+    m_batch_open = m_batch_events > 0;
+
+    // A batch that filled most of the buffer means more events are queued: read again right away
+    ssize_t length;
+    do {
+        length = read(m_inotify_fd, buffer, buffer_len);
+
         if (length < 0) {
-            if (errno == EAGAIN) {
-                continue;  // No data available right now
+            if (errno != EAGAIN && errno != EINTR) {
+                LOG_ERROR("Error reading inotify events: {}", strerror(errno));
+                m_reactor.remove(m_inotify_fd);
             }
-            std::cerr << "Error reading inotify events: " << strerror(errno) << std::endl;
-            break;
+            break;  // EAGAIN: no data available right now
         }
-        
+
         // Process events
         ssize_t i = 0;
         while (i < length) {
@@ -214,5 +710,8 @@ void filesMonitor::thread()
             processEvent(event);
             i += sizeof(struct inotify_event) + event->len;
         }
-    }
+        flushBatch();
+    } while (m_batch_open && static_cast<size_t>(length) > buffer_len / 2);
+
+    m_batch_open = false;
 }
\ No newline at end of file
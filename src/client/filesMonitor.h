@@ -1,13 +1,21 @@
 #ifndef FILES_MONITOR_H
 #define FILES_MONITOR_H
 
-#include "../utilities/threadBase.h"
-#include "../utilities/subject.h"
+#include "../utilities/Reactor.h"
+#include "../utilities/EventBus.h"
+#include "../utilities/SmallPath.h"
+#include "watchTable.h"
+#include "fanotifyBackend.h"
+#include "eventCoalescer.h"
+#include "../utilities/PathFilter.h"
+#include "../utilities/Metrics.h"
 #include <atomic>
+#include <chrono>
 #include <string>
 #include <unordered_map>
 #include <mutex>
 #include <functional>
+#include <memory>
 #include <vector>
 
 /**
@@ -16,13 +24,23 @@
  *
  * The filesMonitor class uses inotify to detect file system events in a specified directory
  * and notifies registered observers when events matching configured filters occur.
- * It runs in a separate thread to avoid blocking the main application.
+ * It runs on a Reactor (the process-wide loop by default) to avoid blocking the main
+ * application: the kernel event descriptor is registered there, and nothing polls.
+ * In recursive mode every subdirectory is watched as well, and reported filenames are
+ * relative to the monitored directory (e.g. "sub/dir/file.txt").
+ * Events come from inotify by default; the fanotify backend can be selected to cover the
+ * whole filesystem with a single mark instead of one watch per directory.
+ * With coalescing enabled, bursts of create/modify/attribute events on a file are merged
+ * and reported once, after the file is closed or stops changing.
+ * When the kernel event queue overflows, the tree is rescanned a few directories at a
+ * time and every existing file is reported again, so observers converge on the current
+ * state without stalling live events.
  * 
- * @note This class inherits from ThreadBase for thread management and subject for observer pattern
- * implementation.
+ * Observers are attached with attach() and receive each event as a const FileEvent& through
+ * an EventBus: no base class, no virtual call and no allocation per event. Observers
+ * are called on the reactor thread (settled events flushed by Stop(): on its caller).
  */
-class filesMonitor : public ThreadBase,
-                     public Subject    
+class filesMonitor
 {
 public:
     /**
@@ -36,21 +54,36 @@ public:
         ATTRIB_CHANGED   ///< File attributes (permissions, ownership) changed
     };
 
+    /**
+     * @enum Backend
+     * @brief Kernel interface used to receive file system events
+     */
+    enum class Backend {
+        INOTIFY,         ///< One inotify watch per directory (default)
+        FANOTIFY         ///< One fanotify filesystem mark; needs CAP_SYS_ADMIN, falls back to inotify
+    };
+
     /**
      * @struct FileEvent
      * @brief Data structure containing information about a file system event
      */
     struct FileEvent {
-        std::string filename;  ///< Name of the file that triggered the event
+        SmallPath filename;    ///< Name of the file that triggered the event
         EventType eventType;   ///< Type of event that occurred
+        bool settled = false;  ///< true if coalesced: the file was closed or stopped changing
+        bool rescan = false;   ///< true if reported by a rescan after events were lost
+        std::chrono::steady_clock::time_point detected = std::chrono::steady_clock::now(); ///< When the event was read (settled events: when they settled)
     };
 
     /**
      * @brief Constructs a filesMonitor instance for the specified directory
      * @param dir_path Path to the directory to monitor
+     * @param recursive Also watch every subdirectory, including ones created later
+     * @param reactor Loop reading the events and running the coalescing timer
      * @throw std::invalid_argument if the directory path is empty
      */
-    explicit filesMonitor(const std::string& dir_path);
+    explicit filesMonitor(const std::string& dir_path, bool recursive = false,
+                          Reactor& reactor = Reactor::getInstance());
     
     /**
      * @brief Destructor - stops monitoring and cleans up resources
@@ -58,7 +91,44 @@ public:
     ~filesMonitor();
 
     /**
-     * @brief Start monitoring the directory in a separate thread
+     * @brief Attach an observer whose member function Method(const FileEvent&) receives the events
+     * @param observer Observer; must stay valid until detached
+     * @note Thread-safe, also while events are being delivered
+     */
+    template <auto Method, typename Observer>
+    void attach(Observer* observer) { m_observers.template attach<Method>(observer); }
+
+    /**
+     * @brief Attach an observer whose onEvent(const FileEvent&) receives the events
+     * @param observer Observer; must stay valid until detached
+     */
+    template <typename Observer>
+    void attach(Observer* observer) { m_observers.attach(observer); }
+
+    /**
+     * @brief Attach an observer whose member function Method(const FileEvent* events, size_t count)
+     *        receives whole batches of events (see SetBatching())
+     * @param observer Observer; must stay valid until detached
+     */
+    template <auto Method, typename Observer>
+    void attachBatch(Observer* observer) { m_observers.template attachBatch<Method>(observer); }
+
+    /**
+     * @brief Attach an observer whose onEvents(const FileEvent* events, size_t count) receives whole batches
+     * @param observer Observer; must stay valid until detached
+     */
+    template <typename Observer>
+    void attachBatch(Observer* observer) { m_observers.attachBatch(observer); }
+
+    /**
+     * @brief Detach an observer
+     * @param observer Observer passed to attach() or attachBatch()
+     * @note Once this returns, the observer is no longer called (unless detached from its own handler)
+     */
+    void detach(const void* observer) { m_observers.detach(observer); }
+
+    /**
+     * @brief Start monitoring the directory on the reactor
      * @return true if monitoring started successfully, false otherwise
      * @note If monitoring is already active, this function returns false
      */
@@ -69,43 +139,151 @@ public:
      * @note This method is thread-safe and can be called from any context
      */
     void Stop();
+
+    /**
+     * @brief Select the event backend used by the next Start()
+     * @param backend Backend to use
+     * @note If the fanotify backend cannot be initialized, Start() falls back to inotify
+     */
+    void SetBackend(Backend backend);
+
+    /**
+     * @brief Merge bursts of events per file into one settled event
+     * @param quiet_period Time without changes after which a file is reported;
+     *        zero (the default) disables coalescing
+     * @note Takes effect on the next Start(). Deletions are always reported immediately.
+     */
+    void SetCoalescing(std::chrono::milliseconds quiet_period);
+
+    /**
+     * @brief Read kernel events in batches and deliver them to observers a batch at a time
+     * @param events Number of events the read buffer is sized for (names of up to 48 bytes);
+     *        zero (the default) reads into a 4 KiB buffer and delivers events one at a time
+     * @note Takes effect on the next Start(). A read that fills most of the buffer is followed
+     *       by another read without polling. With coalescing enabled, batches are cut before
+     *       each settled file so events keep their order.
+     */
+    void SetBatching(size_t events);
     
     /**
      * @brief Add a filter pattern to limit notifications to files matching the pattern
-     * @param pattern String pattern to match against filenames
-     * @note Patterns are substring matches (not regex or glob patterns)
+     * @param pattern "glob:<glob>", "re:<regex>", or a plain substring of the file name
+     * @return false if the pattern is an invalid regular expression
+     * @note Rules are evaluated as in PathFilter: the last matching rule decides
      * @note If no filters are added, all files will generate notifications
      */
-    void AddFilter(const std::string& pattern);
+    bool AddFilter(const std::string& pattern);
+
+    /**
+     * @brief Add a pattern whose files are never reported
+     * @param pattern Same syntax as AddFilter()
+     * @return false if the pattern is an invalid regular expression
+     * @note Overrides earlier rules, and is overridden by later ones
+     */
+    bool AddExclude(const std::string& pattern);
+
+    /**
+     * @brief Add the rules of a .gitignore-style file
+     * @param path Ignore file; every line is a glob excluding what it matches,
+     *        a leading '!' re-includes instead, '#' starts a comment
+     * @return false if the file cannot be read
+     */
+    bool LoadIgnoreFile(const std::string& path);
     
     /**
      * @brief Remove a previously added filter pattern
-     * @param pattern The filter pattern to remove
+     * @param pattern The filter pattern to remove (as passed to AddFilter() or AddExclude())
      */
     void RemoveFilter(const std::string& pattern);
 
-protected:
     /**
-     * @brief Thread function that performs the actual file monitoring
-     * @note Inherited from ThreadBase
+     * @brief Rescan the monitored tree and report every existing file again
+     * @note Thread-safe; used when events were lost (kernel queue overflow, or an
+     *       observer dropping events). A rescan in progress starts over.
+     */
+    void RequestRescan();
+
+    /**
+     * @brief Path of the monitored directory
      */
-    void thread() override;
+    const std::string& GetDirectory() const { return m_dir_path; }
+
+    /**
+     * @brief Whether subdirectories are monitored as well
+     */
+    bool IsRecursive() const { return m_recursive; }
+
+    /**
+     * @brief Check if a file passes the configured filters
+     * @param relPath Path of the file relative to the monitored directory
+     * @return true if the file passes or if no filters are defined
+     * @note Thread-safe and lock-free: reads the current compiled filter snapshot;
+     *       lets a startup scan report exactly the files the monitor would
+     */
+    bool matchesFilter(const std::string& relPath) const;
 
 private:
+    /**
+     * @struct PendingDir
+     * @brief Directory waiting to be walked
+     */
+    struct PendingDir {
+        int parent_wd;               ///< Watch descriptor of the parent, -1 for the root
+        std::string name;            ///< Name inside the parent (empty for the root)
+        std::string rel_dir;         ///< '/'-terminated path relative to the root (empty for the root)
+    };
+
+    /**
+     * @struct ReadBlock
+     * @brief Cache-line-aligned piece of the read buffer
+     */
+    struct alignas(64) ReadBlock {
+        char bytes[64];
+    };
+
     std::string m_dir_path;          ///< Path to the monitored directory
-    std::atomic_bool m_run_flag;     ///< Flag controlling the monitoring thread
+    Reactor& m_reactor;              ///< Loop the event and wakeup descriptors are registered on
+    std::atomic_bool m_run_flag;     ///< Whether the monitor is started
+    int m_wake_fd;                   ///< eventfd signalling a rescan to the reactor thread
     int m_inotify_fd;                ///< File descriptor for the inotify instance
     int m_watch_fd;                  ///< Watch descriptor for the monitored directory
+    bool m_recursive;                ///< Whether subdirectories are watched as well
+    Backend m_backend;               ///< Backend requested through SetBackend()
+    bool m_use_fanotify;             ///< Whether the running monitor uses the fanotify backend
+    FanotifyBackend m_fanotify;      ///< fanotify event source
+    std::chrono::milliseconds m_quiet_period; ///< Coalescing quiet period, zero if disabled
+    EventCoalescer m_coalescer;      ///< Per-file burst merging, active if m_quiet_period > 0
+    EventBus<FileEvent> m_observers; ///< Observers of the events
+    std::string m_event_path;        ///< Path of the inotify event being processed, reused (reactor thread only)
+    size_t m_batch_events;           ///< Events the batched read buffer is sized for, zero if batching is off
+    bool m_batch_open;               ///< Events are collected in m_batch instead of published (reactor thread only)
+    std::vector<FileEvent> m_batch;  ///< Events read but not yet published, reused (reactor thread only)
+    std::vector<ReadBlock> m_read_buffer; ///< Buffer inotify events are read into, sized by Start()
+
+    WatchTable m_watches;            ///< Watch descriptor to directory mapping (reactor thread only)
+    int m_last_wd;                   ///< Watch descriptor whose path is cached in m_last_dir
+    std::string m_last_dir;          ///< Cached relative path of m_last_wd, reused between events
+    std::atomic_bool m_rescan_requested; ///< Set by RequestRescan(), consumed on the reactor thread
+    std::vector<PendingDir> m_rescan_dirs; ///< Directories the running rescan has yet to walk
     
-    mutable std::mutex m_filter_mutex;  ///< Mutex for thread-safe access to filters
-    std::vector<std::string> m_filters; ///< List of filename patterns to filter events
+    std::mutex m_filter_mutex;          ///< Serializes filter changes
+    std::vector<PathFilter::Rule> m_filter_rules; ///< Filter rules in order (writers only)
+    std::shared_ptr<const PathFilter> m_filter; ///< Compiled snapshot of m_filter_rules, swapped atomically
+
+    MetricCounter& m_events_received;   ///< File events read from the kernel
+    MetricCounter& m_events_filtered;   ///< File events dropped by the filters
     
     /**
-     * @brief Check if a filename matches any of the configured filters
-     * @param filename Name of the file to check against filters
-     * @return true if filename matches a filter or if no filters are defined
+     * @brief Append a rule, recompile and publish the new filter snapshot
+     * @return false if the rule does not compile
+     */
+    bool addFilterRule(const PathFilter::Rule& rule);
+
+    /**
+     * @brief Compile m_filter_rules and publish it; m_filter_mutex must be held
+     * @return false (keeping the previous snapshot) if the rules do not compile
      */
-    bool matchesFilter(const std::string& filename) const;
+    bool publishFilter();
     
     /**
      * @brief Initialize the inotify system and add a watch for the monitored directory
@@ -117,12 +295,103 @@ private:
      * @brief Clean up inotify resources (watch and file descriptors)
      */
     void cleanupInotify();
+
+    /**
+     * @brief Watch a directory and, recursively, all of its subdirectories
+     * @param parent_wd Watch descriptor of the parent directory, or -1 for the root
+     * @param name Name of the directory inside its parent (empty for the root)
+     * @param rel_dir Path of the directory relative to the root, '/'-terminated (empty for the root)
+     * @param notify_existing Report files already present as CREATED events
+     * @return Number of directories that were added to the watch table
+     */
+    size_t addWatchTree(int parent_wd, const std::string& name, const std::string& rel_dir,
+                        bool notify_existing);
+
+    /**
+     * @brief Walk pending directories, watching them (inotify) and queueing their subdirectories
+     * @param pending Directories to walk; subdirectories are pushed onto it
+     * @param notify_existing Report files already present as CREATED events
+     * @param rescan Mark reported files as found by a rescan
+     * @param max_dirs Stop after this many directories, leaving the rest in pending
+     * @return Number of directories that were added to the watch table
+     */
+    size_t walkTree(std::vector<PendingDir>& pending, bool notify_existing, bool rescan, size_t max_dirs);
+
+    /**
+     * @brief Get the relative path of the directory a watch descriptor refers to
+     * @param wd Watch descriptor from an inotify event
+     * @return Pointer to the cached '/'-terminated path, or nullptr if unknown
+     */
+    const std::string* directoryOf(int wd);
+
+    /**
+     * @brief Stop watching a directory and every directory below it (moved out of its tracked path)
+     * @param wd Watch descriptor of the top directory; unknown descriptors are ignored
+     */
+    void unwatchTree(int wd);
     
+    /**
+     * @brief Reactor handler of the inotify descriptor: read and process the queued events
+     */
+    void onInotifyReadable();
+
+    /**
+     * @brief Reactor handler of the fanotify descriptor: read and process the queued events
+     */
+    void onFanotifyReadable();
+
+    /**
+     * @brief Reactor handler of m_wake_fd: start or continue a rescan
+     */
+    void onWake();
+
+    /**
+     * @brief Signal m_wake_fd
+     */
+    void wake();
+
     /**
      * @brief Process an inotify event and notify observers if applicable
      * @param event Pointer to the inotify_event structure to process
      */
     void processEvent(const struct inotify_event* event);
+
+    /**
+     * @brief Process a fanotify event and notify observers if applicable
+     * @param filename Path of the entry relative to the monitored directory
+     * @param mask fanotify event mask
+     */
+    void processFanotifyEvent(const std::string& filename, uint64_t mask);
+
+    /**
+     * @brief Notify observers of an event, or hand it to the coalescer when enabled (rescan events excepted)
+     * @param fileEvent Event to deliver
+     */
+    void dispatch(FileEvent& fileEvent);
+
+    /**
+     * @brief Publish an event, or collect it in the open batch
+     * @param fileEvent Event to deliver
+     */
+    void deliver(const FileEvent& fileEvent);
+
+    /**
+     * @brief Publish the events collected in m_batch
+     */
+    void flushBatch();
+
+    /**
+     * @brief Handle a file being closed after writing (settles coalesced changes)
+     * @param filename Path of the file relative to the monitored directory
+     */
+    void dispatchCloseWrite(const std::string& filename);
+
+    /**
+     * @brief Notify observers of a file whose coalesced changes have settled
+     * @param filename Path of the file relative to the monitored directory
+     * @param changes EventCoalescer::Change flags merged for the file
+     */
+    void onSettled(const std::string& filename, unsigned changes);
 };
 
 #endif /* FILES_MONITOR_H */
\ No newline at end of file
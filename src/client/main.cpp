@@ -1,6 +1,9 @@
+#include <cstdlib>
 #include <iostream>
 #include "filesMonitor.h" 
 #include "restApiMngr.h"
+#include "../utilities/Metrics.h"
+#include "../utilities/Logger.h"
 
 
 int main(int argc, char* argv[]) 
@@ -13,17 +16,62 @@ int main(int argc, char* argv[])
     // Create the REST API manager instance
     RestApiMngr apiManager("http://localhost:3000");
 
-    fileMonitor.attach(&apiManager);
+    // Send only changed blocks of large modified files
+    apiManager.SetDeltaSync(64 * 1024, 1024 * 1024);
+
+    // Upload large files as parallel, resumable chunks
+    apiManager.SetChunkedUpload(8 * 1024 * 1024, 64 * 1024 * 1024);
+
+    // Local server: stream whole-file uploads with sendfile instead of libcurl
+    apiManager.SetZeroCopyUpload(true);
+
+    // Stat and read small files in batches through io_uring
+    apiManager.SetBatchedSmallFiles(64 * 1024);
+
+    // Send small files together, one request per batch
+    apiManager.SetBatchUpload(64 * 1024);
+
+    // Keep one queued event per file under event storms; rescan if events are ever dropped
+    apiManager.SetEventQueue(16384, QueuePolicy::COALESCE);
+    apiManager.SetOverflowHandler([&fileMonitor]() { fileMonitor.RequestRescan(); });
+
+    // Remember what was uploaded across restarts
+    const char* home = getenv("HOME");
+    apiManager.SetSyncJournal(std::string(home ? home : ".") + "/.filesServer-journal");
+
+    // Keep uploads and deletes that failed every retry, and send them again at startup
+    apiManager.SetDeadLetterFile(std::string(home ? home : ".") + "/.filesServer-dead-letters");
+
+    // Dump counters and latency histograms in Prometheus text format
+    MetricsExporter metricsExporter(std::string(home ? home : ".") + "/.filesServer-metrics.prom",
+                                    std::chrono::seconds(10));
+
+    fileMonitor.attachBatch(&apiManager);
+
+    // Read bursts of kernel events a few hundred at a time and queue them as one batch
+    fileMonitor.SetBatching(512);
+
+    // Report each burst of writes to a file once it settles
+    fileMonitor.SetCoalescing(std::chrono::milliseconds(500));
 
     if (!fileMonitor.Start()) 
     {
-        std::cerr << "Failed to start file monitoring." << std::endl;
+        LOG_ERROR("Failed to start file monitoring.");
+        fileMonitor.detach(&apiManager);
         return 1;
     }
 
+    // Catch up with what changed while the client was not running, and with what the server lacks
+    apiManager.Reconcile(fileMonitor);
+    apiManager.RetryDeadLetters();
+
     std::cout << "Press Enter to exit..." << std::endl;
     std::cin.get();
 
+    // apiManager is destroyed first: stop the monitor while it still observes, as Stop() reports the files still settling
+    fileMonitor.Stop();
+    fileMonitor.detach(&apiManager);
+
     return 0;
   
 }
@@ -1,184 +1,1014 @@
 #include "restApiMngr.h"
+#include "../utilities/Logger.h"
+#include "../utilities/contentHash.h"
 #include <curl/curl.h>
 #include <filesystem>
-#include <fstream>
-#include <iostream>
 #include <thread>
 #include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <future>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../utilities/ParallelTreeWalker.h"
+#include "compression.h"
 
-RestApiMngr::RestApiMngr(const std::string& serverUrl)
-    : m_serverUrl(serverUrl)
+// Time the destructor gives the requests in flight before failing them
+static const unsigned SHUTDOWN_DRAIN_SECONDS = 5;
+
+// Name of a file on the server: its path relative to the watched directory
+static std::string remoteName(const std::string& localFilePath)
+{
+    return std::filesystem::path(localFilePath).lexically_normal().generic_string();
+}
+
+// The servers store no hidden names, which they keep for their temporary files: dotfiles are not synced.
+// Monitor and walker paths are already normal, so no remoteName() per event
+static bool hiddenName(const std::string& localFilePath)
 {
-    itsQueueThread = new QueueThread();
+    return localFilePath[0] == '.' || localFilePath.find("/.") != std::string::npos;
+}
+
+RestApiMngr::RestApiMngr(const std::string& serverUrl, size_t maxInFlight, size_t workers)
+    : m_serverUrl(serverUrl),
+      m_admitted(0),
+      itsChunkedUploader(nullptr),
+      itsZeroCopySender(nullptr),
+      itsFileLoader(nullptr),
+      itsUploadBatcher(nullptr),
+      itsRetryQueue(nullptr),
+      m_batchMaxFileSize(0),
+      m_chunkMinSize(0),
+      m_compressionLevel(0),
+      m_deltaBlockSize(0),
+      m_deltaMinSize(0),
+      m_queueDepth(MetricsRegistry::getInstance().gauge(
+          "filesserver_event_queue_depth", "File events waiting to be handled")),
+      m_uploadStartLatency(MetricsRegistry::getInstance().histogram(
+          "filesserver_event_to_upload_start_seconds", "Time from a file event to the start of its upload")),
+      m_uploadDoneLatency(MetricsRegistry::getInstance().histogram(
+          "filesserver_event_to_upload_done_seconds", "Time from a file event to the end of its upload")),
+      m_uploadsOk(MetricsRegistry::getInstance().counter(
+          "filesserver_uploads_total", "Finished uploads by result", "result=\"ok\"")),
+      m_uploadsFailed(MetricsRegistry::getInstance().counter(
+          "filesserver_uploads_total", "Finished uploads by result", "result=\"failed\""))
+{
+    itsEventQueue = new BoundedQueue<filesMonitor::FileEvent, SmallPath>(16384, QueuePolicy::BLOCK);
+    itsTransferEngine = new TransferEngine(maxInFlight);
+    itsThreadPool = new ThreadPool(workers);
+    itsRetryQueue = new RetryQueue(itsTransferEngine->reactor().timers(),
+                                   [this](const std::string& filename, RetryQueue::Operation op) { retry(filename, op); });
 }
 
 RestApiMngr::~RestApiMngr()
 {
-    if (itsQueueThread)
+    // Release a monitor blocked on a full queue
+    itsEventQueue->close();
+
+    // Stop producing requests before the engine goes away; loader callbacks see a null pool
+    ThreadPool* pool;
+    {
+        std::lock_guard<std::mutex> lock(m_pathMutex);
+        pool = itsThreadPool;
+        itsThreadPool = nullptr;
+    }
+    delete pool;
+
+    if (itsFileLoader)
     {
-        delete itsQueueThread;
-        itsQueueThread = nullptr;
+        delete itsFileLoader;
+        itsFileLoader = nullptr;
     }
+
+    // Sends what is still waiting for a batch
+    if (itsUploadBatcher)
+    {
+        delete itsUploadBatcher;
+        itsUploadBatcher = nullptr;
+    }
+
+    // Every request reports before the retry queue stops: the ones cut short are retried or dead-lettered.
+    // The engine goes first, as a delta falling back to a full upload may still hand it to the zero-copy sender
+    itsTransferEngine->Stop(std::chrono::seconds(SHUTDOWN_DRAIN_SECONDS));
+
+    if (itsZeroCopySender)
+    {
+        delete itsZeroCopySender;
+        itsZeroCopySender = nullptr;
+    }
+
+    // Nothing runs any more: files still holding a slot have tasks the pool or the loader dropped
+    std::vector<std::string> abandoned;
+    {
+        std::lock_guard<std::mutex> lock(m_pathMutex);
+        for (const auto& entry : m_pathTasks)
+        {
+            abandoned.push_back(entry.first);
+        }
+        m_pathTasks.clear();
+    }
+    if (!abandoned.empty())
+    {
+        LOG_WARN("Dead-lettering {} files with events left unhandled at shutdown", abandoned.size());
+    }
+    for (const std::string& filename : abandoned)
+    {
+        // What the file's latest state needs; a replay of an unchanged file sends nothing
+        struct stat st;
+        bool exists = stat(filename.c_str(), &st) == 0;
+        itsRetryQueue->failed(filename, exists ? RetryQueue::Operation::UPLOAD : RetryQueue::Operation::DELETE, false);
+    }
+
+    // From here on failures are dead-lettered, not retried
+    itsRetryQueue->Stop();
+
+    if (itsChunkedUploader)
+    {
+        delete itsChunkedUploader;
+        itsChunkedUploader = nullptr;
+    }
+
+    if (itsTransferEngine)
+    {
+        delete itsTransferEngine;
+        itsTransferEngine = nullptr;
+    }
+
+    delete itsRetryQueue;
+    itsRetryQueue = nullptr;
+
+    delete itsEventQueue;
+    itsEventQueue = nullptr;
 }
 
-void RestApiMngr::update(void* params)
+void RestApiMngr::SetDeltaSync(uint32_t blockSize, uint64_t minFileSize)
 {
-    filesMonitor::FileEvent* fileEvent = static_cast<filesMonitor::FileEvent*>(params);
-    if (!fileEvent)
+    m_deltaBlockSize = blockSize;
+    m_deltaMinSize = minFileSize;
+}
+
+void RestApiMngr::SetChunkedUpload(uint64_t chunkSize, uint64_t minFileSize, size_t parallelChunks)
+{
+    delete itsChunkedUploader;
+    itsChunkedUploader = nullptr;
+    if (chunkSize > 0)
     {
-        std::cerr << "FileEvent is null." << std::endl;
-        return;
+        itsChunkedUploader = new ChunkedUploader(itsTransferEngine, m_serverUrl, chunkSize, parallelChunks);
+        itsChunkedUploader->setCompression(m_compressionLevel);
     }
+    m_chunkMinSize = minFileSize;
+}
 
-    const std::string filename = fileEvent->filename;
-    if (filename.empty())
+bool RestApiMngr::SetZeroCopyUpload(bool enable)
+{
+    delete itsZeroCopySender;
+    itsZeroCopySender = nullptr;
+    if (!enable)
     {
-        std::cerr << "Filename is empty." << std::endl;
-        return;
+        return true;
+    }
+
+    try
+    {
+        itsZeroCopySender = new ZeroCopySender(m_serverUrl);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARN("Zero-copy uploads disabled: {}", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool RestApiMngr::SetBatchedSmallFiles(uint64_t maxFileSize)
+{
+    delete itsFileLoader;
+    itsFileLoader = nullptr;
+    if (maxFileSize == 0)
+    {
+        return true;
+    }
+
+    try
+    {
+        itsFileLoader = new UringFileLoader(maxFileSize);
+    }
+    catch (const std::exception& e)
+    {
+        LOG_WARN("Batched small-file loading disabled: {}", e.what());
+        return false;
+    }
+    return true;
+}
+
+void RestApiMngr::SetBatchUpload(uint64_t maxFileSize, size_t maxBatchBytes, std::chrono::milliseconds maxDelay)
+{
+    delete itsUploadBatcher;
+    itsUploadBatcher = nullptr;
+    if (maxFileSize > 0)
+    {
+        itsUploadBatcher = new UploadBatcher(itsTransferEngine, m_serverUrl, maxBatchBytes, maxDelay);
+    }
+    m_batchMaxFileSize = maxFileSize;
+}
+
+void RestApiMngr::SetCompression(int level)
+{
+    m_compressionLevel = std::max(0, std::min(level, 9));
+    if (itsChunkedUploader)
+    {
+        itsChunkedUploader->setCompression(m_compressionLevel);
+    }
+}
+
+void RestApiMngr::SetEventQueue(size_t capacity, QueuePolicy policy)
+{
+    delete itsEventQueue;
+    itsEventQueue = new BoundedQueue<filesMonitor::FileEvent, SmallPath>(capacity, policy);
+}
+
+void RestApiMngr::SetOverflowHandler(std::function<void()> handler)
+{
+    m_overflowHandler = std::move(handler);
+}
+
+bool RestApiMngr::SetSyncJournal(const std::string& journalDir)
+{
+    return m_contentIndex.Open(journalDir);
+}
+
+void RestApiMngr::SetRetryPolicy(std::chrono::milliseconds baseDelay, std::chrono::milliseconds maxDelay,
+                                 unsigned maxAttempts)
+{
+    RetryQueue::Policy policy;
+    policy.baseDelay = baseDelay;
+    policy.maxDelay = maxDelay;
+    policy.maxAttempts = maxAttempts;
+    itsRetryQueue->SetPolicy(policy);
+}
+
+bool RestApiMngr::SetDeadLetterFile(const std::string& path)
+{
+    return itsRetryQueue->SetDeadLetterFile(path);
+}
+
+size_t RestApiMngr::RetryDeadLetters()
+{
+    std::vector<RetryQueue::DeadLetter> letters = itsRetryQueue->takeDeadLetters();
+    for (const RetryQueue::DeadLetter& letter : letters)
+    {
+        // Given up on by an older client that still sent hidden names
+        if (hiddenName(letter.path))
+        {
+            itsRetryQueue->resolved(letter.path);
+            continue;
+        }
+        retry(letter.path, letter.op);
     }
+    if (!letters.empty())
+    {
+        LOG_INFO("Retrying {} operations from the dead-letter file", letters.size());
+    }
+    return letters.size();
+}
 
-    switch (fileEvent->eventType)
+bool RestApiMngr::fetchServerListing(std::unordered_map<std::string, RemoteFile>& files)
+{
+    std::promise<bool> done;
+    std::future<bool> listed = done.get_future();
+    std::string partial;
+
+    // Parsed as it streams in: a listing of millions of files is never held as one string
+    TransferEngine::Request request;
+    request.method = "GET";
+    request.url = m_serverUrl + "/api/files/list";
+    request.onBodyData = [&files, &partial](const char* data, size_t len) {
+        partial.append(data, len);
+        size_t start = 0;
+        for (size_t end; (end = partial.find('\n', start)) != std::string::npos; start = end + 1)
+        {
+            const char* line = partial.c_str() + start;
+            const char* lineEnd = partial.c_str() + end;
+            char* tab = nullptr;
+            uint64_t size = strtoull(line, &tab, 10);
+            if (tab != line && *tab == '\t' && tab + 1 < lineEnd)
+            {
+                files[std::string(static_cast<const char*>(tab) + 1, lineEnd)].size = size;
+            }
+        }
+        partial.erase(0, start);
+    };
+    request.onDone = [&done](const TransferEngine::Result& result) {
+        if (!result.ok())
+        {
+            LOG_ERROR("Failed to list files on the server (HTTP {}) {}", result.httpStatus, result.error);
+        }
+        done.set_value(result.ok());
+    };
+
+    itsTransferEngine->submit(std::move(request));
+    if (!listed.get())
+    {
+        files.clear();
+        return false;
+    }
+    return true;
+}
+
+size_t RestApiMngr::Reconcile(const filesMonitor& monitor)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::unordered_map<std::string, RemoteFile> remote;
+    bool haveListing = fetchServerListing(remote);
+
+    m_contentIndex.beginReconcile();
+
+    std::atomic<size_t> queued(0);
+    std::atomic<size_t> missing(0);
+    std::mutex seenMutex;
+    ParallelTreeWalker walker(RECONCILE_THREADS);
+    uint64_t scanned = walker.walk(monitor.GetDirectory(), monitor.IsRecursive(),
+                                   [&](const std::string& relDir, const char* name, const struct stat& st) {
+        std::string key = relDir + name;
+        int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+
+        // Marked even when filtered out, so a filter added later does not delete the server copy
+        bool unchanged = m_contentIndex.reconcile(key, static_cast<uint64_t>(st.st_size), mtimeNs,
+                                                  static_cast<uint64_t>(st.st_ino));
+        if (!monitor.matchesFilter(key) || hiddenName(key))
+        {
+            return;
+        }
+
+        // The server lists files by their path relative to the watched directory
+        if (haveListing)
+        {
+            auto it = remote.find(key);
+            bool onServer = it != remote.end() && it->second.size == static_cast<uint64_t>(st.st_size);
+            if (it != remote.end())
+            {
+                std::lock_guard<std::mutex> lock(seenMutex);
+                it->second.seen = true;
+            }
+            else
+            {
+                ++missing;
+            }
+            if (!onServer)
+            {
+                // Whatever was uploaded before is gone: upload even if the content is unchanged
+                m_contentIndex.forget(key);
+                unchanged = false;
+            }
+        }
+        if (unchanged)
+        {
+            return;
+        }
+
+        // New, changed or missing on the server; hashing decides whether it is uploaded
+        filesMonitor::FileEvent fileEvent;
+        fileEvent.filename = std::move(key);
+        fileEvent.eventType = filesMonitor::EventType::CREATED;
+        fileEvent.settled = true;
+        fileEvent.rescan = true;
+        onEvent(fileEvent);
+        ++queued;
+    });
+
+    // Whatever the walk did not see was deleted meanwhile
+    std::vector<std::string> deleted = m_contentIndex.unreconciled();
+    for (std::string& key : deleted)
+    {
+        filesMonitor::FileEvent fileEvent;
+        fileEvent.filename = std::move(key);
+        fileEvent.eventType = filesMonitor::EventType::DELETED;
+        fileEvent.settled = true;
+        fileEvent.rescan = true;
+        onEvent(fileEvent);
+    }
+
+    // Files only the server has are reported, not deleted: they may not come from this client
+    size_t serverOnly = 0;
+    for (const auto& entry : remote)
+    {
+        serverOnly += entry.second.seen ? 0 : 1;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+    if (haveListing)
+    {
+        LOG_INFO("Reconciled {} files in {} ms: {} new or changed ({} missing on the server), {} deleted, "
+                 "{} only on the server", scanned, elapsed.count(), queued.load(), missing.load(), deleted.size(),
+                 serverOnly);
+    }
+    else
+    {
+        LOG_INFO("Reconciled {} files in {} ms: {} new or changed ({} missing on the server), {} deleted",
+                 scanned, elapsed.count(), queued.load(), missing.load(), deleted.size());
+    }
+    return queued + deleted.size();
+}
+
+void RestApiMngr::onEvent(const filesMonitor::FileEvent& fileEvent)
+{
+    onEvents(&fileEvent, 1);
+}
+
+void RestApiMngr::onEvents(const filesMonitor::FileEvent* events, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        const filesMonitor::FileEvent& fileEvent = events[i];
+        if (fileEvent.filename.empty())
+        {
+            LOG_WARN("Filename is empty.");
+            continue;
+        }
+        if (hiddenName(fileEvent.filename.str()))
+        {
+            continue;
+        }
+
+        // Rescan events must not be dropped, or the rescan that recovers from drops would drop again
+        if (!itsEventQueue->push(fileEvent.filename, fileEvent, fileEvent.rescan))
+        {
+            if (m_overflowHandler)
+            {
+                m_overflowHandler();
+            }
+        }
+
+        // Admit as we go: a batch larger than the free room would otherwise wait on itself
+        pumpEvents();
+    }
+    m_queueDepth.set(static_cast<int64_t>(itsEventQueue->size()));
+}
+
+void RestApiMngr::pumpEvents()
+{
+    for (;;)
+    {
+        filesMonitor::FileEvent fileEvent;
+        {
+            std::lock_guard<std::mutex> lock(m_admitMutex);
+            if (m_admitted >= MAX_ADMITTED_EVENTS || itsTransferEngine->pending() >= MAX_ADMITTED_EVENTS ||
+                !itsEventQueue->tryPop(fileEvent))
+            {
+                return;
+            }
+            ++m_admitted;
+        }
+        m_queueDepth.add(-1);
+        dispatchEvent(fileEvent);
+    }
+}
+
+void RestApiMngr::onEventDone()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_admitMutex);
+        --m_admitted;
+    }
+    pumpEvents();
+}
+
+void RestApiMngr::dispatchEvent(const filesMonitor::FileEvent& fileEvent)
+{
+    const std::string filename = fileEvent.filename.str();
+    switch (fileEvent.eventType)
     {
         case filesMonitor::EventType::CREATED:
-            handleFileCreation(filename);
+            handleFileCreation(filename, fileEvent.settled, fileEvent.detected);
             break;
         case filesMonitor::EventType::MODIFIED:
-            handleFileModification(filename);
+            handleFileModification(filename, fileEvent.settled, fileEvent.detected);
             break;
         case filesMonitor::EventType::DELETED:
             handleFileDeletion(filename);
             break;
         case filesMonitor::EventType::ATTRIB_CHANGED:
-            handleFileModification(filename);
+            handleFileModification(filename, fileEvent.settled, fileEvent.detected);
             break;
         default:
-            std::cerr << "Unknown event type." << std::endl;
+            LOG_WARN("Unknown event type.");
+            onEventDone();
             break;
     }
 }
 
-size_t readCallback(void* ptr, size_t size, size_t nmemb, void* stream) {
-    std::ifstream* file = static_cast<std::ifstream*>(stream);
-    if (!file->read(static_cast<char*>(ptr), size * nmemb)) {
-        return file->gcount(); // Return the number of bytes read
+// Read a file expected to hold about sizeHint bytes
+static bool readSmallFile(const std::string& path, uint64_t sizeHint, std::string& out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    out.resize(static_cast<size_t>(sizeHint) + 1);
+    size_t used = 0;
+    for (;;) {
+        if (used == out.size()) {
+            out.resize(out.size() * 2);
+        }
+        ssize_t n = read(fd, &out[used], out.size() - used);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            out.resize(used);
+            return n == 0;
+        }
+        used += static_cast<size_t>(n);
     }
-    return size * nmemb;
 }
 
-bool RestApiMngr::sendFile(const std::string& localFilePath)
+bool RestApiMngr::sendFile(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                           std::chrono::steady_clock::time_point detected,
+                           std::shared_ptr<DeltaSync::Signatures> signatures,
+                           std::shared_ptr<const std::string> content)
 {
-    CURL* curl = curl_easy_init();
-    if (!curl)
-    {
-        std::cerr << "Failed to init curl" << std::endl;
+    if (!content && !std::filesystem::exists(localFilePath)) {
+        LOG_WARN("File does not exist: {}", localFilePath);
         return false;
     }
 
-    if (!std::filesystem::exists(localFilePath)) {
-        std::cerr << "File does not exist: " << localFilePath << std::endl;
-        curl_easy_cleanup(curl);
-        return false;
+    if (itsUploadBatcher && fingerprint.size <= m_batchMaxFileSize) {
+        if (!content) {
+            auto data = std::make_shared<std::string>();
+            if (!readSmallFile(localFilePath, fingerprint.size, *data)) {
+                LOG_ERROR("Failed to read file: {}", localFilePath);
+                return false;
+            }
+            content = std::move(data);
+        }
+        itsUploadBatcher->add(remoteName(localFilePath), std::move(content),
+                              [this, localFilePath, fingerprint, signatures, detected](bool ok, bool retryable) {
+            onFileSent(localFilePath, fingerprint, signatures, ok, retryable, detected);
+        });
+        return true;
     }
 
-    std::filesystem::path p(localFilePath);
-    curl_mime* mime = curl_mime_init(curl);
-    curl_mimepart* part = curl_mime_addpart(mime);
+    if (!content && itsChunkedUploader && fingerprint.size >= m_chunkMinSize) {
+        itsChunkedUploader->upload(localFilePath, remoteName(localFilePath),
+                                   fingerprint.size, fingerprint.mtimeNs, fingerprint.hash,
+                                   [this, localFilePath, fingerprint, signatures, detected](bool ok, bool retryable) {
+            onFileSent(localFilePath, fingerprint, signatures, ok, retryable, detected);
+        });
+        return true;
+    }
 
-    curl_mime_name(part, "file");
-    curl_mime_filedata(part, localFilePath.c_str());
+    if (!content && m_compressionLevel > 0 && GzipFileReader::worthCompressing(localFilePath, fingerprint.size)) {
+        return sendCompressed(localFilePath, fingerprint, signatures, detected);
+    }
 
-    curl_easy_setopt(curl, CURLOPT_URL, (m_serverUrl + "/api/files/upload").c_str());
-    curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+    if (!content && itsZeroCopySender) {
+        itsZeroCopySender->upload(localFilePath, remoteName(localFilePath),
+                                  [this, localFilePath, fingerprint, signatures, detected](bool ok, bool retryable) {
+            onFileSent(localFilePath, fingerprint, signatures, ok, retryable, detected);
+        });
+        return true;
+    }
 
-    CURLcode res = curl_easy_perform(curl);
+    TransferEngine::Request request;
+    request.method = "POST";
+    request.url = m_serverUrl + "/api/files/upload";
+    request.mimeFilename = remoteName(localFilePath);
+    if (content) {
+        request.mimeData = std::move(content);
+    } else {
+        request.mimeFile = localFilePath;
+    }
+    request.onDone = [this, localFilePath, fingerprint, signatures, detected](const TransferEngine::Result& result) {
+        if (result.code != CURLE_OK) {
+            LOG_ERROR("Failed to send file: {}", result.error);
+        }
+        onFileSent(localFilePath, fingerprint, signatures, result.ok(), result.retryable(), detected);
+    };
+
+    itsTransferEngine->submit(std::move(request));
+    return true;
+}
+
+bool RestApiMngr::sendCompressed(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                                 std::shared_ptr<DeltaSync::Signatures> signatures,
+                                 std::chrono::steady_clock::time_point detected)
+{
+    auto reader = std::make_shared<GzipFileReader>(localFilePath, 0, fingerprint.size, m_compressionLevel);
+    if (!reader->ok()) {
+        LOG_ERROR("Failed to open file for compression: {}", localFilePath);
+        return false;
+    }
+
+    TransferEngine::Request request;
+    request.method = "PUT";
+    request.url = m_serverUrl + "/api/files/raw/" + TransferEngine::encodeSegment(remoteName(localFilePath));
+    request.headers = {"Content-Type: application/octet-stream", "Content-Encoding: gzip", "Expect:"};
+    request.bodySource = [reader](char* buffer, size_t len) { return reader->read(buffer, len); };
+    request.onDone = [this, localFilePath, fingerprint, signatures, reader, detected](const TransferEngine::Result& result) {
+        if (!result.ok()) {
+            LOG_ERROR("Failed to send compressed file (HTTP {}): {}", result.httpStatus, result.error);
+        } else {
+            LOG_INFO("Compressed {}: {} -> {} bytes", localFilePath, reader->bytesIn(), reader->bytesOut());
+        }
+        onFileSent(localFilePath, fingerprint, signatures, result.ok(), result.retryable(), detected);
+    };
 
-    long response_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-    std::cout << "HTTP Response Code: " << response_code << std::endl;
+    itsTransferEngine->submit(std::move(request));
+    return true;
+}
 
-    if (res != CURLE_OK) {
-        std::cerr << "Failed to send file: " << curl_easy_strerror(res) << std::endl;
+void RestApiMngr::onFileSent(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                             const std::shared_ptr<DeltaSync::Signatures>& signatures, bool ok, bool retryable,
+                             std::chrono::steady_clock::time_point detected)
+{
+    recordUploadDone(detected, ok);
+
+    if (ok) {
+        LOG_INFO("File sent successfully: {}", localFilePath);
+        m_contentIndex.recordUploaded(localFilePath, fingerprint);
+        itsRetryQueue->resolved(localFilePath);
     } else {
-        std::cout << "File sent successfully: " << localFilePath << std::endl;
+        // Not a duplicate to skip: the next event or retry for the file must send it
+        {
+            std::lock_guard<std::mutex> lock(m_uploadsMutex);
+            recentUploads.erase(localFilePath);
+        }
+        itsRetryQueue->failed(localFilePath, RetryQueue::Operation::UPLOAD, retryable);
     }
 
+    // Signatures only describe the server copy if the file did not change while uploading
+    struct stat st;
+    if (signatures && ok && stat(localFilePath.c_str(), &st) == 0 &&
+        static_cast<uint64_t>(st.st_size) == fingerprint.size &&
+        static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec == fingerprint.mtimeNs) {
+        m_deltaSync.store(localFilePath, std::move(*signatures));
+    } else {
+        m_deltaSync.forget(localFilePath);
+    }
 
-    curl_mime_free(mime);
-    curl_easy_cleanup(curl);
-    return res == CURLE_OK;
+    // The upload is over: the file's next task may run
+    resumeOrdered(localFilePath);
 }
 
-bool RestApiMngr::deleteFile(const std::string& filename)
+void RestApiMngr::recordUploadStart(std::chrono::steady_clock::time_point detected)
 {
-    CURL* curl = curl_easy_init();
-    if (!curl)
-    {
-        std::cerr << "Failed to init curl" << std::endl;
+    m_uploadStartLatency.record(std::chrono::steady_clock::now() - detected);
+}
+
+void RestApiMngr::recordUploadDone(std::chrono::steady_clock::time_point detected, bool ok)
+{
+    m_uploadDoneLatency.record(std::chrono::steady_clock::now() - detected);
+    (ok ? m_uploadsOk : m_uploadsFailed).inc();
+}
+
+bool RestApiMngr::sendDelta(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                            const DeltaSync::Signatures& base, std::chrono::steady_clock::time_point detected)
+{
+    // Past half the file a full upload is cheaper for both sides
+    auto delta = std::make_shared<DeltaSync::Delta>();
+    if (!DeltaSync::computeDelta(localFilePath, base, fingerprint.size / 2, *delta)) {
         return false;
     }
 
-    std::string url = m_serverUrl + "/api/files/" + std::filesystem::path(filename).filename().string();
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+    LOG_INFO("Delta for {}: {} literal bytes, {} copied bytes, {} bytes on the wire for a {} byte file",
+             localFilePath, delta->literalBytes, delta->copiedBytes, delta->payload.size(), fingerprint.size);
+
+    recordUploadStart(detected);
+
+    TransferEngine::Request request;
+    request.method = "POST";
+    request.url = m_serverUrl + "/api/files/patch/" + TransferEngine::encodeSegment(remoteName(localFilePath));
+    request.headers = {"Content-Type: application/octet-stream", "Expect:"};
+    request.body = std::move(delta->payload);
+    request.onDone = [this, localFilePath, fingerprint, delta, detected](const TransferEngine::Result& result) {
+        if (result.ok()) {
+            LOG_INFO("File patched successfully: {}", localFilePath);
+            recordUploadDone(detected, true);
+            m_contentIndex.recordUploaded(localFilePath, fingerprint);
+            m_deltaSync.store(localFilePath, std::move(delta->target));
+            itsRetryQueue->resolved(localFilePath);
+            resumeOrdered(localFilePath);
+            return;
+        }
+
+        // Server copy missing or different: resend the whole file, as the same upload
+        LOG_ERROR("Delta upload failed for {} (HTTP {}), sending full file",
+                  localFilePath, result.httpStatus);
+        m_deltaSync.forget(localFilePath);
+        if (!sendFile(localFilePath, fingerprint, detected)) {
+            onFileSent(localFilePath, fingerprint, nullptr, false, true, detected);
+        }
+    };
+
+    itsTransferEngine->submit(std::move(request));
+    return true;
+}
+
+bool RestApiMngr::deleteFile(const std::string& filename)
+{
+    TransferEngine::Request request;
+    request.method = "DELETE";
+    request.url = m_serverUrl + "/api/files/file/" + TransferEngine::encodeSegment(remoteName(filename));
+    request.onDone = [this, filename](const TransferEngine::Result& result) {
+        // Already gone on the server is what a delete asked for
+        if (result.ok() || result.httpStatus == 404) {
+            itsRetryQueue->resolved(filename);
+        } else {
+            LOG_ERROR("Failed to delete file {} (HTTP {}) {}", filename, result.httpStatus, result.error);
+            itsRetryQueue->failed(filename, RetryQueue::Operation::DELETE, result.retryable());
+        }
+        resumeOrdered(filename);
+    };
 
-    CURLcode res = curl_easy_perform(curl);
-    curl_easy_cleanup(curl);
-    return res == CURLE_OK;
+    itsTransferEngine->submit(std::move(request));
+    return true;
 }
 
 bool RestApiMngr::shouldSendFile(const std::string& filename)
 {
     auto now = std::chrono::steady_clock::now();
-    auto it = recentUploads.find(filename);
-    if (it == recentUploads.end())
+    ContentIndex::Fingerprint queued;
+    {
+        std::lock_guard<std::mutex> lock(m_uploadsMutex);
+        auto it = recentUploads.find(filename);
+        if (it == recentUploads.end() ||
+            std::chrono::duration_cast<std::chrono::seconds>(now - it->second.first).count() > 2)
+        {
+            return true;
+        }
+        queued = it->second.second;
+    }
+
+    // Only a repeated event for what was just queued is a duplicate; a real change must go out
+    struct stat st;
+    if (stat(filename.c_str(), &st) == -1)
     {
         return true;
     }
-    auto diff = std::chrono::duration_cast<std::chrono::seconds>(now - it->second);
-    return diff.count() > 2;
+    int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    return static_cast<uint64_t>(st.st_size) != queued.size || mtimeNs != queued.mtimeNs ||
+           static_cast<uint64_t>(st.st_ino) != queued.inode;
 }
 
-void RestApiMngr::handleFileCreation(const std::string& filename)
+void RestApiMngr::recordQueued(const std::string& filename, const ContentIndex::Fingerprint& fingerprint)
 {
-    auto task = [this, filename]() {
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
-        if (shouldSendFile(filename))
+    std::lock_guard<std::mutex> lock(m_uploadsMutex);
+    recentUploads[filename] = std::make_pair(std::chrono::steady_clock::now(), fingerprint);
+}
+
+bool RestApiMngr::uploadIfChanged(const std::string& filename, std::chrono::steady_clock::time_point detected)
+{
+    if (!shouldSendFile(filename))
+    {
+        LOG_INFO("Skipping duplicate send of: {}", filename);
+        return true;
+    }
+
+    if (!itsFileLoader)
+    {
+        return !uploadFromDisk(filename, detected);
+    }
+
+    // Stat and read on the loader's ring; the file's later tasks wait until uploadLoaded() is done
+    itsFileLoader->load(filename, [this, detected](UringFileLoader::LoadedFile& file) {
+        uploadLoaded(file, detected);
+    });
+    return false;
+}
+
+bool RestApiMngr::uploadFromDisk(const std::string& filename, std::chrono::steady_clock::time_point detected)
+{
+    ContentIndex::Fingerprint fingerprint;
+    if (!m_contentIndex.fingerprint(filename, filename, fingerprint))
+    {
+        LOG_WARN("File does not exist: {}", filename);
+        return false;
+    }
+
+    if (m_contentIndex.isUnchanged(filename, fingerprint))
+    {
+        LOG_INFO("Skipping unchanged file: {}", filename);
+        return false;
+    }
+
+    bool deltaEligible = m_deltaBlockSize > 0 && fingerprint.size >= m_deltaMinSize;
+    DeltaSync::Signatures base;
+    if (deltaEligible && m_deltaSync.lookup(filename, base) && sendDelta(filename, fingerprint, base, detected))
+    {
+        recordQueued(filename, fingerprint);
+        return true;
+    }
+
+    std::shared_ptr<DeltaSync::Signatures> signatures;
+    if (deltaEligible)
+    {
+        signatures = std::make_shared<DeltaSync::Signatures>();
+        if (!DeltaSync::computeSignatures(filename, m_deltaBlockSize, *signatures))
         {
-            sendFile(filename);
-            recentUploads[filename] = std::chrono::steady_clock::now();
-            std::cout << "File sent: " << filename << std::endl;
+            signatures.reset();
         }
-        else
+    }
+
+    if (!sendFile(filename, fingerprint, detected, signatures))
+    {
+        return false;
+    }
+    recordUploadStart(detected);
+    recordQueued(filename, fingerprint);
+    LOG_INFO("Upload queued: {}", filename);
+    return true;
+}
+
+void RestApiMngr::uploadLoaded(UringFileLoader::LoadedFile& file, std::chrono::steady_clock::time_point detected)
+{
+    const std::string filename = file.path;
+    if (file.error != 0)
+    {
+        LOG_WARN("File does not exist: {}", filename);
+        resumeOrdered(filename);
+        return;
+    }
+
+    // Large, special or changing files, and delta candidates, take the streaming path on the pool
+    bool deltaEligible = m_deltaBlockSize > 0 && file.size >= m_deltaMinSize;
+    if (!file.loaded || deltaEligible)
+    {
         {
-            std::cout << "Skipping duplicate send of: " << filename << std::endl;
+            std::lock_guard<std::mutex> lock(m_pathMutex);
+            if (itsThreadPool)
+            {
+                itsThreadPool->put([this, filename, detected]() {
+                    if (!uploadFromDisk(filename, detected))
+                    {
+                        resumeOrdered(filename);
+                    }
+                });
+                return;
+            }
         }
-    };
-    itsQueueThread->put(task);
+        resumeOrdered(filename);
+        return;
+    }
+
+    ContentIndex::Fingerprint fingerprint;
+    fingerprint.size = file.size;
+    fingerprint.mtimeNs = file.mtimeNs;
+    fingerprint.inode = file.inode;
+    fingerprint.hash = contentHash::hash64(file.data.data(), file.data.size());
+
+    if (m_contentIndex.isUnchanged(filename, fingerprint))
+    {
+        LOG_INFO("Skipping unchanged file: {}", filename);
+    }
+    else if (sendFile(filename, fingerprint, detected, nullptr, std::make_shared<const std::string>(std::move(file.data))))
+    {
+        recordUploadStart(detected);
+        recordQueued(filename, fingerprint);
+        LOG_INFO("Upload queued: {}", filename);
+        return;  // onFileSent() resumes the file's tasks
+    }
+    resumeOrdered(filename);
 }
 
-void RestApiMngr::handleFileModification(const std::string& filename)
+void RestApiMngr::handleFileCreation(const std::string& filename, bool settled,
+                                      std::chrono::steady_clock::time_point detected)
 {
-    auto task = [this, filename]() {
-        std::this_thread::sleep_for(std::chrono::milliseconds(300));
-        if (shouldSendFile(filename))
+    auto task = [this, filename, settled, detected]() {
+        // Give the writer time to finish unless the monitor already coalesced the burst
+        if (!settled)
         {
-            sendFile(filename);
-            recentUploads[filename] = std::chrono::steady_clock::now();
-            std::cout << "File sent: " << filename << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
         }
-        else
+        return uploadIfChanged(filename, detected);
+    };
+    putOrdered(filename, task);
+}
+
+void RestApiMngr::handleFileModification(const std::string& filename, bool settled,
+                                          std::chrono::steady_clock::time_point detected)
+{
+    auto task = [this, filename, settled, detected]() {
+        // Give the writer time to finish unless the monitor already coalesced the burst
+        if (!settled)
         {
-            std::cout << "Skipping duplicate send of: " << filename << std::endl;
+            std::this_thread::sleep_for(std::chrono::milliseconds(300));
         }
+        return uploadIfChanged(filename, detected);
     };
-    itsQueueThread->put(task);
+    putOrdered(filename, task);
 }
 
 void RestApiMngr::handleFileDeletion(const std::string& filename)
 {
     auto task = [this, filename]() {
-        deleteFile(filename);
+        m_contentIndex.forget(filename);
+        m_deltaSync.forget(filename);
+        return !deleteFile(filename);
     };
-    itsQueueThread->put(task);
+    putOrdered(filename, task);
+}
+
+void RestApiMngr::retry(const std::string& filename, RetryQueue::Operation op)
+{
+    // Accounted for like an admitted event: released once the task and its request are done, or by putOrdered() if dropped
+    {
+        std::lock_guard<std::mutex> lock(m_admitMutex);
+        ++m_admitted;
+    }
+
+    if (op == RetryQueue::Operation::DELETE)
+    {
+        putOrdered(filename, [this, filename]() {
+            // Recreated since: its own events upload it
+            struct stat st;
+            if (stat(filename.c_str(), &st) == 0)
+            {
+                itsRetryQueue->resolved(filename);
+                return true;
+            }
+            return !deleteFile(filename);
+        });
+        return;
+    }
+
+    auto detected = std::chrono::steady_clock::now();
+    putOrdered(filename, [this, filename, detected]() {
+        // The current content is sent; a file gone or already uploaded leaves nothing to retry
+        if (!uploadFromDisk(filename, detected))
+        {
+            itsRetryQueue->resolved(filename);
+            return true;
+        }
+        return false;
+    });
+}
+
+void RestApiMngr::putOrdered(const std::string& filename, std::function<bool()> task)
+{
+    std::lock_guard<std::mutex> lock(m_pathMutex);
+    auto it = m_pathTasks.find(filename);
+    if (it != m_pathTasks.end())
+    {
+        // A task for this file is running; it picks this one up when done
+        it->second.push_back(std::move(task));
+        return;
+    }
+    m_pathTasks.emplace(filename, std::deque<std::function<bool()>>());
+    if (!itsThreadPool)
+    {
+        // Shutting down: the task never runs, so its admission is released here; the destructor dead-letters the file
+        std::lock_guard<std::mutex> admitLock(m_admitMutex);
+        --m_admitted;
+        return;
+    }
+
+    itsThreadPool->put([this, filename, task]() { runOrdered(filename, task); });
+}
+
+void RestApiMngr::runOrdered(const std::string& filename, std::function<bool()> task)
+{
+    for (;;)
+    {
+        if (!task())
+        {
+            return;  // Finishes asynchronously and calls resumeOrdered()
+        }
+        onEventDone();
+
+        std::lock_guard<std::mutex> lock(m_pathMutex);
+        auto it = m_pathTasks.find(filename);
+        if (it->second.empty())
+        {
+            m_pathTasks.erase(it);
+            return;
+        }
+        task = std::move(it->second.front());
+        it->second.pop_front();
+    }
 }
 
+void RestApiMngr::resumeOrdered(const std::string& filename)
+{
+    onEventDone();
+
+    std::lock_guard<std::mutex> lock(m_pathMutex);
+    auto it = m_pathTasks.find(filename);
+    if (it->second.empty())
+    {
+        m_pathTasks.erase(it);
+        return;
+    }
+    if (!itsThreadPool)
+    {
+        return;  // Shutting down: the destructor dead-letters the file
+    }
+    std::function<bool()> task = std::move(it->second.front());
+    it->second.pop_front();
+
+    itsThreadPool->put([this, filename, task]() { runOrdered(filename, task); });
+}
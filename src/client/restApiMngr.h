@@ -5,69 +5,381 @@
 #ifndef REST_API_MNGR_H
 #define REST_API_MNGR_H
 
+#include <atomic>
 #include <string>
 #include <unordered_map>
+#include <deque>
+#include <mutex>
 #include <chrono>
 #include "filesMonitor.h"
-#include "../utilities/IObserver.h"
-#include "../utilities/QueueThread.h"
+#include "../utilities/ThreadPool.h"
+#include "../utilities/BoundedQueue.h"
+#include "transferEngine.h"
+#include "contentIndex.h"
+#include "deltaSync.h"
+#include "chunkedUpload.h"
+#include "zeroCopySender.h"
+#include "uploadBatcher.h"
+#include "retryQueue.h"
+#include "../utilities/UringFileLoader.h"
+#include "../utilities/Metrics.h"
+#include <memory>
 
 /**
  * @class RestApiMngr
  * @brief Handles file transfer operations using a REST API.
  *
  * This class observes file events from filesMonitor and sends the
- * appropriate REST requests to the remote server. File operations are
- * performed asynchronously using QueueThread from the utilities module.
+ * appropriate REST requests to the remote server. Events are handled on a
+ * ThreadPool from the utilities module, in order per file but concurrently
+ * across files, and the HTTP requests themselves run concurrently over
+ * persistent connections on a TransferEngine. A file's next event waits for
+ * the request of the previous one to complete, so the requests for one file
+ * never overlap or overtake each other, whichever transport sends them. Files are named on the server
+ * by their path relative to the watched directory; hidden files and
+ * directories are skipped, as the servers reserve dot names.
+ *
+ * Incoming events wait in a BoundedQueue and are only taken from it while
+ * fewer than MAX_ADMITTED_EVENTS events are being handled and requests are
+ * pending, so memory stays flat however fast events arrive.
+ *
+ * Failed uploads and deletes go to a RetryQueue, which runs them again with
+ * backoff (one retry per file however many events fail meanwhile) and
+ * dead-letters those that keep failing.
  */
-class RestApiMngr : public IObserver
+class RestApiMngr
 {
 public:
     /**
      * @brief Construct a RestApiMngr.
      * @param serverUrl Base URL of the REST server (e.g. "http://127.0.0.1:8080")
+     * @param maxInFlight Maximum number of concurrent HTTP transfers
+     * @param workers Number of threads handling file events
      */
-    explicit RestApiMngr(const std::string& serverUrl);
+    explicit RestApiMngr(const std::string& serverUrl, size_t maxInFlight = 8, size_t workers = 4);
 
     /**
-     * @brief Destructor cleans up resources.
+     * @brief Destructor; waits up to 5 s for the requests in flight.
+     *
+     * Requests that do not finish in time fail like any other, so their
+     * operations end up in the dead-letter file, as do files whose queued
+     * tasks never ran.
      */
     ~RestApiMngr();
 
     /**
-     * @brief Callback for file events from filesMonitor.
+     * @brief Callback for file events from filesMonitor (see filesMonitor::attach()).
+     *
+     * The event is queued for processing on a separate thread.
+     */
+    void onEvent(const filesMonitor::FileEvent& fileEvent);
+
+    /**
+     * @brief Callback for batches of file events from filesMonitor (see filesMonitor::attachBatch()).
+     *
+     * The events are queued in order, as if passed to onEvent() one by one.
+     */
+    void onEvents(const filesMonitor::FileEvent* events, size_t count);
+
+    /**
+     * @brief Enable delta uploads for large modified files.
+     *
+     * Files of at least minFileSize bytes keep block signatures of the copy on
+     * the server; later modifications send only the changed blocks to the
+     * server's patch endpoint, falling back to a full upload when the server
+     * copy does not match or most of the file changed.
+     *
+     * @param blockSize Signature block size in bytes; 0 disables delta uploads.
+     * @param minFileSize Smallest file size for which deltas are used.
+     */
+    void SetDeltaSync(uint32_t blockSize, uint64_t minFileSize);
+
+    /**
+     * @brief Enable chunked, resumable uploads for large files.
+     *
+     * Full uploads of files of at least minFileSize bytes are split into
+     * chunkSize chunks that are sent in parallel and assembled by the server.
+     * Chunks already stored on the server (e.g. from an interrupted upload of
+     * the same content) are not sent again.
+     *
+     * @param chunkSize Chunk size in bytes; 0 disables chunked uploads.
+     * @param minFileSize Smallest file size uploaded in chunks.
+     * @param parallelChunks Maximum number of chunks of one file in flight.
+     */
+    void SetChunkedUpload(uint64_t chunkSize, uint64_t minFileSize, size_t parallelChunks = 4);
+
+    /**
+     * @brief Send full uploads as raw bodies with sendfile(2) instead of libcurl.
+     *
+     * Avoids copying file data through user space; meant for plain HTTP to a
+     * local or LAN server. Files large enough for chunked uploads still use
+     * chunks.
+     *
+     * @param enable true to use the zero-copy transport.
+     * @return false if the server URL does not allow it (e.g. https).
+     */
+    bool SetZeroCopyUpload(bool enable);
+
+    /**
+     * @brief Stat, read and hash small files in batches through io_uring.
+     *
+     * Files of at most maxFileSize bytes are loaded by a UringFileLoader, which
+     * keeps many stat/open/read requests in flight on one thread, and are
+     * uploaded from the loaded copy. Larger files are read the usual way.
+     *
+     * @param maxFileSize Largest file loaded through io_uring; 0 disables batching.
+     * @return false if io_uring is not available.
+     */
+    bool SetBatchedSmallFiles(uint64_t maxFileSize);
+
+    /**
+     * @brief Upload small files in groups, one request per group.
+     *
+     * Full uploads of files of at most maxFileSize bytes go to an
+     * UploadBatcher, which sends them together to POST /api/files/batch once
+     * maxBatchBytes are pending or the oldest waited maxDelay. Saves one HTTP
+     * round trip per file when many tiny files appear at once.
+     *
+     * @param maxFileSize Largest file sent in a batch; 0 disables batching.
+     * @param maxBatchBytes Content bytes that trigger sending a batch.
+     * @param maxDelay Longest time a file waits for its batch to fill.
+     */
+    void SetBatchUpload(uint64_t maxFileSize, size_t maxBatchBytes = 1024 * 1024,
+                        std::chrono::milliseconds maxDelay = std::chrono::milliseconds(20));
+
+    /**
+     * @brief Compress uploads of compressible files on the fly.
+     *
+     * Full and chunked uploads of files that GzipFileReader::worthCompressing()
+     * accepts are deflated while they are sent ("Content-Encoding: gzip",
+     * chunked transfer coding) and inflated by the server before they are
+     * stored. Media, archives and files whose sample does not shrink go out as
+     * they are. A compressed full upload goes through libcurl even when the
+     * zero-copy transport is enabled.
      *
-     * The parameter must be a pointer to filesMonitor::FileEvent. The
-     * event is queued for processing on a separate thread.
+     * @param level zlib compression level (1 = fastest, 9 = smallest); 0 disables compression.
      */
-    void update(void* params) override;
+    void SetCompression(int level);
+
+    /**
+     * @brief Set the size and overflow policy of the incoming event queue.
+     *
+     * The default is 16384 events with QueuePolicy::BLOCK, which stalls the
+     * monitor (and lets the kernel queue overflow into a rescan) when events
+     * arrive faster than they are handled. QueuePolicy::COALESCE keeps the
+     * newest event per file; QueuePolicy::DROP_OLDEST calls the overflow handler.
+     * Events already queued are discarded; call before attaching to a monitor.
+     *
+     * @param capacity Maximum number of queued events.
+     * @param policy What to do with new events when the queue is full.
+     */
+    void SetEventQueue(size_t capacity, QueuePolicy policy);
+
+    /**
+     * @brief Set the callback invoked when events were dropped.
+     *
+     * Typically requests a rescan from the monitor so the server converges
+     * despite the lost events.
+     *
+     * @param handler Callback; may run on any thread calling onEvent().
+     */
+    void SetOverflowHandler(std::function<void()> handler);
+
+    /**
+     * @brief Keep the content index in a persistent journal.
+     *
+     * With a journal, a restart remembers what was already uploaded: unchanged
+     * files are neither hashed nor uploaded again, and Reconcile() can tell
+     * which files changed or disappeared while the client was down.
+     *
+     * @param journalDir Journal directory; created if missing.
+     * @return false if the journal cannot be opened; the index stays in memory.
+     */
+    bool SetSyncJournal(const std::string& journalDir);
+
+    /**
+     * @brief Set the backoff of retried uploads and deletes.
+     *
+     * Retry n of a file waits a random time between d/2 and d, with
+     * d = min(maxDelay, baseDelay * 2^(n-1)). The defaults are 1 s, 5 min and 8 retries.
+     *
+     * @param baseDelay Longest wait before the first retry.
+     * @param maxDelay Longest wait before any retry.
+     * @param maxAttempts Retries before an operation is dead-lettered.
+     */
+    void SetRetryPolicy(std::chrono::milliseconds baseDelay, std::chrono::milliseconds maxDelay,
+                        unsigned maxAttempts);
+
+    /**
+     * @brief Keep operations given up on in a file (see RetryQueue).
+     *
+     * Uploads and deletes that failed every retry, and retries still pending
+     * when the manager is destroyed, are appended to it.
+     *
+     * @param path Dead-letter file; created if missing.
+     * @return false if the file cannot be opened; given-up operations are then only logged.
+     */
+    bool SetDeadLetterFile(const std::string& path);
+
+    /**
+     * @brief Run the operations of the dead-letter file again.
+     *
+     * Typically called at startup, or once the server is back. Operations
+     * that fail again are retried and, if need be, dead-lettered again. The
+     * file keeps them until all are done, in case the client stops first.
+     *
+     * @return Number of operations queued.
+     */
+    size_t RetryDeadLetters();
+
+    /**
+     * @brief Bring the server up to date with the monitored tree (startup full sync).
+     *
+     * Lists the server (GET /api/files/list) and walks the tree with
+     * RECONCILE_THREADS threads. A file that passes the monitor's filters is
+     * queued as a settled CREATED event when its (size, mtime, inode) differ
+     * from its journal entry, when it has none, or when the server lacks it or
+     * holds a different size. Journal entries with no file left are queued as
+     * DELETED events. Unchanged files cost one directory entry and one
+     * fstatat(). Without a listing (older server) only the journal is compared.
+     *
+     * Call after the monitor has started, so nothing changed during the walk is missed.
+     *
+     * @param monitor Monitor whose directory, recursion and filters are used.
+     * @return Number of events queued.
+     */
+    size_t Reconcile(const filesMonitor& monitor);
 
 private:
+    /** Events handled (or pending as requests) at the same time; enough to keep the loader and connections busy */
+    static const size_t MAX_ADMITTED_EVENTS = 1024;
+
+    /** Directory readers of Reconcile(); many, so a cold tree keeps the disk queue full */
+    static const unsigned RECONCILE_THREADS = 16;
+
+    /**
+     * @struct RemoteFile
+     * @brief A file listed by the server.
+     */
+    struct RemoteFile {
+        uint64_t size = 0;      ///< Size on the server
+        bool     seen = false;  ///< Found in the local tree (set under Reconcile()'s lock)
+    };
+
+    /**
+     * @brief Fetch the names and sizes of the files on the server (blocking).
+     * @param files Receives path relative to the upload directory -> file.
+     * @return false if the server could not be listed.
+     */
+    bool fetchServerListing(std::unordered_map<std::string, RemoteFile>& files);
+
+    /**
+     * @brief Hand a file event to the matching handler.
+     * @param fileEvent Event taken from the event queue.
+     */
+    void dispatchEvent(const filesMonitor::FileEvent& fileEvent);
+
+    /**
+     * @brief Take events from the event queue while there is room to handle them.
+     */
+    void pumpEvents();
+
+    /**
+     * @brief Account for a finished event and take the next ones.
+     */
+    void onEventDone();
+
+    /**
+     * @brief Run a due retry (retry queue callback, on the transfer engine's reactor thread).
+     * @param filename Local path of the file.
+     * @param op Operation to run again.
+     */
+    void retry(const std::string& filename, RetryQueue::Operation op);
+
+    /**
+     * @brief Queue an upload of a file to the server using HTTP POST.
+     * @param localFilePath Path to the local file on disk.
+     * @param fingerprint Content fingerprint recorded once the upload succeeds.
+     * @param detected When the event that caused the upload was detected.
+     * @param signatures Block signatures stored for delta sync once the upload succeeds, may be null.
+     * @param content Content already read from the file, sent instead of reading it again; may be null.
+     * @return true if the upload was queued (onFileSent() follows), false otherwise.
+     */
+    bool sendFile(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                  std::chrono::steady_clock::time_point detected,
+                  std::shared_ptr<DeltaSync::Signatures> signatures = nullptr,
+                  std::shared_ptr<const std::string> content = nullptr);
+
+    /**
+     * @brief Queue a full upload of a file, gzip-encoded on the fly as a raw PUT.
+     * @param localFilePath Path to the local file on disk.
+     * @param fingerprint Content fingerprint recorded once the upload succeeds.
+     * @param signatures Block signatures stored for delta sync once the upload succeeds, may be null.
+     * @param detected When the event that caused the upload was detected.
+     * @return true if the upload was queued, false if the file cannot be opened.
+     */
+    bool sendCompressed(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                        std::shared_ptr<DeltaSync::Signatures> signatures,
+                        std::chrono::steady_clock::time_point detected);
+
+    /**
+     * @brief Record the outcome of a full upload and resume the file's ordered tasks.
+     * @param localFilePath Path to the local file on disk.
+     * @param fingerprint Content fingerprint of the uploaded file.
+     * @param signatures Block signatures of the uploaded file, may be null.
+     * @param ok true if the server stored the file.
+     * @param retryable On failure, false if sending the file again cannot succeed (the server rejected it).
+     * @param detected When the event that caused the upload was detected.
+     */
+    void onFileSent(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                    const std::shared_ptr<DeltaSync::Signatures>& signatures, bool ok, bool retryable,
+                    std::chrono::steady_clock::time_point detected);
+
+    /**
+     * @brief Record the latency from an event to the start of its upload.
+     */
+    void recordUploadStart(std::chrono::steady_clock::time_point detected);
+
+    /**
+     * @brief Record the outcome of an upload and the latency from its event to completion.
+     */
+    void recordUploadDone(std::chrono::steady_clock::time_point detected, bool ok);
+
     /**
-     * @brief Upload a file to the server using HTTP POST.
+     * @brief Queue a delta upload of a modified file against the server's copy.
      * @param localFilePath Path to the local file on disk.
-     * @return true on success, false otherwise.
+     * @param fingerprint Content fingerprint recorded once the patch succeeds.
+     * @param base Signatures of the copy held by the server.
+     * @param detected When the event that caused the upload was detected.
+     * @return true if the delta was queued, false if a full upload is needed instead.
      */
-    bool sendFile(const std::string& localFilePath);
+    bool sendDelta(const std::string& localFilePath, const ContentIndex::Fingerprint& fingerprint,
+                   const DeltaSync::Signatures& base, std::chrono::steady_clock::time_point detected);
 
     /**
-     * @brief Issue an HTTP DELETE request for a remote file.
+     * @brief Queue an HTTP DELETE request for a remote file.
      * @param filename Name of the file to remove on the server.
-     * @return true on success, false otherwise.
+     * @return true if the request was queued; its completion calls resumeOrdered().
      */
     bool deleteFile(const std::string& filename);
 
     /**
      * @brief Process a file creation event.
      * @param filename Path to the newly created file.
+     * @param settled true if the monitor already waited for the file to stop changing.
+     * @param detected When the monitor detected the event.
      */
-    void handleFileCreation(const std::string& filename);
+    void handleFileCreation(const std::string& filename, bool settled,
+                            std::chrono::steady_clock::time_point detected);
 
     /**
      * @brief Process a file modification event.
      * @param filename Path to the modified file.
+     * @param settled true if the monitor already waited for the file to stop changing.
+     * @param detected When the monitor detected the event.
      */
-    void handleFileModification(const std::string& filename);
+    void handleFileModification(const std::string& filename, bool settled,
+                                std::chrono::steady_clock::time_point detected);
 
     /**
      * @brief Process a file deletion event.
@@ -75,21 +387,151 @@ private:
      */
     void handleFileDeletion(const std::string& filename);
 
+    /**
+     * @brief Upload a file unless it was sent recently or its content is unchanged.
+     * @param filename Path to the created or modified file.
+     * @param detected When the monitor detected the event.
+     * @return false if an upload was queued or the file was handed to the file loader;
+     *         resumeOrdered() follows when that is done.
+     */
+    bool uploadIfChanged(const std::string& filename, std::chrono::steady_clock::time_point detected);
+
+    /**
+     * @brief Fingerprint a file on disk and upload it (as a delta if possible) if it changed.
+     * @param filename Path to the created or modified file.
+     * @param detected When the monitor detected the event.
+     * @return true if an upload was queued (its completion calls resumeOrdered()),
+     *         false if the file is gone, unreadable or unchanged.
+     */
+    bool uploadFromDisk(const std::string& filename, std::chrono::steady_clock::time_point detected);
+
+    /**
+     * @brief Upload a file loaded by the file loader if it changed (runs on the loader thread).
+     *
+     * Calls resumeOrdered() when done, or leaves it to the completion of the upload it queued.
+     * @param file Metadata and content of the file.
+     * @param detected When the monitor detected the event.
+     */
+    void uploadLoaded(UringFileLoader::LoadedFile& file, std::chrono::steady_clock::time_point detected);
+
+    /**
+     * @brief Run a task on the pool after all earlier tasks queued for the same file.
+     * @param filename File the task works on.
+     * @param task Task to run; returns false if it finishes asynchronously: it queued a request, or
+     *             handed the file to the loader, whose completion calls resumeOrdered(). The file's
+     *             next task waits until then.
+     * @note The task holds an admission (m_admitted), released once it is done or dropped at shutdown.
+     */
+    void putOrdered(const std::string& filename, std::function<bool()> task);
+
+    /**
+     * @brief Run a file's queued tasks one after another, starting with task.
+     */
+    void runOrdered(const std::string& filename, std::function<bool()> task);
+
+    /**
+     * @brief Continue with the next queued task of a file after an asynchronous task finished.
+     * @note Called exactly once per task that returned false.
+     */
+    void resumeOrdered(const std::string& filename);
+
     /**
      * @brief Determine if a file should be sent based on recent uploads.
      * @param filename Name of the file to check.
-     * @return true if the file was not sent in the last 2 seconds.
+     * @return false if an upload of the same size, mtime and inode was queued in the last 2 seconds.
      */
     bool shouldSendFile(const std::string& filename);
 
+    /**
+     * @brief Remember that an upload of a file was queued.
+     * @param filename Name of the file.
+     * @param fingerprint Fingerprint of the queued content.
+     */
+    void recordQueued(const std::string& filename, const ContentIndex::Fingerprint& fingerprint);
+
     /** Base REST server URL */
     std::string    m_serverUrl;
 
-    /** Queue thread used to run HTTP requests asynchronously */
-    QueueThread*   itsQueueThread;
+    /** Events waiting to be handled */
+    BoundedQueue<filesMonitor::FileEvent, SmallPath>* itsEventQueue;
+
+    /** Called when the event queue dropped events */
+    std::function<void()> m_overflowHandler;
+
+    /** Protects m_admitted and taking events from itsEventQueue */
+    std::mutex     m_admitMutex;
+
+    /** Events taken from the queue whose ordered task, request included, has not finished */
+    size_t         m_admitted;
+
+    /** Worker pool handling file events, null once shutting down */
+    ThreadPool*    itsThreadPool;
+
+    /** Protects m_pathTasks and itsThreadPool */
+    std::mutex     m_pathMutex;
+
+    /** Tasks waiting behind a running task of the same file; a key exists while one runs or was dropped at shutdown */
+    std::unordered_map<std::string, std::deque<std::function<bool()>>> m_pathTasks;
+
+    /** Protects recentUploads */
+    std::mutex     m_uploadsMutex;
+
+    /** Transfer engine running the HTTP requests */
+    TransferEngine* itsTransferEngine;
+
+    /** Chunked uploader for large files, null if chunked uploads are disabled */
+    ChunkedUploader* itsChunkedUploader;
+
+    /** Zero-copy transport for full uploads, null if disabled */
+    ZeroCopySender* itsZeroCopySender;
+
+    /** io_uring loader for small files, null if batching is disabled */
+    UringFileLoader* itsFileLoader;
+
+    /** Groups small uploads into batch requests, null if disabled */
+    UploadBatcher* itsUploadBatcher;
+
+    /** Retries of failed uploads and deletes */
+    RetryQueue*    itsRetryQueue;
+
+    /** Largest file sent in a batch */
+    uint64_t       m_batchMaxFileSize;
+
+    /** Smallest file size uploaded in chunks */
+    uint64_t       m_chunkMinSize;
+
+    /** gzip level for uploads, 0 if compression is disabled */
+    int            m_compressionLevel;
+
+    /** Map tracking the last queued upload of each file; entries of failed uploads are removed */
+    std::unordered_map<std::string, std::pair<std::chrono::steady_clock::time_point, ContentIndex::Fingerprint>> recentUploads;
+
+    /** Content last uploaded for each file, used to skip unchanged files */
+    ContentIndex   m_contentIndex;
+
+    /** Block signatures of the server copies, used for delta uploads */
+    DeltaSync      m_deltaSync;
+
+    /** Delta sync block size, 0 if delta uploads are disabled */
+    uint32_t       m_deltaBlockSize;
+
+    /** Smallest file size eligible for delta uploads */
+    uint64_t       m_deltaMinSize;
+
+    /** Events waiting in itsEventQueue */
+    MetricGauge&       m_queueDepth;
+
+    /** Latency from an event to the start of its upload */
+    LatencyHistogram&  m_uploadStartLatency;
+
+    /** Latency from an event to the end of its upload */
+    LatencyHistogram&  m_uploadDoneLatency;
+
+    /** Uploads the server accepted */
+    MetricCounter&     m_uploadsOk;
 
-    /** Map tracking the last upload time for each file */
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> recentUploads;
+    /** Uploads that failed */
+    MetricCounter&     m_uploadsFailed;
 };
 
 #endif // REST_API_MNGR_H
@@ -0,0 +1,399 @@
+#include "retryQueue.h"
+#include "../utilities/Logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+
+namespace {
+    const char* operationName(RetryQueue::Operation op)
+    {
+        return op == RetryQueue::Operation::DELETE ? "DELETE" : "UPLOAD";
+    }
+
+    /**
+     * @brief Escape the characters that delimit dead-letter records.
+     */
+    std::string escapePath(const std::string& path)
+    {
+        std::string out;
+        out.reserve(path.size());
+        for (char c : path) {
+            switch (c) {
+                case '\\': out += "\\\\"; break;
+                case '\t': out += "\\t"; break;
+                case '\n': out += "\\n"; break;
+                default:   out += c; break;
+            }
+        }
+        return out;
+    }
+
+    std::string unescapePath(const std::string& text)
+    {
+        std::string out;
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != '\\' || i + 1 == text.size()) {
+                out += text[i];
+                continue;
+            }
+            char c = text[++i];
+            out += c == 't' ? '\t' : c == 'n' ? '\n' : c;
+        }
+        return out;
+    }
+
+    /**
+     * @brief Read a file from an offset to its end.
+     */
+    bool readFrom(const std::string& path, uint64_t offset, std::string& content)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            return false;
+        }
+        char buffer[65536];
+        for (;;) {
+            ssize_t n = pread(fd, buffer, sizeof(buffer), static_cast<off_t>(offset + content.size()));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                int error = errno;
+                close(fd);
+                errno = error;
+                return n == 0;
+            }
+            content.append(buffer, static_cast<size_t>(n));
+        }
+    }
+}
+
+RetryQueue::RetryQueue(TimerWheel& timers, RetryHandler handler)
+    : m_timers(timers),
+      m_handler(std::move(handler)),
+      m_stopped(false),
+      m_deadLetterFd(-1),
+      m_replayedBytes(0),
+      m_rng(std::random_device()()),
+      m_retries(MetricsRegistry::getInstance().counter(
+          "filesserver_retries_total", "Retries of failed uploads and deletes")),
+      m_collapsed(MetricsRegistry::getInstance().counter(
+          "filesserver_retries_collapsed_total", "Failures merged into a retry already pending for the path")),
+      m_deadLetters(MetricsRegistry::getInstance().counter(
+          "filesserver_dead_letters_total", "Failed operations given up on")),
+      m_pending(MetricsRegistry::getInstance().gauge(
+          "filesserver_retries_pending", "Paths waiting for or running a retry"))
+{
+}
+
+RetryQueue::~RetryQueue()
+{
+    std::vector<TimerWheel::TimerId> timers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& entry : m_entries) {
+            if (entry.second.timer != 0) {
+                timers.push_back(entry.second.timer);
+            }
+        }
+        m_pending.add(-static_cast<int64_t>(m_entries.size()));
+        m_entries.clear();
+    }
+    for (TimerWheel::TimerId timer : timers) {
+        m_timers.cancel(timer);
+    }
+
+    if (m_deadLetterFd != -1) {
+        close(m_deadLetterFd);
+    }
+}
+
+void RetryQueue::SetPolicy(const Policy& policy)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_policy = policy;
+    m_policy.baseDelay = std::max(std::chrono::milliseconds(1), m_policy.baseDelay);
+    m_policy.maxDelay = std::max(m_policy.baseDelay, m_policy.maxDelay);
+}
+
+bool RetryQueue::SetDeadLetterFile(const std::string& path)
+{
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        LOG_ERROR("Failed to open dead-letter file {}: {}", path, strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_deadLetterFd != -1) {
+        close(m_deadLetterFd);
+    }
+    m_deadLetterFd = fd;
+    m_deadLetterPath = path;
+    m_replayedBytes = 0;
+    m_replaying.clear();
+    return true;
+}
+
+void RetryQueue::Stop()
+{
+    std::vector<TimerWheel::TimerId> timers;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+        if (!m_entries.empty()) {
+            LOG_WARN("Giving up on {} pending retries at shutdown", m_entries.size());
+        }
+        for (const auto& entry : m_entries) {
+            // A retry still waiting for its timer has not run
+            unsigned run = entry.second.attempts;
+            if (entry.second.timer != 0) {
+                timers.push_back(entry.second.timer);
+                --run;
+            }
+            deadLetter(entry.first, entry.second.op, run);
+        }
+        m_pending.add(-static_cast<int64_t>(m_entries.size()));
+        m_entries.clear();
+    }
+
+    // Outside the lock: cancel() waits for a running onTimer(), which takes it
+    for (TimerWheel::TimerId timer : timers) {
+        m_timers.cancel(timer);
+    }
+}
+
+void RetryQueue::failed(const std::string& path, Operation op, bool retryable)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(path);
+    if (m_stopped) {
+        deadLetter(path, op, it == m_entries.end() ? 0 : it->second.attempts);
+        return;
+    }
+
+    // Already waiting: its retry does the latest operation, one request per backoff period
+    if (it != m_entries.end() && it->second.timer != 0) {
+        it->second.op = op;
+        m_collapsed.inc();
+        return;
+    }
+
+    unsigned attempts = it == m_entries.end() ? 0 : it->second.attempts;
+    if (!retryable || attempts >= m_policy.maxAttempts) {
+        deadLetter(path, op, attempts);
+        if (it != m_entries.end()) {
+            m_entries.erase(it);
+            m_pending.add(-1);
+        }
+        return;
+    }
+
+    if (it == m_entries.end()) {
+        it = m_entries.emplace(path, Entry{op, 0, 0}).first;
+        m_pending.add(1);
+    }
+    Entry& entry = it->second;
+    entry.op = op;
+    entry.attempts = attempts + 1;
+    std::chrono::milliseconds delay = backoff(entry.attempts);
+    entry.timer = m_timers.schedule(delay, [this, path]() { onTimer(path); });
+    LOG_WARN("{} of {} failed, retry {} in {} ms", operationName(op), path, entry.attempts, delay.count());
+}
+
+void RetryQueue::resolved(const std::string& path)
+{
+    TimerWheel::TimerId timer = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        replayDone(path);
+        auto it = m_entries.find(path);
+        if (it == m_entries.end()) {
+            return;
+        }
+        timer = it->second.timer;
+        m_entries.erase(it);
+        m_pending.add(-1);
+    }
+    if (timer != 0) {
+        m_timers.cancel(timer);
+    }
+}
+
+size_t RetryQueue::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
+
+std::vector<RetryQueue::DeadLetter> RetryQueue::takeDeadLetters()
+{
+    std::string content;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_deadLetterFd == -1) {
+            return {};
+        }
+
+        // Records appended from now on follow the taken ones, which dropReplayed() removes
+        if (!readFrom(m_deadLetterPath, m_replayedBytes, content)) {
+            LOG_ERROR("Failed to read dead-letter file {}: {}", m_deadLetterPath, strerror(errno));
+            return {};
+        }
+        m_replayedBytes += content.size();
+    }
+
+    std::vector<DeadLetter> letters;
+    std::unordered_map<std::string, size_t> latest;
+    size_t start = 0;
+    while (start < content.size()) {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos) {
+            break;  // Torn last record
+        }
+        std::string line = content.substr(start, end - start);
+        start = end + 1;
+
+        size_t tab1 = line.find('\t');
+        size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+        size_t tab3 = tab2 == std::string::npos ? tab2 : line.find('\t', tab2 + 1);
+        if (tab3 == std::string::npos) {
+            continue;
+        }
+        std::string op = line.substr(tab1 + 1, tab2 - tab1 - 1);
+        if (op != "UPLOAD" && op != "DELETE") {
+            continue;
+        }
+
+        DeadLetter letter;
+        letter.time = std::strtoll(line.c_str(), nullptr, 10);
+        letter.op = op == "DELETE" ? Operation::DELETE : Operation::UPLOAD;
+        letter.attempts = static_cast<unsigned>(std::strtoul(line.c_str() + tab2 + 1, nullptr, 10));
+        letter.path = unescapePath(line.substr(tab3 + 1));
+
+        auto it = latest.find(letter.path);
+        if (it != latest.end()) {
+            letters[it->second] = std::move(letter);
+            continue;
+        }
+        latest.emplace(letter.path, letters.size());
+        letters.push_back(std::move(letter));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const DeadLetter& letter : letters) {
+        m_replaying.insert(letter.path);
+    }
+    if (m_replaying.empty() && m_replayedBytes > 0) {
+        dropReplayed();  // Nothing to replay, e.g. only a torn record
+    }
+    return letters;
+}
+
+void RetryQueue::onTimer(const std::string& path)
+{
+    Operation op;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(path);
+        if (it == m_entries.end() || it->second.timer == 0) {
+            return;  // Resolved, or run early by a timer that was being cancelled
+        }
+        it->second.timer = 0;
+        op = it->second.op;
+    }
+
+    m_retries.inc();
+    m_handler(path, op);
+}
+
+std::chrono::milliseconds RetryQueue::backoff(unsigned attempt)
+{
+    std::chrono::milliseconds delay = m_policy.baseDelay;
+    for (unsigned i = 1; i < attempt && delay < m_policy.maxDelay; ++i) {
+        delay *= 2;
+    }
+    delay = std::min(delay, m_policy.maxDelay);
+
+    std::uniform_int_distribution<int64_t> jitter(delay.count() / 2, delay.count());
+    return std::chrono::milliseconds(jitter(m_rng));
+}
+
+void RetryQueue::deadLetter(const std::string& path, Operation op, unsigned attempts)
+{
+    m_deadLetters.inc();
+    LOG_ERROR("Giving up on {} of {} after {} retries", operationName(op), path, attempts);
+    if (m_deadLetterFd == -1) {
+        return;
+    }
+
+    std::string record = std::to_string(static_cast<int64_t>(time(nullptr))) + '\t' + operationName(op) + '\t' +
+                         std::to_string(attempts) + '\t' + escapePath(path) + '\n';
+
+    // One write per record: O_APPEND keeps records whole
+    ssize_t written;
+    do {
+        written = write(m_deadLetterFd, record.data(), record.size());
+    } while (written == -1 && errno == EINTR);
+    if (written != static_cast<ssize_t>(record.size())) {
+        LOG_ERROR("Failed to write dead-letter file {}: {}", m_deadLetterPath,
+                  written == -1 ? strerror(errno) : "short write");
+    }
+
+    // Its new record is past the replayed ones
+    replayDone(path);
+}
+
+void RetryQueue::replayDone(const std::string& path)
+{
+    if (m_replaying.erase(path) != 0 && m_replaying.empty()) {
+        dropReplayed();
+    }
+}
+
+void RetryQueue::dropReplayed()
+{
+    std::string kept;
+    if (!readFrom(m_deadLetterPath, m_replayedBytes, kept)) {
+        LOG_ERROR("Failed to read dead-letter file {}: {}", m_deadLetterPath, strerror(errno));
+        return;
+    }
+    if (kept.empty()) {
+        if (ftruncate(m_deadLetterFd, 0) == -1) {
+            LOG_ERROR("Failed to empty dead-letter file {}: {}", m_deadLetterPath, strerror(errno));
+            return;
+        }
+        m_replayedBytes = 0;
+        return;
+    }
+
+    // Records appended during the replays are kept: they go to a new file that replaces the old one
+    std::string tmpPath = m_deadLetterPath + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    ssize_t written = -1;
+    if (fd != -1) {
+        do {
+            written = write(fd, kept.data(), kept.size());
+        } while (written == -1 && errno == EINTR);
+    }
+    if (written != static_cast<ssize_t>(kept.size()) || rename(tmpPath.c_str(), m_deadLetterPath.c_str()) == -1) {
+        // The old file stays: its replayed records are replayed again at the next start
+        LOG_ERROR("Failed to rewrite dead-letter file {}: {}", m_deadLetterPath, strerror(errno));
+        if (fd != -1) {
+            close(fd);
+            unlink(tmpPath.c_str());
+        }
+        return;
+    }
+
+    close(m_deadLetterFd);
+    m_deadLetterFd = fd;
+    m_replayedBytes = 0;
+}
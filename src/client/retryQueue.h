@@ -0,0 +1,208 @@
+/**
+ * @file retryQueue.h
+ * @brief Retries of failed transfers, with a dead-letter file for those that keep failing.
+ */
+#ifndef RETRY_QUEUE_H
+#define RETRY_QUEUE_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "../utilities/TimerWheel.h"
+#include "../utilities/Metrics.h"
+
+/**
+ * @class RetryQueue
+ * @brief Reschedules failed uploads and deletes with jittered exponential backoff.
+ *
+ * A path has at most one retry. A failure reported while the path already
+ * waits for its retry only replaces the operation to retry (the latest one
+ * wins), so a file that keeps changing while the server is down costs one
+ * request per backoff period rather than one per event. A success for the
+ * path, or resolved(), drops its retry.
+ *
+ * Retry n waits a random time in [d/2, d], d = min(maxDelay, baseDelay * 2^(n-1)),
+ * so clients that failed together do not retry together. The waits are
+ * one-shot TimerWheel timers; the retry handler runs on the wheel's reactor
+ * thread and must not block.
+ *
+ * An operation that failed maxAttempts retries, or failed in a way retrying
+ * cannot fix, is appended to the dead-letter file, as are the retries still
+ * pending at Stop(). One line per operation:
+ * @code
+ *   <unix seconds> TAB <UPLOAD|DELETE> TAB <retries> TAB <path> LF
+ * @endcode
+ * with backslash, tab and newline escaped in the path. takeDeadLetters()
+ * reads the records added since the last call, to replay them once the
+ * server is back. They stay in the file until every replayed path was
+ * resolved() or given up on again, so a replay cut short by a crash or a
+ * shutdown is not lost; the file then drops them and keeps the records
+ * appended meanwhile.
+ *
+ * @note All methods are thread-safe.
+ */
+class RetryQueue
+{
+public:
+    /**
+     * @enum Operation
+     * @brief What is retried for a path
+     */
+    enum class Operation {
+        UPLOAD,     ///< Upload the current content of the file
+        DELETE      ///< Delete the file on the server
+    };
+
+    /**
+     * @struct Policy
+     * @brief Backoff parameters
+     */
+    struct Policy {
+        std::chrono::milliseconds baseDelay{1000};      ///< Longest wait before the first retry
+        std::chrono::milliseconds maxDelay{300000};     ///< Longest wait before any retry
+        unsigned                  maxAttempts = 8;      ///< Retries before an operation is dead-lettered
+    };
+
+    /**
+     * @struct DeadLetter
+     * @brief An operation given up on, as read back from the dead-letter file
+     */
+    struct DeadLetter {
+        Operation   op;         ///< Operation that failed
+        std::string path;       ///< Local path of the file
+        unsigned    attempts;   ///< Retries made before giving up
+        int64_t     time;       ///< When it was given up on, in seconds since the epoch
+    };
+
+    /**
+     * @brief Callback running a retry; reports its outcome through failed() and resolved()
+     */
+    using RetryHandler = std::function<void(const std::string& path, Operation op)>;
+
+    /**
+     * @brief Construct a retry queue
+     * @param timers Wheel running the backoff timers
+     * @param handler Called when a retry is due
+     */
+    RetryQueue(TimerWheel& timers, RetryHandler handler);
+
+    /**
+     * @brief Destructor - pending retries not dead-lettered by Stop() are dropped, and
+     *        records of unfinished replays stay in the dead-letter file
+     */
+    ~RetryQueue();
+
+    RetryQueue(const RetryQueue&) = delete;
+    RetryQueue& operator=(const RetryQueue&) = delete;
+
+    /**
+     * @brief Set the backoff parameters; applies to retries scheduled afterwards
+     */
+    void SetPolicy(const Policy& policy);
+
+    /**
+     * @brief Append given-up operations to a file
+     * @param path Dead-letter file; created if missing
+     * @return false if it cannot be opened; given-up operations are then only logged
+     */
+    bool SetDeadLetterFile(const std::string& path);
+
+    /**
+     * @brief Cancel the timers and dead-letter every pending retry and every later failure
+     * @note Once this returns, the retry handler is not running (unless called from it)
+     */
+    void Stop();
+
+    /**
+     * @brief Report a failed operation
+     * @param path Local path of the file
+     * @param op Operation that failed
+     * @param retryable false if retrying cannot help (e.g. the server rejected the request)
+     */
+    void failed(const std::string& path, Operation op, bool retryable = true);
+
+    /**
+     * @brief Report that nothing is left to retry for a path (an operation succeeded, or became moot)
+     */
+    void resolved(const std::string& path);
+
+    /**
+     * @brief Number of paths waiting for or running a retry
+     */
+    size_t pending() const;
+
+    /**
+     * @brief Read the dead-letter records not taken yet, to replay them
+     * @return Given-up operations, oldest first, one per path (the latest)
+     * @note Report each returned path through resolved() or failed(); the records are
+     *       removed from the file once all of them were
+     */
+    std::vector<DeadLetter> takeDeadLetters();
+
+private:
+    /**
+     * @struct Entry
+     * @brief Retry state of one path
+     */
+    struct Entry {
+        Operation           op;         ///< Operation to retry
+        unsigned            attempts;   ///< Retries scheduled so far, the last one possibly not run yet
+        TimerWheel::TimerId timer;      ///< Backoff timer, 0 while the retry runs
+    };
+
+    /**
+     * @brief Timer callback: run the path's retry
+     */
+    void onTimer(const std::string& path);
+
+    /**
+     * @brief Wait before a retry
+     * @param attempt Retry number, from 1
+     * @note m_mutex must be held
+     */
+    std::chrono::milliseconds backoff(unsigned attempt);
+
+    /**
+     * @brief Give up on an operation: log it and append it to the dead-letter file
+     * @note m_mutex must be held
+     */
+    void deadLetter(const std::string& path, Operation op, unsigned attempts);
+
+    /**
+     * @brief End the replay of a path; after the last one, remove the replayed records from the file
+     * @note m_mutex must be held
+     */
+    void replayDone(const std::string& path);
+
+    /**
+     * @brief Remove the first m_replayedBytes of the dead-letter file
+     * @note m_mutex must be held
+     */
+    void dropReplayed();
+
+    TimerWheel&     m_timers;       ///< Wheel running the backoff timers
+    RetryHandler    m_handler;      ///< Runs due retries
+
+    mutable std::mutex                      m_mutex;            ///< Protects the members below
+    Policy                                  m_policy;           ///< Backoff parameters
+    std::unordered_map<std::string, Entry>  m_entries;          ///< Paths waiting for or running a retry
+    bool                                    m_stopped;          ///< Failures go straight to the dead-letter file
+    std::string                             m_deadLetterPath;   ///< Dead-letter file, empty if none
+    int                                     m_deadLetterFd;     ///< Dead-letter file opened for appending, -1 if none
+    uint64_t                                m_replayedBytes;    ///< Leading bytes of the file taken by takeDeadLetters()
+    std::unordered_set<std::string>         m_replaying;        ///< Taken paths not resolved or given up on yet
+    std::mt19937_64                         m_rng;              ///< Backoff jitter
+
+    MetricCounter&  m_retries;      ///< Retries run
+    MetricCounter&  m_collapsed;    ///< Failures merged into a pending retry
+    MetricCounter&  m_deadLetters;  ///< Operations given up on
+    MetricGauge&    m_pending;      ///< Paths in m_entries
+};
+
+#endif // RETRY_QUEUE_H
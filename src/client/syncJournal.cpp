@@ -0,0 +1,500 @@
+#include "syncJournal.h"
+#include "../utilities/Logger.h"
+#include "../utilities/contentHash.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char INDEX_MAGIC[8] = {'F', 'S', 'J', 'I', 'D', 'X', '1', '\0'};
+
+struct SyncJournal::IndexHeader {
+    char     magic[8];      ///< INDEX_MAGIC
+    uint64_t count;         ///< Number of records
+    uint64_t buckets;       ///< Hash table size, a power of two
+    uint64_t version;       ///< Last version contained in the index
+    uint64_t arenaSize;     ///< Bytes of path data
+};
+
+struct SyncJournal::IndexRecord {
+    uint64_t pathHash;      ///< XXH64 of the path
+    uint64_t pathOffset;    ///< Offset of the path in the arena
+    uint32_t pathLen;       ///< Length of the path
+    uint32_t reserved;      ///< Zero
+    Record   record;        ///< Synced state
+};
+
+/**
+ * @brief Log record header, followed by a Record and the path bytes.
+ */
+struct LogHeader {
+    uint32_t length;        ///< Bytes after the header
+    uint32_t live;          ///< 1 for put, 0 for erase
+    uint64_t checksum;      ///< XXH64 of the bytes after the header, seeded with live
+};
+
+static uint64_t hashPath(const char* path, size_t len)
+{
+    return contentHash::hash64(path, len);
+}
+
+static bool writeAll(int fd, const char* data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+SyncJournal::SyncJournal()
+    : m_logFd(-1),
+      m_map(nullptr),
+      m_mapSize(0),
+      m_header(nullptr),
+      m_records(nullptr),
+      m_table(nullptr),
+      m_arena(nullptr),
+      m_liveCount(0),
+      m_version(0)
+{
+}
+
+SyncJournal::~SyncJournal()
+{
+    close();
+}
+
+bool SyncJournal::open(const std::string& dir)
+{
+    close();
+
+    if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+        LOG_ERROR("Failed to create journal directory {}: {}", dir, strerror(errno));
+        return false;
+    }
+
+    m_logFd = ::open((dir + "/log").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_logFd == -1) {
+        LOG_ERROR("Failed to open journal log in {}: {}", dir, strerror(errno));
+        return false;
+    }
+    m_dir = dir;
+
+    mapIndex();
+    replayLog();
+    return true;
+}
+
+void SyncJournal::close()
+{
+    if (m_logFd != -1) {
+        fdatasync(m_logFd);
+        ::close(m_logFd);
+        m_logFd = -1;
+    }
+    unmapIndex();
+    m_dir.clear();
+    m_overlay.clear();
+    m_liveCount = 0;
+    m_version = 0;
+}
+
+bool SyncJournal::mapIndex()
+{
+    int fd = ::open((m_dir + "/index").c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(st.st_size);
+    void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Failed to map journal index: {}", strerror(errno));
+        return false;
+    }
+
+    const IndexHeader* header = static_cast<const IndexHeader*>(map);
+    bool valid = memcmp(header->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0 &&
+                 header->buckets >= 2 * header->count && (header->buckets & (header->buckets - 1)) == 0 &&
+                 header->count < (1ULL << 32) && header->buckets < (1ULL << 34) &&
+                 size == sizeof(IndexHeader) + header->count * sizeof(IndexRecord) +
+                         header->buckets * sizeof(uint32_t) + header->arenaSize;
+
+    const IndexRecord* records = reinterpret_cast<const IndexRecord*>(header + 1);
+    for (uint64_t i = 0; valid && i < header->count; ++i) {
+        valid = records[i].pathOffset + records[i].pathLen <= header->arenaSize;
+    }
+
+    if (!valid) {
+        LOG_ERROR("Ignoring corrupt journal index in {}", m_dir);
+        munmap(map, size);
+        return false;
+    }
+
+    m_map = map;
+    m_mapSize = size;
+    m_header = header;
+    m_records = records;
+    m_table = reinterpret_cast<const uint32_t*>(records + header->count);
+    m_arena = reinterpret_cast<const char*>(m_table + header->buckets);
+    m_marks.assign(header->count, false);
+    m_liveCount = header->count;
+    m_version = header->version;
+    return true;
+}
+
+void SyncJournal::unmapIndex()
+{
+    if (m_map) {
+        munmap(m_map, m_mapSize);
+    }
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_header = nullptr;
+    m_records = nullptr;
+    m_table = nullptr;
+    m_arena = nullptr;
+    m_marks.clear();
+}
+
+long SyncJournal::findIndexed(const std::string& path) const
+{
+    if (!m_map) {
+        return -1;
+    }
+
+    uint64_t hash = hashPath(path.data(), path.size());
+    uint64_t mask = m_header->buckets - 1;
+    for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+        uint32_t slot = m_table[i];
+        if (slot == 0 || slot > m_header->count) {
+            return -1;
+        }
+        const IndexRecord& rec = m_records[slot - 1];
+        if (rec.pathHash == hash && rec.pathLen == path.size() &&
+            memcmp(m_arena + rec.pathOffset, path.data(), path.size()) == 0) {
+            return static_cast<long>(slot - 1);
+        }
+    }
+}
+
+bool SyncJournal::lookup(const std::string& path, Record& out) const
+{
+    auto it = m_overlay.find(path);
+    if (it != m_overlay.end()) {
+        if (!it->second.live) {
+            return false;
+        }
+        out = it->second.record;
+        return true;
+    }
+
+    long pos = findIndexed(path);
+    if (pos < 0) {
+        return false;
+    }
+    out = m_records[pos].record;
+    return true;
+}
+
+void SyncJournal::apply(bool live, const std::string& path, const Record& record)
+{
+    bool existed;
+    long pos;
+    auto it = m_overlay.find(path);
+    if (it != m_overlay.end()) {
+        existed = it->second.live;
+        pos = live ? -1 : findIndexed(path);
+    } else {
+        pos = findIndexed(path);
+        existed = pos >= 0;
+        it = m_overlay.emplace(path, Overlay()).first;
+        it->second.marked = pos >= 0 && m_marks[pos];
+    }
+
+    it->second.live = live;
+    it->second.record = record;
+    if (live && !existed) {
+        ++m_liveCount;
+    } else if (!live && existed) {
+        --m_liveCount;
+    }
+    if (record.version > m_version) {
+        m_version = record.version;
+    }
+
+    // A tombstone is only needed to hide an index record
+    if (!live && pos < 0) {
+        m_overlay.erase(it);
+    }
+}
+
+void SyncJournal::put(const std::string& path, const Record& record)
+{
+    Record stored = record;
+    stored.version = ++m_version;
+    appendLog(true, path, stored);
+    apply(true, path, stored);
+    maybeCompact();
+}
+
+void SyncJournal::erase(const std::string& path)
+{
+    Record stored;
+    if (!lookup(path, stored)) {
+        return;
+    }
+    stored.version = ++m_version;
+    appendLog(false, path, stored);
+    apply(false, path, stored);
+    maybeCompact();
+}
+
+void SyncJournal::appendLog(bool live, const std::string& path, const Record& record)
+{
+    if (m_logFd == -1) {
+        return;
+    }
+
+    std::string buffer(sizeof(LogHeader) + sizeof(Record) + path.size(), '\0');
+    LogHeader header;
+    header.length = static_cast<uint32_t>(sizeof(Record) + path.size());
+    header.live = live ? 1 : 0;
+    memcpy(&buffer[sizeof(LogHeader)], &record, sizeof(Record));
+    memcpy(&buffer[sizeof(LogHeader) + sizeof(Record)], path.data(), path.size());
+    header.checksum = contentHash::hash64(&buffer[sizeof(LogHeader)], header.length, header.live);
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    // One write per record keeps records whole in the page cache; the tail check handles crashes
+    if (!writeAll(m_logFd, buffer.data(), buffer.size())) {
+        LOG_ERROR("Failed to append to journal log: {}", strerror(errno));
+    }
+}
+
+void SyncJournal::replayLog()
+{
+    struct stat st;
+    if (fstat(m_logFd, &st) == -1 || st.st_size == 0) {
+        return;
+    }
+
+    std::string data(static_cast<size_t>(st.st_size), '\0');
+    size_t size = 0;
+    while (size < data.size()) {
+        ssize_t n = pread(m_logFd, &data[size], data.size() - size, static_cast<off_t>(size));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        size += static_cast<size_t>(n);
+    }
+
+    size_t offset = 0;
+    size_t replayed = 0;
+    while (offset + sizeof(LogHeader) <= size) {
+        LogHeader header;
+        memcpy(&header, &data[offset], sizeof(header));
+        const char* payload = &data[offset + sizeof(LogHeader)];
+        if (header.live > 1 || header.length < sizeof(Record) ||
+            header.length > size - offset - sizeof(LogHeader) ||
+            contentHash::hash64(payload, header.length, header.live) != header.checksum) {
+            break;
+        }
+
+        Record record;
+        memcpy(&record, payload, sizeof(Record));
+        apply(header.live == 1, std::string(payload + sizeof(Record), header.length - sizeof(Record)), record);
+        offset += sizeof(LogHeader) + header.length;
+        ++replayed;
+    }
+
+    if (offset < static_cast<size_t>(st.st_size)) {
+        LOG_WARN("Discarding {} bytes of torn journal log", st.st_size - offset);
+        if (ftruncate(m_logFd, static_cast<off_t>(offset)) == -1) {
+            LOG_ERROR("Failed to truncate journal log: {}", strerror(errno));
+        }
+    }
+
+    LOG_INFO("Journal: {} files, {} log records replayed", m_liveCount, replayed);
+}
+
+void SyncJournal::maybeCompact()
+{
+    size_t indexed = m_header ? m_header->count : 0;
+    if (m_logFd != -1 && m_overlay.size() >= COMPACT_MIN_RECORDS && m_overlay.size() * 2 >= indexed) {
+        compact();
+    }
+}
+
+bool SyncJournal::compact()
+{
+    if (m_logFd == -1) {
+        return true;
+    }
+
+    std::vector<IndexRecord> records;
+    std::vector<bool> marks;
+    std::string arena;
+    records.reserve(m_liveCount);
+    marks.reserve(m_liveCount);
+
+    auto add = [&](const char* path, size_t len, uint64_t hash, const Record& record, bool marked) {
+        IndexRecord rec;
+        rec.pathHash = hash;
+        rec.pathOffset = arena.size();
+        rec.pathLen = static_cast<uint32_t>(len);
+        rec.reserved = 0;
+        rec.record = record;
+        records.push_back(rec);
+        marks.push_back(marked);
+        arena.append(path, len);
+    };
+
+    // Index records replaced or erased since are superseded by the overlay
+    std::vector<bool> superseded(m_header ? m_header->count : 0, false);
+    for (const auto& entry : m_overlay) {
+        long pos = findIndexed(entry.first);
+        if (pos >= 0) {
+            superseded[pos] = true;
+        }
+    }
+    for (uint64_t i = 0; m_header && i < m_header->count; ++i) {
+        if (!superseded[i]) {
+            const IndexRecord& rec = m_records[i];
+            add(m_arena + rec.pathOffset, rec.pathLen, rec.pathHash, rec.record, m_marks[i]);
+        }
+    }
+    for (const auto& entry : m_overlay) {
+        if (entry.second.live) {
+            add(entry.first.data(), entry.first.size(), hashPath(entry.first.data(), entry.first.size()),
+                entry.second.record, entry.second.marked);
+        }
+    }
+
+    uint64_t buckets = 16;
+    while (buckets < 2 * records.size()) {
+        buckets <<= 1;
+    }
+    std::vector<uint32_t> table(buckets, 0);
+    for (size_t i = 0; i < records.size(); ++i) {
+        uint64_t slot = records[i].pathHash & (buckets - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (buckets - 1);
+        }
+        table[slot] = static_cast<uint32_t>(i + 1);
+    }
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.count = records.size();
+    header.buckets = buckets;
+    header.version = m_version;
+    header.arenaSize = arena.size();
+
+    // Write aside and rename, so a crash leaves either the old or the new index
+    std::string tmpPath = m_dir + "/index.tmp";
+    int fd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd != -1 &&
+              writeAll(fd, reinterpret_cast<const char*>(&header), sizeof(header)) &&
+              writeAll(fd, reinterpret_cast<const char*>(records.data()), records.size() * sizeof(IndexRecord)) &&
+              writeAll(fd, reinterpret_cast<const char*>(table.data()), table.size() * sizeof(uint32_t)) &&
+              writeAll(fd, arena.data(), arena.size()) &&
+              fsync(fd) == 0;
+    if (fd != -1) {
+        ::close(fd);
+    }
+    if (!ok || rename(tmpPath.c_str(), (m_dir + "/index").c_str()) == -1) {
+        LOG_ERROR("Failed to write journal index: {}", strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    int dirFd = ::open(m_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd != -1) {
+        fsync(dirFd);
+        ::close(dirFd);
+    }
+
+    // Only now is the log redundant
+    unmapIndex();
+    m_overlay.clear();
+    if (ftruncate(m_logFd, 0) == -1) {
+        LOG_ERROR("Failed to truncate journal log: {}", strerror(errno));
+    }
+
+    uint64_t version = m_version;
+    if (!mapIndex()) {
+        m_liveCount = 0;
+        return false;
+    }
+    m_version = version;
+    m_marks = std::move(marks);
+    return true;
+}
+
+void SyncJournal::clearMarks()
+{
+    m_marks.assign(m_marks.size(), false);
+    for (auto& entry : m_overlay) {
+        entry.second.marked = false;
+    }
+}
+
+bool SyncJournal::mark(const std::string& path, Record& out)
+{
+    auto it = m_overlay.find(path);
+    if (it != m_overlay.end()) {
+        if (!it->second.live) {
+            return false;
+        }
+        it->second.marked = true;
+        out = it->second.record;
+        return true;
+    }
+
+    long pos = findIndexed(path);
+    if (pos < 0) {
+        return false;
+    }
+    m_marks[pos] = true;
+    out = m_records[pos].record;
+    return true;
+}
+
+void SyncJournal::forEachUnmarked(const std::function<void(const std::string& path)>& fn) const
+{
+    for (uint64_t i = 0; m_header && i < m_header->count; ++i) {
+        if (m_marks[i]) {
+            continue;
+        }
+        const IndexRecord& rec = m_records[i];
+        std::string path(m_arena + rec.pathOffset, rec.pathLen);
+        if (m_overlay.find(path) == m_overlay.end()) {
+            fn(path);
+        }
+    }
+    for (const auto& entry : m_overlay) {
+        if (entry.second.live && !entry.second.marked) {
+            fn(entry.first);
+        }
+    }
+}
@@ -0,0 +1,188 @@
+/**
+ * @file syncJournal.h
+ * @brief On-disk journal of what was synced for each file.
+ */
+#ifndef SYNC_JOURNAL_H
+#define SYNC_JOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class SyncJournal
+ * @brief Persistent map of path -> (size, mtime, inode, hash, version).
+ *
+ * Two files live in the journal directory:
+ * - "index": a compacted snapshot, memory mapped read-only. Fixed-size
+ *   records, an open-addressing table keyed by the XXH64 of the path, and an
+ *   arena holding the path bytes. Lookups touch a few pages and nothing is
+ *   parsed at startup.
+ * - "log": records appended since the snapshot (put or erase, each with an
+ *   XXH64 checksum), replayed into an in-memory overlay on open(). A torn
+ *   record at the tail is cut off.
+ *
+ * When the overlay grows past half the snapshot (and at least
+ * COMPACT_MIN_RECORDS), snapshot and overlay are merged into a new index that
+ * atomically replaces the old one, and the log is truncated. Replaying a log
+ * over an index that already contains it is harmless, so a crash at any point
+ * loses at most the log records not yet written back by the kernel - those
+ * files are then hashed and, if needed, uploaded again.
+ *
+ * Without open() the journal is a plain in-memory map.
+ *
+ * Reconciliation support: mark() flags entries seen on disk, and
+ * forEachUnmarked() lists the rest (files deleted while the client was down).
+ *
+ * @note Not thread-safe; ContentIndex serializes access.
+ */
+class SyncJournal
+{
+public:
+    /**
+     * @struct Record
+     * @brief What was synced for one path.
+     */
+    struct Record {
+        uint64_t size = 0;      ///< File size in bytes
+        int64_t  mtimeNs = 0;   ///< Modification time in nanoseconds since the epoch
+        uint64_t inode = 0;     ///< Inode number
+        uint64_t hash = 0;      ///< XXH64 digest of the content
+        uint64_t version = 0;   ///< Journal sequence number of the last change
+    };
+
+    /** Smallest overlay that triggers a compaction */
+    static const size_t COMPACT_MIN_RECORDS = 65536;
+
+    SyncJournal();
+    ~SyncJournal();
+
+    SyncJournal(const SyncJournal&) = delete;
+    SyncJournal& operator=(const SyncJournal&) = delete;
+
+    /**
+     * @brief Open (or create) the journal in a directory and load it.
+     *
+     * Records stored before open() are discarded.
+     *
+     * @param dir Journal directory; created if missing.
+     * @return false if the directory or log cannot be opened; the journal stays in memory.
+     */
+    bool open(const std::string& dir);
+
+    /**
+     * @brief Flush and close the journal files; the journal is empty afterwards.
+     */
+    void close();
+
+    /**
+     * @brief Look up a path.
+     * @return false if the path has no record.
+     */
+    bool lookup(const std::string& path, Record& out) const;
+
+    /**
+     * @brief Store the record of a path; its version is assigned by the journal.
+     */
+    void put(const std::string& path, const Record& record);
+
+    /**
+     * @brief Remove the record of a path.
+     */
+    void erase(const std::string& path);
+
+    /**
+     * @brief Number of paths with a record.
+     */
+    size_t size() const { return m_liveCount; }
+
+    /**
+     * @brief Merge the log into a new index and truncate the log.
+     * @return false if the new index could not be written.
+     */
+    bool compact();
+
+    /**
+     * @brief Clear all marks set by mark().
+     */
+    void clearMarks();
+
+    /**
+     * @brief Look up a path and flag it as seen.
+     * @return false if the path has no record.
+     */
+    bool mark(const std::string& path, Record& out);
+
+    /**
+     * @brief Call fn for every path with a record that was not marked.
+     */
+    void forEachUnmarked(const std::function<void(const std::string& path)>& fn) const;
+
+private:
+    struct IndexHeader;
+    struct IndexRecord;
+
+    /**
+     * @struct Overlay
+     * @brief Change made since the index was written.
+     */
+    struct Overlay {
+        Record record;          ///< New record (if live)
+        bool   live = false;    ///< false if the path was erased
+        bool   marked = false;  ///< Seen by the running reconciliation
+    };
+
+    /**
+     * @brief Find a path in the mapped index.
+     * @return Record position, or -1 if absent.
+     */
+    long findIndexed(const std::string& path) const;
+
+    /**
+     * @brief Map the index file, if present and valid.
+     */
+    bool mapIndex();
+
+    /**
+     * @brief Unmap the index file.
+     */
+    void unmapIndex();
+
+    /**
+     * @brief Apply the log to the overlay, cutting off a torn tail.
+     */
+    void replayLog();
+
+    /**
+     * @brief Append one record to the log.
+     */
+    void appendLog(bool live, const std::string& path, const Record& record);
+
+    /**
+     * @brief Apply one change to the overlay and the live count.
+     */
+    void apply(bool live, const std::string& path, const Record& record);
+
+    /**
+     * @brief Compact if the overlay has grown large enough.
+     */
+    void maybeCompact();
+
+    std::string                                 m_dir;          ///< Journal directory, empty if in memory
+    int                                         m_logFd;        ///< Append-only log, -1 if in memory
+    void*                                       m_map;          ///< Mapped index, nullptr if none
+    size_t                                      m_mapSize;      ///< Size of the mapping
+    const IndexHeader*                          m_header;       ///< Index header
+    const IndexRecord*                          m_records;      ///< Index records
+    const uint32_t*                             m_table;        ///< Hash table of record positions + 1
+    const char*                                 m_arena;        ///< Path bytes
+    std::unordered_map<std::string, Overlay>    m_overlay;      ///< Changes since the index was written
+    std::vector<bool>                           m_marks;        ///< Marks of index records
+    size_t                                      m_liveCount;    ///< Paths with a record
+    uint64_t                                    m_version;      ///< Last assigned version
+};
+
+#endif // SYNC_JOURNAL_H
@@ -0,0 +1,453 @@
+#include "transferEngine.h"
+#include "../utilities/Logger.h"
+#include "../utilities/Metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Response bodies beyond this size are truncated
+static const size_t MAX_RESPONSE_BODY = 1 << 20;
+
+// A server that does not accept the connection within this time is taken as down
+static const long CONNECT_TIMEOUT_SECONDS = 10;
+
+// A transfer moving less than LOW_SPEED_LIMIT bytes/s for LOW_SPEED_TIME seconds is stalled and aborted
+static const long LOW_SPEED_LIMIT = 1;
+static const long LOW_SPEED_TIME = 30;
+
+/**
+ * @brief Per-transfer state, reachable from the easy handle via CURLOPT_PRIVATE.
+ */
+struct TransferEngine::Transfer {
+    Request                                 request;
+    curl_mime*                              mime = nullptr;
+    curl_slist*                             headers = nullptr;
+    std::chrono::steady_clock::time_point   started;
+    char                                    error[CURL_ERROR_SIZE] = {};
+    std::string                             response;
+    int                                     bodyFd = -1;
+    uint64_t                                bodySent = 0;
+
+    ~Transfer()
+    {
+        curl_mime_free(mime);
+        curl_slist_free_all(headers);
+        if (bodyFd != -1) {
+            close(bodyFd);
+        }
+    }
+};
+
+// Stream the body to the request, or keep a bounded prefix of it for the completion callback
+size_t TransferEngine::collectBody(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    Transfer* transfer = static_cast<Transfer*>(userdata);
+    size_t len = size * nmemb;
+    if (transfer->request.onBodyData) {
+        transfer->request.onBodyData(data, len);
+    } else if (transfer->response.size() < MAX_RESPONSE_BODY) {
+        transfer->response.append(data, std::min(len, MAX_RESPONSE_BODY - transfer->response.size()));
+    }
+    return len;
+}
+
+size_t TransferEngine::readFileRange(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    Transfer* transfer = static_cast<Transfer*>(userdata);
+    const Request& req = transfer->request;
+    uint64_t left = req.bodyLength - transfer->bodySent;
+    size_t want = static_cast<size_t>(std::min<uint64_t>(left, size * nitems));
+    if (want == 0) {
+        return 0;
+    }
+
+    ssize_t n = pread(transfer->bodyFd, buffer, want, static_cast<off_t>(req.bodyOffset + transfer->bodySent));
+    if (n <= 0) {
+        return CURL_READFUNC_ABORT;  // File shrank or became unreadable
+    }
+    transfer->bodySent += static_cast<uint64_t>(n);
+    return static_cast<size_t>(n);
+}
+
+size_t TransferEngine::readSource(char* buffer, size_t size, size_t nitems, void* userdata)
+{
+    Transfer* transfer = static_cast<Transfer*>(userdata);
+    long n = transfer->request.bodySource(buffer, size * nitems);
+    return n < 0 ? CURL_READFUNC_ABORT : static_cast<size_t>(n);
+}
+
+TransferEngine::TransferEngine(size_t maxInFlight)
+    : m_startPosted(false),
+      m_maxInFlight(maxInFlight ? maxInFlight : 1),
+      m_stopped(false),
+      m_pending(0),
+      m_completed(0),
+      m_totalSeconds(0.0),
+      m_totalBytes(0)
+{
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerFd == -1) {
+        throw std::runtime_error(std::string("timerfd_create error: ") + strerror(errno));
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    m_multi = curl_multi_init();
+    curl_multi_setopt(m_multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(m_maxInFlight));
+    curl_multi_setopt(m_multi, CURLMOPT_MAXCONNECTS, static_cast<long>(m_maxInFlight));
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETFUNCTION, onSocketChange);
+    curl_multi_setopt(m_multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERFUNCTION, onTimerChange);
+    curl_multi_setopt(m_multi, CURLMOPT_TIMERDATA, this);
+
+    m_reactor.add(m_timerFd, EPOLLIN, [this](uint32_t) {
+        uint64_t expirations;
+        if (read(m_timerFd, &expirations, sizeof(expirations)) > 0) {
+            drive(CURL_SOCKET_TIMEOUT, 0);
+        }
+    });
+}
+
+TransferEngine::~TransferEngine()
+{
+    Stop(std::chrono::milliseconds(0));
+
+    for (CURL* easy : m_idleHandles) {
+        curl_easy_cleanup(easy);
+    }
+    curl_multi_cleanup(m_multi);
+    curl_global_cleanup();
+
+    m_reactor.remove(m_timerFd);
+    close(m_timerFd);
+}
+
+void TransferEngine::Stop(std::chrono::milliseconds drainTimeout)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_drainMutex);
+        if (!m_drained.wait_for(lock, drainTimeout, [this]() { return m_pending.load() == 0; })) {
+            LOG_WARN("Failing {} transfers still pending after {} ms", m_pending.load(), drainTimeout.count());
+        }
+    }
+
+    m_reactor.Stop();
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_stopped = true;
+    }
+    failUnfinished();
+}
+
+void TransferEngine::failUnfinished()
+{
+    Result result;
+    result.code = CURLE_ABORTED_BY_CALLBACK;
+    result.error = "Transfer engine stopped";
+
+    // Callbacks may submit follow-up requests: fail those too, until none is left
+    for (;;) {
+        std::vector<CURL*> active;
+        active.swap(m_active);
+        std::deque<Request> queued;
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            queued.swap(m_queue);
+        }
+        if (active.empty() && queued.empty()) {
+            return;
+        }
+
+        for (CURL* easy : active) {
+            Transfer* transfer = nullptr;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, &transfer);
+            curl_multi_remove_handle(m_multi, easy);
+            m_idleHandles.push_back(easy);
+            finish(transfer->request, result);
+            delete transfer;
+        }
+        for (Request& request : queued) {
+            finish(request, result);
+        }
+    }
+}
+
+void TransferEngine::finish(Request& request, const Result& result)
+{
+    if (request.onDone) {
+        request.onDone(result);
+    }
+
+    // Counted after the callback, so Stop() also waits for the requests it submits
+    if (--m_pending == 0) {
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        m_drained.notify_all();
+    }
+}
+
+void TransferEngine::submit(Request request)
+{
+    ++m_pending;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.push_back(std::move(request));
+        if (m_stopped) {
+            return;  // Failed by Stop() or the destructor
+        }
+    }
+
+    // One task starts every request queued before it runs
+    if (!m_startPosted.exchange(true)) {
+        m_reactor.post([this]() {
+            m_startPosted = false;
+            startQueued();
+        });
+    }
+}
+
+int TransferEngine::onSocketChange(CURL*, curl_socket_t socket, int what, void* userp, void* socketp)
+{
+    TransferEngine* engine = static_cast<TransferEngine*>(userp);
+    if (what == CURL_POLL_REMOVE) {
+        engine->m_reactor.remove(socket);
+        return 0;
+    }
+
+    uint32_t events = (what & CURL_POLL_IN ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+                      (what & CURL_POLL_OUT ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+    if (socketp) {
+        engine->m_reactor.modify(socket, events);
+        return 0;
+    }
+
+    bool added = engine->m_reactor.add(socket, events, [engine, socket](uint32_t ready) {
+        int flags = (ready & EPOLLIN ? CURL_CSELECT_IN : 0) | (ready & EPOLLOUT ? CURL_CSELECT_OUT : 0) |
+                    (ready & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0);
+        engine->drive(socket, flags);
+    });
+    if (!added) {
+        LOG_ERROR("Failed to watch socket {}: {}", static_cast<int>(socket), strerror(errno));
+        return -1;
+    }
+
+    // Marks the socket as registered, so the next change is a modify()
+    curl_multi_assign(engine->m_multi, socket, engine);
+    return 0;
+}
+
+int TransferEngine::onTimerChange(CURLM*, long timeoutMs, void* userp)
+{
+    TransferEngine* engine = static_cast<TransferEngine*>(userp);
+
+    // A zero timeout must not call back into libcurl from here: expire the timerfd at once instead
+    struct itimerspec due = {};
+    if (timeoutMs >= 0) {
+        due.it_value.tv_sec = timeoutMs / 1000;
+        due.it_value.tv_nsec = timeoutMs % 1000 * 1000000 + (timeoutMs == 0 ? 1 : 0);
+    }
+    return timerfd_settime(engine->m_timerFd, 0, &due, nullptr) == 0 ? 0 : -1;
+}
+
+void TransferEngine::drive(curl_socket_t socket, int flags)
+{
+    int still_running = 0;
+    CURLMcode mc = curl_multi_socket_action(m_multi, socket, flags, &still_running);
+    if (mc != CURLM_OK) {
+        LOG_ERROR("curl_multi_socket_action failed: {}", curl_multi_strerror(mc));
+    }
+
+    completeFinished();
+    startQueued();
+}
+
+CURL* TransferEngine::acquireHandle()
+{
+    if (!m_idleHandles.empty()) {
+        CURL* easy = m_idleHandles.back();
+        m_idleHandles.pop_back();
+        curl_easy_reset(easy);
+        return easy;
+    }
+    return curl_easy_init();
+}
+
+void TransferEngine::startQueued()
+{
+    while (m_active.size() < m_maxInFlight) {
+        Request request;
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (m_queue.empty()) {
+                return;
+            }
+            request = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        CURL* easy = acquireHandle();
+        if (!easy) {
+            LOG_ERROR("Failed to init curl");
+            Result result;
+            result.code = CURLE_FAILED_INIT;
+            result.error = "Failed to init curl";
+            finish(request, result);
+            continue;
+        }
+
+        Transfer* transfer = new Transfer();
+        transfer->request = std::move(request);
+        transfer->started = std::chrono::steady_clock::now();
+        const Request& req = transfer->request;
+
+        curl_easy_setopt(easy, CURLOPT_URL, req.url.c_str());
+        curl_easy_setopt(easy, CURLOPT_PRIVATE, transfer);
+        curl_easy_setopt(easy, CURLOPT_ERRORBUFFER, transfer->error);
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, collectBody);
+        curl_easy_setopt(easy, CURLOPT_WRITEDATA, transfer);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, CONNECT_TIMEOUT_SECONDS);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_LIMIT, LOW_SPEED_LIMIT);
+        curl_easy_setopt(easy, CURLOPT_LOW_SPEED_TIME, LOW_SPEED_TIME);
+
+        if (!req.mimeFile.empty() || req.mimeData) {
+            transfer->mime = curl_mime_init(easy);
+            curl_mimepart* part = curl_mime_addpart(transfer->mime);
+            curl_mime_name(part, "file");
+            if (!req.mimeFile.empty()) {
+                curl_mime_filedata(part, req.mimeFile.c_str());
+            } else {
+                curl_mime_data(part, req.mimeData->data(), req.mimeData->size());
+            }
+            if (!req.mimeFilename.empty()) {
+                curl_mime_filename(part, req.mimeFilename.c_str());
+            }
+            curl_easy_setopt(easy, CURLOPT_MIMEPOST, transfer->mime);
+        }
+        else if (!req.bodyFile.empty()) {
+            transfer->bodyFd = open(req.bodyFile.c_str(), O_RDONLY | O_CLOEXEC);
+            curl_easy_setopt(easy, CURLOPT_UPLOAD, 1L);
+            curl_easy_setopt(easy, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(req.bodyLength));
+            curl_easy_setopt(easy, CURLOPT_READFUNCTION, readFileRange);
+            curl_easy_setopt(easy, CURLOPT_READDATA, transfer);
+        }
+        else if (req.bodySource) {
+            // No size given: curl sends the body with chunked transfer coding
+            curl_easy_setopt(easy, CURLOPT_UPLOAD, 1L);
+            curl_easy_setopt(easy, CURLOPT_READFUNCTION, readSource);
+            curl_easy_setopt(easy, CURLOPT_READDATA, transfer);
+        }
+        else if (!req.body.empty()) {
+            curl_easy_setopt(easy, CURLOPT_POSTFIELDS, req.body.data());
+            curl_easy_setopt(easy, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(req.body.size()));
+        }
+
+        if (req.method != "GET" && req.method != "POST") {
+            curl_easy_setopt(easy, CURLOPT_CUSTOMREQUEST, req.method.c_str());
+        }
+
+        for (const auto& header : req.headers) {
+            transfer->headers = curl_slist_append(transfer->headers, header.c_str());
+        }
+        if (transfer->headers) {
+            curl_easy_setopt(easy, CURLOPT_HTTPHEADER, transfer->headers);
+        }
+
+        curl_multi_add_handle(m_multi, easy);
+        m_active.push_back(easy);
+    }
+}
+
+void TransferEngine::completeFinished()
+{
+    int remaining = 0;
+    while (CURLMsg* msg = curl_multi_info_read(m_multi, &remaining)) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        CURL* easy = msg->easy_handle;
+        Transfer* transfer = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &transfer);
+
+        Result result;
+        result.code = msg->data.result;
+        curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &result.httpStatus);
+        curl_easy_getinfo(easy, CURLINFO_SIZE_UPLOAD_T, &result.bytesSent);
+        result.seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - transfer->started).count();
+        if (result.code != CURLE_OK) {
+            result.error = transfer->error[0] ? transfer->error : curl_easy_strerror(result.code);
+        }
+        result.body = std::move(transfer->response);
+
+        curl_multi_remove_handle(m_multi, easy);
+        m_active.erase(std::find(m_active.begin(), m_active.end(), easy));
+        m_idleHandles.push_back(easy);
+
+        recordResponse(result.code == CURLE_OK ? result.httpStatus : 0, static_cast<uint64_t>(result.bytesSent),
+                       std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::duration<double>(result.seconds)));
+        ++m_completed;
+        m_totalSeconds += result.seconds;
+        m_totalBytes += result.bytesSent;
+        LOG_INFO("{} {} -> HTTP {} in {} ms (avg {} ms over {} requests, {} bytes sent)",
+                 transfer->request.method, transfer->request.url, result.httpStatus, result.seconds * 1000.0,
+                 m_totalSeconds * 1000.0 / m_completed, m_completed, m_totalBytes);
+
+        finish(transfer->request, result);
+        delete transfer;
+    }
+}
+
+std::string TransferEngine::encodeSegment(const std::string& in)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : in) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            out.push_back(static_cast<char>(c));
+        } else {
+            out.push_back('%');
+            out.push_back(hex[c >> 4]);
+            out.push_back(hex[c & 0xf]);
+        }
+    }
+    return out;
+}
+
+void TransferEngine::recordResponse(long httpStatus, uint64_t bytesSent, std::chrono::nanoseconds duration)
+{
+    // Looked up once; responses are counted by status class to keep the label set small
+    struct Metrics {
+        MetricCounter* responses[6];
+        MetricCounter& bytes;
+        LatencyHistogram& latency;
+
+        Metrics()
+            : bytes(MetricsRegistry::getInstance().counter(
+                  "filesserver_bytes_sent_total", "Request body bytes uploaded")),
+              latency(MetricsRegistry::getInstance().histogram(
+                  "filesserver_http_request_seconds", "Duration of HTTP requests"))
+        {
+            static const char* const labels[6] = {"code=\"error\"", "code=\"1xx\"", "code=\"2xx\"",
+                                                  "code=\"3xx\"", "code=\"4xx\"", "code=\"5xx\""};
+            for (int i = 0; i < 6; ++i) {
+                responses[i] = &MetricsRegistry::getInstance().counter(
+                    "filesserver_http_responses_total", "HTTP responses by status class, error if none", labels[i]);
+            }
+        }
+    };
+    static Metrics metrics;
+
+    long statusClass = httpStatus / 100;
+    metrics.responses[statusClass >= 1 && statusClass <= 5 ? statusClass : 0]->inc();
+    metrics.bytes.inc(bytesSent);
+    metrics.latency.record(duration);
+}
@@ -0,0 +1,223 @@
+/**
+ * @file transferEngine.h
+ * @brief Asynchronous HTTP transfer engine built on the libcurl multi interface.
+ */
+#ifndef TRANSFER_ENGINE_H
+#define TRANSFER_ENGINE_H
+
+#include <curl/curl.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "../utilities/Reactor.h"
+
+/**
+ * @class TransferEngine
+ * @brief Runs many HTTP transfers concurrently on a single event loop thread.
+ *
+ * Requests are queued with submit() from any thread and driven by one
+ * curl_multi handle. Connections are kept alive in the multi handle's
+ * connection cache and easy handles are recycled, so consecutive requests to
+ * the same server reuse an established TCP/TLS connection instead of paying a
+ * new handshake. At most maxInFlight transfers run at the same time; the rest
+ * wait in FIFO order.
+ *
+ * Every submitted request gets exactly one onDone call. Stop() lets the
+ * running transfers finish for a while, then fails whatever is left.
+ *
+ * The transfer sockets and a timerfd for libcurl's timeouts are registered on
+ * a Reactor owned by the engine (curl_multi_socket_action), so the loop
+ * sleeps in epoll until a socket is ready or a timeout is due, with no
+ * polling interval. The engine has its own reactor rather than the shared
+ * one: handlers on the shared loop may wait for room in a bounded event
+ * queue, and the completions that make that room must not wait behind them.
+ */
+class TransferEngine
+{
+public:
+    /**
+     * @struct Result
+     * @brief Outcome of a finished transfer.
+     */
+    struct Result {
+        CURLcode    code = CURLE_OK;    ///< libcurl result code
+        long        httpStatus = 0;     ///< HTTP response status, 0 if none was received
+        double      seconds = 0.0;      ///< Time from submit() to completion
+        curl_off_t  bytesSent = 0;      ///< Request body bytes uploaded
+        std::string error;              ///< Error description when code != CURLE_OK
+        std::string body;               ///< Response body (truncated to 1 MiB)
+
+        /** @brief true if the transfer completed with a 2xx status */
+        bool ok() const { return code == CURLE_OK && httpStatus >= 200 && httpStatus < 300; }
+
+        /** @brief true if a failed transfer may succeed when sent again */
+        bool retryable() const { return code != CURLE_OK || retryableStatus(httpStatus); }
+    };
+
+    /**
+     * @brief true if a request may succeed when sent again after this response:
+     *        none (0), timeout, throttling or a server error
+     */
+    static bool retryableStatus(long httpStatus)
+    {
+        return httpStatus == 0 || httpStatus == 408 || httpStatus == 429 || httpStatus >= 500;
+    }
+
+    /**
+     * @struct Request
+     * @brief Description of one HTTP request.
+     */
+    struct Request {
+        std::string method = "GET";     ///< HTTP method
+        std::string url;                ///< Absolute request URL
+        std::string mimeFile;           ///< If set, sent as the "file" part of a multipart POST
+        std::string mimeFilename;       ///< Filename reported for the "file" part (mimeFile defaults to its basename)
+        std::shared_ptr<const std::string> mimeData; ///< If set (and no mimeFile), sent from memory as the "file" part named mimeFilename
+        std::string body;               ///< If set (and no mimeFile), sent as the raw request body
+        std::string bodyFile;           ///< If set, bodyLength bytes at bodyOffset of this file are the raw body
+        uint64_t    bodyOffset = 0;     ///< Start of the byte range sent from bodyFile
+        uint64_t    bodyLength = 0;     ///< Length of the byte range sent from bodyFile
+        std::function<long(char* buffer, size_t len)> bodySource; ///< If set (and no bodyFile), produces the raw body, sent chunked: returns bytes written, 0 at the end, -1 to abort
+        std::vector<std::string> headers; ///< Extra request headers ("Name: value")
+        std::function<void(const char* data, size_t len)> onBodyData; ///< If set, receives the response body as it arrives (Result::body stays empty)
+        std::function<void(const Result&)> onDone; ///< Completion callback, runs on the engine's reactor thread (or in Stop())
+    };
+
+    /**
+     * @brief Construct the engine and start its reactor.
+     * @param maxInFlight Maximum number of concurrent transfers.
+     */
+    explicit TransferEngine(size_t maxInFlight = 8);
+
+    /**
+     * @brief Destructor; calls Stop() without waiting.
+     */
+    ~TransferEngine();
+
+    /**
+     * @brief Wait for the pending requests, then stop the event loop and fail those still unfinished.
+     * @param drainTimeout Longest wait for the pending requests to finish.
+     * @note The failed requests get CURLE_ABORTED_BY_CALLBACK, on the calling thread; requests their
+     *       callbacks submit fail too. Must not be called from an onDone callback.
+     */
+    void Stop(std::chrono::milliseconds drainTimeout);
+
+    /**
+     * @brief Queue a request for execution.
+     * @param request Request to run; its onDone callback is invoked when it finishes.
+     * @note Once Stop() has begun, the request fails instead of running (in Stop() or the destructor).
+     */
+    void submit(Request request);
+
+    /**
+     * @brief Number of requests queued or running.
+     */
+    size_t pending() const { return m_pending.load(); }
+
+    /**
+     * @brief Account for a finished HTTP exchange in the process metrics.
+     * @param httpStatus Response status, 0 if no response was received.
+     * @param bytesSent Request body bytes uploaded.
+     * @param duration Time the request took.
+     * @note Thread-safe and lock-free; also used by transports that bypass the engine.
+     */
+    static void recordResponse(long httpStatus, uint64_t bytesSent, std::chrono::nanoseconds duration);
+
+    /**
+     * @brief Percent-encode a string as one URL path segment ('/' included).
+     */
+    static std::string encodeSegment(const std::string& in);
+
+    /**
+     * @brief The loop running the transfers, for timers that submit requests (e.g. UploadBatcher).
+     */
+    Reactor& reactor() { return m_reactor; }
+
+private:
+    struct Transfer;
+
+    /**
+     * @brief CURLMOPT_SOCKETFUNCTION: register, update or unregister a transfer socket on the reactor.
+     */
+    static int onSocketChange(CURL* easy, curl_socket_t socket, int what, void* userp, void* socketp);
+
+    /**
+     * @brief CURLMOPT_TIMERFUNCTION: arm the timerfd for libcurl's next timeout (-1 disarms it).
+     */
+    static int onTimerChange(CURLM* multi, long timeoutMs, void* userp);
+
+    /**
+     * @brief Let libcurl act on a ready socket (or on its timeout), then report and start transfers.
+     * @param socket Ready socket, or CURL_SOCKET_TIMEOUT.
+     * @param flags CURL_CSELECT_* flags of the socket.
+     */
+    void drive(curl_socket_t socket, int flags);
+
+    /**
+     * @brief Move queued requests into the multi handle up to the in-flight limit.
+     */
+    void startQueued();
+
+    /**
+     * @brief Collect finished transfers, report them and recycle their handles.
+     */
+    void completeFinished();
+
+    /**
+     * @brief Run a request's callback and count it as done, waking Stop() when none is left.
+     */
+    void finish(Request& request, const Result& result);
+
+    /**
+     * @brief Fail the running and queued requests until none is left (loop stopped).
+     */
+    void failUnfinished();
+
+    /**
+     * @brief Get an idle easy handle or create a new one.
+     */
+    CURL* acquireHandle();
+
+    /**
+     * @brief CURLOPT_READFUNCTION streaming a byte range of Request::bodyFile.
+     */
+    static size_t readFileRange(char* buffer, size_t size, size_t nitems, void* userdata);
+
+    /**
+     * @brief CURLOPT_READFUNCTION pulling the body from Request::bodySource.
+     */
+    static size_t readSource(char* buffer, size_t size, size_t nitems, void* userdata);
+
+    /**
+     * @brief CURLOPT_WRITEFUNCTION feeding Request::onBodyData or collecting the response body.
+     */
+    static size_t collectBody(char* data, size_t size, size_t nmemb, void* userdata);
+
+    Reactor                 m_reactor;          ///< Loop the sockets and m_timerFd are registered on
+    int                     m_timerFd;          ///< timerfd armed for libcurl's next timeout
+    std::atomic<bool>       m_startPosted;      ///< A startQueued() task is posted and has not run yet
+
+    CURLM*                  m_multi;            ///< Multi handle owning the connection cache
+    size_t                  m_maxInFlight;      ///< Concurrency limit
+    std::vector<CURL*>      m_active;           ///< Easy handles attached to m_multi (loop thread only)
+    std::vector<CURL*>      m_idleHandles;      ///< Easy handles available for reuse (loop thread only)
+
+    std::mutex              m_queueMutex;       ///< Protects m_queue and m_stopped
+    std::deque<Request>     m_queue;            ///< Requests waiting for a free slot
+    bool                    m_stopped;          ///< Stop() stopped the loop: queued requests never start
+    std::atomic<size_t>     m_pending;          ///< Requests queued or running, until their onDone returned
+    std::mutex              m_drainMutex;       ///< Pairs with m_drained
+    std::condition_variable m_drained;          ///< Signalled when m_pending drops to 0
+
+    uint64_t                m_completed;        ///< Finished transfers (loop thread only)
+    double                  m_totalSeconds;     ///< Sum of transfer latencies (loop thread only)
+    curl_off_t              m_totalBytes;       ///< Sum of uploaded bytes (loop thread only)
+};
+
+#endif // TRANSFER_ENGINE_H
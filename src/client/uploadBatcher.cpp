@@ -0,0 +1,154 @@
+#include "uploadBatcher.h"
+#include "../utilities/Logger.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+static void putU32(std::string& out, uint32_t value)
+{
+    char bytes[4];
+    for (int i = 0; i < 4; ++i) {
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    }
+    out.append(bytes, sizeof(bytes));
+}
+
+static void putU64(std::string& out, uint64_t value)
+{
+    char bytes[8];
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>(value >> (8 * i));
+    }
+    out.append(bytes, sizeof(bytes));
+}
+
+UploadBatcher::UploadBatcher(TransferEngine* engine, const std::string& serverUrl,
+                             size_t maxBatchBytes, std::chrono::milliseconds maxDelay)
+    : m_engine(engine),
+      m_serverUrl(serverUrl),
+      m_maxBatchBytes(maxBatchBytes),
+      m_maxDelay(std::max(std::chrono::milliseconds(1), maxDelay)),
+      m_timers(engine->reactor().timers()),
+      m_pendingBytes(0),
+      m_batch(0),
+      m_timer(0)
+{
+}
+
+UploadBatcher::~UploadBatcher()
+{
+    flush();
+}
+
+void UploadBatcher::add(const std::string& remoteName, std::shared_ptr<const std::string> content,
+                        std::function<void(bool ok, bool retryable)> onDone)
+{
+    std::vector<Entry> full;
+    TimerWheel::TimerId timer = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.empty()) {
+            uint64_t batch = m_batch;
+            m_timer = m_timers.schedule(m_maxDelay, [this, batch]() { onTimeout(batch); });
+        }
+        m_pendingBytes += content->size();
+        m_pending.push_back(Entry{remoteName, std::move(content), std::move(onDone)});
+        if (m_pendingBytes >= m_maxBatchBytes || m_pending.size() >= MAX_BATCH_FILES) {
+            full.swap(m_pending);
+            m_pendingBytes = 0;
+            ++m_batch;
+            std::swap(timer, m_timer);
+        }
+    }
+
+    // Outside the lock: cancel() waits for a running onTimeout(), which takes it
+    if (timer != 0) {
+        m_timers.cancel(timer);
+    }
+    if (!full.empty()) {
+        send(m_engine, m_serverUrl, std::move(full));
+    }
+}
+
+void UploadBatcher::flush()
+{
+    std::vector<Entry> batch;
+    TimerWheel::TimerId timer = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        batch.swap(m_pending);
+        m_pendingBytes = 0;
+        ++m_batch;
+        std::swap(timer, m_timer);
+    }
+    if (timer != 0) {
+        m_timers.cancel(timer);
+    }
+    if (!batch.empty()) {
+        send(m_engine, m_serverUrl, std::move(batch));
+    }
+}
+
+void UploadBatcher::onTimeout(uint64_t batch)
+{
+    std::vector<Entry> due;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (batch != m_batch) {
+            return;  // Sent meanwhile, its cancel() racing with this call
+        }
+        due.swap(m_pending);
+        m_pendingBytes = 0;
+        ++m_batch;
+        m_timer = 0;
+    }
+    if (!due.empty()) {
+        send(m_engine, m_serverUrl, std::move(due));
+    }
+}
+
+void UploadBatcher::send(TransferEngine* engine, const std::string& serverUrl, std::vector<Entry> batch)
+{
+    size_t total = 4 + 12;
+    for (const Entry& entry : batch) {
+        total += 12 + entry.name.size() + entry.content->size();
+    }
+
+    TransferEngine::Request request;
+    request.method = "POST";
+    request.url = serverUrl + "/api/files/batch";
+    request.headers = {"Content-Type: application/octet-stream", "Expect:"};
+    request.body.reserve(total);
+    request.body.append("FSB1", 4);
+    for (const Entry& entry : batch) {
+        putU32(request.body, static_cast<uint32_t>(entry.name.size()));
+        putU64(request.body, entry.content->size());
+        request.body.append(entry.name);
+        request.body.append(*entry.content);
+    }
+    putU32(request.body, 0);
+    putU64(request.body, 0);
+
+    auto entries = std::make_shared<std::vector<Entry>>(std::move(batch));
+    request.onDone = [engine, serverUrl, entries](const TransferEngine::Result& result) {
+        // Rejected: resend in halves, so only the files the server refuses end up failed
+        if (!result.ok() && !result.retryable() && entries->size() > 1) {
+            LOG_WARN("Batch of {} files rejected (HTTP {}), resending it in halves",
+                     entries->size(), result.httpStatus);
+            auto middle = entries->begin() + static_cast<std::ptrdiff_t>(entries->size() / 2);
+            std::vector<Entry> first(std::make_move_iterator(entries->begin()), std::make_move_iterator(middle));
+            std::vector<Entry> second(std::make_move_iterator(middle), std::make_move_iterator(entries->end()));
+            send(engine, serverUrl, std::move(first));
+            send(engine, serverUrl, std::move(second));
+            return;
+        }
+        if (!result.ok()) {
+            LOG_ERROR("Failed to send batch of {} files (HTTP {}) {}",
+                      entries->size(), result.httpStatus, result.error);
+        }
+        for (Entry& entry : *entries) {
+            entry.onDone(result.ok(), result.retryable());
+        }
+    };
+    engine->submit(std::move(request));
+}
@@ -0,0 +1,117 @@
+/**
+ * @file uploadBatcher.h
+ * @brief Uploads of many small files grouped into one request.
+ */
+#ifndef UPLOAD_BATCHER_H
+#define UPLOAD_BATCHER_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "transferEngine.h"
+#include "../utilities/TimerWheel.h"
+
+/**
+ * @class UploadBatcher
+ * @brief Collects small files in memory and sends them as one POST per batch.
+ *
+ * A batch is sent once it holds maxBatchBytes of content or MAX_BATCH_FILES
+ * files, or when its oldest file has waited maxDelay, so a burst of tiny files
+ * costs one round trip per batch instead of one per file, and a lone file is
+ * delayed by at most maxDelay. The delay is a one-shot TimerWheel timer armed
+ * when a batch gets its first file, so nothing ticks while no batch is open.
+ *
+ * Wire format (all integers little-endian), sent as
+ * application/octet-stream to POST /api/files/batch:
+ * @code
+ *   "FSB1"
+ *   per file:   u32 nameLength, u64 size, name bytes, size content bytes
+ *   terminator: u32 0, u64 0
+ * @endcode
+ * The server stores every file of a batch or none of them. A batch it rejects
+ * (a failure that retrying cannot fix, e.g. 400 for one bad name) is sent
+ * again in halves until the rejected files are alone, so one file never
+ * fails the others of its batch.
+ *
+ * @note add() and flush() may be called from any thread; the timers and the
+ *       completion callbacks run on the TransferEngine's reactor thread, so a
+ *       batch is sent even while the shared loop waits for queue room.
+ */
+class UploadBatcher
+{
+public:
+    /** Most files in one batch; the server rejects larger batches */
+    static const size_t MAX_BATCH_FILES = 1024;
+
+    /**
+     * @brief Construct a batcher.
+     * @param engine Engine running the HTTP requests (not owned).
+     * @param serverUrl Base URL of the REST server.
+     * @param maxBatchBytes Content bytes that trigger sending a batch.
+     * @param maxDelay Longest time a file waits for its batch to fill.
+     */
+    UploadBatcher(TransferEngine* engine, const std::string& serverUrl,
+                  size_t maxBatchBytes, std::chrono::milliseconds maxDelay);
+
+    /**
+     * @brief Cancel the timer and send what is still pending.
+     */
+    ~UploadBatcher();
+
+    /**
+     * @brief Add a file to the current batch.
+     * @param remoteName Filename used on the server.
+     * @param content File content.
+     * @param onDone Called with true once the server stored the batch, false on failure,
+     *               and whether sending the file again may succeed.
+     */
+    void add(const std::string& remoteName, std::shared_ptr<const std::string> content,
+             std::function<void(bool ok, bool retryable)> onDone);
+
+    /**
+     * @brief Send the current batch now, if any.
+     */
+    void flush();
+
+private:
+    /**
+     * @struct Entry
+     * @brief One file of a batch.
+     */
+    struct Entry {
+        std::string                         name;       ///< Filename on the server
+        std::shared_ptr<const std::string>  content;    ///< File content
+        std::function<void(bool, bool)>     onDone;     ///< Completion callback
+    };
+
+    /**
+     * @brief Encode and submit a batch.
+     * @note Static: halves of a rejected batch are sent from its completion, which may run after the
+     *       batcher is gone (the engine outlives it).
+     */
+    static void send(TransferEngine* engine, const std::string& serverUrl, std::vector<Entry> batch);
+
+    /**
+     * @brief Timer callback: send the batch it was armed for, if still pending.
+     * @param batch Sequence number of that batch.
+     */
+    void onTimeout(uint64_t batch);
+
+    TransferEngine*                         m_engine;       ///< Engine running the requests (not owned)
+    std::string                             m_serverUrl;    ///< Base URL of the REST server
+    size_t                                  m_maxBatchBytes;///< Content bytes that trigger a send
+    std::chrono::milliseconds               m_maxDelay;     ///< Longest wait of a file
+    TimerWheel&                             m_timers;       ///< Timers of the engine's reactor
+
+    std::mutex                              m_mutex;        ///< Protects the members below
+    std::vector<Entry>                      m_pending;      ///< Files of the current batch
+    size_t                                  m_pendingBytes; ///< Content bytes of the current batch
+    uint64_t                                m_batch;        ///< Sequence number of the current batch
+    TimerWheel::TimerId                     m_timer;        ///< Delay timer of the current batch, 0 if none
+};
+
+#endif // UPLOAD_BATCHER_H
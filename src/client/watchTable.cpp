@@ -0,0 +1,156 @@
+#include "watchTable.h"
+
+void WatchTable::add(int wd, int parent_wd, const std::string& name)
+{
+    if (wd < 0) {
+        return;
+    }
+
+    if (static_cast<size_t>(wd) >= m_entries.size()) {
+        m_entries.resize(static_cast<size_t>(wd) + 1, Entry{-1, 0, 0, 0});
+    }
+
+    Entry& entry = m_entries[wd];
+    if (entry.used) {
+        // The kernel returns the existing descriptor when a directory is watched twice
+        m_deadBytes += entry.nameLen;
+        --m_count;
+    }
+
+    entry.parent = parent_wd;
+    entry.nameOffset = static_cast<uint32_t>(m_names.size());
+    entry.nameLen = static_cast<uint16_t>(name.size());
+    entry.used = 1;
+    m_names.append(name);
+    ++m_count;
+}
+
+void WatchTable::remove(int wd)
+{
+    if (!contains(wd)) {
+        return;
+    }
+
+    Entry& entry = m_entries[wd];
+    m_deadBytes += entry.nameLen;
+    entry.used = 0;
+    --m_count;
+
+    // Keep the arena from growing without bound under directory churn
+    if (m_deadBytes > 4096 && m_deadBytes * 2 > m_names.size()) {
+        compactNames();
+    }
+}
+
+bool WatchTable::contains(int wd) const
+{
+    return wd >= 0 && static_cast<size_t>(wd) < m_entries.size() && m_entries[wd].used;
+}
+
+bool WatchTable::resolve(int wd, std::string& out) const
+{
+    out.clear();
+
+    // Collect the chain up to the root, then emit it in reverse order
+    m_chain.clear();
+    int current = wd;
+    while (current != -1) {
+        if (!contains(current) || m_chain.size() > m_entries.size()) {
+            return false;
+        }
+        m_chain.push_back(current);
+        current = m_entries[current].parent;
+    }
+
+    for (auto it = m_chain.rbegin(); it != m_chain.rend(); ++it) {
+        const Entry& entry = m_entries[*it];
+        if (entry.nameLen == 0) {
+            continue;  // Root directory
+        }
+        out.append(m_names, entry.nameOffset, entry.nameLen);
+        out.push_back('/');
+    }
+
+    return true;
+}
+
+int WatchTable::find(int parent_wd, const std::string& name) const
+{
+    for (size_t wd = 0; wd < m_entries.size(); ++wd) {
+        const Entry& entry = m_entries[wd];
+        if (entry.used && entry.parent == parent_wd && entry.nameLen == name.size() &&
+            m_names.compare(entry.nameOffset, entry.nameLen, name) == 0) {
+            return static_cast<int>(wd);
+        }
+    }
+    return -1;
+}
+
+void WatchTable::subtree(int wd, std::vector<int>& out) const
+{
+    out.clear();
+    if (!contains(wd)) {
+        return;
+    }
+
+    // 1: at or below wd, 2: elsewhere; each entry is settled once, with the whole chain that led to it
+    std::vector<uint8_t> state(m_entries.size(), 0);
+    state[wd] = 1;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (!m_entries[i].used || state[i] != 0) {
+            continue;
+        }
+        m_chain.clear();
+        uint8_t found = 2;
+        int current = static_cast<int>(i);
+        while (current != -1 && contains(current) && m_chain.size() <= m_entries.size()) {
+            if (state[current] != 0) {
+                found = state[current];
+                break;
+            }
+            m_chain.push_back(current);
+            current = m_entries[current].parent;
+        }
+        for (int32_t settled : m_chain) {
+            state[settled] = found;
+        }
+    }
+
+    out.push_back(wd);
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        if (state[i] == 1 && static_cast<int>(i) != wd) {
+            out.push_back(static_cast<int>(i));
+        }
+    }
+}
+
+void WatchTable::clear()
+{
+    m_entries.clear();
+    m_names.clear();
+    m_deadBytes = 0;
+    m_count = 0;
+}
+
+size_t WatchTable::memoryUsage() const
+{
+    return m_entries.capacity() * sizeof(Entry) + m_names.capacity();
+}
+
+void WatchTable::compactNames()
+{
+    std::string names;
+    names.reserve(m_names.size() - m_deadBytes);
+
+    for (Entry& entry : m_entries) {
+        if (!entry.used) {
+            continue;
+        }
+        uint32_t offset = static_cast<uint32_t>(names.size());
+        names.append(m_names, entry.nameOffset, entry.nameLen);
+        entry.nameOffset = offset;
+    }
+
+    m_names.swap(names);
+    m_deadBytes = 0;
+}
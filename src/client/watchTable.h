@@ -0,0 +1,111 @@
+#ifndef WATCH_TABLE_H
+#define WATCH_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @class WatchTable
+ * @brief Compact mapping from inotify watch descriptors to directory paths
+ *
+ * Every watched directory is stored as a (parent, name) pair indexed directly by
+ * its watch descriptor, with all names packed into a single character arena.
+ * A full relative path is never stored per directory; it is rebuilt on demand by
+ * walking the parent chain into a caller-provided buffer, so the table costs a
+ * fixed 12 bytes plus the directory name for each watched directory.
+ *
+ * @note The table is not thread-safe; it is owned by the monitoring thread.
+ */
+class WatchTable
+{
+public:
+    /**
+     * @brief Register a watched directory
+     * @param wd Watch descriptor returned by inotify_add_watch
+     * @param parent_wd Watch descriptor of the parent directory, or -1 for the root
+     * @param name Directory name relative to its parent (empty for the root)
+     */
+    void add(int wd, int parent_wd, const std::string& name);
+
+    /**
+     * @brief Forget a watch descriptor (e.g. after IN_IGNORED)
+     * @param wd Watch descriptor to remove
+     */
+    void remove(int wd);
+
+    /**
+     * @brief Check whether a watch descriptor is registered
+     * @param wd Watch descriptor to look up
+     * @return true if the descriptor belongs to a watched directory
+     */
+    bool contains(int wd) const;
+
+    /**
+     * @brief Build the path of a watched directory relative to the root
+     * @param wd Watch descriptor to resolve
+     * @param out Buffer receiving the path; empty for the root, otherwise
+     *            terminated with '/' so a file name can be appended directly
+     * @return false if the descriptor is unknown
+     */
+    bool resolve(int wd, std::string& out) const;
+
+    /**
+     * @brief Find a watched directory by its parent and name
+     * @param parent_wd Watch descriptor of the parent directory
+     * @param name Directory name relative to its parent
+     * @return Its watch descriptor, or -1 if not registered
+     * @note Scans the whole table; meant for rare events such as a directory moved away
+     */
+    int find(int parent_wd, const std::string& name) const;
+
+    /**
+     * @brief Collect a watched directory and every watched directory below it
+     * @param wd Watch descriptor of the top directory
+     * @param out Receives the descriptors, wd first; empty if wd is unknown
+     * @note Scans the whole table once
+     */
+    void subtree(int wd, std::vector<int>& out) const;
+
+    /**
+     * @brief Remove every entry
+     */
+    void clear();
+
+    /**
+     * @brief Number of directories currently registered
+     */
+    size_t size() const { return m_count; }
+
+    /**
+     * @brief Approximate heap memory held by the table, in bytes
+     */
+    size_t memoryUsage() const;
+
+private:
+    /**
+     * @struct Entry
+     * @brief Per-directory record, 12 bytes
+     */
+    struct Entry {
+        int32_t  parent;       ///< Parent watch descriptor, -1 for the root
+        uint32_t nameOffset;   ///< Offset of the name in m_names
+        uint16_t nameLen;      ///< Length of the name
+        uint16_t used;         ///< Non-zero if the slot holds a live entry
+    };
+
+    /**
+     * @brief Rebuild the name arena dropping names of removed entries
+     */
+    void compactNames();
+
+    std::vector<Entry> m_entries;        ///< Entries indexed by watch descriptor
+    std::string        m_names;          ///< Packed directory names
+    size_t             m_deadBytes = 0;  ///< Arena bytes belonging to removed entries
+    size_t             m_count = 0;      ///< Number of live entries
+
+    mutable std::vector<int32_t> m_chain; ///< Scratch buffer used by resolve()
+};
+
+#endif /* WATCH_TABLE_H */
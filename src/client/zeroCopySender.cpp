@@ -0,0 +1,404 @@
+#include "zeroCopySender.h"
+#include "../utilities/Logger.h"
+#include "transferEngine.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <csignal>
+#include <fcntl.h>
+#include <future>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Largest amount handed to one sendfile/splice call
+const size_t SEND_STEP = 1 << 30;
+
+// Socket send/receive timeout
+const int IO_TIMEOUT_SECONDS = 30;
+
+bool sendAll(int sock, const char* data, size_t len, int flags)
+{
+    while (len > 0) {
+        ssize_t n = ::send(sock, data, len, flags | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+double threadCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+} // namespace
+
+ZeroCopySender::ZeroCopySender(const std::string& serverUrl)
+    : m_socket(-1),
+      m_reused(false),
+      m_stopping(false),
+      itsWorker(nullptr)
+{
+    const std::string scheme = "http://";
+    if (serverUrl.compare(0, scheme.size(), scheme) != 0) {
+        throw std::invalid_argument("Zero-copy uploads need an http:// server URL: " + serverUrl);
+    }
+
+    std::string rest = serverUrl.substr(scheme.size());
+    size_t slash = rest.find('/');
+    m_hostHeader = rest.substr(0, slash);
+    m_basePath = (slash == std::string::npos) ? "" : rest.substr(slash);
+    while (!m_basePath.empty() && m_basePath.back() == '/') {
+        m_basePath.pop_back();
+    }
+
+    size_t colon = m_hostHeader.rfind(':');
+    if (colon != std::string::npos && m_hostHeader.find(']', colon) == std::string::npos) {
+        m_host = m_hostHeader.substr(0, colon);
+        m_port = m_hostHeader.substr(colon + 1);
+    } else {
+        m_host = m_hostHeader;
+        m_port = "80";
+    }
+    if (m_host.size() > 2 && m_host.front() == '[' && m_host.back() == ']') {
+        m_host = m_host.substr(1, m_host.size() - 2);
+    }
+    if (m_host.empty()) {
+        throw std::invalid_argument("Missing host in server URL: " + serverUrl);
+    }
+
+    itsWorker = new QueueThread();
+
+    // A peer closing the connection mid-sendfile must fail the call, not kill the process
+    itsWorker->put([]() {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+    });
+}
+
+ZeroCopySender::~ZeroCopySender()
+{
+    if (itsWorker)
+    {
+        // The upload running finishes; those queued behind it fail, so their callers can retry them later
+        m_stopping = true;
+        std::promise<void> drained;
+        itsWorker->put([&drained]() { drained.set_value(); });
+        drained.get_future().wait();
+
+        delete itsWorker;
+        itsWorker = nullptr;
+    }
+    closeSocket();
+}
+
+void ZeroCopySender::upload(const std::string& localFilePath, const std::string& remoteName,
+                            std::function<void(bool ok, bool retryable)> onDone)
+{
+    itsWorker->put([this, localFilePath, remoteName, onDone]() {
+        int status = 0;
+        bool ok = !m_stopping && send(localFilePath, remoteName, status);
+        if (onDone) {
+            onDone(ok, TransferEngine::retryableStatus(status));
+        }
+    });
+}
+
+bool ZeroCopySender::send(const std::string& localFilePath, const std::string& remoteName, int& status)
+{
+    int fd = open(localFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        LOG_ERROR("Failed to open {}: {}", localFilePath, strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        LOG_ERROR("Failed to stat {}: {}", localFilePath, strerror(errno));
+        close(fd);
+        return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+
+    auto started = std::chrono::steady_clock::now();
+    double cpuStarted = threadCpuSeconds();
+
+    bool retry = false;
+    bool ok = sendOnce(fd, size, remoteName, retry, status);
+    if (!ok && retry) {
+        // The server closed the idle keep-alive connection: one fresh attempt
+        ok = sendOnce(fd, size, remoteName, retry, status);
+    }
+    close(fd);
+
+    if (ok) {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        double cpu = threadCpuSeconds() - cpuStarted;
+        LOG_INFO("Zero-copy upload of {}: {} bytes in {} ms ({} MB/s, {} ms CPU, {} s CPU per GB)",
+                 localFilePath, size, seconds * 1000.0, (seconds > 0 ? size / seconds / 1e6 : 0.0),
+                 cpu * 1000.0, (size > 0 ? cpu * 1e9 / size : 0.0));
+    }
+    return ok;
+}
+
+bool ZeroCopySender::sendOnce(int fd, uint64_t size, const std::string& remoteName, bool& retry, int& status)
+{
+    retry = false;
+    status = 0;
+    if (!connectSocket()) {
+        TransferEngine::recordResponse(0, 0, std::chrono::nanoseconds(0));
+        return false;
+    }
+    auto started = std::chrono::steady_clock::now();
+    const bool reused = m_reused;
+    m_reused = true;
+
+    std::string head = "PUT " + m_basePath + "/api/files/raw/" + TransferEngine::encodeSegment(remoteName) + " HTTP/1.1\r\n"
+                       "Host: " + m_hostHeader + "\r\n"
+                       "Content-Type: application/octet-stream\r\n"
+                       "Content-Length: " + std::to_string(size) + "\r\n"
+                       "Connection: keep-alive\r\n\r\n";
+
+    // MSG_MORE lets the headers share a segment with the first body pages
+    if (!sendAll(m_socket, head.data(), head.size(), size > 0 ? MSG_MORE : 0)) {
+        retry = reused;
+        if (!retry) {
+            LOG_ERROR("Failed to send request headers: {}", strerror(errno));
+            TransferEngine::recordResponse(0, 0, std::chrono::steady_clock::now() - started);
+        }
+        closeSocket();
+        return false;
+    }
+
+    if (!sendBody(fd, size)) {
+        retry = reused && (errno == EPIPE || errno == ECONNRESET);
+        if (!retry) {
+            LOG_ERROR("Failed to send {}: {}", remoteName, strerror(errno));
+            TransferEngine::recordResponse(0, 0, std::chrono::steady_clock::now() - started);
+        }
+        closeSocket();
+        return false;
+    }
+
+    bool keepAlive = true;
+    status = readResponse(keepAlive);
+    // A stale keep-alive connection is retried, not counted
+    if (status != 0 || !reused) {
+        TransferEngine::recordResponse(status, status != 0 ? size : 0, std::chrono::steady_clock::now() - started);
+    }
+    if (status == 0) {
+        retry = reused;
+        closeSocket();
+        if (!retry) {
+            LOG_WARN("No response to upload of {}", remoteName);
+        }
+        return false;
+    }
+    if (!keepAlive) {
+        closeSocket();
+    }
+    if (status < 200 || status >= 300) {
+        LOG_ERROR("Upload of {} failed with HTTP {}", remoteName, status);
+        return false;
+    }
+    return true;
+}
+
+bool ZeroCopySender::sendBody(int fd, uint64_t size)
+{
+    off_t offset = 0;
+
+    // Page cache -> socket inside the kernel
+    while (static_cast<uint64_t>(offset) < size) {
+        size_t step = static_cast<size_t>(std::min<uint64_t>(size - offset, SEND_STEP));
+        ssize_t n = sendfile(m_socket, fd, &offset, step);
+        if (n > 0) {
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            errno = EIO;  // File shrank while sending
+            return false;
+        }
+        if (errno != EINVAL && errno != ENOSYS) {
+            return false;
+        }
+        break;  // Not supported for this file: fall back below
+    }
+    if (static_cast<uint64_t>(offset) == size) {
+        return true;
+    }
+
+    // Through a pipe with splice, still without user-space copies
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == 0) {
+        bool spliceOk = true;
+        while (spliceOk && static_cast<uint64_t>(offset) < size) {
+            size_t step = static_cast<size_t>(std::min<uint64_t>(size - offset, SEND_STEP));
+            ssize_t in = splice(fd, &offset, pipefd[1], nullptr, step, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (in <= 0) {
+                spliceOk = false;
+                break;
+            }
+            while (in > 0) {
+                ssize_t out = splice(pipefd[0], nullptr, m_socket, nullptr, static_cast<size_t>(in),
+                                     SPLICE_F_MOVE | SPLICE_F_MORE);
+                if (out <= 0) {
+                    close(pipefd[0]);
+                    close(pipefd[1]);
+                    return false;  // Data is stuck in the pipe: the request is lost
+                }
+                in -= out;
+            }
+        }
+        close(pipefd[0]);
+        close(pipefd[1]);
+        if (spliceOk) {
+            return true;
+        }
+    }
+
+    // Plain read/write as the last resort
+    std::vector<char> buffer(1 << 20);
+    while (static_cast<uint64_t>(offset) < size) {
+        ssize_t n = pread(fd, buffer.data(), std::min<uint64_t>(buffer.size(), size - offset), offset);
+        if (n <= 0) {
+            errno = (n == 0) ? EIO : errno;
+            return false;
+        }
+        if (!sendAll(m_socket, buffer.data(), static_cast<size_t>(n), 0)) {
+            return false;
+        }
+        offset += n;
+    }
+    return true;
+}
+
+int ZeroCopySender::readResponse(bool& keepAlive)
+{
+    std::string response;
+    size_t headerEnd;
+    char buffer[4096];
+    while ((headerEnd = response.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(m_socket, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        response.append(buffer, static_cast<size_t>(n));
+        if (response.size() > 64 * 1024) {
+            return 0;
+        }
+    }
+
+    int status = 0;
+    if (sscanf(response.c_str(), "HTTP/%*d.%*d %d", &status) != 1) {
+        return 0;
+    }
+
+    // Headers are case-insensitive
+    std::string headers = response.substr(0, headerEnd);
+    std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+    keepAlive = headers.find("\r\nconnection: close") == std::string::npos;
+
+    size_t contentLength = 0;
+    size_t pos = headers.find("\r\ncontent-length:");
+    if (pos != std::string::npos) {
+        contentLength = std::stoul(headers.substr(pos + 17));
+    } else if (headers.find("\r\ntransfer-encoding:") != std::string::npos) {
+        keepAlive = false;  // Body length unknown without decoding chunks
+        return status;
+    }
+
+    // Drain the body so the connection is ready for the next request
+    size_t have = response.size() - (headerEnd + 4);
+    while (have < contentLength) {
+        ssize_t n = recv(m_socket, buffer, std::min(sizeof(buffer), contentLength - have), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            keepAlive = false;
+            break;
+        }
+        have += static_cast<size_t>(n);
+    }
+    return status;
+}
+
+bool ZeroCopySender::connectSocket()
+{
+    if (m_socket != -1) {
+        return true;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    int rc = getaddrinfo(m_host.c_str(), m_port.c_str(), &hints, &result);
+    if (rc != 0) {
+        LOG_ERROR("Failed to resolve {}: {}", m_host, gai_strerror(rc));
+        return false;
+    }
+
+    for (struct addrinfo* ai = result; ai; ai = ai->ai_next) {
+        int sock = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if (sock == -1) {
+            continue;
+        }
+        struct timeval timeout = {IO_TIMEOUT_SECONDS, 0};
+        setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            int one = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            m_socket = sock;
+            m_reused = false;
+            break;
+        }
+        close(sock);
+    }
+    freeaddrinfo(result);
+
+    if (m_socket == -1) {
+        LOG_ERROR("Failed to connect to {}: {}", m_hostHeader, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void ZeroCopySender::closeSocket()
+{
+    if (m_socket != -1) {
+        close(m_socket);
+        m_socket = -1;
+    }
+}
@@ -0,0 +1,101 @@
+/**
+ * @file zeroCopySender.h
+ * @brief Raw HTTP uploads that move file data to the socket with sendfile(2).
+ */
+#ifndef ZERO_COPY_SENDER_H
+#define ZERO_COPY_SENDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include "../utilities/QueueThread.h"
+
+/**
+ * @class ZeroCopySender
+ * @brief Uploads whole files as raw PUT bodies without copying them through user space.
+ *
+ * libcurl reads request bodies into its own buffers before writing them to
+ * the socket, so every byte is copied at least twice in user space. For plain
+ * HTTP to a local or LAN server this class writes the request headers itself
+ * and hands the body to the kernel with sendfile(2), which moves page-cache
+ * pages straight into the socket. If sendfile is not supported for a file it
+ * falls back to splice(2) through a pipe, and finally to read/write.
+ *
+ * Uploads run one at a time on a dedicated worker thread over a single
+ * keep-alive connection that is re-established on error. Each upload logs its
+ * throughput and the CPU time it cost the worker thread.
+ *
+ * Request: PUT <serverUrl>/api/files/raw/<remoteName> with the file as body.
+ *
+ * @note Only http:// URLs are supported; TLS needs the data in user space.
+ */
+class ZeroCopySender
+{
+public:
+    /**
+     * @brief Construct a sender.
+     * @param serverUrl Base URL of the REST server ("http://host[:port]").
+     * @throw std::invalid_argument if the URL is not a plain http URL.
+     */
+    explicit ZeroCopySender(const std::string& serverUrl);
+
+    /**
+     * @brief Finish the running upload, fail the queued ones (retryable) and close the connection.
+     */
+    ~ZeroCopySender();
+
+    /**
+     * @brief Queue an upload.
+     * @param localFilePath Path of the file on disk.
+     * @param remoteName Filename used on the server.
+     * @param onDone Called on the worker thread with true if the server stored the file,
+     *               and whether uploading it again may succeed.
+     */
+    void upload(const std::string& localFilePath, const std::string& remoteName,
+                std::function<void(bool ok, bool retryable)> onDone);
+
+private:
+    /**
+     * @brief Run one upload, reconnecting once if a kept-alive connection went stale.
+     */
+    bool send(const std::string& localFilePath, const std::string& remoteName, int& status);
+
+    /**
+     * @brief Send the request and read the response on the current connection.
+     * @param retry Set to true if a reused connection failed before any response arrived.
+     * @param status Set to the HTTP status of the response, 0 if none arrived.
+     */
+    bool sendOnce(int fd, uint64_t size, const std::string& remoteName, bool& retry, int& status);
+
+    /**
+     * @brief Move size bytes of fd to the socket with sendfile, splice or read/write.
+     */
+    bool sendBody(int fd, uint64_t size);
+
+    /**
+     * @brief Read the response headers and body; returns the HTTP status or 0.
+     */
+    int readResponse(bool& keepAlive);
+
+    /**
+     * @brief Open the connection to the server if it is not open.
+     */
+    bool connectSocket();
+
+    /**
+     * @brief Close the connection.
+     */
+    void closeSocket();
+
+    std::string     m_host;         ///< Server host name or address
+    std::string     m_port;         ///< Server port
+    std::string     m_hostHeader;   ///< Value of the Host header
+    std::string     m_basePath;     ///< Path prefix from the server URL
+    int             m_socket;       ///< Keep-alive connection, -1 if closed (worker thread only)
+    bool            m_reused;       ///< true once m_socket carried a request (worker thread only)
+    std::atomic<bool> m_stopping;   ///< Set by the destructor: queued uploads fail without being sent
+    QueueThread*    itsWorker;      ///< Thread running the uploads
+};
+
+#endif // ZERO_COPY_SENDER_H
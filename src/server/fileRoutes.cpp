@@ -0,0 +1,1117 @@
+#include "fileRoutes.h"
+#include "multipartParser.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Largest JSON body accepted by the commit route
+const size_t MAX_JSON_BODY = 64 * 1024;
+
+// Longest stored file name, directories included
+const size_t MAX_NAME = 4096;
+
+// Limits of the batch route
+const size_t MAX_BATCH_FILES = 4096;
+
+// Delta operations (format in the client's deltaSync.h)
+const uint8_t DELTA_END  = 0;
+const uint8_t DELTA_COPY = 1;
+const uint8_t DELTA_DATA = 2;
+
+std::string jsonEscape(const std::string& in)
+{
+    std::string out;
+    for (unsigned char c : in) {
+        if (c == '"' || c == '\\') {
+            out.push_back('\\');
+            out.push_back(static_cast<char>(c));
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out.push_back(static_cast<char>(c));
+        }
+    }
+    return out;
+}
+
+void reply(HttpResponse& response, int status, const std::string& message)
+{
+    response.status = status;
+    response.body = "{\"message\":\"" + jsonEscape(message) + "\"}";
+}
+
+std::string percentDecode(const std::string& in)
+{
+    std::string out;
+    for (size_t i = 0; i < in.size(); ++i) {
+        if (in[i] == '%' && i + 2 < in.size() && isxdigit(static_cast<unsigned char>(in[i + 1])) &&
+            isxdigit(static_cast<unsigned char>(in[i + 2]))) {
+            out.push_back(static_cast<char>(std::stoi(in.substr(i + 1, 2), nullptr, 16)));
+            i += 2;
+        } else {
+            out.push_back(in[i]);
+        }
+    }
+    return out;
+}
+
+// Stored file names: relative paths without empty, hidden, "." or ".." components (temporary files are hidden)
+bool validName(const std::string& name)
+{
+    if (name.empty() || name.size() > MAX_NAME || name.find('\0') != std::string::npos) {
+        return false;
+    }
+    for (size_t start = 0;;) {
+        size_t end = std::min(name.find('/', start), name.size());
+        if (end == start || name[start] == '.') {
+            return false;
+        }
+        if (end == name.size()) {
+            return true;
+        }
+        start = end + 1;
+    }
+}
+
+// Create the directories of a valid name under root; an existing one must be a real directory, not a symlink
+bool makeParents(const std::string& root, const std::string& name)
+{
+    for (size_t end = name.find('/'); end != std::string::npos; end = name.find('/', end + 1)) {
+        std::string dir = root + "/" + name.substr(0, end);
+        struct stat st;
+        if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+            return false;
+        }
+        if (lstat(dir.c_str(), &st) == -1) {
+            return false;
+        }
+        if (!S_ISDIR(st.st_mode)) {
+            errno = ENOTDIR;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Remove the directories of a name under root that became empty
+void removeEmptyParents(const std::string& root, const std::string& name)
+{
+    for (size_t end = name.rfind('/'); end != std::string::npos && end > 0; end = name.rfind('/', end - 1)) {
+        if (rmdir((root + "/" + name.substr(0, end)).c_str()) == -1) {
+            return;
+        }
+    }
+}
+
+// Append "<size>\t<path>\n" for every regular file below an open directory; takes ownership of dirFd
+void listTree(int dirFd, const std::string& prefix, std::string& out)
+{
+    DIR* dir = fdopendir(dirFd);
+    if (!dir) {
+        close(dirFd);
+        return;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        struct stat st;
+        // Hidden entries are temporary files and unfinished chunks
+        if (entry->d_name[0] == '.' || strchr(entry->d_name, '\n') ||
+            fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            int sub = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (sub != -1) {
+                listTree(sub, prefix + entry->d_name + "/", out);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            out += std::to_string(st.st_size);
+            out += '\t';
+            out += prefix;
+            out += entry->d_name;
+            out += '\n';
+        }
+    }
+    closedir(dir);
+}
+
+bool validUploadId(const std::string& id)
+{
+    return !id.empty() && id.size() <= 128 &&
+           std::all_of(id.begin(), id.end(), [](unsigned char c) { return isalnum(c) || c == '-' || c == '_'; });
+}
+
+bool isIndex(const std::string& s)
+{
+    return !s.empty() && s.size() <= 18 && std::all_of(s.begin(), s.end(), ::isdigit);
+}
+
+// Naive lookup of a top-level "key": value in a small JSON object
+bool jsonValue(const std::string& body, const std::string& key, std::string& out)
+{
+    size_t pos = body.find("\"" + key + "\"");
+    if (pos == std::string::npos || (pos = body.find(':', pos)) == std::string::npos) {
+        return false;
+    }
+    pos = body.find_first_not_of(" \t\r\n", pos + 1);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    out.clear();
+    if (body[pos] == '"') {
+        for (++pos; pos < body.size() && body[pos] != '"'; ++pos) {
+            if (body[pos] == '\\' && pos + 1 < body.size()) {
+                ++pos;
+            }
+            out.push_back(body[pos]);
+        }
+        return pos < body.size();
+    }
+    while (pos < body.size() && (isdigit(static_cast<unsigned char>(body[pos])) || body[pos] == '-')) {
+        out.push_back(body[pos++]);
+    }
+    return !out.empty();
+}
+
+// Unique hidden name for a temporary file in dir
+std::string tempName(const std::string& dir)
+{
+    static std::atomic<uint64_t> counter(0);
+    return dir + "/.upload-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+}
+
+/**
+ * @brief Streams data into a hidden temporary file that is renamed into place on commit.
+ */
+class FileSink
+{
+public:
+    ~FileSink()
+    {
+        if (m_fd != -1) {
+            close(m_fd);
+        }
+        if (!m_tmpPath.empty()) {
+            unlink(m_tmpPath.c_str());
+        }
+    }
+
+    bool open(const std::string& dir)
+    {
+        m_tmpPath = tempName(dir);
+        m_fd = ::open(m_tmpPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (m_fd == -1) {
+            m_tmpPath.clear();
+        }
+        return m_fd != -1;
+    }
+
+    /** @brief Close the file before commit(); it stays hidden until then */
+    bool finish()
+    {
+        bool ok = close(m_fd) == 0;
+        m_fd = -1;
+        return ok;
+    }
+
+    bool write(const char* data, size_t len)
+    {
+        while (len > 0) {
+            ssize_t n = ::write(m_fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            data += n;
+            len -= static_cast<size_t>(n);
+            m_size += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    /** @brief Append a whole file with copy_file_range (no user-space copy) */
+    bool append(const std::string& path)
+    {
+        int in = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in == -1) {
+            return false;
+        }
+        bool ok = true;
+        for (;;) {
+            ssize_t n = copy_file_range(in, nullptr, m_fd, nullptr, 1 << 30, 0);
+            if (n > 0) {
+                m_size += static_cast<uint64_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = (n == 0);
+            break;
+        }
+        close(in);
+        return ok;
+    }
+
+    /** @brief Append a byte range of an open file with copy_file_range */
+    bool appendRange(int in, uint64_t offset, uint64_t length)
+    {
+        loff_t from = static_cast<loff_t>(offset);
+        while (length > 0) {
+            ssize_t n = copy_file_range(in, &from, m_fd, nullptr, std::min<uint64_t>(length, 1 << 30), 0);
+            if (n > 0) {
+                m_size += static_cast<uint64_t>(n);
+                length -= static_cast<uint64_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n == 0) {
+                errno = ENODATA;  // The range ends past the end of the file
+            }
+            return false;
+        }
+        return true;
+    }
+
+    bool commit(const std::string& target)
+    {
+        bool ok = (m_fd == -1 || close(m_fd) == 0) && rename(m_tmpPath.c_str(), target.c_str()) == 0;
+        m_fd = -1;
+        if (!ok) {
+            unlink(m_tmpPath.c_str());
+        }
+        m_tmpPath.clear();
+        return ok;
+    }
+
+    uint64_t size() const { return m_size; }
+
+private:
+    int         m_fd = -1;
+    std::string m_tmpPath;
+    uint64_t    m_size = 0;
+};
+
+/**
+ * @brief Raw request body stored as one file (raw uploads and chunks).
+ */
+class RawBody : public BodyHandler
+{
+public:
+    RawBody(const std::string& dir, const std::string& name, const std::string& what)
+        : m_dir(dir), m_name(name), m_what(what)
+    {
+        m_ok = m_sink.open(dir);
+    }
+
+    bool opened() const { return m_ok; }
+
+    bool onData(const char* data, size_t len, HttpResponse& error) override
+    {
+        if (!m_sink.write(data, len)) {
+            reply(error, 500, std::string("Failed to write ") + m_what + ": " + strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    void onEnd(HttpResponse& response) override
+    {
+        if (!makeParents(m_dir, m_name) || !m_sink.commit(m_dir + "/" + m_name)) {
+            reply(response, 500, std::string("Failed to store ") + m_what + ": " + strerror(errno));
+            return;
+        }
+        response.body = "{\"message\":\"" + jsonEscape(m_what) + " stored.\",\"bytes\":" +
+                        std::to_string(m_sink.size()) + "}";
+    }
+
+private:
+    FileSink    m_sink;
+    std::string m_dir;
+    std::string m_name;
+    std::string m_what;
+    bool        m_ok;
+};
+
+/**
+ * @brief multipart/form-data upload; the "file" part is streamed to disk.
+ */
+class MultipartUpload : public BodyHandler, private MultipartParser::Listener
+{
+public:
+    MultipartUpload(const std::string& dir, const std::string& boundary)
+        : m_dir(dir), m_parser(boundary, *this)
+    {
+    }
+
+    bool onData(const char* data, size_t len, HttpResponse& error) override
+    {
+        if (!m_parser.feed(data, len)) {
+            reply(error, m_status, m_message.empty() ? m_parser.error() : m_message);
+            return false;
+        }
+        return true;
+    }
+
+    void onEnd(HttpResponse& response) override
+    {
+        if (!m_parser.done()) {
+            reply(response, 400, "Incomplete multipart body.");
+        } else if (!m_sink || !m_fileDone) {
+            std::cout << "No file received." << std::endl;
+            reply(response, 400, "No file uploaded.");
+        } else if (!makeParents(m_dir, m_filename) || !m_sink->commit(m_dir + "/" + m_filename)) {
+            reply(response, 500, std::string("Failed to store file: ") + strerror(errno));
+        } else {
+            std::cout << "File received: " << m_filename << " (" << m_sink->size() << " bytes)" << std::endl;
+            response.body = "{\"message\":\"File uploaded successfully.\",\"file\":{\"originalname\":\"" +
+                            jsonEscape(m_filename) + "\",\"size\":" + std::to_string(m_sink->size()) + "}}";
+        }
+    }
+
+private:
+    bool onPartBegin(const std::string& name, const std::string& filename) override
+    {
+        m_inFile = false;
+        if (name != "file" || filename.empty() || m_sink) {
+            return true;  // Other fields are ignored, like multer.single("file")
+        }
+        // A path relative to the upload directory is kept; a Windows client's drive path is not
+        m_filename = filename.substr(filename.find_last_of('\\') + 1);
+        if (!validName(m_filename)) {
+            m_status = 400;
+            m_message = "Invalid filename.";
+            return false;
+        }
+        m_sink.reset(new FileSink());
+        if (!m_sink->open(m_dir)) {
+            m_status = 500;
+            m_message = std::string("Failed to create file: ") + strerror(errno);
+            return false;
+        }
+        m_inFile = true;
+        return true;
+    }
+
+    bool onPartData(const char* data, size_t len) override
+    {
+        if (m_inFile && !m_sink->write(data, len)) {
+            m_status = 500;
+            m_message = std::string("Failed to write file: ") + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    bool onPartEnd() override
+    {
+        if (m_inFile) {
+            m_fileDone = true;
+            m_inFile = false;
+        }
+        return true;
+    }
+
+    std::string                 m_dir;
+    MultipartParser             m_parser;
+    std::unique_ptr<FileSink>   m_sink;
+    std::string                 m_filename;
+    bool                        m_inFile = false;
+    bool                        m_fileDone = false;
+    int                         m_status = 400;
+    std::string                 m_message;
+};
+
+/**
+ * @brief Batch of small files (format in the client's uploadBatcher.h).
+ *
+ * Every file is written to its own hidden temporary file as it arrives; only
+ * once the terminator was received are they all renamed into place, so a
+ * truncated or malformed batch stores nothing. Before the first rename every
+ * file has its directories and every file it replaces a hard-linked backup,
+ * so a rename failing halfway puts the earlier files back and the batch still
+ * stores nothing.
+ */
+class BatchUpload : public BodyHandler
+{
+public:
+    explicit BatchUpload(const std::string& dir)
+        : m_dir(dir)
+    {
+    }
+
+    bool onData(const char* data, size_t len, HttpResponse& error) override
+    {
+        while (len > 0) {
+            if (m_state == State::CONTENT) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(len, m_left));
+                if (!m_files.back().sink->write(data, n)) {
+                    reply(error, 500, std::string("Failed to write file: ") + strerror(errno));
+                    return false;
+                }
+                data += n;
+                len -= n;
+                m_left -= n;
+                if (m_left == 0 && !endFile(error)) {
+                    return false;
+                }
+                continue;
+            }
+            if (m_state == State::DONE) {
+                reply(error, 400, "Data after the end of the batch.");
+                return false;
+            }
+
+            // Magic, file headers and names are collected whole before they are parsed
+            size_t n = std::min(len, m_need - m_buffer.size());
+            m_buffer.append(data, n);
+            data += n;
+            len -= n;
+            if (m_buffer.size() == m_need && !parse(error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void onEnd(HttpResponse& response) override
+    {
+        if (m_state != State::DONE) {
+            reply(response, 400, "Incomplete batch.");
+            return;
+        }
+        std::vector<std::string> backups;
+        for (auto& file : m_files) {
+            std::string target = m_dir + "/" + file.name;
+            backups.push_back(tempName(m_dir));
+            if (!makeParents(m_dir, file.name) ||
+                (link(target.c_str(), backups.back().c_str()) == -1 && errno != ENOENT)) {
+                int error = errno;
+                backups.pop_back();
+                restore(backups, 0);
+                reply(response, 500, "Failed to store " + file.name + ": " + strerror(error));
+                return;
+            }
+        }
+
+        uint64_t bytes = 0;
+        for (size_t i = 0; i < m_files.size(); ++i) {
+            bytes += m_files[i].sink->size();
+            if (!m_files[i].sink->commit(m_dir + "/" + m_files[i].name)) {
+                int error = errno;
+                restore(backups, i);
+                reply(response, 500, "Failed to store " + m_files[i].name + ": " + strerror(error));
+                return;
+            }
+        }
+        restore(backups, 0);  // All stored: only drops the backups
+        std::cout << "Batch received: " << m_files.size() << " files (" << bytes << " bytes)" << std::endl;
+        response.body = "{\"message\":\"Batch stored.\",\"files\":" + std::to_string(m_files.size()) +
+                        ",\"bytes\":" + std::to_string(bytes) + "}";
+    }
+
+private:
+    enum class State { MAGIC, HEADER, NAME, CONTENT, DONE };
+
+    struct File {
+        std::string                 name;
+        std::unique_ptr<FileSink>   sink;
+    };
+
+    static uint64_t littleEndian(const char* bytes, int count)
+    {
+        uint64_t value = 0;
+        for (int i = count - 1; i >= 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(bytes[i]);
+        }
+        return value;
+    }
+
+    bool parse(HttpResponse& error)
+    {
+        std::string field;
+        field.swap(m_buffer);
+
+        switch (m_state) {
+        case State::MAGIC:
+            if (field != "FSB1") {
+                reply(error, 400, "Not a batch.");
+                return false;
+            }
+            expect(State::HEADER, 12);
+            return true;
+
+        case State::HEADER: {
+            uint64_t nameLength = littleEndian(field.data(), 4);
+            m_left = littleEndian(field.data() + 4, 8);
+            if (nameLength == 0) {
+                m_state = State::DONE;
+                return true;
+            }
+            if (nameLength > MAX_NAME) {
+                reply(error, 400, "Invalid filename.");
+                return false;
+            }
+            if (m_files.size() == MAX_BATCH_FILES) {
+                reply(error, 413, "Too many files in one batch.");
+                return false;
+            }
+            expect(State::NAME, static_cast<size_t>(nameLength));
+            return true;
+        }
+
+        case State::NAME: {
+            if (!validName(field)) {
+                reply(error, 400, "Invalid filename.");
+                return false;
+            }
+            std::unique_ptr<FileSink> sink(new FileSink());
+            if (!sink->open(m_dir)) {
+                reply(error, 500, std::string("Failed to create file: ") + strerror(errno));
+                return false;
+            }
+            m_files.push_back(File{field, std::move(sink)});
+            m_state = State::CONTENT;
+            return m_left > 0 || endFile(error);
+        }
+
+        default:
+            return false;
+        }
+    }
+
+    // Put back the files replaced by the first `renamed` files, newest first, and drop the other backups
+    void restore(const std::vector<std::string>& backups, size_t renamed)
+    {
+        for (size_t i = backups.size(); i-- > 0;) {
+            std::string target = m_dir + "/" + m_files[i].name;
+            if (i >= renamed) {
+                unlink(backups[i].c_str());
+            } else if (rename(backups[i].c_str(), target.c_str()) == -1 && errno == ENOENT) {
+                unlink(target.c_str());  // No backup: the file was new
+            }
+        }
+    }
+
+    bool endFile(HttpResponse& error)
+    {
+        // Closed right away: a batch of thousands of files must not hold thousands of descriptors
+        if (!m_files.back().sink->finish()) {
+            reply(error, 500, std::string("Failed to write file: ") + strerror(errno));
+            return false;
+        }
+        expect(State::HEADER, 12);
+        return true;
+    }
+
+    void expect(State state, size_t bytes)
+    {
+        m_state = state;
+        m_need = bytes;
+    }
+
+    std::string         m_dir;
+    State               m_state = State::MAGIC;
+    size_t              m_need = 4;
+    std::string         m_buffer;
+    uint64_t            m_left = 0;
+    std::vector<File>   m_files;
+};
+
+/**
+ * @brief Rebuilds a stored file from a delta against its current copy.
+ *
+ * COPY operations are copied from the stored copy, opened before the body
+ * arrives so a concurrent replace does not change the base mid-patch; DATA
+ * operations are streamed as they arrive. The result is renamed into place
+ * only if the delta was complete and produced the announced size.
+ */
+class DeltaPatch : public BodyHandler
+{
+public:
+    DeltaPatch(const std::string& dir, const std::string& name)
+        : m_dir(dir), m_name(name)
+    {
+    }
+
+    ~DeltaPatch() override
+    {
+        if (m_base != -1) {
+            close(m_base);
+        }
+    }
+
+    /** @brief Open the stored copy and the temporary file; false with the response set on failure */
+    bool open(HttpResponse& response)
+    {
+        m_base = ::open((m_dir + "/" + m_name).c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_base == -1) {
+            // Conflict rather than not found: the client answers it with a full upload
+            reply(response, errno == ENOENT ? 409 : 500, "No stored copy of " + m_name + ": " + strerror(errno));
+            return false;
+        }
+        if (!m_sink.open(m_dir)) {
+            reply(response, 500, std::string("Failed to create file: ") + strerror(errno));
+            return false;
+        }
+        return true;
+    }
+
+    bool onData(const char* data, size_t len, HttpResponse& error) override
+    {
+        while (len > 0) {
+            if (m_state == State::LITERAL) {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(len, m_left));
+                if (!m_sink.write(data, n)) {
+                    reply(error, 500, std::string("Failed to write file: ") + strerror(errno));
+                    return false;
+                }
+                data += n;
+                len -= n;
+                m_left -= n;
+                if (m_left == 0) {
+                    expect(State::OP, 1);
+                }
+                continue;
+            }
+            if (m_state == State::DONE) {
+                reply(error, 400, "Data after the end of the delta.");
+                return false;
+            }
+
+            // Header and operation fields are collected whole before they are parsed
+            size_t n = std::min(len, m_need - m_buffer.size());
+            m_buffer.append(data, n);
+            data += n;
+            len -= n;
+            if (m_buffer.size() == m_need && !parse(error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void onEnd(HttpResponse& response) override
+    {
+        if (m_state != State::DONE) {
+            reply(response, 400, "Incomplete delta.");
+            return;
+        }
+        if (m_sink.size() != m_targetSize) {
+            reply(response, 400, "Patched size " + std::to_string(m_sink.size()) +
+                                 " does not match expected " + std::to_string(m_targetSize) + ".");
+            return;
+        }
+        if (!m_sink.commit(m_dir + "/" + m_name)) {
+            reply(response, 500, std::string("Failed to store file: ") + strerror(errno));
+            return;
+        }
+        std::cout << "Patched " << m_name << ": " << m_literalBytes << " literal bytes -> " << m_targetSize
+                  << " bytes" << std::endl;
+        reply(response, 200, "File " + m_name + " patched successfully.");
+    }
+
+private:
+    enum class State { HEADER, OP, COPY, DATA, LITERAL, DONE };
+
+    static uint64_t littleEndian(const char* bytes, int count)
+    {
+        uint64_t value = 0;
+        for (int i = count - 1; i >= 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(bytes[i]);
+        }
+        return value;
+    }
+
+    bool parse(HttpResponse& error)
+    {
+        std::string field;
+        field.swap(m_buffer);
+
+        switch (m_state) {
+        case State::HEADER: {
+            struct stat st;
+            m_blockSize = littleEndian(field.data() + 4, 4);
+            m_baseSize = littleEndian(field.data() + 8, 8);
+            m_targetSize = littleEndian(field.data() + 16, 8);
+            if (field.compare(0, 4, "FSD1") != 0 || m_blockSize == 0) {
+                reply(error, 400, "Malformed delta.");
+                return false;
+            }
+            if (fstat(m_base, &st) == -1 || static_cast<uint64_t>(st.st_size) != m_baseSize) {
+                reply(error, 409, "Stored copy of " + m_name + " does not match the delta base.");
+                return false;
+            }
+            expect(State::OP, 1);
+            return true;
+        }
+
+        case State::OP:
+            switch (static_cast<uint8_t>(field[0])) {
+            case DELTA_END:
+                m_state = State::DONE;
+                return true;
+            case DELTA_COPY:
+                expect(State::COPY, 12);
+                return true;
+            case DELTA_DATA:
+                expect(State::DATA, 4);
+                return true;
+            default:
+                reply(error, 400, "Unknown delta operation.");
+                return false;
+            }
+
+        case State::COPY: {
+            uint64_t first = littleEndian(field.data(), 8);
+            uint64_t count = littleEndian(field.data() + 8, 4);
+            if (first > m_baseSize / m_blockSize) {
+                reply(error, 400, "Delta references data beyond the stored copy.");
+                return false;
+            }
+            // A run past the end of the stored copy is malformed, not cut short; the last block may be partial
+            uint64_t start = first * m_blockSize;
+            uint64_t left = m_baseSize - start;
+            if (count > left / m_blockSize + (left % m_blockSize != 0 ? 1 : 0)) {
+                reply(error, 400, "Delta references data beyond the stored copy.");
+                return false;
+            }
+            if (!m_sink.appendRange(m_base, start, std::min(count * m_blockSize, left))) {
+                reply(error, 500, std::string("Failed to copy from the stored copy: ") + strerror(errno));
+                return false;
+            }
+            expect(State::OP, 1);
+            return true;
+        }
+
+        case State::DATA:
+            m_left = littleEndian(field.data(), 4);
+            m_literalBytes += m_left;
+            if (m_left == 0) {
+                expect(State::OP, 1);
+            } else {
+                m_state = State::LITERAL;
+            }
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    void expect(State state, size_t bytes)
+    {
+        m_state = state;
+        m_need = bytes;
+    }
+
+    std::string m_dir;
+    std::string m_name;
+    int         m_base = -1;
+    FileSink    m_sink;
+    State       m_state = State::HEADER;
+    size_t      m_need = 24;
+    std::string m_buffer;
+    uint64_t    m_left = 0;
+    uint64_t    m_blockSize = 0;
+    uint64_t    m_baseSize = 0;
+    uint64_t    m_targetSize = 0;
+    uint64_t    m_literalBytes = 0;
+};
+
+/**
+ * @brief Assembles stored chunks into the final file.
+ */
+class ChunkCommit : public BodyHandler
+{
+public:
+    ChunkCommit(const std::string& uploadDir, const std::string& chunkDir)
+        : m_uploadDir(uploadDir), m_chunkDir(chunkDir)
+    {
+    }
+
+    bool onData(const char* data, size_t len, HttpResponse& error) override
+    {
+        if (m_body.size() + len > MAX_JSON_BODY) {
+            reply(error, 413, "Commit body too large.");
+            return false;
+        }
+        m_body.append(data, len);
+        return true;
+    }
+
+    void onEnd(HttpResponse& response) override
+    {
+        std::string filename, count, size;
+        if (!jsonValue(m_body, "filename", filename) || !jsonValue(m_body, "chunkCount", count) ||
+            !jsonValue(m_body, "size", size) || !isIndex(count) || !isIndex(size)) {
+            reply(response, 400, "Commit needs filename, chunkCount and size.");
+            return;
+        }
+        if (!validName(filename)) {
+            reply(response, 400, "Invalid filename.");
+            return;
+        }
+
+        uint64_t chunkCount = std::stoull(count);
+        uint64_t expected = std::stoull(size);
+        for (uint64_t i = 0; i < chunkCount; ++i) {
+            if (access((m_chunkDir + "/" + std::to_string(i)).c_str(), F_OK) != 0) {
+                reply(response, 409, "Chunk " + std::to_string(i) + " is missing.");
+                return;
+            }
+        }
+
+        FileSink sink;
+        if (!sink.open(m_uploadDir)) {
+            reply(response, 500, std::string("Failed to create file: ") + strerror(errno));
+            return;
+        }
+        for (uint64_t i = 0; i < chunkCount; ++i) {
+            if (!sink.append(m_chunkDir + "/" + std::to_string(i))) {
+                reply(response, 500, std::string("Failed to assemble file: ") + strerror(errno));
+                return;
+            }
+        }
+
+        std::error_code ec;
+        if (sink.size() != expected) {
+            // Chunks do not add up: drop them so the client starts over
+            std::filesystem::remove_all(m_chunkDir, ec);
+            reply(response, 409, "Assembled size " + std::to_string(sink.size()) +
+                                 " does not match expected " + size + ".");
+            return;
+        }
+        if (!makeParents(m_uploadDir, filename) || !sink.commit(m_uploadDir + "/" + filename)) {
+            reply(response, 500, std::string("Failed to store file: ") + strerror(errno));
+            return;
+        }
+        std::filesystem::remove_all(m_chunkDir, ec);
+        std::cout << "Assembled " << filename << " from " << chunkCount << " chunks (" << expected
+                  << " bytes)" << std::endl;
+        reply(response, 200, "File " + filename + " uploaded successfully.");
+    }
+
+private:
+    std::string m_uploadDir;
+    std::string m_chunkDir;
+    std::string m_body;
+};
+
+} // namespace
+
+FileRoutes::FileRoutes(const std::string& uploadDir)
+    : m_uploadDir(uploadDir),
+      m_chunkDir(uploadDir + "/.chunks")
+{
+    std::error_code ec;
+    std::filesystem::create_directories(m_chunkDir, ec);
+    if (ec) {
+        throw std::runtime_error("Failed to create " + m_chunkDir + ": " + ec.message());
+    }
+}
+
+std::unique_ptr<BodyHandler> FileRoutes::route(const HttpRequest& request, HttpResponse& response)
+{
+    const std::string prefix = "/api/files/";
+    if (request.path.compare(0, prefix.size(), prefix) != 0) {
+        reply(response, 404, "Not found.");
+        return nullptr;
+    }
+
+    std::vector<std::string> parts;
+    size_t start = prefix.size();
+    while (start <= request.path.size()) {
+        size_t end = request.path.find('/', start);
+        if (end == std::string::npos) {
+            end = request.path.size();
+        }
+        parts.push_back(percentDecode(request.path.substr(start, end - start)));
+        start = end + 1;
+    }
+
+    // File names may contain '/', sent encoded (%2F) or as further segments
+    std::string name;
+    for (size_t i = 1; i < parts.size(); ++i) {
+        name += (i > 1 ? "/" : "") + parts[i];
+    }
+
+    const std::string& method = request.method;
+    if (parts.size() == 1 && parts[0] == "list" && method == "GET") {
+        listFiles(response);
+        return nullptr;
+    }
+    if (parts.size() == 1 && parts[0] == "batch" && method == "POST") {
+        return std::unique_ptr<BodyHandler>(new BatchUpload(m_uploadDir));
+    }
+    if (parts.size() == 1 && parts[0] == "upload" && method == "POST") {
+        return upload(request, response);
+    }
+    if (parts.size() >= 2 && parts[0] == "raw" && method == "PUT") {
+        return putRaw(name, response);
+    }
+    if (parts.size() >= 2 && parts[0] == "patch" && method == "POST") {
+        return patch(name, response);
+    }
+    if (parts.size() >= 2 && parts[0] == "file" && method == "DELETE") {
+        deleteFile(name, response);
+        return nullptr;
+    }
+    if (parts.size() >= 2 && parts[0] == "chunks") {
+        if (!validUploadId(parts[1])) {
+            reply(response, 400, "Invalid upload id.");
+            return nullptr;
+        }
+        if (parts.size() == 2 && method == "GET") {
+            listChunks(parts[1], response);
+            return nullptr;
+        }
+        if (parts.size() == 2 && method == "DELETE") {
+            abortChunks(parts[1], response);
+            return nullptr;
+        }
+        if (parts.size() == 3 && parts[2] == "commit" && method == "POST") {
+            return commitChunks(parts[1], response);
+        }
+        if (parts.size() == 3 && method == "PUT") {
+            return putChunk(parts[1], parts[2], response);
+        }
+    }
+
+    reply(response, 404, "Not found.");
+    return nullptr;
+}
+
+void FileRoutes::listFiles(HttpResponse& response)
+{
+    int dirFd = open(m_uploadDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd == -1) {
+        reply(response, 500, std::string("Failed to list files: ") + strerror(errno));
+        return;
+    }
+
+    // Tab-separated lines rather than JSON: cheap to produce and to parse for millions of files
+    response.contentType = "text/plain";
+    listTree(dirFd, "", response.body);
+}
+
+std::unique_ptr<BodyHandler> FileRoutes::upload(const HttpRequest& request, HttpResponse& response)
+{
+    std::cout << "Received POST /upload" << std::endl;
+    std::string boundary = MultipartParser::boundaryOf(request.header("content-type"));
+    if (boundary.empty() || (request.contentLength == 0 && !request.chunked)) {
+        reply(response, 400, "No file uploaded.");
+        return nullptr;
+    }
+    return std::unique_ptr<BodyHandler>(new MultipartUpload(m_uploadDir, boundary));
+}
+
+std::unique_ptr<BodyHandler> FileRoutes::putRaw(const std::string& name, HttpResponse& response)
+{
+    if (!validName(name)) {
+        reply(response, 400, "Invalid filename.");
+        return nullptr;
+    }
+    std::unique_ptr<RawBody> body(new RawBody(m_uploadDir, name, "File " + name));
+    if (!body->opened()) {
+        reply(response, 500, std::string("Failed to create file: ") + strerror(errno));
+        return nullptr;
+    }
+    return body;
+}
+
+std::unique_ptr<BodyHandler> FileRoutes::patch(const std::string& name, HttpResponse& response)
+{
+    if (!validName(name)) {
+        reply(response, 400, "Invalid filename.");
+        return nullptr;
+    }
+    std::unique_ptr<DeltaPatch> body(new DeltaPatch(m_uploadDir, name));
+    if (!body->open(response)) {
+        return nullptr;
+    }
+    return body;
+}
+
+void FileRoutes::deleteFile(const std::string& name, HttpResponse& response)
+{
+    if (!validName(name)) {
+        reply(response, 400, "Invalid filename.");
+        return;
+    }
+    if (unlink((m_uploadDir + "/" + name).c_str()) == -1) {
+        reply(response, errno == ENOENT ? 404 : 500, "Failed to delete " + name + ": " + strerror(errno));
+        return;
+    }
+    removeEmptyParents(m_uploadDir, name);
+    std::cout << "Deleted " << name << std::endl;
+    reply(response, 200, "File " + name + " deleted successfully.");
+}
+
+void FileRoutes::listChunks(const std::string& uploadId, HttpResponse& response)
+{
+    std::vector<uint64_t> chunks;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(m_chunkDir + "/" + uploadId, ec)) {
+        std::string name = entry.path().filename().string();
+        if (isIndex(name)) {
+            chunks.push_back(std::stoull(name));
+        }
+    }
+    std::sort(chunks.begin(), chunks.end());
+
+    response.body = "{\"uploadId\":\"" + uploadId + "\",\"chunks\":[";
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        response.body += (i ? "," : "") + std::to_string(chunks[i]);
+    }
+    response.body += "]}";
+}
+
+std::unique_ptr<BodyHandler> FileRoutes::putChunk(const std::string& uploadId, const std::string& index,
+                                                  HttpResponse& response)
+{
+    if (!isIndex(index)) {
+        reply(response, 400, "Invalid chunk index.");
+        return nullptr;
+    }
+    std::string dir = m_chunkDir + "/" + uploadId;
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+
+    std::string chunk = std::to_string(std::stoull(index));
+    std::unique_ptr<RawBody> body(new RawBody(dir, chunk, "Chunk " + chunk));
+    if (!body->opened()) {
+        reply(response, 500, std::string("Failed to create chunk: ") + strerror(errno));
+        return nullptr;
+    }
+    return body;
+}
+
+std::unique_ptr<BodyHandler> FileRoutes::commitChunks(const std::string& uploadId, HttpResponse&)
+{
+    return std::unique_ptr<BodyHandler>(new ChunkCommit(m_uploadDir, m_chunkDir + "/" + uploadId));
+}
+
+void FileRoutes::abortChunks(const std::string& uploadId, HttpResponse& response)
+{
+    std::error_code ec;
+    std::filesystem::remove_all(m_chunkDir + "/" + uploadId, ec);
+    reply(response, 200, "Upload " + uploadId + " discarded.");
+}
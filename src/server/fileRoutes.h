@@ -0,0 +1,72 @@
+/**
+ * @file fileRoutes.h
+ * @brief The /api/files routes of the receiving server.
+ */
+#ifndef FILE_ROUTES_H
+#define FILE_ROUTES_H
+
+#include <string>
+#include "httpServer.h"
+
+/**
+ * @class FileRoutes
+ * @brief Stores uploaded files in a directory; same API as local-rest-api-server.
+ *
+ * Routes:
+ * @code
+ *   GET    /api/files/list                   text/plain, one "<size>\t<name>\n" per stored file
+ *   POST   /api/files/upload                 multipart/form-data, "file" part
+ *   POST   /api/files/batch                  many small files, all stored or none
+ *   PUT    /api/files/raw/<name>             raw body is the file
+ *   POST   /api/files/patch/<name>           delta against the stored copy (client's deltaSync.h)
+ *   DELETE /api/files/file/<name>
+ *   GET    /api/files/chunks/<id>            {"chunks":[stored indices]}
+ *   PUT    /api/files/chunks/<id>/<index>    raw chunk body
+ *   POST   /api/files/chunks/<id>/commit     {"filename","chunkCount","size"}
+ *   DELETE /api/files/chunks/<id>
+ * @endcode
+ *
+ * A name is a path relative to the upload directory ("dir/file.txt"; '/' may
+ * be sent as %2F), the way a recursive client sends files below its watched
+ * directory. Empty, hidden, "." and ".." components are refused, missing
+ * directories are created on store (never through a symlink) and removed
+ * once a delete leaves them empty.
+ *
+ * Bodies are streamed to a hidden temporary file in the upload directory and
+ * renamed into place only once complete, so readers never see partial files
+ * and dropped connections leave nothing behind. A delta patch is refused
+ * with 409 when the stored copy is missing or is not the delta's base; the
+ * client then falls back to a full upload.
+ */
+class FileRoutes : public RequestRouter
+{
+public:
+    /**
+     * @brief Construct the routes.
+     * @param uploadDir Directory receiving the files; created if missing.
+     * @throw std::runtime_error if the directory cannot be created.
+     */
+    explicit FileRoutes(const std::string& uploadDir);
+
+    /**
+     * @brief Route a request (thread-safe).
+     */
+    std::unique_ptr<BodyHandler> route(const HttpRequest& request, HttpResponse& response) override;
+
+private:
+    void listFiles(HttpResponse& response);
+    std::unique_ptr<BodyHandler> upload(const HttpRequest& request, HttpResponse& response);
+    std::unique_ptr<BodyHandler> putRaw(const std::string& name, HttpResponse& response);
+    std::unique_ptr<BodyHandler> patch(const std::string& name, HttpResponse& response);
+    void deleteFile(const std::string& name, HttpResponse& response);
+    void listChunks(const std::string& uploadId, HttpResponse& response);
+    std::unique_ptr<BodyHandler> putChunk(const std::string& uploadId, const std::string& index,
+                                          HttpResponse& response);
+    std::unique_ptr<BodyHandler> commitChunks(const std::string& uploadId, HttpResponse& response);
+    void abortChunks(const std::string& uploadId, HttpResponse& response);
+
+    std::string m_uploadDir;    ///< Directory receiving the files
+    std::string m_chunkDir;     ///< Directory holding chunks of unfinished uploads
+};
+
+#endif // FILE_ROUTES_H
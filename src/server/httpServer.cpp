@@ -0,0 +1,740 @@
+#include "httpServer.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+// Per-worker socket read buffer
+const size_t READ_BUFFER = 256 * 1024;
+
+// Reads per readiness event before other connections get a turn
+const int READS_PER_EVENT = 8;
+
+// Limit on the request line plus headers
+const size_t MAX_HEAD = 64 * 1024;
+
+// Idle keep-alive connections are closed after this long
+const std::chrono::seconds IDLE_TIMEOUT(60);
+
+// Limit on a chunk-size or trailer line of a chunked body
+const size_t MAX_CHUNK_LINE = 4096;
+
+// Inflated bytes handed to the body handler at a time
+const size_t INFLATE_BUFFER = 256 * 1024;
+
+const char* reasonPhrase(int status)
+{
+    switch (status) {
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 411: return "Length Required";
+    case 413: return "Payload Too Large";
+    case 415: return "Unsupported Media Type";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    default:  return "Unknown";
+    }
+}
+
+std::string lower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+std::string trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t");
+    size_t end = s.find_last_not_of(" \t\r");
+    return begin == std::string::npos ? std::string() : s.substr(begin, end - begin + 1);
+}
+
+int createListenSocket(uint16_t port)
+{
+    // Dual-stack IPv6 socket so both "localhost" resolutions reach us; IPv4 if IPv6 is unavailable
+    int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    bool v6 = fd != -1;
+    if (!v6) {
+        fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    if (fd == -1) {
+        return -1;
+    }
+
+    int one = 1;
+    int zero = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    int rc;
+    if (v6) {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &zero, sizeof(zero));
+        struct sockaddr_in6 addr = {};
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(port);
+        rc = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    } else {
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        rc = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    }
+
+    if (rc == -1 || listen(fd, SOMAXCONN) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Inflates a gzip-encoded body on its way to the routed handler.
+ *
+ * The inner handler only ever sees the decoded bytes. A stream that is
+ * corrupt, truncated or followed by garbage rejects the body, and the inner
+ * handler is destroyed without onEnd(), which undoes its partial work.
+ */
+class GzipBody : public BodyHandler
+{
+public:
+    explicit GzipBody(std::unique_ptr<BodyHandler> inner)
+        : m_inner(std::move(inner)),
+          m_out(INFLATE_BUFFER),
+          m_done(false)
+    {
+        m_zs = {};
+        m_ok = inflateInit2(&m_zs, 15 + 16) == Z_OK;  // 16: gzip wrapper only
+    }
+
+    ~GzipBody() override
+    {
+        if (m_ok) {
+            inflateEnd(&m_zs);
+        }
+    }
+
+    bool onData(const char* data, size_t len, HttpResponse& error) override
+    {
+        if (!m_ok) {
+            error.status = 500;
+            error.body = "{\"message\":\"Failed to set up decompression.\"}";
+            return false;
+        }
+        if (m_done && len > 0) {
+            return reject(error, "Data after the end of the gzip stream.");
+        }
+
+        m_zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_zs.avail_in = static_cast<uInt>(len);
+        while (m_zs.avail_in > 0 && !m_done) {
+            m_zs.next_out = reinterpret_cast<Bytef*>(m_out.data());
+            m_zs.avail_out = static_cast<uInt>(m_out.size());
+            int rc = inflate(&m_zs, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END && rc != Z_BUF_ERROR) {
+                return reject(error, "Corrupt gzip body.");
+            }
+            size_t produced = m_out.size() - m_zs.avail_out;
+            if (produced > 0 && !m_inner->onData(m_out.data(), produced, error)) {
+                return false;
+            }
+            m_done = rc == Z_STREAM_END;
+        }
+        if (m_done && m_zs.avail_in > 0) {
+            return reject(error, "Data after the end of the gzip stream.");
+        }
+        return true;
+    }
+
+    void onEnd(HttpResponse& response) override
+    {
+        if (!m_done) {
+            response.status = 400;
+            response.body = "{\"message\":\"Truncated gzip body.\"}";
+            m_inner.reset();  // Undo the partial upload
+            return;
+        }
+        m_inner->onEnd(response);
+    }
+
+private:
+    static bool reject(HttpResponse& error, const char* message)
+    {
+        error.status = 400;
+        error.body = std::string("{\"message\":\"") + message + "\"}";
+        return false;
+    }
+
+    std::unique_ptr<BodyHandler>    m_inner;    ///< Routed handler, fed the inflated bytes
+    z_stream                        m_zs;       ///< Inflate state
+    std::vector<char>               m_out;      ///< Inflate output buffer
+    bool                            m_ok;       ///< m_zs was initialized
+    bool                            m_done;     ///< End of the gzip stream seen
+};
+
+/**
+ * @brief Framing position inside a chunked body.
+ */
+enum class ChunkPhase {
+    SIZE,       ///< Expecting a chunk-size line
+    DATA_END,   ///< Expecting the CRLF after chunk data
+    TRAILER     ///< Expecting trailer lines up to the empty line
+};
+
+} // namespace
+
+/**
+ * @brief State of one client connection (owned by one worker).
+ */
+struct HttpServer::Connection {
+    int                             fd = -1;
+    std::string                     head;               ///< Header bytes of the next request
+    bool                            inBody = false;     ///< Reading a request body
+    uint64_t                        remaining = 0;      ///< Body bytes still expected (of the current chunk if chunked)
+    bool                            chunked = false;    ///< Body uses the chunked transfer coding
+    ChunkPhase                      chunkPhase = ChunkPhase::SIZE; ///< Framing expected when remaining is 0
+    std::string                     chunkLine;          ///< Partial chunk-size or trailer line
+    std::unique_ptr<BodyHandler>    handler;            ///< Consumer of the current body
+    bool                            keepAlive = true;   ///< Current request allows keep-alive
+    std::string                     out;                ///< Pending output
+    size_t                          outPos = 0;         ///< Bytes of out already sent
+    bool                            closing = false;    ///< Close once out is sent
+    bool                            wantWrite = false;  ///< EPOLLOUT is armed
+    std::chrono::steady_clock::time_point lastActive;   ///< Time of the last I/O
+};
+
+/**
+ * @brief One event loop thread with its own listening socket.
+ */
+struct HttpServer::Worker {
+    int                 epollFd = -1;
+    int                 listenFd = -1;
+    int                 stopFd = -1;
+    std::thread         thread;
+    std::vector<char>   buffer;
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+
+    ~Worker()
+    {
+        for (int fd : {epollFd, listenFd, stopFd}) {
+            if (fd != -1) {
+                close(fd);
+            }
+        }
+    }
+};
+
+HttpServer::HttpServer(uint16_t port, size_t workers, RequestRouter& router)
+    : m_port(port),
+      m_router(router)
+{
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < workers; ++i) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->buffer.resize(READ_BUFFER);
+        worker->listenFd = createListenSocket(port);
+        if (worker->listenFd == -1) {
+            throw std::runtime_error("Failed to listen on port " + std::to_string(port) + ": " + strerror(errno));
+        }
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->stopFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (worker->epollFd == -1 || worker->stopFd == -1) {
+            throw std::runtime_error(std::string("Failed to create worker event loop: ") + strerror(errno));
+        }
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = worker->listenFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->listenFd, &ev);
+        ev.data.fd = worker->stopFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->stopFd, &ev);
+
+        m_workers.push_back(std::move(worker));
+    }
+}
+
+HttpServer::~HttpServer()
+{
+    Stop();
+}
+
+void HttpServer::Start()
+{
+    for (auto& worker : m_workers) {
+        if (!worker->thread.joinable()) {
+            worker->thread = std::thread(&HttpServer::run, this, std::ref(*worker));
+        }
+    }
+    std::cout << "Server listening on port " << m_port << " with " << m_workers.size() << " workers" << std::endl;
+}
+
+void HttpServer::Stop()
+{
+    for (auto& worker : m_workers) {
+        uint64_t one = 1;
+        if (write(worker->stopFd, &one, sizeof(one)) == -1) {
+            std::cerr << "Failed to signal worker: " << strerror(errno) << std::endl;
+        }
+    }
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+}
+
+void HttpServer::run(Worker& worker)
+{
+    std::vector<struct epoll_event> events(256);
+    auto lastSweep = std::chrono::steady_clock::now();
+
+    for (;;) {
+        int n = epoll_wait(worker.epollFd, events.data(), static_cast<int>(events.size()), 1000);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        bool stop = false;
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == worker.stopFd) {
+                stop = true;
+                continue;
+            }
+            if (fd == worker.listenFd) {
+                acceptConnections(worker);
+                continue;
+            }
+
+            auto it = worker.connections.find(fd);
+            if (it == worker.connections.end()) {
+                continue;
+            }
+            Connection& conn = *it->second;
+            conn.lastActive = std::chrono::steady_clock::now();
+
+            bool keep = true;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                keep = (events[i].events & EPOLLIN) && onReadable(worker, conn);
+                keep = keep && !(events[i].events & EPOLLERR);
+            } else {
+                if (keep && (events[i].events & EPOLLOUT)) {
+                    keep = flush(worker, conn);
+                }
+                if (keep && (events[i].events & EPOLLIN)) {
+                    keep = onReadable(worker, conn);
+                }
+            }
+            if (!keep) {
+                closeConnection(worker, fd);
+            }
+        }
+        if (stop) {
+            break;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastSweep >= std::chrono::seconds(5)) {
+            lastSweep = now;
+            std::vector<int> idle;
+            for (const auto& entry : worker.connections) {
+                if (now - entry.second->lastActive >= IDLE_TIMEOUT) {
+                    idle.push_back(entry.first);
+                }
+            }
+            for (int fd : idle) {
+                closeConnection(worker, fd);
+            }
+        }
+    }
+
+    // Dropping the connections destroys unfinished body handlers, which undo partial uploads
+    std::vector<int> open;
+    for (const auto& entry : worker.connections) {
+        open.push_back(entry.first);
+    }
+    for (int fd : open) {
+        closeConnection(worker, fd);
+    }
+}
+
+void HttpServer::acceptConnections(Worker& worker)
+{
+    for (;;) {
+        int fd = accept4(worker.listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd == -1) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                std::cerr << "accept failed: " << strerror(errno) << std::endl;
+            }
+            return;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        std::unique_ptr<Connection> conn(new Connection());
+        conn->fd = fd;
+        conn->lastActive = std::chrono::steady_clock::now();
+
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = fd;
+        if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            std::cerr << "Failed to watch connection: " << strerror(errno) << std::endl;
+            close(fd);
+            continue;
+        }
+        worker.connections[fd] = std::move(conn);
+    }
+}
+
+bool HttpServer::onReadable(Worker& worker, Connection& conn)
+{
+    for (int i = 0; i < READS_PER_EVENT; ++i) {
+        ssize_t n = recv(conn.fd, worker.buffer.data(), worker.buffer.size(), 0);
+        if (n > 0) {
+            if (!process(worker, conn, worker.buffer.data(), static_cast<size_t>(n))) {
+                return false;
+            }
+            if (static_cast<size_t>(n) < worker.buffer.size()) {
+                return true;  // Drained for now
+            }
+            continue;
+        }
+        if (n == 0) {
+            return false;  // Peer closed; an unfinished body handler is dropped
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    return true;
+}
+
+bool HttpServer::process(Worker& worker, Connection& conn, const char* data, size_t len)
+{
+    while (len > 0) {
+        if (conn.closing) {
+            break;  // Ignore input after a final response
+        }
+
+        if (!conn.inBody) {
+            size_t oldSize = conn.head.size();
+            conn.head.append(data, len);
+            size_t pos = conn.head.find("\r\n\r\n", oldSize >= 3 ? oldSize - 3 : 0);
+            if (pos == std::string::npos) {
+                if (conn.head.size() > MAX_HEAD) {
+                    HttpResponse response;
+                    response.status = 431;
+                    response.body = "{\"message\":\"Request headers too large.\"}";
+                    respond(worker, conn, response, true);
+                }
+                return true;
+            }
+
+            size_t consumed = pos + 4 - oldSize;
+            data += consumed;
+            len -= consumed;
+            conn.head.resize(pos);
+            std::string head;
+            head.swap(conn.head);
+            if (!beginRequest(worker, conn, head)) {
+                return false;
+            }
+            continue;
+        }
+
+        if (conn.chunked && conn.remaining == 0) {
+            int framing = readChunkFraming(conn, data, len);
+            if (framing < 0) {
+                HttpResponse error;
+                error.status = 400;
+                error.body = "{\"message\":\"Malformed chunked body.\"}";
+                conn.handler.reset();
+                conn.inBody = false;
+                respond(worker, conn, error, true);
+                return true;
+            }
+            if (framing > 0) {
+                endBody(worker, conn);
+            }
+            continue;
+        }
+
+        size_t take = static_cast<size_t>(std::min<uint64_t>(len, conn.remaining));
+        HttpResponse error;
+        if (!conn.handler->onData(data, take, error)) {
+            conn.handler.reset();
+            conn.inBody = false;
+            respond(worker, conn, error, true);
+            return true;
+        }
+        data += take;
+        len -= take;
+        conn.remaining -= take;
+
+        if (conn.remaining == 0 && !conn.chunked) {
+            endBody(worker, conn);
+        }
+    }
+    return !conn.closing || conn.outPos < conn.out.size();
+}
+
+int HttpServer::readChunkFraming(Connection& conn, const char*& data, size_t& len)
+{
+    while (len > 0) {
+        const char* eol = static_cast<const char*>(memchr(data, '\n', len));
+        size_t take = eol ? static_cast<size_t>(eol - data) + 1 : len;
+        conn.chunkLine.append(data, eol ? take - 1 : take);
+        data += take;
+        len -= take;
+        if (conn.chunkLine.size() > MAX_CHUNK_LINE) {
+            return -1;
+        }
+        if (!eol) {
+            return 0;
+        }
+
+        std::string line;
+        line.swap(conn.chunkLine);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        switch (conn.chunkPhase) {
+        case ChunkPhase::SIZE: {
+            // Chunk extensions after ';' are ignored
+            char* end = nullptr;
+            uint64_t size = strtoull(line.c_str(), &end, 16);
+            if (end == line.c_str() || (*end != '\0' && *end != ';' && *end != ' ' && *end != '\t')) {
+                return -1;
+            }
+            if (size == 0) {
+                conn.chunkPhase = ChunkPhase::TRAILER;
+                break;
+            }
+            conn.remaining = size;
+            conn.chunkPhase = ChunkPhase::DATA_END;
+            return 0;
+        }
+        case ChunkPhase::DATA_END:
+            if (!line.empty()) {
+                return -1;
+            }
+            conn.chunkPhase = ChunkPhase::SIZE;
+            break;
+        case ChunkPhase::TRAILER:
+            if (line.empty()) {
+                conn.chunkPhase = ChunkPhase::SIZE;
+                return 1;
+            }
+            break;  // Trailer fields are ignored
+        }
+    }
+    return 0;
+}
+
+void HttpServer::endBody(Worker& worker, Connection& conn)
+{
+    HttpResponse response;
+    conn.handler->onEnd(response);
+    conn.handler.reset();
+    conn.inBody = false;
+    conn.chunked = false;
+    respond(worker, conn, response, !conn.keepAlive);
+}
+
+bool HttpServer::beginRequest(Worker& worker, Connection& conn, const std::string& head)
+{
+    HttpRequest request;
+    HttpResponse response;
+
+    size_t lineEnd = head.find("\r\n");
+    std::string line = head.substr(0, lineEnd);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string::npos || sp2 == sp1 || line.compare(sp2 + 1, 5, "HTTP/") != 0) {
+        response.status = 400;
+        response.body = "{\"message\":\"Malformed request line.\"}";
+        respond(worker, conn, response, true);
+        return true;
+    }
+    request.method = line.substr(0, sp1);
+    std::string target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    if (question != std::string::npos) {
+        request.query = target.substr(question + 1);
+    }
+    bool http10 = line.compare(sp2 + 1, 8, "HTTP/1.0") == 0;
+
+    size_t start = (lineEnd == std::string::npos) ? head.size() : lineEnd + 2;
+    while (start < head.size()) {
+        size_t end = head.find("\r\n", start);
+        if (end == std::string::npos) {
+            end = head.size();
+        }
+        size_t colon = head.find(':', start);
+        if (colon != std::string::npos && colon < end) {
+            std::string name = head.substr(start, colon - start);
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            request.headers[name] = trim(head.substr(colon + 1, end - colon - 1));
+        }
+        start = end + 2;
+    }
+
+    std::string connection = request.header("connection");
+    std::transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+    conn.keepAlive = http10 ? connection == "keep-alive" : connection != "close";
+
+    std::string transferEncoding = lower(request.header("transfer-encoding"));
+    if (!transferEncoding.empty()) {
+        if (transferEncoding != "chunked") {
+            response.status = 501;
+            response.body = "{\"message\":\"Only the chunked transfer coding is supported.\"}";
+            respond(worker, conn, response, true);
+            return true;
+        }
+        request.chunked = true;
+    }
+    std::string length = request.header("content-length");
+    if (!length.empty() && !request.chunked) {
+        char* end = nullptr;
+        request.contentLength = strtoull(length.c_str(), &end, 10);
+        if (end == length.c_str() || *end != '\0') {
+            response.status = 400;
+            response.body = "{\"message\":\"Invalid Content-Length.\"}";
+            respond(worker, conn, response, true);
+            return true;
+        }
+    }
+
+    std::string contentEncoding = lower(request.header("content-encoding"));
+    bool gzip = contentEncoding == "gzip" || contentEncoding == "x-gzip";
+    if (!gzip && !contentEncoding.empty() && contentEncoding != "identity") {
+        response.status = 415;
+        response.body = "{\"message\":\"Unsupported Content-Encoding.\"}";
+        respond(worker, conn, response, true);
+        return true;
+    }
+
+    conn.handler = m_router.route(request, response);
+    if (!conn.handler) {
+        // Unread body bytes would be taken for the next request: close instead
+        respond(worker, conn, response, !conn.keepAlive || request.contentLength > 0 || request.chunked);
+        return true;
+    }
+    if (gzip) {
+        conn.handler.reset(new GzipBody(std::move(conn.handler)));
+    }
+
+    if (request.contentLength == 0 && !request.chunked) {
+        conn.handler->onEnd(response);
+        conn.handler.reset();
+        respond(worker, conn, response, !conn.keepAlive);
+        return true;
+    }
+
+    std::string expect = request.header("expect");
+    std::transform(expect.begin(), expect.end(), expect.begin(), ::tolower);
+    if (expect == "100-continue") {
+        conn.out += "HTTP/1.1 100 Continue\r\n\r\n";
+        if (!flush(worker, conn)) {
+            return false;
+        }
+    }
+
+    conn.inBody = true;
+    conn.chunked = request.chunked;
+    conn.chunkPhase = ChunkPhase::SIZE;
+    conn.chunkLine.clear();
+    conn.remaining = request.chunked ? 0 : request.contentLength;
+    return true;
+}
+
+void HttpServer::respond(Worker& worker, Connection& conn, const HttpResponse& response, bool close)
+{
+    conn.out += "HTTP/1.1 " + std::to_string(response.status) + " " + reasonPhrase(response.status) + "\r\n"
+                "Content-Type: " + response.contentType + "\r\n"
+                "Content-Length: " + std::to_string(response.body.size()) + "\r\n"
+                "Connection: " + (close ? "close" : "keep-alive") + "\r\n\r\n";
+    conn.out += response.body;
+    if (close) {
+        conn.closing = true;
+    }
+    flush(worker, conn);
+}
+
+bool HttpServer::flush(Worker& worker, Connection& conn)
+{
+    while (conn.outPos < conn.out.size()) {
+        ssize_t n = send(conn.fd, conn.out.data() + conn.outPos, conn.out.size() - conn.outPos, MSG_NOSIGNAL);
+        if (n > 0) {
+            conn.outPos += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            if (!conn.wantWrite) {
+                struct epoll_event ev = {};
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+                ev.data.fd = conn.fd;
+                epoll_ctl(worker.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+                conn.wantWrite = true;
+            }
+            return true;
+        }
+        conn.closing = true;
+        conn.out.clear();
+        conn.outPos = 0;
+        return false;
+    }
+
+    conn.out.clear();
+    conn.outPos = 0;
+    if (conn.wantWrite) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.fd = conn.fd;
+        epoll_ctl(worker.epollFd, EPOLL_CTL_MOD, conn.fd, &ev);
+        conn.wantWrite = false;
+    }
+    return !conn.closing;
+}
+
+void HttpServer::closeConnection(Worker& worker, int fd)
+{
+    epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    close(fd);
+    worker.connections.erase(fd);
+}
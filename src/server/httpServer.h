@@ -0,0 +1,199 @@
+/**
+ * @file httpServer.h
+ * @brief Minimal multi-threaded HTTP/1.1 server on epoll.
+ */
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @struct HttpRequest
+ * @brief Request line and headers of one request.
+ */
+struct HttpRequest {
+    std::string method;                                     ///< Request method
+    std::string path;                                       ///< Path part of the target, still percent-encoded
+    std::string query;                                      ///< Query string without '?'
+    std::unordered_map<std::string, std::string> headers;   ///< Headers by lower-case name
+    uint64_t    contentLength = 0;                          ///< Body length in bytes
+    bool        chunked = false;                            ///< Body uses the chunked transfer coding (length unknown)
+
+    /** @brief Header value by lower-case name, empty if absent */
+    std::string header(const std::string& name) const
+    {
+        auto it = headers.find(name);
+        return it == headers.end() ? std::string() : it->second;
+    }
+};
+
+/**
+ * @struct HttpResponse
+ * @brief Response sent for a request.
+ */
+struct HttpResponse {
+    int         status = 200;                       ///< HTTP status code
+    std::string contentType = "application/json";   ///< Content-Type of body
+    std::string body;                               ///< Response body
+};
+
+/**
+ * @class BodyHandler
+ * @brief Consumes the body of an accepted request as it arrives.
+ *
+ * A handler that is destroyed before onEnd() (connection dropped, body
+ * rejected) must undo any partial work, e.g. remove temporary files.
+ */
+class BodyHandler
+{
+public:
+    virtual ~BodyHandler() = default;
+
+    /**
+     * @brief Next piece of the body.
+     * @param error Response to send if the body is rejected.
+     * @return false to reject the body; error is sent and the connection closed.
+     */
+    virtual bool onData(const char* data, size_t len, HttpResponse& error) = 0;
+
+    /**
+     * @brief The whole body arrived.
+     * @param response Receives the response.
+     */
+    virtual void onEnd(HttpResponse& response) = 0;
+};
+
+/**
+ * @class RequestRouter
+ * @brief Maps requests to responses or body handlers.
+ *
+ * route() is called from every worker thread and must be thread-safe.
+ */
+class RequestRouter
+{
+public:
+    virtual ~RequestRouter() = default;
+
+    /**
+     * @brief Handle the headers of a request.
+     * @param request Parsed request line and headers.
+     * @param response Receives the response if no handler is returned.
+     * @return Handler for the body (onEnd() is called at once for empty bodies),
+     *         or null if response already holds the answer.
+     */
+    virtual std::unique_ptr<BodyHandler> route(const HttpRequest& request, HttpResponse& response) = 0;
+};
+
+/**
+ * @class HttpServer
+ * @brief Serves HTTP/1.1 with keep-alive on several epoll worker threads.
+ *
+ * Every worker owns a listening socket bound with SO_REUSEPORT, so the
+ * kernel spreads new connections across workers and no state is shared
+ * between them. Bodies are handed to the BodyHandler in the pieces they are
+ * read from the socket and are never buffered whole. "Expect: 100-continue"
+ * is answered once a request is accepted. Chunked request bodies are
+ * de-chunked, and "Content-Encoding: gzip" bodies are inflated, before they
+ * reach the handler; other content codings are refused (415).
+ */
+class HttpServer
+{
+public:
+    /**
+     * @brief Construct the server and bind its listening sockets.
+     * @param port TCP port.
+     * @param workers Number of worker threads (0 = hardware concurrency).
+     * @param router Request router (not owned).
+     * @throw std::runtime_error if the sockets cannot be set up.
+     */
+    HttpServer(uint16_t port, size_t workers, RequestRouter& router);
+
+    /**
+     * @brief Stop the workers and close all connections.
+     */
+    ~HttpServer();
+
+    /**
+     * @brief Start the worker threads.
+     */
+    void Start();
+
+    /**
+     * @brief Stop the worker threads.
+     */
+    void Stop();
+
+private:
+    struct Connection;
+    struct Worker;
+
+    /**
+     * @brief Event loop of one worker.
+     */
+    void run(Worker& worker);
+
+    /**
+     * @brief Accept all pending connections of a worker.
+     */
+    void acceptConnections(Worker& worker);
+
+    /**
+     * @brief Read from a connection and process what arrived.
+     * @return false if the connection must be closed.
+     */
+    bool onReadable(Worker& worker, Connection& conn);
+
+    /**
+     * @brief Parse and dispatch requests / feed body data from a piece of input.
+     * @return false if the connection must be closed.
+     */
+    bool process(Worker& worker, Connection& conn, const char* data, size_t len);
+
+    /**
+     * @brief Parse the header block of a request and route it.
+     * @return false if the connection must be closed.
+     */
+    bool beginRequest(Worker& worker, Connection& conn, const std::string& head);
+
+    /**
+     * @brief Consume chunk-size lines, chunk CRLFs and the trailer of a chunked body.
+     *
+     * Stops at the start of chunk data (conn.remaining is then set), at the end
+     * of the body, or when the input is used up.
+     *
+     * @return 1 at the end of the body, 0 otherwise, -1 on malformed framing.
+     */
+    int readChunkFraming(Connection& conn, const char*& data, size_t& len);
+
+    /**
+     * @brief Hand the end of the body to the handler and respond.
+     */
+    void endBody(Worker& worker, Connection& conn);
+
+    /**
+     * @brief Queue a response and try to send it.
+     */
+    void respond(Worker& worker, Connection& conn, const HttpResponse& response, bool close);
+
+    /**
+     * @brief Send queued output; arms EPOLLOUT if the socket is full.
+     * @return false if the connection must be closed.
+     */
+    bool flush(Worker& worker, Connection& conn);
+
+    /**
+     * @brief Close a connection and drop its state.
+     */
+    void closeConnection(Worker& worker, int fd);
+
+    uint16_t                                m_port;     ///< Listening port
+    RequestRouter&                          m_router;   ///< Routes requests
+    std::vector<std::unique_ptr<Worker>>    m_workers;  ///< Worker threads and their sockets
+};
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,52 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <pthread.h>
+#include "httpServer.h"
+#include "fileRoutes.h"
+
+
+int main(int argc, char* argv[]) 
+{
+    // Usage: server.elf [port] [upload dir] [workers]; PORT, UPLOAD_DIR and WORKERS work as well
+    const char* portEnv = getenv("PORT");
+    const char* dirEnv = getenv("UPLOAD_DIR");
+    const char* workersEnv = getenv("WORKERS");
+
+    int port = argc > 1 ? atoi(argv[1]) : (portEnv ? atoi(portEnv) : 3000);
+    std::string uploadDir = argc > 2 ? argv[2] : (dirEnv ? dirEnv : "uploads");
+    size_t workers = argc > 3 ? strtoul(argv[3], nullptr, 10) : (workersEnv ? strtoul(workersEnv, nullptr, 10) : 0);
+
+    if (port <= 0 || port > 65535) 
+    {
+        std::cerr << "Invalid port." << std::endl;
+        return 1;
+    }
+
+    // Block the shutdown signals in every thread; main waits for them below
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try 
+    {
+        FileRoutes routes(uploadDir);
+        HttpServer server(static_cast<uint16_t>(port), workers, routes);
+        server.Start();
+        std::cout << "Storing uploads in " << uploadDir << std::endl;
+
+        int signal = 0;
+        sigwait(&signals, &signal);
+        std::cout << "Shutting down." << std::endl;
+        server.Stop();
+    } 
+    catch (const std::exception& e) 
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include "multipartParser.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+// Limit on the size of one part's header block
+const size_t MAX_PART_HEADERS = 16 * 1024;
+
+std::string lower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+// Value of a (possibly quoted) parameter such as name="x" in a header value
+std::string parameter(const std::string& value, const std::string& key)
+{
+    std::string lowered = lower(value);
+    size_t pos = 0;
+    while ((pos = lowered.find(key + "=", pos)) != std::string::npos) {
+        // Must be a whole parameter name ("name" must not match "filename")
+        if (pos > 0 && lowered[pos - 1] != ';' && lowered[pos - 1] != ' ' && lowered[pos - 1] != '\t') {
+            pos += key.size();
+            continue;
+        }
+        pos += key.size() + 1;
+        std::string out;
+        if (pos < value.size() && value[pos] == '"') {
+            for (++pos; pos < value.size() && value[pos] != '"'; ++pos) {
+                if (value[pos] == '\\' && pos + 1 < value.size()) {
+                    ++pos;
+                }
+                out.push_back(value[pos]);
+            }
+        } else {
+            while (pos < value.size() && value[pos] != ';' && !isspace(static_cast<unsigned char>(value[pos]))) {
+                out.push_back(value[pos++]);
+            }
+        }
+        return out;
+    }
+    return std::string();
+}
+
+} // namespace
+
+MultipartParser::MultipartParser(const std::string& boundary, Listener& listener)
+    : m_delimiter("\r\n--" + boundary),
+      m_listener(listener),
+      m_state(State::PREAMBLE),
+      m_buffer("\r\n")  // The first boundary has no CRLF in front; pretend it has
+{
+}
+
+std::string MultipartParser::boundaryOf(const std::string& contentType)
+{
+    if (lower(contentType).compare(0, 19, "multipart/form-data") != 0) {
+        return std::string();
+    }
+    return parameter(contentType, "boundary");
+}
+
+bool MultipartParser::fail(const std::string& error)
+{
+    m_state = State::FAILED;
+    m_error = error;
+    return false;
+}
+
+bool MultipartParser::beginPart(const std::string& headers)
+{
+    std::string name;
+    std::string filename;
+    size_t start = 0;
+    while (start < headers.size()) {
+        size_t end = headers.find("\r\n", start);
+        if (end == std::string::npos) {
+            end = headers.size();
+        }
+        std::string line = headers.substr(start, end - start);
+        start = end + 2;
+
+        size_t colon = line.find(':');
+        if (colon != std::string::npos && lower(line.substr(0, colon)) == "content-disposition") {
+            std::string value = line.substr(colon + 1);
+            name = parameter(value, "name");
+            filename = parameter(value, "filename");
+        }
+    }
+    return m_listener.onPartBegin(name, filename) || fail("Upload rejected");
+}
+
+bool MultipartParser::feed(const char* data, size_t len)
+{
+    if (m_state == State::FAILED) {
+        return false;
+    }
+    if (m_state == State::DONE) {
+        return true;  // Epilogue is ignored
+    }
+    m_buffer.append(data, len);
+
+    for (;;) {
+        switch (m_state) {
+        case State::PREAMBLE: {
+            size_t pos = m_buffer.find(m_delimiter);
+            if (pos == std::string::npos) {
+                // Keep what could be the start of the delimiter
+                if (m_buffer.size() >= m_delimiter.size()) {
+                    m_buffer.erase(0, m_buffer.size() - m_delimiter.size() + 1);
+                }
+                return true;
+            }
+            m_buffer.erase(0, pos + m_delimiter.size());
+            m_state = State::AFTER_BOUNDARY;
+            break;
+        }
+
+        case State::AFTER_BOUNDARY:
+            if (m_buffer.size() < 2) {
+                return true;
+            }
+            if (m_buffer.compare(0, 2, "--") == 0) {
+                m_buffer.clear();
+                m_state = State::DONE;
+                return true;
+            }
+            if (m_buffer.compare(0, 2, "\r\n") != 0) {
+                return fail("Malformed multipart boundary");
+            }
+            m_buffer.erase(0, 2);
+            m_state = State::HEADERS;
+            break;
+
+        case State::HEADERS: {
+            size_t pos = m_buffer.compare(0, 2, "\r\n") == 0 ? 0 : m_buffer.find("\r\n\r\n");
+            if (pos == std::string::npos) {
+                return m_buffer.size() <= MAX_PART_HEADERS || fail("Multipart headers too large");
+            }
+            std::string headers = m_buffer.substr(0, pos);
+            m_buffer.erase(0, pos == 0 ? 2 : pos + 4);
+            if (!beginPart(headers)) {
+                return false;
+            }
+            m_state = State::BODY;
+            break;
+        }
+
+        case State::BODY: {
+            size_t pos = m_buffer.find(m_delimiter);
+            if (pos == std::string::npos) {
+                // Everything except a possible delimiter prefix at the end is part data
+                if (m_buffer.size() >= m_delimiter.size()) {
+                    size_t safe = m_buffer.size() - m_delimiter.size() + 1;
+                    if (!m_listener.onPartData(m_buffer.data(), safe)) {
+                        return fail("Upload rejected");
+                    }
+                    m_buffer.erase(0, safe);
+                }
+                return true;
+            }
+            if ((pos > 0 && !m_listener.onPartData(m_buffer.data(), pos)) || !m_listener.onPartEnd()) {
+                return fail("Upload rejected");
+            }
+            m_buffer.erase(0, pos + m_delimiter.size());
+            m_state = State::AFTER_BOUNDARY;
+            break;
+        }
+
+        case State::DONE:
+            return true;
+
+        case State::FAILED:
+            return false;
+        }
+    }
+}
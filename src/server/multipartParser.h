@@ -0,0 +1,99 @@
+/**
+ * @file multipartParser.h
+ * @brief Incremental multipart/form-data parser.
+ */
+#ifndef MULTIPART_PARSER_H
+#define MULTIPART_PARSER_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @class MultipartParser
+ * @brief Splits a multipart/form-data body into parts as bytes arrive.
+ *
+ * The body can be fed in pieces of any size; part data is passed on as soon
+ * as it is known not to contain the start of the next boundary, so a file
+ * part is streamed without ever holding more than one read buffer (plus the
+ * boundary length) in memory.
+ */
+class MultipartParser
+{
+public:
+    /**
+     * @class Listener
+     * @brief Receives the parts of the body.
+     */
+    class Listener
+    {
+    public:
+        virtual ~Listener() = default;
+
+        /**
+         * @brief A part starts.
+         * @param name Form field name.
+         * @param filename Filename of a file part, empty otherwise.
+         * @return false to abort parsing.
+         */
+        virtual bool onPartBegin(const std::string& name, const std::string& filename) = 0;
+
+        /**
+         * @brief Data of the current part.
+         * @return false to abort parsing.
+         */
+        virtual bool onPartData(const char* data, size_t len) = 0;
+
+        /**
+         * @brief The current part ended.
+         * @return false to abort parsing.
+         */
+        virtual bool onPartEnd() = 0;
+    };
+
+    /**
+     * @brief Construct a parser.
+     * @param boundary Boundary from the Content-Type header (without leading dashes).
+     * @param listener Receives the parts.
+     */
+    MultipartParser(const std::string& boundary, Listener& listener);
+
+    /**
+     * @brief Extract the boundary parameter of a multipart Content-Type header.
+     * @return Empty string if the header is not multipart/form-data with a boundary.
+     */
+    static std::string boundaryOf(const std::string& contentType);
+
+    /**
+     * @brief Feed the next piece of the body.
+     * @return false on malformed input or if the listener aborted.
+     */
+    bool feed(const char* data, size_t len);
+
+    /**
+     * @brief true once the closing boundary was seen.
+     */
+    bool done() const { return m_state == State::DONE; }
+
+    /**
+     * @brief Description of the last error.
+     */
+    const std::string& error() const { return m_error; }
+
+private:
+    enum class State { PREAMBLE, HEADERS, BODY, AFTER_BOUNDARY, DONE, FAILED };
+
+    /**
+     * @brief Parse the buffered part headers and notify the listener.
+     */
+    bool beginPart(const std::string& headers);
+
+    bool fail(const std::string& error);
+
+    std::string     m_delimiter;    ///< "\r\n--" + boundary
+    Listener&       m_listener;     ///< Receives the parts
+    State           m_state;        ///< Parser state
+    std::string     m_buffer;       ///< Bytes not consumed yet
+    std::string     m_error;        ///< Last error
+};
+
+#endif // MULTIPART_PARSER_H
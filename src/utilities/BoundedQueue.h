@@ -0,0 +1,214 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+/**
+ * @enum QueuePolicy
+ * @brief What a BoundedQueue does with a new item when it is full.
+ */
+enum class QueuePolicy
+{
+    BLOCK,          // Wait until the consumer makes room
+    DROP_OLDEST,    // Drop the oldest queued item to make room
+    COALESCE        // Merge into a queued item with the same key; wait if there is none
+};
+
+/**
+ * @class BoundedQueue
+ * @brief Keyed FIFO queue with a fixed capacity and an overflow policy.
+ *
+ * Every item carries a key (e.g. a file path). With QueuePolicy::COALESCE a
+ * new item whose key is already queued is merged into that item in place,
+ * whether or not the queue is full, so a storm of events on the same few
+ * files occupies one slot per file.
+ *
+ * @tparam T Element type; must be move-constructible.
+ * @tparam Key Key type; must be hashable and equality-comparable.
+ */
+template <typename T, typename Key = std::string>
+class BoundedQueue
+{
+
+public:
+
+    /**
+     * @brief Merges a new item into a queued item with the same key.
+     */
+    using Merge = std::function<void(T& queued, T&& incoming)>;
+
+    /**
+     * @brief Constructor for BoundedQueue.
+     *
+     * @param capacity Maximum number of queued items.
+     * @param policy Overflow policy.
+     * @param merge Merge function for QueuePolicy::COALESCE; the default keeps the newer item.
+     */
+    BoundedQueue            (size_t capacity, QueuePolicy policy, Merge merge = nullptr)
+        : m_capacity(capacity ? capacity : 1),
+          m_policy(policy),
+          m_merge(merge ? std::move(merge) : [](T& queued, T&& incoming) { queued = std::move(incoming); }),
+          m_closed(false),
+          m_dropped(0),
+          m_coalesced(0)
+    {
+    }
+
+    /**
+     * @brief Queue an item according to the policy (thread-safe).
+     *
+     * @param key Key of the item.
+     * @param item Item to queue.
+     * @param wait Wait for room even with QueuePolicy::DROP_OLDEST.
+     * @return false if an older item was dropped to make room. Items pushed
+     *         after close() are discarded.
+     */
+    bool push               (const Key& key, T item, bool wait = false)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool dropped = false;
+
+        // Re-checked after every wait: the key may have been queued meanwhile
+        for (;;)
+        {
+            if (m_policy == QueuePolicy::COALESCE)
+            {
+                auto it = m_index.find(key);
+                if (it != m_index.end())
+                {
+                    m_merge(it->second->second, std::move(item));
+                    ++m_coalesced;
+                    return true;
+                }
+            }
+            if (m_closed)
+            {
+                return true;
+            }
+            if (m_items.size() < m_capacity)
+            {
+                break;
+            }
+            if (m_policy == QueuePolicy::DROP_OLDEST && !wait)
+            {
+                eraseFront();
+                ++m_dropped;
+                dropped = true;
+                continue;
+            }
+            m_notFull.wait(lock);
+        }
+
+        m_items.emplace_back(key, std::move(item));
+        if (m_policy == QueuePolicy::COALESCE)
+        {
+            m_index[key] = std::prev(m_items.end());
+        }
+        return !dropped;
+    }
+
+    /**
+     * @brief Take the oldest item without waiting (thread-safe).
+     *
+     * @return false if the queue is empty.
+     */
+    bool tryPop             (T& item)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_items.empty())
+            {
+                return false;
+            }
+            item = std::move(m_items.front().second);
+            eraseFront();
+        }
+        m_notFull.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Release waiting producers and discard all further pushes.
+     */
+    void close              ()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+    }
+
+    /**
+     * @brief Number of queued items.
+     */
+    size_t size             () const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+    /**
+     * @brief Number of items dropped by QueuePolicy::DROP_OLDEST so far.
+     */
+    uint64_t dropped        () const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+
+    /**
+     * @brief Number of items merged by QueuePolicy::COALESCE so far.
+     */
+    uint64_t coalesced      () const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_coalesced;
+    }
+
+private:
+
+    using Entry = std::pair<Key, T>;
+
+    /**
+     * @brief Remove the oldest item; m_mutex must be held.
+     */
+    void eraseFront         ()
+    {
+        if (m_policy == QueuePolicy::COALESCE)
+        {
+            m_index.erase(m_items.front().first);
+        }
+        m_items.pop_front();
+    }
+
+    mutable std::mutex      m_mutex;        // Protects all members below
+
+    std::condition_variable m_notFull;      // Signalled when an item is taken
+
+    std::list<Entry>        m_items;        // Queued items, oldest first
+
+    std::unordered_map<Key, typename std::list<Entry>::iterator> m_index;  // Key -> item (COALESCE only)
+
+    size_t                  m_capacity;     // Maximum number of queued items
+
+    QueuePolicy             m_policy;       // Overflow policy
+
+    Merge                   m_merge;        // Merges items with the same key
+
+    bool                    m_closed;       // Set by close()
+
+    uint64_t                m_dropped;      // Items dropped by DROP_OLDEST
+
+    uint64_t                m_coalesced;    // Items merged by COALESCE
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,240 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class EventBus
+ * @brief Typed publish/subscribe of events of one type, without allocating per event.
+ *
+ * Observers are plain objects with a member function taking const Event&; no
+ * base class or virtual call is needed. attach() instantiates a small thunk
+ * for the observer's type and member function at compile time, so the
+ * compiler sees the concrete handler and can inline it into the thunk.
+ * Events can also be published in batches (publishBatch()); observers
+ * attached with attachBatch() then receive a whole batch in one call, the
+ * others one event at a time.
+ *
+ * The observer list is immutable and replaced as a whole by attach() and
+ * detach(), so observers may be attached or detached from any thread,
+ * including from inside a handler, while events are being published.
+ * publish() takes no lock: it registers in one of two reader counters, picked
+ * by the current epoch, and iterates the list it loaded. A writer publishes
+ * the new list, advances the epoch and waits for the counter of the previous
+ * epoch to drain before freeing the old list. Once detach() returns, the
+ * observer is not called again, unless detach() was called from a handler.
+ *
+ * @tparam Event Event type, passed to observers by const reference.
+ */
+template <typename Event>
+class EventBus
+{
+
+public:
+
+    EventBus                    () : m_observers(new List()), m_epoch(0)
+    {
+        m_readers[0].store(0);
+        m_readers[1].store(0);
+    }
+
+    /**
+     * @brief Destructor; no publish() may be running.
+     */
+    ~EventBus                   ()
+    {
+        delete m_observers.load();
+    }
+
+    EventBus                    (const EventBus&) = delete;
+    EventBus& operator=         (const EventBus&) = delete;
+
+    /**
+     * @brief Attach an observer, called through a member function (thread-safe).
+     *
+     * @tparam Method Member function of the observer taking const Event&, e.g. &RestApiMngr::onEvent.
+     * @param observer Observer; must stay valid until detached.
+     */
+    template <auto Method, typename Observer>
+    void attach                 (Observer* observer)
+    {
+        add(observer, [](void* target, const Event* events, size_t count) {
+            for (size_t i = 0; i < count; ++i)
+            {
+                (static_cast<Observer*>(target)->*Method)(events[i]);
+            }
+        });
+    }
+
+    /**
+     * @brief Attach an observer whose handler is onEvent(const Event&) (thread-safe).
+     */
+    template <typename Observer>
+    void attach                 (Observer* observer)
+    {
+        attach<&Observer::onEvent>(observer);
+    }
+
+    /**
+     * @brief Attach an observer receiving whole batches through a member function (thread-safe).
+     *
+     * @tparam Method Member function of the observer taking (const Event* events, size_t count);
+     *                events published one at a time arrive as batches of one.
+     * @param observer Observer; must stay valid until detached.
+     */
+    template <auto Method, typename Observer>
+    void attachBatch            (Observer* observer)
+    {
+        add(observer, [](void* target, const Event* events, size_t count) {
+            (static_cast<Observer*>(target)->*Method)(events, count);
+        });
+    }
+
+    /**
+     * @brief Attach an observer whose handler is onEvents(const Event* events, size_t count) (thread-safe).
+     */
+    template <typename Observer>
+    void attachBatch            (Observer* observer)
+    {
+        attachBatch<&Observer::onEvents>(observer);
+    }
+
+    /**
+     * @brief Detach an observer (thread-safe).
+     *
+     * Waits for publish() calls that may still see the observer, except when
+     * called from a handler.
+     *
+     * @param observer Observer passed to attach(); every attachment of it is removed.
+     */
+    void detach                 (const void* observer)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        List* observers = new List(*m_observers.load());
+        observers->erase(std::remove_if(observers->begin(), observers->end(),
+                                        [observer](const Subscriber& s) { return s.observer == observer; }),
+                         observers->end());
+        replace(observers);
+    }
+
+    /**
+     * @brief Call every attached observer with an event (thread-safe, lock-free).
+     */
+    void publish                (const Event& event) const
+    {
+        publishBatch(&event, 1);
+    }
+
+    /**
+     * @brief Call every attached observer with a batch of events, in order (thread-safe, lock-free).
+     *
+     * @param events First event of the batch.
+     * @param count Number of events.
+     */
+    void publishBatch           (const Event* events, size_t count) const
+    {
+        for (;;)
+        {
+            uint32_t epoch = m_epoch.load();
+            std::atomic<uint32_t>& readers = m_readers[epoch & 1];
+            readers.fetch_add(1);
+
+            // A writer advanced the epoch meanwhile and may not wait for this counter: register again
+            if (m_epoch.load() != epoch)
+            {
+                readers.fetch_sub(1);
+                continue;
+            }
+
+            // Unregisters even if a handler throws, or writers would wait forever
+            struct Registration
+            {
+                std::atomic<uint32_t>& readers;
+                ~Registration() { --publishDepth(); readers.fetch_sub(1); }
+            } registration{readers};
+            ++publishDepth();
+
+            const List* observers = m_observers.load();
+            for (const Subscriber& subscriber : *observers)
+            {
+                subscriber.handler(subscriber.observer, events, count);
+            }
+            return;
+        }
+    }
+
+private:
+
+    // Thunk delivering a batch to one observer
+    using Handler = void (*)(void* observer, const Event* events, size_t count);
+
+    /**
+     * @struct Subscriber
+     * @brief Observer and the thunk calling its handler.
+     */
+    struct Subscriber
+    {
+        void*   observer;   // Observer object
+        Handler handler;    // Calls the observer's member function
+    };
+
+    using List = std::vector<Subscriber>;
+
+    /**
+     * @brief Add a subscriber to a new observer list.
+     */
+    void add                    (void* observer, Handler handler)
+    {
+        std::lock_guard<std::mutex> lock(m_writeMutex);
+        List* observers = new List(*m_observers.load());
+        observers->push_back(Subscriber{observer, handler});
+        replace(observers);
+    }
+
+    /**
+     * @brief Install a new observer list and free the old ones once unused; m_writeMutex must be held.
+     */
+    void replace                (const List* observers)
+    {
+        m_retired.emplace_back(m_observers.exchange(observers));
+
+        // A handler cannot wait for the publish() running it: the next writer frees the list
+        if (publishDepth() > 0)
+        {
+            return;
+        }
+
+        // Readers registered under the new epoch see the new list
+        uint32_t previous = m_epoch.fetch_add(1);
+        while (m_readers[previous & 1].load() != 0)
+        {
+            std::this_thread::yield();
+        }
+        m_retired.clear();
+    }
+
+    /**
+     * @brief Number of publish() calls running on this thread, across all buses of this event type.
+     */
+    static int& publishDepth    ()
+    {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    std::atomic<const List*>                m_observers;    // Current list
+    std::atomic<uint32_t>                   m_epoch;        // Advanced by every writer that waits for readers
+    mutable std::atomic<uint32_t>           m_readers[2];   // publish() calls running, by epoch parity
+
+    std::mutex                              m_writeMutex;   // Serializes attach() and detach()
+    std::vector<std::unique_ptr<const List>> m_retired;     // Replaced lists readers may still use
+};
+
+#endif // EVENT_BUS_H
@@ -0,0 +1,151 @@
+#include "IoUring.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sysSetup(unsigned entries, io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+IoUring::IoUring(unsigned entries)
+    : m_sqRing(MAP_FAILED),
+      m_cqRing(MAP_FAILED),
+      m_sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_fd = sysSetup(entries, &params);
+    if (m_fd == -1)
+    {
+        throw std::runtime_error(std::string("io_uring_setup failed: ") + strerror(errno));
+    }
+
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap)
+    {
+        m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+    }
+
+    m_sqRing = mmap(nullptr, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    m_cqRing = singleMmap ? m_sqRing
+                          : mmap(nullptr, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(
+        mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+
+    if (m_sqRing == MAP_FAILED || m_cqRing == MAP_FAILED || m_sqes == MAP_FAILED)
+    {
+        int saved = errno;
+        this->~IoUring();
+        throw std::runtime_error(std::string("Failed to map io_uring: ") + strerror(saved));
+    }
+
+    char* sq = static_cast<char*>(m_sqRing);
+    char* cq = static_cast<char*>(m_cqRing);
+    m_sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    m_sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+    m_sqLocalTail = *m_sqTail;
+    m_cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    m_cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // SQE i always sits in slot i, so the indirection array never changes
+    unsigned* array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    for (unsigned i = 0; i < m_sqEntries; ++i)
+    {
+        array[i] = i;
+    }
+}
+
+IoUring::~IoUring()
+{
+    if (m_sqes != MAP_FAILED)
+    {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    }
+    if (m_cqRing != MAP_FAILED && m_cqRing != m_sqRing)
+    {
+        munmap(m_cqRing, m_cqRingSize);
+    }
+    m_cqRing = MAP_FAILED;
+    if (m_sqRing != MAP_FAILED)
+    {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = MAP_FAILED;
+    }
+    if (m_fd != -1)
+    {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+unsigned IoUring::freeSqes() const
+{
+    return m_sqEntries - (m_sqLocalTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE));
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    if (freeSqes() == 0)
+    {
+        return nullptr;
+    }
+    io_uring_sqe* sqe = &m_sqes[m_sqLocalTail & m_sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    ++m_sqLocalTail;
+    return sqe;
+}
+
+int IoUring::submit(unsigned waitFor)
+{
+    unsigned toSubmit = m_sqLocalTail - *m_sqTail;
+    __atomic_store_n(m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE);
+
+    if (toSubmit == 0 && waitFor == 0)
+    {
+        return 0;
+    }
+
+    for (;;)
+    {
+        int rc = sysEnter(m_fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0);
+        if (rc >= 0)
+        {
+            return rc;
+        }
+        if (errno != EINTR)
+        {
+            return -errno;
+        }
+    }
+}
+
+bool IoUring::popCompletion(io_uring_cqe& out)
+{
+    unsigned head = *m_cqHead;
+    if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+    {
+        return false;
+    }
+    out = m_cqes[head & m_cqMask];
+    __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
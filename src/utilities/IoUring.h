@@ -0,0 +1,90 @@
+#ifndef IO_URING_H
+#define IO_URING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <linux/io_uring.h>
+
+/**
+ * @class IoUring
+ * @brief Minimal io_uring instance driven through the raw system calls.
+ *
+ * Sets up the submission and completion rings with io_uring_setup(2), maps
+ * them, and exposes just enough to queue SQEs, submit them in one
+ * io_uring_enter(2) call and walk the completions. No liburing dependency.
+ *
+ * @note Not thread-safe; one thread owns the instance.
+ */
+class IoUring
+{
+
+public:
+
+    /**
+     * @brief Constructor for IoUring.
+     *
+     * @param entries Submission queue size (rounded up to a power of two by the kernel).
+     * @throw std::runtime_error if io_uring is unavailable or the rings cannot be mapped.
+     */
+    explicit IoUring        (unsigned entries);
+
+    /**
+     * @brief Destructor for IoUring. Unmaps the rings and closes the ring fd.
+     */
+    ~IoUring                ();
+
+    IoUring                 (const IoUring&) = delete;
+    IoUring& operator=      (const IoUring&) = delete;
+
+    /**
+     * @brief Get a zeroed SQE to fill in.
+     *
+     * @return nullptr if the submission queue is full.
+     */
+    io_uring_sqe* getSqe    ();
+
+    /**
+     * @brief Submit queued SQEs and optionally wait for completions.
+     *
+     * @param waitFor Minimum number of completions to wait for.
+     * @return Number of SQEs submitted, or -errno.
+     */
+    int submit              (unsigned waitFor = 0);
+
+    /**
+     * @brief Take the next completion.
+     *
+     * @param out Receives a copy of the CQE.
+     * @return false if the completion queue is empty.
+     */
+    bool popCompletion      (io_uring_cqe& out);
+
+    /**
+     * @brief Number of free SQE slots.
+     */
+    unsigned freeSqes       () const;
+
+private:
+
+    int                 m_fd;           // Ring file descriptor
+
+    void*               m_sqRing;       // Mapped submission ring
+    size_t              m_sqRingSize;   // Size of the submission ring mapping
+    void*               m_cqRing;       // Mapped completion ring (may alias m_sqRing)
+    size_t              m_cqRingSize;   // Size of the completion ring mapping
+    io_uring_sqe*       m_sqes;         // Mapped SQE array
+    size_t              m_sqesSize;     // Size of the SQE mapping
+
+    unsigned*           m_sqHead;       // Kernel-owned SQ head
+    unsigned*           m_sqTail;       // Shared SQ tail
+    unsigned            m_sqMask;       // SQ index mask
+    unsigned            m_sqEntries;    // SQ size
+    unsigned            m_sqLocalTail;  // Tail including SQEs not yet published
+
+    unsigned*           m_cqHead;       // Shared CQ head
+    unsigned*           m_cqTail;       // Kernel-owned CQ tail
+    unsigned            m_cqMask;       // CQ index mask
+    io_uring_cqe*       m_cqes;         // CQE array
+};
+
+#endif // IO_URING_H
@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include "Logger.h"
+#include "Metrics.h"
+
+// Default ring size per logging thread
+static const size_t DEFAULT_RING_SIZE = 256 * 1024;
+
+// Time between two drains when nothing asks for one
+static const std::chrono::milliseconds DRAIN_INTERVAL(50);
+
+// Formatted output written as soon as this much is pending
+static const size_t WRITE_BATCH = 1 << 20;
+
+namespace
+{
+    const char* const LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO ", "WARN ", "ERROR"};
+
+    /**
+     * @brief Write a whole buffer to a file descriptor.
+     */
+    void writeAll(int fd, const std::string& data)
+    {
+        size_t done = 0;
+        while (done < data.size())
+        {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                return;
+            }
+            done += static_cast<size_t>(n);
+        }
+    }
+
+    /**
+     * @brief Copy bytes out of a ring, wrapping at its end.
+     */
+    void readRing(const std::vector<char>& ring, size_t mask, uint64_t pos, void* out, size_t len)
+    {
+        size_t start = static_cast<size_t>(pos) & mask;
+        size_t first = std::min(len, ring.size() - start);
+        std::memcpy(out, ring.data() + start, first);
+        std::memcpy(static_cast<char*>(out) + first, ring.data(), len - first);
+    }
+
+    /**
+     * @struct RingHandle
+     * @brief Thread-local owner of a thread's ring; retires it when the thread exits.
+     */
+    struct RingHandle
+    {
+        std::shared_ptr<void> ring;         // Keeps the ring alive while the writer may still drain it
+        std::atomic<bool>*    retired = nullptr;
+
+        ~RingHandle()
+        {
+            if (retired)
+            {
+                retired->store(true, std::memory_order_release);
+            }
+        }
+    };
+}
+
+Logger::Ring::Ring(size_t capacity)
+    : m_buffer(capacity),
+      m_mask(capacity - 1),
+      m_tid(static_cast<int>(::syscall(SYS_gettid))),
+      m_head(0),
+      m_tail(0),
+      m_dropped(0),
+      m_retired(false)
+{
+}
+
+bool Logger::Ring::write(const RecordHeader& header, const void* args, size_t argsSize)
+{
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    uint64_t tail = m_tail.load(std::memory_order_acquire);
+    if (header.size > m_buffer.size() - (head - tail))
+    {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Copy in up to three pieces: header, arguments, each possibly wrapping around the end
+    auto put = [this](uint64_t pos, const void* data, size_t len) {
+        size_t start = static_cast<size_t>(pos) & m_mask;
+        size_t first = std::min(len, m_buffer.size() - start);
+        std::memcpy(m_buffer.data() + start, data, first);
+        std::memcpy(m_buffer.data(), static_cast<const char*>(data) + first, len - first);
+    };
+    put(head, &header, sizeof(header));
+    put(head + sizeof(header), args, argsSize);
+
+    m_head.store(head + header.size, std::memory_order_release);
+    return true;
+}
+
+Logger& Logger::getInstance()
+{
+    static Logger instance;
+    return instance;
+}
+
+Logger::Logger()
+    : m_ringSize(DEFAULT_RING_SIZE),
+      m_stampSecond(-1),
+      m_wake(false),
+      m_passes(0),
+      // Registered first so the registry outlives the logger's last drain
+      m_droppedCounter(MetricsRegistry::getInstance().counter(
+          "filesserver_log_records_dropped_total", "Log records lost to a full ring"))
+{
+    start();
+}
+
+Logger::~Logger()
+{
+    stop();
+    drain();
+}
+
+void Logger::SetRingSize(size_t bytes)
+{
+    size_t size = 4096;
+    while (size < bytes)
+    {
+        size <<= 1;
+    }
+    m_ringSize.store(size);
+}
+
+Logger::Ring& Logger::localRing()
+{
+    thread_local RingHandle handle;
+    if (!handle.ring)
+    {
+        auto ring = std::make_shared<Ring>(m_ringSize.load());
+        {
+            std::lock_guard<std::mutex> lock(m_ringsMutex);
+            m_rings.push_back(ring);
+        }
+        handle.retired = &ring->m_retired;
+        handle.ring = ring;
+    }
+    return *static_cast<Ring*>(handle.ring.get());
+}
+
+void Logger::encodeString(char*& out, const char* data, size_t len)
+{
+    uint32_t length = static_cast<uint32_t>(len);
+    *out++ = ARG_STRING;
+    std::memcpy(out, &length, sizeof(length));
+    out += sizeof(length);
+    std::memcpy(out, data, len);
+    out += len;
+}
+
+void Logger::format(const RecordHeader& header, int tid, const char* args, std::string& out)
+{
+    // Timestamp: UTC, microseconds; the date and time only change once per second
+    int64_t seconds = header.timeNs / 1000000000;
+    if (seconds != m_stampSecond)
+    {
+        time_t t = static_cast<time_t>(seconds);
+        struct tm parts;
+        gmtime_r(&t, &parts);
+        char date[32];
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S.", &parts);
+        m_stampSecond = seconds;
+        m_stampText = date;
+    }
+    out += m_stampText;
+    char micros[6];
+    uint32_t us = static_cast<uint32_t>(header.timeNs % 1000000000 / 1000);
+    for (int i = 5; i >= 0; --i, us /= 10)
+    {
+        micros[i] = static_cast<char>('0' + us % 10);
+    }
+    out.append(micros, sizeof(micros));
+    out += "Z ";
+    out += LEVEL_NAMES[static_cast<unsigned>(header.level)];
+    out += " [";
+    appendNumber(out, static_cast<uint64_t>(tid));
+    out += "] ";
+
+    unsigned remaining = header.argc;
+    auto appendArg = [&out, &args, &remaining]() {
+        --remaining;
+        switch (static_cast<uint8_t>(*args++))
+        {
+            case ARG_INT:
+            {
+                int64_t v;
+                std::memcpy(&v, args, sizeof(v));
+                args += sizeof(v);
+                if (v < 0)
+                {
+                    out += '-';
+                }
+                appendNumber(out, v < 0 ? 0 - static_cast<uint64_t>(v) : static_cast<uint64_t>(v));
+                break;
+            }
+            case ARG_UINT:
+            {
+                uint64_t v;
+                std::memcpy(&v, args, sizeof(v));
+                args += sizeof(v);
+                appendNumber(out, v);
+                break;
+            }
+            case ARG_DOUBLE:
+            {
+                double v;
+                std::memcpy(&v, args, sizeof(v));
+                args += sizeof(v);
+                char number[32];
+                snprintf(number, sizeof(number), "%g", v);
+                out += number;
+                break;
+            }
+            case ARG_BOOL:
+                out += *args++ ? "true" : "false";
+                break;
+            case ARG_CHAR:
+                out += *args++;
+                break;
+            case ARG_STRING:
+            {
+                uint32_t length;
+                std::memcpy(&length, args, sizeof(length));
+                args += sizeof(length);
+                out.append(args, length);
+                args += length;
+                break;
+            }
+        }
+    };
+
+    const char* literal = header.format;
+    for (const char* p = header.format; *p; ++p)
+    {
+        if (p[0] == '{' && p[1] == '}' && remaining > 0)
+        {
+            out.append(literal, p - literal);
+            appendArg();
+            literal = ++p + 1;
+        }
+    }
+    out += literal;
+
+    // More arguments than placeholders: append them rather than lose them
+    while (remaining > 0)
+    {
+        out += ' ';
+        appendArg();
+    }
+    out += '\n';
+}
+
+void Logger::appendNumber(std::string& out, uint64_t value)
+{
+    char digits[20];
+    int n = 0;
+    do
+    {
+        digits[sizeof(digits) - 1 - n++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+    out.append(digits + sizeof(digits) - n, n);
+}
+
+void Logger::drain()
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        rings = m_rings;
+    }
+
+    // Every ring is in time order already: merge them, oldest record first
+    struct Cursor
+    {
+        Ring*           ring;
+        uint64_t        tail;
+        uint64_t        head;
+        RecordHeader    next;
+    };
+    std::vector<Cursor> cursors;
+    std::vector<std::shared_ptr<Ring>> retired;
+    for (const auto& ring : rings)
+    {
+        // Read retired before head: a retired ring whose records are all consumed can go
+        if (ring->m_retired.load(std::memory_order_acquire))
+        {
+            retired.push_back(ring);
+        }
+        Cursor cursor;
+        cursor.ring = ring.get();
+        cursor.tail = ring->m_tail.load(std::memory_order_relaxed);
+        cursor.head = ring->m_head.load(std::memory_order_acquire);
+        if (cursor.tail < cursor.head)
+        {
+            readRing(ring->m_buffer, ring->m_mask, cursor.tail, &cursor.next, sizeof(cursor.next));
+            cursors.push_back(cursor);
+        }
+    }
+
+    std::string out;
+    std::string err;
+    std::vector<char> record;
+    while (!cursors.empty())
+    {
+        size_t oldest = 0;
+        for (size_t i = 1; i < cursors.size(); ++i)
+        {
+            if (cursors[i].next.timeNs < cursors[oldest].next.timeNs)
+            {
+                oldest = i;
+            }
+        }
+
+        Cursor& cursor = cursors[oldest];
+        Ring& ring = *cursor.ring;
+        record.resize(cursor.next.size - sizeof(RecordHeader));
+        readRing(ring.m_buffer, ring.m_mask, cursor.tail + sizeof(RecordHeader), record.data(), record.size());
+        format(cursor.next, ring.m_tid, record.data(), cursor.next.level >= Level::WARN ? err : out);
+        cursor.tail += cursor.next.size;
+        ring.m_tail.store(cursor.tail, std::memory_order_release);
+
+        if (cursor.tail < cursor.head)
+        {
+            readRing(ring.m_buffer, ring.m_mask, cursor.tail, &cursor.next, sizeof(cursor.next));
+        }
+        else
+        {
+            cursors.erase(cursors.begin() + oldest);
+        }
+
+        // Bounded memory however much was logged since the last drain
+        if (out.size() >= WRITE_BATCH)
+        {
+            writeAll(STDOUT_FILENO, out);
+            out.clear();
+        }
+    }
+
+    for (const auto& ring : rings)
+    {
+        uint64_t dropped = ring->m_dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0)
+        {
+            m_droppedCounter.inc(dropped);
+            err += "Logger: " + std::to_string(dropped) + " records of thread " +
+                   std::to_string(ring->m_tid) + " dropped, ring full\n";
+        }
+    }
+
+    writeAll(STDOUT_FILENO, out);
+    writeAll(STDERR_FILENO, err);
+
+    if (!retired.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        for (const auto& ring : retired)
+        {
+            m_rings.erase(std::remove(m_rings.begin(), m_rings.end(), ring), m_rings.end());
+        }
+    }
+}
+
+void Logger::flush()
+{
+    std::unique_lock<std::mutex> lock(m_wakeMutex);
+
+    // The drain running now may have started before the call: wait for the next one to end
+    uint64_t target = m_passes + 2;
+    while (m_passes < target && m_running)
+    {
+        m_wake = true;
+        m_wakeCond.notify_one();
+        m_passCond.wait(lock);
+    }
+}
+
+void Logger::thread()
+{
+    while (m_running)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            if (!m_wake)
+            {
+                m_wakeCond.wait_for(lock, DRAIN_INTERVAL);
+            }
+            m_wake = false;
+        }
+
+        drain();
+
+        {
+            std::lock_guard<std::mutex> lock(m_wakeMutex);
+            ++m_passes;
+        }
+        m_passCond.notify_all();
+    }
+}
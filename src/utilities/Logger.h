@@ -0,0 +1,321 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "threadBase.h"
+
+class MetricCounter;
+
+/** Log levels, usable in #if */
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO  2
+#define LOG_LEVEL_WARN  3
+#define LOG_LEVEL_ERROR 4
+
+/** Calls below this level are compiled out, arguments included (-DFILESSERVER_LOG_LEVEL=LOG_LEVEL_DEBUG) */
+#ifndef FILESSERVER_LOG_LEVEL
+#define FILESSERVER_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * @class Logger
+ * @brief Asynchronous logger: threads append binary records, one background thread formats and writes them.
+ *
+ * A log call copies a pointer to its format string (which must be a string
+ * literal), a timestamp and its arguments into a ring buffer owned by the
+ * calling thread. It takes no lock, does not format, and makes no system
+ * call. The writer thread drains every ring every 50 ms (at once for
+ * warnings and errors), merges the records by time, replaces each "{}"
+ * of the format with the next argument and writes whole batches to stdout
+ * (errors and warnings to stderr). A full ring drops the record and counts
+ * it, so a log storm never blocks the thread that logs.
+ *
+ * Use the LOG_* macros, e.g. LOG_INFO("Upload queued: {}", filename);
+ * arguments may be integers, floating point numbers, bools, chars, C strings
+ * and std::strings.
+ */
+class Logger : public ThreadBase
+{
+
+public:
+
+    /**
+     * @enum Level
+     * @brief Severity of a record.
+     */
+    enum class Level : uint8_t
+    {
+        TRACE = LOG_LEVEL_TRACE,
+        DEBUG = LOG_LEVEL_DEBUG,
+        INFO  = LOG_LEVEL_INFO,
+        WARN  = LOG_LEVEL_WARN,
+        ERROR = LOG_LEVEL_ERROR
+    };
+
+    /**
+     * @brief The process-wide logger.
+     */
+    static Logger& getInstance();
+
+    /**
+     * @brief Stop the writer thread after writing everything logged so far.
+     */
+    ~Logger                     ();
+
+    /**
+     * @brief Append a record to the calling thread's ring (lock-free, no formatting).
+     *
+     * @param level Severity.
+     * @param format String literal; each "{}" is replaced by the next argument.
+     * @param args Arguments, copied into the record.
+     */
+    template <size_t N, typename... Args>
+    void log                    (Level level, const char (&format)[N], const Args&... args);
+
+    /**
+     * @brief Wait until everything logged before the call has been written.
+     */
+    void flush                  ();
+
+    /**
+     * @brief Size in bytes of the rings of threads that start logging afterwards.
+     *
+     * @param bytes Ring size, rounded up to a power of two.
+     */
+    void SetRingSize            (size_t bytes);
+
+protected:
+
+    void thread                 () override;
+
+private:
+
+    /** Argument type tags in a record */
+    enum ArgType : uint8_t
+    {
+        ARG_INT,
+        ARG_UINT,
+        ARG_DOUBLE,
+        ARG_BOOL,
+        ARG_CHAR,
+        ARG_STRING
+    };
+
+    /**
+     * @struct RecordHeader
+     * @brief Fixed part of a record; the encoded arguments follow.
+     */
+    struct RecordHeader
+    {
+        uint32_t    size;       // Whole record, header included
+        Level       level;      // Severity
+        uint8_t     argc;       // Number of arguments
+        int64_t     timeNs;     // Wall clock time since the epoch
+        const char* format;     // String literal
+    };
+
+    /**
+     * @class Ring
+     * @brief Single-producer, single-consumer byte ring of one thread.
+     */
+    class Ring
+    {
+    public:
+        explicit Ring           (size_t capacity);
+
+        /**
+         * @brief Append a record (producer thread only).
+         *
+         * @return false, counting the record as dropped, if the ring is full.
+         */
+        bool write              (const RecordHeader& header, const void* args, size_t argsSize);
+
+        std::vector<char>       m_buffer;       // Storage, power-of-two size
+        size_t                  m_mask;         // m_buffer.size() - 1
+        int                     m_tid;          // Kernel thread id of the producer
+        alignas(64) std::atomic<uint64_t> m_head;   // Bytes written (producer)
+        alignas(64) std::atomic<uint64_t> m_tail;   // Bytes consumed (writer thread)
+        std::atomic<uint64_t>   m_dropped;      // Records lost to a full ring
+        std::atomic<bool>       m_retired;      // Producer thread has exited
+    };
+
+    Logger                      ();
+
+    /**
+     * @brief Ring of the calling thread, created and registered on first use.
+     */
+    Ring& localRing             ();
+
+    /**
+     * @brief Drain all rings and write the result.
+     */
+    void drain                  ();
+
+    /**
+     * @brief Format one record read from a ring, appending a line to out.
+     */
+    void format                 (const RecordHeader& header, int tid, const char* args, std::string& out);
+
+    /**
+     * @brief Append a number in decimal.
+     */
+    static void appendNumber    (std::string& out, uint64_t value);
+
+    // Encoded size of one argument
+    template <typename T>
+    static size_t argSize       (const T& value);
+    static size_t argSize       (const char* value) { return 5 + std::strlen(value); }
+    static size_t argSize       (const std::string& value) { return 5 + value.size(); }
+
+    // Encode one argument at out, advancing it
+    template <typename T>
+    static void encode          (char*& out, const T& value);
+    static void encode          (char*& out, const char* value) { encodeString(out, value, std::strlen(value)); }
+    static void encode          (char*& out, const std::string& value) { encodeString(out, value.data(), value.size()); }
+    static void encodeString    (char*& out, const char* data, size_t len);
+
+    std::mutex                          m_ringsMutex;   // Protects m_rings
+    std::vector<std::shared_ptr<Ring>>  m_rings;        // Rings of every thread that logged
+    std::atomic<size_t>                 m_ringSize;     // Size of new rings
+
+    int64_t                             m_stampSecond;  // Second formatted in m_stampText (writer only)
+    std::string                         m_stampText;    // Date and time of m_stampSecond (writer only)
+
+    std::mutex                          m_wakeMutex;    // Protects m_wake and m_passes
+    std::condition_variable             m_wakeCond;     // Wakes the writer early
+    std::condition_variable             m_passCond;     // Signals a finished drain
+    bool                                m_wake;         // Drain requested
+    uint64_t                            m_passes;       // Finished drains
+
+    MetricCounter&                      m_droppedCounter; // Records lost to full rings
+};
+
+template <typename T>
+size_t Logger::argSize(const T& value)
+{
+    if constexpr (std::is_convertible<T, const char*>::value)
+    {
+        return argSize(static_cast<const char*>(value));
+    }
+    else
+    {
+        static_assert(std::is_arithmetic<T>::value, "Logger arguments must be numbers, chars, bools or strings");
+        return std::is_same<T, bool>::value || std::is_same<T, char>::value ? 2 : 9;
+    }
+}
+
+template <typename T>
+void Logger::encode(char*& out, const T& value)
+{
+    if constexpr (std::is_convertible<T, const char*>::value)
+    {
+        encode(out, static_cast<const char*>(value));
+    }
+    else if constexpr (std::is_same<T, bool>::value)
+    {
+        *out++ = ARG_BOOL;
+        *out++ = value ? 1 : 0;
+    }
+    else if constexpr (std::is_same<T, char>::value)
+    {
+        *out++ = ARG_CHAR;
+        *out++ = static_cast<char>(value);
+    }
+    else if constexpr (std::is_floating_point<T>::value)
+    {
+        double v = static_cast<double>(value);
+        *out++ = ARG_DOUBLE;
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    }
+    else if constexpr (std::is_signed<T>::value)
+    {
+        int64_t v = static_cast<int64_t>(value);
+        *out++ = ARG_INT;
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    }
+    else
+    {
+        uint64_t v = static_cast<uint64_t>(value);
+        *out++ = ARG_UINT;
+        std::memcpy(out, &v, sizeof(v));
+        out += sizeof(v);
+    }
+}
+
+template <size_t N, typename... Args>
+void Logger::log(Level level, const char (&format)[N], const Args&... args)
+{
+    RecordHeader header;
+    header.level = level;
+    header.argc = static_cast<uint8_t>(sizeof...(Args));
+    header.format = format;
+    header.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+
+    size_t argsSize = 0;
+    (void)std::initializer_list<int>{(argsSize += argSize(args), 0)...};
+    header.size = static_cast<uint32_t>(sizeof(RecordHeader) + argsSize);
+
+    // Small records are encoded on the stack, large ones (long strings) on the heap
+    char stackArgs[512];
+    std::unique_ptr<char[]> heapArgs;
+    char* encoded = stackArgs;
+    if (argsSize > sizeof(stackArgs))
+    {
+        heapArgs.reset(new char[argsSize]);
+        encoded = heapArgs.get();
+    }
+    char* out = encoded;
+    (void)std::initializer_list<int>{(encode(out, args), 0)...};
+    (void)out;
+
+    localRing().write(header, encoded, argsSize);
+
+    // Problems are written at once instead of at the next periodic drain
+    if (level >= Level::WARN)
+    {
+        m_wakeCond.notify_one();
+    }
+}
+
+#if FILESSERVER_LOG_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) Logger::getInstance().log(Logger::Level::TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) do {} while (0)
+#endif
+
+#if FILESSERVER_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Logger::getInstance().log(Logger::Level::DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if FILESSERVER_LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) Logger::getInstance().log(Logger::Level::INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if FILESSERVER_LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) Logger::getInstance().log(Logger::Level::WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#define LOG_ERROR(...) Logger::getInstance().log(Logger::Level::ERROR, __VA_ARGS__)
+
+#endif // LOGGER_H
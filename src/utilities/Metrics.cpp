@@ -0,0 +1,258 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "Metrics.h"
+
+uint64_t LatencyHistogram::Snapshot::quantile(double q) const
+{
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(count) + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+    if (rank > count)
+    {
+        rank = count;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < buckets.size(); ++i)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t upper = bucketMax(i);
+            return upper < maxNs ? upper : maxNs;
+        }
+    }
+
+    // A record() was half applied when the snapshot was taken
+    return maxNs;
+}
+
+LatencyHistogram::LatencyHistogram() : m_count(0), m_sumNs(0), m_maxNs(0)
+{
+    for (auto& bucket : m_buckets)
+    {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+unsigned LatencyHistogram::bucketOf(uint64_t value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return static_cast<unsigned>(value);
+    }
+
+    // Values in [2^exp, 2^(exp+1)) keep the SUB_BUCKET_BITS bits below the top one
+    unsigned exp = 63 - __builtin_clzll(value);
+    unsigned sub = static_cast<unsigned>(value >> (exp - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return (exp - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketMax(unsigned bucket)
+{
+    if (bucket < SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    unsigned exp = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    uint64_t width = uint64_t(1) << (exp - SUB_BUCKET_BITS);
+    return (uint64_t(1) << exp) + (sub + 1) * width - 1;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds duration)
+{
+    uint64_t ns = duration.count() > 0 ? static_cast<uint64_t>(duration.count()) : 0;
+
+    m_buckets[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+
+    uint64_t max = m_maxNs.load(std::memory_order_relaxed);
+    while (ns > max && !m_maxNs.compare_exchange_weak(max, ns, std::memory_order_relaxed))
+    {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snap;
+    snap.count = m_count.load(std::memory_order_relaxed);
+    snap.sumNs = m_sumNs.load(std::memory_order_relaxed);
+    snap.maxNs = m_maxNs.load(std::memory_order_relaxed);
+    snap.buckets.resize(BUCKETS);
+    for (unsigned i = 0; i < BUCKETS; ++i)
+    {
+        snap.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+    }
+    return snap;
+}
+
+MetricsRegistry& MetricsRegistry::getInstance()
+{
+    static MetricsRegistry instance;
+    return instance;
+}
+
+MetricsRegistry::Entry& MetricsRegistry::entry(const std::string& name, const std::string& help,
+                                               const std::string& labels, Type type)
+{
+    auto& slot = m_entries[name + '{' + labels];
+    if (!slot)
+    {
+        slot.reset(new Entry());
+        slot->name = name;
+        slot->help = help;
+        slot->labels = labels;
+        slot->type = type;
+        switch (type)
+        {
+            case Type::COUNTER: slot->counter.reset(new MetricCounter()); break;
+            case Type::GAUGE:   slot->gauge.reset(new MetricGauge()); break;
+            case Type::SUMMARY: slot->histogram.reset(new LatencyHistogram()); break;
+        }
+    }
+    else if (slot->type != type)
+    {
+        // Programming error: one name used for two kinds of metric
+        std::cerr << "Metric " << name << " registered with two types" << std::endl;
+        std::abort();
+    }
+    return *slot;
+}
+
+MetricCounter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return *entry(name, help, labels, Type::COUNTER).counter;
+}
+
+MetricGauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return *entry(name, help, labels, Type::GAUGE).gauge;
+}
+
+LatencyHistogram& MetricsRegistry::histogram(const std::string& name, const std::string& help, const std::string& labels)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return *entry(name, help, labels, Type::SUMMARY).histogram;
+}
+
+namespace
+{
+    /**
+     * @brief Label set with one more label, in Prometheus syntax.
+     */
+    std::string withLabel(const std::string& labels, const std::string& extra)
+    {
+        if (labels.empty())
+        {
+            return extra.empty() ? std::string() : "{" + extra + "}";
+        }
+        return "{" + labels + (extra.empty() ? "" : "," + extra) + "}";
+    }
+}
+
+std::string MetricsRegistry::render() const
+{
+    std::ostringstream out;
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const std::string* family = nullptr;
+    for (const auto& item : m_entries)
+    {
+        const Entry& e = *item.second;
+
+        if (!family || *family != e.name)
+        {
+            family = &e.name;
+            const char* type = e.type == Type::COUNTER ? "counter" : e.type == Type::GAUGE ? "gauge" : "summary";
+            out << "# HELP " << e.name << ' ' << e.help << '\n';
+            out << "# TYPE " << e.name << ' ' << type << '\n';
+        }
+
+        switch (e.type)
+        {
+            case Type::COUNTER:
+                out << e.name << withLabel(e.labels, "") << ' ' << e.counter->value() << '\n';
+                break;
+
+            case Type::GAUGE:
+                out << e.name << withLabel(e.labels, "") << ' ' << e.gauge->value() << '\n';
+                break;
+
+            case Type::SUMMARY:
+            {
+                LatencyHistogram::Snapshot snap = e.histogram->snapshot();
+                for (double q : {0.5, 0.9, 0.99, 0.999})
+                {
+                    std::ostringstream quantile;
+                    quantile << "quantile=\"" << q << '"';
+                    out << e.name << withLabel(e.labels, quantile.str()) << ' '
+                        << snap.quantile(q) / 1e9 << '\n';
+                }
+                out << e.name << "_sum" << withLabel(e.labels, "") << ' ' << snap.sumNs / 1e9 << '\n';
+                out << e.name << "_count" << withLabel(e.labels, "") << ' ' << snap.count << '\n';
+                break;
+            }
+        }
+    }
+
+    return out.str();
+}
+
+MetricsExporter::MetricsExporter(const std::string& path, std::chrono::milliseconds interval)
+    : m_path(path)
+{
+    SetTimer(interval, interval);
+    Start();
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    Stop();
+    dump();
+}
+
+bool MetricsExporter::dump()
+{
+    std::string tmp = m_path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out)
+        {
+            std::cerr << "Cannot write metrics to " << tmp << std::endl;
+            return false;
+        }
+        out << MetricsRegistry::getInstance().render();
+        if (!out.flush())
+        {
+            std::cerr << "Cannot write metrics to " << tmp << std::endl;
+            return false;
+        }
+    }
+
+    if (0 != std::rename(tmp.c_str(), m_path.c_str()))
+    {
+        std::cerr << "Cannot replace " << m_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void MetricsExporter::onTimeout()
+{
+    dump();
+}
@@ -0,0 +1,262 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TimerFd.h"
+
+/**
+ * @class MetricCounter
+ * @brief Monotonic counter; inc() is a single relaxed atomic add.
+ */
+class MetricCounter
+{
+
+public:
+
+    MetricCounter               () : m_value(0) {}
+
+    /**
+     * @brief Add to the counter (thread-safe, lock-free).
+     */
+    void inc                    (uint64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+
+    /**
+     * @brief Current value.
+     */
+    uint64_t value              () const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+
+    alignas(64) std::atomic<uint64_t> m_value;  // Own cache line: hot counters do not share one
+};
+
+/**
+ * @class MetricGauge
+ * @brief Value that goes up and down, e.g. a queue depth.
+ */
+class MetricGauge
+{
+
+public:
+
+    MetricGauge                 () : m_value(0) {}
+
+    /**
+     * @brief Set the value (thread-safe, lock-free).
+     */
+    void set                    (int64_t value) { m_value.store(value, std::memory_order_relaxed); }
+
+    /**
+     * @brief Add to the value, negative to subtract (thread-safe, lock-free).
+     */
+    void add                    (int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+
+    /**
+     * @brief Current value.
+     */
+    int64_t value               () const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+
+    alignas(64) std::atomic<int64_t> m_value;
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief HDR-style histogram of durations with about 6% relative precision.
+ *
+ * Values are nanoseconds. Each power of two is split into SUB_BUCKETS linear
+ * buckets, so the bucket of a value is found with one bit scan and any value
+ * from 1 ns to centuries fits in a fixed array of atomic counters. record()
+ * is a few relaxed atomic operations and never allocates or locks; readers
+ * may see a record() half applied, which only skews one snapshot by one
+ * sample.
+ */
+class LatencyHistogram
+{
+
+public:
+
+    /** Linear buckets per power of two (log2) */
+    static const unsigned SUB_BUCKET_BITS = 4;
+
+    /** Linear buckets per power of two */
+    static const unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+
+    /** Number of buckets covering all of uint64_t */
+    static const unsigned BUCKETS = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    /**
+     * @struct Snapshot
+     * @brief Copy of a histogram at one point in time.
+     */
+    struct Snapshot
+    {
+        uint64_t                count = 0;      // Number of samples
+        uint64_t                sumNs = 0;      // Sum of all samples
+        uint64_t                maxNs = 0;      // Largest sample
+        std::vector<uint64_t>   buckets;        // Samples per bucket
+
+        /**
+         * @brief Value at a quantile, in nanoseconds (upper bound of its bucket).
+         *
+         * @param q Quantile in [0, 1].
+         */
+        uint64_t quantile       (double q) const;
+    };
+
+    LatencyHistogram            ();
+
+    /**
+     * @brief Record one duration (thread-safe, lock-free).
+     */
+    void record                 (std::chrono::nanoseconds duration);
+
+    /**
+     * @brief Copy the current state.
+     */
+    Snapshot snapshot           () const;
+
+    /**
+     * @brief Bucket holding a value.
+     */
+    static unsigned bucketOf    (uint64_t value);
+
+    /**
+     * @brief Largest value that falls into a bucket.
+     */
+    static uint64_t bucketMax   (unsigned bucket);
+
+private:
+
+    std::atomic<uint64_t>       m_buckets[BUCKETS];     // Samples per bucket
+    std::atomic<uint64_t>       m_count;                // Number of samples
+    std::atomic<uint64_t>       m_sumNs;                // Sum of all samples
+    std::atomic<uint64_t>       m_maxNs;                // Largest sample
+};
+
+/**
+ * @class MetricsRegistry
+ * @brief Process-wide set of named metrics, rendered in Prometheus text format.
+ *
+ * Components look their metrics up once (registration takes a mutex) and
+ * keep the returned reference, which stays valid for the life of the
+ * process; updating a metric never touches the registry. The same name and
+ * labels always return the same metric.
+ */
+class MetricsRegistry
+{
+
+public:
+
+    /**
+     * @brief The process-wide registry.
+     */
+    static MetricsRegistry& getInstance();
+
+    /**
+     * @brief Find or create a counter.
+     *
+     * @param name Metric name, e.g. "filesserver_bytes_sent_total".
+     * @param help One-line description.
+     * @param labels Label set without braces, e.g. "code=\"2xx\"", or empty.
+     */
+    MetricCounter& counter      (const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /**
+     * @brief Find or create a gauge; parameters as for counter().
+     */
+    MetricGauge& gauge          (const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /**
+     * @brief Find or create a latency histogram, rendered as a summary in seconds; parameters as for counter().
+     */
+    LatencyHistogram& histogram (const std::string& name, const std::string& help, const std::string& labels = "");
+
+    /**
+     * @brief Render every metric in the Prometheus text exposition format.
+     */
+    std::string render          () const;
+
+private:
+
+    MetricsRegistry             () = default;
+
+    enum class Type
+    {
+        COUNTER,
+        GAUGE,
+        SUMMARY
+    };
+
+    struct Entry
+    {
+        std::string                         name;       // Metric name
+        std::string                         help;       // Description
+        std::string                         labels;     // Label set without braces
+        Type                                type;       // Kind of metric
+        std::unique_ptr<MetricCounter>      counter;    // Set if type is COUNTER
+        std::unique_ptr<MetricGauge>        gauge;      // Set if type is GAUGE
+        std::unique_ptr<LatencyHistogram>   histogram;  // Set if type is SUMMARY
+    };
+
+    /**
+     * @brief Find or create an entry; m_mutex must be held.
+     */
+    Entry& entry                (const std::string& name, const std::string& help,
+                                 const std::string& labels, Type type);
+
+    mutable std::mutex                          m_mutex;    // Protects m_entries
+    std::map<std::string, std::unique_ptr<Entry>> m_entries; // By name + '{' + labels, so families stay together
+};
+
+/**
+ * @class MetricsExporter
+ * @brief Writes the registry to a file in Prometheus text format on every timer tick.
+ *
+ * The file is replaced atomically (written aside, then renamed), so it can be
+ * read at any time, e.g. by the node_exporter textfile collector or by hand.
+ */
+class MetricsExporter : public TimerFd
+{
+
+public:
+
+    /**
+     * @brief Constructor for MetricsExporter; starts the timer.
+     *
+     * @param path File receiving the metrics.
+     * @param interval Time between two dumps.
+     */
+    MetricsExporter             (const std::string& path, std::chrono::milliseconds interval);
+
+    /**
+     * @brief Stop the timer and write a last dump.
+     */
+    ~MetricsExporter            ();
+
+    /**
+     * @brief Write the metrics now.
+     *
+     * @return false if the file cannot be written.
+     */
+    bool dump                   ();
+
+protected:
+
+    void onTimeout              () override;
+
+private:
+
+    std::string                 m_path;     // Output file
+};
+
+#endif // METRICS_H
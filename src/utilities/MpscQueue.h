@@ -0,0 +1,140 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/**
+ * @class MpscQueue
+ * @brief Bounded lock-free multi-producer/single-consumer FIFO queue.
+ *
+ * A ring of preallocated slots, each tagged with a sequence number (Vyukov's
+ * bounded queue). Producers claim a slot with one compare-and-swap on the
+ * tail and publish it by advancing the slot's sequence; the single consumer
+ * reads slots in order without any read-modify-write. Values are moved into
+ * and out of the slots, so nothing is allocated after construction.
+ *
+ * @tparam T Element type; must be default- and move-constructible.
+ */
+template <typename T>
+class MpscQueue
+{
+
+public:
+
+    /**
+     * @brief Constructor for MpscQueue.
+     *
+     * @param capacity Number of slots, rounded up to a power of two.
+     */
+    explicit MpscQueue      (size_t capacity = 4096)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_slots.reset(new Slot[size]);
+        for (size_t i = 0; i < size; ++i)
+        {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Adds a value if a slot is free. Safe from any number of threads.
+     *
+     * @param value Value to move into the queue; left untouched on failure.
+     * @return false if the queue is full.
+     */
+    bool tryPush            (T& value)
+    {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot& slot = m_slots[pos & m_mask];
+            size_t sequence = slot.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    slot.value = std::move(value);
+                    slot.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;   // The consumer has not freed this slot yet
+            }
+            else
+            {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief Adds a value, yielding while the queue is full.
+     *
+     * @param value Value to move into the queue.
+     */
+    void push               (T value)
+    {
+        while (!tryPush(value))
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    /**
+     * @brief Removes the oldest value. Consumer thread only.
+     *
+     * @param value Receives the value.
+     * @return false if the queue is empty (or the next value is still being published).
+     */
+    bool tryPop             (T& value)
+    {
+        Slot& slot = m_slots[m_head & m_mask];
+        if (slot.sequence.load(std::memory_order_acquire) != m_head + 1)
+        {
+            return false;
+        }
+        value = std::move(slot.value);
+        slot.sequence.store(m_head + m_mask + 1, std::memory_order_release);
+        ++m_head;
+        return true;
+    }
+
+    /**
+     * @brief true if no published value is waiting. Consumer thread only.
+     */
+    bool empty              () const
+    {
+        return m_slots[m_head & m_mask].sequence.load(std::memory_order_acquire) != m_head + 1;
+    }
+
+private:
+
+    struct Slot
+    {
+        std::atomic<size_t>     sequence;   // pos + 1 when readable at pos, pos + capacity when free again
+        T                       value;      // Stored element
+    };
+
+    std::unique_ptr<Slot[]>             m_slots;        // Ring of slots
+
+    size_t                              m_mask;         // Capacity - 1
+
+    alignas(64) std::atomic<size_t>     m_tail{0};      // Next position producers claim
+
+    alignas(64) size_t                  m_head = 0;     // Next position the consumer reads
+};
+
+#endif // MPSC_QUEUE_H
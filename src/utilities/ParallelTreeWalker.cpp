@@ -0,0 +1,163 @@
+#include "ParallelTreeWalker.h"
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+// getdents64 batch per call; large enough to list most directories in one system call
+static const size_t GETDENTS_BUFFER = 256 * 1024;
+
+/**
+ * @brief Record returned by getdents64(2).
+ */
+struct LinuxDirent64
+{
+    uint64_t        d_ino;
+    int64_t         d_off;
+    unsigned short  d_reclen;
+    unsigned char   d_type;
+    char            d_name[];
+};
+
+ParallelTreeWalker::ParallelTreeWalker(unsigned threads)
+    : m_threads(threads ? threads : 1),
+      m_recursive(false),
+      m_visitor(nullptr),
+      m_busy(0),
+      m_files(0)
+{
+}
+
+uint64_t ParallelTreeWalker::walk(const std::string& root, bool recursive, const Visitor& visitor)
+{
+    m_root = root;
+    m_recursive = recursive;
+    m_visitor = &visitor;
+    m_pending.assign(1, std::string());
+    m_busy = 0;
+    m_files = 0;
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < m_threads; ++i)
+    {
+        threads.emplace_back(&ParallelTreeWalker::run, this);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    m_visitor = nullptr;
+    return m_files;
+}
+
+void ParallelTreeWalker::run()
+{
+    std::vector<char> buffer(GETDENTS_BUFFER);
+
+    for (;;)
+    {
+        std::string relDir;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return !m_pending.empty() || m_busy == 0; });
+            if (m_pending.empty())
+            {
+                // Nothing queued and nobody listing: the tree is exhausted
+                m_wake.notify_all();
+                return;
+            }
+            relDir = std::move(m_pending.back());
+            m_pending.pop_back();
+            ++m_busy;
+        }
+
+        listDirectory(relDir, buffer);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busy;
+        }
+        m_wake.notify_all();
+    }
+}
+
+void ParallelTreeWalker::pushDirectory(std::string relDir)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(std::move(relDir));
+    }
+    m_wake.notify_one();
+}
+
+void ParallelTreeWalker::listDirectory(const std::string& relDir, std::vector<char>& buffer)
+{
+    std::string path = relDir.empty() ? m_root : m_root + "/" + relDir;
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    uint64_t files = 0;
+    for (;;)
+    {
+        long n = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+        if (n <= 0)
+        {
+            break;
+        }
+
+        for (long offset = 0; offset < n;)
+        {
+            const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            const char* name = entry->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_DIR)
+            {
+                if (m_recursive)
+                {
+                    pushDirectory(relDir + name + "/");
+                }
+                continue;
+            }
+            if (type != DT_REG && type != DT_UNKNOWN)
+            {
+                continue;
+            }
+
+            struct stat st;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) == -1)
+            {
+                continue;
+            }
+            if (S_ISDIR(st.st_mode))
+            {
+                if (m_recursive)
+                {
+                    pushDirectory(relDir + name + "/");
+                }
+            }
+            else if (S_ISREG(st.st_mode))
+            {
+                (*m_visitor)(relDir, name, st);
+                ++files;
+            }
+        }
+    }
+
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_files += files;
+}
@@ -0,0 +1,85 @@
+#ifndef PARALLEL_TREE_WALKER_H
+#define PARALLEL_TREE_WALKER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+/**
+ * @class ParallelTreeWalker
+ * @brief Lists a directory tree with many threads reading directories at once.
+ *
+ * Directories are shared work items: each thread takes one, reads it with
+ * large getdents64(2) batches, stats its entries with fstatat(2) relative to
+ * the directory fd and hands subdirectories back to the pool. With a cold
+ * cache this keeps many metadata reads in flight, so a large tree is listed
+ * at the speed of the disk rather than of one thread waiting on each read.
+ */
+class ParallelTreeWalker
+{
+
+public:
+
+    /**
+     * @brief Called for every regular file, concurrently from the walker threads.
+     *
+     * @param relDir Directory of the file relative to the root, "" or ending with '/'.
+     * @param name File name.
+     * @param st Metadata of the file (not following symlinks).
+     */
+    using Visitor = std::function<void(const std::string& relDir, const char* name, const struct stat& st)>;
+
+    /**
+     * @brief Constructor for ParallelTreeWalker.
+     *
+     * @param threads Number of threads per walk().
+     */
+    explicit ParallelTreeWalker (unsigned threads = 16);
+
+    /**
+     * @brief Walk a tree and call the visitor for every regular file.
+     *
+     * Symbolic links are not followed. Directories that cannot be read are skipped.
+     *
+     * @param root Root directory.
+     * @param recursive Also walk subdirectories.
+     * @param visitor Called for every regular file; must be thread-safe.
+     * @return Number of regular files visited.
+     */
+    uint64_t walk               (const std::string& root, bool recursive, const Visitor& visitor);
+
+private:
+
+    /**
+     * @brief Walker thread: takes directories until the tree is exhausted.
+     */
+    void run                    ();
+
+    /**
+     * @brief List one directory.
+     */
+    void listDirectory          (const std::string& relDir, std::vector<char>& buffer);
+
+    /**
+     * @brief Hand a subdirectory to the pool.
+     */
+    void pushDirectory          (std::string relDir);
+
+    unsigned                    m_threads;      // Threads per walk()
+
+    std::string                 m_root;         // Root of the running walk
+    bool                        m_recursive;    // Walk subdirectories
+    const Visitor*              m_visitor;      // Visitor of the running walk
+
+    std::mutex                  m_mutex;        // Protects m_pending and m_busy
+    std::condition_variable     m_wake;         // Signalled on new work and when the walk ends
+    std::vector<std::string>    m_pending;      // Directories not listed yet (taken from the back)
+    unsigned                    m_busy;         // Threads listing a directory
+    uint64_t                    m_files;        // Regular files visited
+};
+
+#endif // PARALLEL_TREE_WALKER_H
@@ -0,0 +1,514 @@
+#include "PathFilter.h"
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <iterator>
+
+// Anchor byte around names and paths; never part of a file name
+static const char ANCHOR = '\0';
+
+// Edge lists up to this long are scanned, longer ones binary searched
+static const size_t LINEAR_EDGES = 8;
+
+// Slow rules whose literal occurs in one path, reused by each thread
+static thread_local std::vector<int32_t> candidates;
+
+/**
+ * @brief Whether a glob has no wildcard, class or escape.
+ */
+static bool isLiteral(const std::string& glob)
+{
+    return glob.find_first_of("*?[\\") == std::string::npos;
+}
+
+/**
+ * @brief Longest run of a glob that any match must contain literally.
+ */
+static std::string longestLiteral(const std::string& glob)
+{
+    std::string best;
+    size_t start = 0;
+    while (start < glob.size())
+    {
+        size_t end = glob.find_first_of("*?[\\", start);
+        if (end == std::string::npos)
+        {
+            end = glob.size();
+        }
+        if (end - start > best.size())
+        {
+            best = glob.substr(start, end - start);
+        }
+        start = end + 1;
+        if (end < glob.size() && glob[end] == '[')
+        {
+            size_t close = glob.find(']', end + 2);     // A leading ']' is a member
+            start = (close == std::string::npos) ? glob.size() : close + 1;
+        }
+    }
+    return best;
+}
+
+PathFilter::Rule PathFilter::parse(const std::string& spec, Action action)
+{
+    if (spec.compare(0, 5, "glob:") == 0)
+    {
+        return Rule{spec.substr(5), Syntax::GLOB, action};
+    }
+    if (spec.compare(0, 3, "re:") == 0)
+    {
+        return Rule{spec.substr(3), Syntax::REGEX, action};
+    }
+    return Rule{spec, Syntax::SUBSTRING, action};
+}
+
+PathFilter::PathFilter(const std::vector<Rule>& rules)
+    : m_hasIncludes(false)
+{
+    for (const Rule& rule : rules)
+    {
+        int32_t index = static_cast<int32_t>(m_actions.size());
+        m_actions.push_back(rule.action);
+        m_hasIncludes = m_hasIncludes || rule.action == Action::INCLUDE;
+
+        switch (rule.syntax)
+        {
+        case Syntax::SUBSTRING:
+            // An empty substring matches every name, as does the leading anchor
+            m_names.add(rule.pattern.empty() ? std::string(1, ANCHOR) : rule.pattern, index);
+            break;
+        case Syntax::GLOB:
+            addGlob(rule.pattern, index);
+            break;
+        case Syntax::REGEX:
+            addSlow(SlowRule{index, Syntax::REGEX, std::string(), false, false,
+                             std::regex(rule.pattern, std::regex::ECMAScript | std::regex::optimize)});
+            break;
+        }
+    }
+
+    m_names.build();
+    m_paths.build();
+    m_nameHints.build();
+    m_pathHints.build();
+}
+
+void PathFilter::addGlob(const std::string& pattern, int32_t index)
+{
+    const std::string anchor(1, ANCHOR);
+    std::string glob = pattern;
+
+    bool dirOnly = false;
+    while (glob.size() > 1 && glob.back() == '/')
+    {
+        glob.pop_back();
+        dirOnly = true;
+    }
+    bool anchored = glob.find('/') != std::string::npos;
+    if (glob.compare(0, 3, "**/") == 0 && glob.find('/', 3) == std::string::npos)
+    {
+        glob.erase(0, 3);   // "**/name" is the same as "name"
+        anchored = false;
+    }
+    if (!glob.empty() && glob[0] == '/')
+    {
+        glob.erase(0, 1);
+    }
+    if (glob.empty())
+    {
+        return;             // Matches nothing
+    }
+
+    if (!anchored && !dirOnly)
+    {
+        // Names hold no '/', so "**" is just '*' here
+        std::string inner = glob.substr(1, glob.size() - 2);
+        std::string head = glob.substr(0, glob.size() - 1);
+        std::string tail = glob.substr(1);
+        if (isLiteral(glob))
+        {
+            m_names.add(anchor + glob + anchor, index);             // Exact name
+            return;
+        }
+        if (glob == "*" || glob == "**")
+        {
+            m_names.add(anchor, index);                             // Any name
+            return;
+        }
+        if (glob.front() == '*' && isLiteral(tail))
+        {
+            m_names.add(tail + anchor, index);                      // Suffix
+            return;
+        }
+        if (glob.back() == '*' && isLiteral(head))
+        {
+            m_names.add(anchor + head, index);                      // Prefix
+            return;
+        }
+        if (glob.size() > 2 && glob.front() == '*' && glob.back() == '*' && isLiteral(inner))
+        {
+            m_names.add(inner, index);                              // Infix
+            return;
+        }
+    }
+    else if (!anchored)
+    {
+        if (isLiteral(glob))
+        {
+            m_paths.add("/" + glob + "/", index);                   // Directory anywhere
+            return;
+        }
+    }
+    else
+    {
+        if (isLiteral(glob))
+        {
+            m_paths.add(anchor + "/" + glob + "/", index);          // Directory at this path
+            if (!dirOnly)
+            {
+                m_paths.add(anchor + "/" + glob + anchor, index);   // File at this path
+            }
+            return;
+        }
+        if (glob.size() > 3 && glob.compare(glob.size() - 3, 3, "/**") == 0 &&
+            isLiteral(glob.substr(0, glob.size() - 3)))
+        {
+            m_paths.add(anchor + "/" + glob.substr(0, glob.size() - 2), index);  // Everything below
+            return;
+        }
+    }
+
+    addSlow(SlowRule{index, Syntax::GLOB, glob, anchored, dirOnly, std::regex()});
+}
+
+void PathFilter::addSlow(SlowRule rule)
+{
+    int32_t position = static_cast<int32_t>(m_slow.size());
+    std::string literal = (rule.syntax == Syntax::GLOB) ? longestLiteral(rule.glob) : std::string();
+    if (literal.empty())
+    {
+        m_unhinted.push_back(position);
+    }
+    else if (!rule.anchored && !rule.dirOnly)
+    {
+        m_nameHints.add(literal, position);
+    }
+    else
+    {
+        m_pathHints.add(literal, position);
+    }
+    m_slow.push_back(std::move(rule));
+}
+
+bool PathFilter::matches(const std::string& relPath) const
+{
+    if (m_actions.empty())
+    {
+        return true;
+    }
+
+    size_t slash = relPath.rfind('/');
+    size_t nameStart = (slash == std::string::npos) ? 0 : slash + 1;
+    int32_t best = -1;
+
+    if (!m_names.empty())
+    {
+        uint32_t state = 0;
+        m_names.feed(state, &ANCHOR, 1, best);
+        m_names.feed(state, relPath.data() + nameStart, relPath.size() - nameStart, best);
+        m_names.feed(state, &ANCHOR, 1, best);
+    }
+    if (!m_paths.empty())
+    {
+        static const char start[2] = {ANCHOR, '/'};
+        uint32_t state = 0;
+        m_paths.feed(state, start, 2, best);
+        m_paths.feed(state, relPath.data(), relPath.size(), best);
+        m_paths.feed(state, &ANCHOR, 1, best);
+    }
+
+    // Only a later rule can override what the automata found
+    if (!m_slow.empty() && m_slow.back().index > best)
+    {
+        candidates.assign(m_unhinted.begin(), m_unhinted.end());
+        uint32_t state = 0;
+        if (!m_nameHints.empty())
+        {
+            m_nameHints.collect(state, relPath.data() + nameStart, relPath.size() - nameStart, candidates);
+        }
+        state = 0;
+        if (!m_pathHints.empty())
+        {
+            m_pathHints.collect(state, relPath.data(), relPath.size(), candidates);
+        }
+        std::sort(candidates.begin(), candidates.end(), std::greater<int32_t>());
+
+        int32_t last = -1;
+        for (int32_t position : candidates)
+        {
+            const SlowRule& rule = m_slow[position];
+            if (rule.index <= best)
+            {
+                break;
+            }
+            if (position != last && matchSlow(rule, relPath, nameStart))
+            {
+                best = rule.index;
+                break;
+            }
+            last = position;
+        }
+    }
+
+    if (best < 0)
+    {
+        return !m_hasIncludes;
+    }
+    return m_actions[best] != Action::EXCLUDE;
+}
+
+bool PathFilter::matchSlow(const SlowRule& rule, const std::string& relPath, size_t nameStart)
+{
+    if (rule.syntax == Syntax::REGEX)
+    {
+        return std::regex_search(relPath, rule.regex);
+    }
+
+    const char* p = rule.glob.data();
+    const char* pe = p + rule.glob.size();
+    const char* path = relPath.data();
+
+    if (!rule.anchored && !rule.dirOnly)
+    {
+        return globMatch(p, pe, path + nameStart, path + relPath.size());
+    }
+
+    // Directories of the path (each ending before a '/'), then the file itself
+    size_t begin = 0;
+    for (size_t end = relPath.find('/'); end != std::string::npos; end = relPath.find('/', end + 1))
+    {
+        if (rule.anchored ? globMatch(p, pe, path, path + end) : globMatch(p, pe, path + begin, path + end))
+        {
+            return true;
+        }
+        begin = end + 1;
+    }
+    return rule.anchored && !rule.dirOnly && globMatch(p, pe, path, path + relPath.size());
+}
+
+bool PathFilter::globMatch(const char* p, const char* pe, const char* s, const char* se)
+{
+    while (p < pe)
+    {
+        char c = *p;
+        if (c == '*')
+        {
+            if (p + 1 < pe && p[1] == '*')
+            {
+                const char* rest = p + 2;
+                // "**/" also matches no directory at all
+                if (rest < pe && *rest == '/' && globMatch(rest + 1, pe, s, se))
+                {
+                    return true;
+                }
+                for (const char* t = s; t <= se; ++t)
+                {
+                    if (globMatch(rest, pe, t, se))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+            ++p;
+            for (const char* t = s; ; ++t)
+            {
+                if (globMatch(p, pe, t, se))
+                {
+                    return true;
+                }
+                if (t == se || *t == '/')
+                {
+                    return false;
+                }
+            }
+        }
+
+        if (s == se)
+        {
+            return false;
+        }
+
+        if (c == '?')
+        {
+            if (*s == '/')
+            {
+                return false;
+            }
+            ++p;
+            ++s;
+            continue;
+        }
+
+        if (c == '[')
+        {
+            const char* q = p + 1;
+            bool negate = q < pe && (*q == '!' || *q == '^');
+            if (negate)
+            {
+                ++q;
+            }
+            const char* close = q < pe ? q + 1 : pe;  // A leading ']' is a member
+            while (close < pe && *close != ']')
+            {
+                ++close;
+            }
+            if (close < pe)
+            {
+                bool found = false;
+                for (; q < close; ++q)
+                {
+                    if (q + 2 < close && q[1] == '-')
+                    {
+                        found = found || (*s >= q[0] && *s <= q[2]);
+                        q += 2;
+                    }
+                    else
+                    {
+                        found = found || *s == *q;
+                    }
+                }
+                if (*s == '/' || found == negate)
+                {
+                    return false;
+                }
+                p = close + 1;
+                ++s;
+                continue;
+            }
+            // No closing ']': a literal '['
+        }
+
+        if (c == '\\' && p + 1 < pe)
+        {
+            c = *++p;
+        }
+        if (*s != c)
+        {
+            return false;
+        }
+        ++p;
+        ++s;
+    }
+    return s == se;
+}
+
+PathFilter::Automaton::Automaton()
+    : m_nodes(1)
+{
+    std::fill(std::begin(m_root), std::end(m_root), 0);
+}
+
+int64_t PathFilter::Automaton::child(uint32_t node, unsigned char c) const
+{
+    const auto& edges = m_nodes[node].edges;
+    if (edges.size() <= LINEAR_EDGES)
+    {
+        for (const auto& edge : edges)
+        {
+            if (edge.first == c)
+            {
+                return edge.second;
+            }
+        }
+        return -1;
+    }
+    auto it = std::lower_bound(edges.begin(), edges.end(), std::make_pair(c, uint32_t(0)));
+    return (it != edges.end() && it->first == c) ? static_cast<int64_t>(it->second) : -1;
+}
+
+uint32_t PathFilter::Automaton::step(uint32_t state, unsigned char c) const
+{
+    while (state != 0)
+    {
+        int64_t next = child(state, c);
+        if (next >= 0)
+        {
+            return static_cast<uint32_t>(next);
+        }
+        state = m_nodes[state].fail;
+    }
+    return m_root[c];
+}
+
+void PathFilter::Automaton::add(const std::string& literal, int32_t id)
+{
+    uint32_t node = 0;
+    for (char ch : literal)
+    {
+        unsigned char c = static_cast<unsigned char>(ch);
+        int64_t next = child(node, c);
+        if (next < 0)
+        {
+            next = static_cast<int64_t>(m_nodes.size());
+            m_nodes.emplace_back();
+            auto& edges = m_nodes[node].edges;
+            auto pos = std::lower_bound(edges.begin(), edges.end(), std::make_pair(c, uint32_t(0)));
+            edges.insert(pos, std::make_pair(c, static_cast<uint32_t>(next)));
+            if (node == 0)
+            {
+                m_root[c] = static_cast<uint32_t>(next);
+            }
+        }
+        node = static_cast<uint32_t>(next);
+    }
+    m_nodes[node].best = std::max(m_nodes[node].best, id);
+    m_nodes[node].ids.push_back(id);
+}
+
+void PathFilter::Automaton::build()
+{
+    // Breadth first, so every failure target is complete before its dependents
+    std::deque<uint32_t> queue;
+    for (const auto& edge : m_nodes[0].edges)
+    {
+        queue.push_back(edge.second);
+    }
+    while (!queue.empty())
+    {
+        uint32_t node = queue.front();
+        queue.pop_front();
+        for (const auto& edge : m_nodes[node].edges)
+        {
+            Node& next = m_nodes[edge.second];
+            next.fail = (node == 0) ? 0 : step(m_nodes[node].fail, edge.first);
+            const Node& fail = m_nodes[next.fail];
+            next.best = std::max(next.best, fail.best);
+            next.dict = fail.ids.empty() ? fail.dict : next.fail;
+            queue.push_back(edge.second);
+        }
+    }
+}
+
+void PathFilter::Automaton::feed(uint32_t& state, const char* data, size_t len, int32_t& best) const
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        state = step(state, static_cast<unsigned char>(data[i]));
+        best = std::max(best, m_nodes[state].best);
+    }
+}
+
+void PathFilter::Automaton::collect(uint32_t& state, const char* data, size_t len,
+                                    std::vector<int32_t>& found) const
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        state = step(state, static_cast<unsigned char>(data[i]));
+        for (uint32_t node = m_nodes[state].ids.empty() ? m_nodes[state].dict : state; node != 0;
+             node = m_nodes[node].dict)
+        {
+            found.insert(found.end(), m_nodes[node].ids.begin(), m_nodes[node].ids.end());
+        }
+    }
+}
@@ -0,0 +1,225 @@
+#ifndef PATH_FILTER_H
+#define PATH_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <regex>
+#include <string>
+#include <vector>
+
+/**
+ * @class PathFilter
+ * @brief Immutable, compiled set of include / exclude rules for relative file paths.
+ *
+ * Rules are ordered and the last matching rule decides, as in .gitignore: an
+ * EXCLUDE rule rejects the path, an INCLUDE or UNEXCLUDE rule accepts it. A
+ * path that matches no rule is accepted unless the set has INCLUDE rules
+ * (UNEXCLUDE only overrides earlier excludes, like "!" in an ignore file).
+ *
+ * Pattern syntax:
+ * - SUBSTRING: literal text anywhere in the file name.
+ * - GLOB: gitignore-style. '*' and '?' do not match '/', "**" does, [...]
+ *   is a character class. Without a '/' the glob matches the file name;
+ *   with one it is anchored at the root and matches the path or one of its
+ *   directories. A trailing '/' matches directories only.
+ * - REGEX: ECMAScript regular expression searched in the relative path.
+ *
+ * Literal patterns and globs that reduce to an exact name, prefix, suffix,
+ * infix or directory ("*.log", "core.*", "build/", "docs/" + "**") are compiled into two
+ * Aho-Corasick automata, one over the anchored file name and one over the
+ * anchored path, whose states carry the highest rule index they complete.
+ * One pass over the name and one over the path therefore decide all of them
+ * at once, whatever their number. Remaining globs are indexed by their
+ * longest literal run in two more automata, so only those whose literal
+ * occurs in the path are tried; they and the regular expressions are tried
+ * from the last rule down, and only if they could still override the
+ * automata.
+ *
+ * A PathFilter never changes after construction, so any number of threads
+ * may call matches() on a shared instance without locking.
+ */
+class PathFilter
+{
+
+public:
+
+    /**
+     * @enum Syntax
+     * @brief How the pattern of a rule is interpreted.
+     */
+    enum class Syntax
+    {
+        SUBSTRING,      // Literal text anywhere in the file name
+        GLOB,           // gitignore-style glob
+        REGEX           // ECMAScript regular expression searched in the relative path
+    };
+
+    /**
+     * @enum Action
+     * @brief What a matching rule does with the path.
+     */
+    enum class Action
+    {
+        INCLUDE,        // Accept; files matching no rule are then rejected
+        EXCLUDE,        // Reject
+        UNEXCLUDE       // Accept, without rejecting files matching no rule
+    };
+
+    /**
+     * @struct Rule
+     * @brief One filter rule.
+     */
+    struct Rule
+    {
+        std::string     pattern;    // Pattern text, without "glob:" / "re:" prefix
+        Syntax          syntax;     // How pattern is interpreted
+        Action          action;     // What a match does
+    };
+
+    /**
+     * @brief Turn a filter specification into a rule.
+     *
+     * "glob:<pattern>" is a glob, "re:<pattern>" a regular expression, and
+     * anything else a substring of the file name.
+     *
+     * @param spec Filter specification.
+     * @param action Action of the rule.
+     */
+    static Rule parse           (const std::string& spec, Action action);
+
+    /**
+     * @brief Constructor for PathFilter; compiles the rules.
+     *
+     * @param rules Rules, in order of increasing precedence.
+     * @throw std::regex_error if a REGEX pattern is invalid.
+     */
+    explicit PathFilter         (const std::vector<Rule>& rules = std::vector<Rule>());
+
+    /**
+     * @brief Decide whether a path passes the filter.
+     *
+     * @param relPath Path relative to the monitored root, without leading '/'.
+     * @return true if the path is accepted.
+     */
+    bool matches                (const std::string& relPath) const;
+
+    /**
+     * @brief Number of rules.
+     */
+    size_t size                 () const { return m_actions.size(); }
+
+private:
+
+    /**
+     * @class Automaton
+     * @brief Aho-Corasick automaton over the literals of the rules.
+     *
+     * Reports either the highest rule index among the literals found (feed())
+     * or every id of the literals found (collect()).
+     */
+    class Automaton
+    {
+    public:
+        Automaton               ();
+
+        /**
+         * @brief Add a literal; must be called before build().
+         *
+         * @param literal Non-empty byte string.
+         * @param id Rule index (for feed()) or any id (for collect()).
+         */
+        void add                (const std::string& literal, int32_t id);
+
+        /**
+         * @brief Compute failure links and per-state results.
+         */
+        void build              ();
+
+        /**
+         * @brief Whether any literal was added.
+         */
+        bool empty              () const { return m_nodes.size() == 1; }
+
+        /**
+         * @brief Feed bytes from a state.
+         *
+         * @param state Current state, updated.
+         * @param best Highest id found so far, updated.
+         */
+        void feed               (uint32_t& state, const char* data, size_t len, int32_t& best) const;
+
+        /**
+         * @brief Feed bytes from a state and append the ids of all literals that end in them.
+         */
+        void collect            (uint32_t& state, const char* data, size_t len, std::vector<int32_t>& found) const;
+
+    private:
+
+        struct Node
+        {
+            std::vector<std::pair<unsigned char, uint32_t>> edges;  // Sorted children
+            std::vector<int32_t> ids;   // Ids of the literals ending here
+            uint32_t    fail = 0;       // Longest proper suffix that is also a trie prefix
+            uint32_t    dict = 0;       // Nearest node along the failure chain with ids, 0 if none
+            int32_t     best = -1;      // Highest id completed here or along the failure chain
+        };
+
+        /**
+         * @brief Child of a node by byte, or -1.
+         */
+        int64_t child           (uint32_t node, unsigned char c) const;
+
+        /**
+         * @brief Next state after a byte.
+         */
+        uint32_t step           (uint32_t state, unsigned char c) const;
+
+        std::vector<Node>       m_nodes;    // Trie; node 0 is the root
+        uint32_t                m_root[256];// Children of the root by byte, 0 if none
+    };
+
+    /**
+     * @struct SlowRule
+     * @brief Rule that the automata cannot express.
+     */
+    struct SlowRule
+    {
+        int32_t     index;      // Rule index
+        Syntax      syntax;     // GLOB or REGEX
+        std::string glob;       // Normalized glob (no leading or trailing '/')
+        bool        anchored;   // Glob is matched against the path, else the name
+        bool        dirOnly;    // Glob only matches directories
+        std::regex  regex;      // Compiled REGEX pattern
+    };
+
+    /**
+     * @brief Compile one glob rule.
+     */
+    void addGlob                (const std::string& pattern, int32_t index);
+
+    /**
+     * @brief Queue a rule for one-by-one matching, indexed by its longest literal if it has one.
+     */
+    void addSlow                (SlowRule rule);
+
+    /**
+     * @brief Match a compiled slow rule.
+     */
+    static bool matchSlow       (const SlowRule& rule, const std::string& relPath, size_t nameStart);
+
+    /**
+     * @brief Match a glob against a whole string; only "**" crosses '/'.
+     */
+    static bool globMatch       (const char* p, const char* pe, const char* s, const char* se);
+
+    Automaton               m_names;        // Literals over '\0' + name + '\0'
+    Automaton               m_paths;        // Literals over "\0/" + path + '\0'
+    Automaton               m_nameHints;    // Longest literal of slow name globs -> m_slow position
+    Automaton               m_pathHints;    // Longest literal of slow path globs -> m_slow position
+    std::vector<SlowRule>   m_slow;         // Other rules, by increasing index
+    std::vector<int32_t>    m_unhinted;     // Positions in m_slow without a literal, always tried
+    std::vector<Action>     m_actions;      // Action of every rule
+    bool                    m_hasIncludes;  // Some rule is an INCLUDE
+};
+
+#endif // PATH_FILTER_H
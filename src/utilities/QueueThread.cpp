@@ -1,47 +1,78 @@
 #include "QueueThread.h"
 #include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
 
 
-QueueThread::QueueThread() 
+QueueThread::QueueThread(size_t capacity) 
+    : taskQueue(capacity),
+      m_sleeping(false)
 {
+    m_eventFd = eventfd(0, EFD_CLOEXEC);
+    if (m_eventFd == -1)
+    {
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
+
     start();
 }
 
 QueueThread::~QueueThread() 
 {
+    m_running = false;
+
+    // Wake the worker so it can observe m_running and exit
+    wake();
     stop();
+    close(m_eventFd);
 }
 
-void QueueThread::put(std::function<void()> task) 
+void QueueThread::enqueue(SmallTask task) 
 {
+    taskQueue.push(std::move(task));
+
+    // Pairs with the fence in thread(): either the worker sees the task or we see it sleeping.
+    // Only the producer that clears the flag pays for the wakeup syscall.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed) && m_sleeping.exchange(false))
     {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        taskQueue.push(task);
+        wake();
     }
+}
 
-    queueCondition.notify_one();
+void QueueThread::wake()
+{
+    uint64_t one = 1;
+    while (write(m_eventFd, &one, sizeof(one)) == -1 && errno == EINTR)
+    {
+    }
 }
 
 void QueueThread::thread() 
 {
     while (m_running) 
     {
-        std::function<void()> task;
+        SmallTask task;
+        if (taskQueue.tryPop(task))
         {
+            task();
+            continue;
+        }
 
-            std::unique_lock<std::mutex> lock(queueMutex);
-            queueCondition.wait(lock, [this] { return !m_running || !taskQueue.empty(); });
-            if (!m_running && taskQueue.empty()) 
+        m_sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (taskQueue.empty() && m_running)
+        {
+            uint64_t count;
+            if (read(m_eventFd, &count, sizeof(count)) == -1 && errno != EINTR)
             {
-                return;
+                std::cerr << "Failed to read queue eventfd: " << strerror(errno) << std::endl;
             }
-
-            task = std::move(taskQueue.front());
-            taskQueue.pop();
-
         }
-
-        task();
+        m_sleeping.store(false, std::memory_order_relaxed);
     }
-}
\ No newline at end of file
+}
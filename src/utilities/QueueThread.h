@@ -1,12 +1,11 @@
 #ifndef QUEUE_THREAD_H
 #define QUEUE_THREAD_H
 
-#include <queue>
-#include <mutex>
-#include <condition_variable>
-#include <functional>
 #include <atomic>
+#include <utility>
 #include "threadBase.h"
+#include "MpscQueue.h"
+#include "SmallTask.h"
 
 /**
  * @class QueueThread
@@ -14,6 +13,11 @@
  * 
  * QueueThread is derived from ThreadBase and provides methods to add tasks to a queue.
  * The thread processes tasks from the queue.
+ *
+ * Tasks are stored as SmallTask in a lock-free MpscQueue, so put() neither
+ * takes a lock nor allocates for typical lambdas. The idle worker sleeps on an
+ * eventfd that producers only write when the worker announced it is sleeping.
+ * When the queue is full, put() yields until the worker frees a slot.
  */
 class QueueThread : public ThreadBase 
 {
@@ -22,22 +26,28 @@ public:
 
     /**
      * @brief Constructor for QueueThread.
-     * Initializes the task queue and condition variable.
+     * Initializes the task queue and the wakeup eventfd.
+     *
+     * @param capacity Maximum number of queued tasks.
      */
-    QueueThread             ();
+    explicit QueueThread    (size_t capacity = 4096);
 
     /**
      * @brief Destructor for QueueThread.
-     * Ensures the thread is stopped and the queue is cleared.
+     * Ensures the thread is stopped; tasks still queued are discarded.
      */
     ~QueueThread            ();
 
     /**
      * @brief Adds a task to the queue.
      * 
-     * @param task The task to be added to the queue.
+     * @param task The task to be added to the queue (any void() callable).
      */
-    void put                (std::function<void()> task);
+    template <typename F>
+    void put                (F&& task)
+    {
+        enqueue(SmallTask(std::forward<F>(task)));
+    }
 
 protected:
 
@@ -48,11 +58,21 @@ protected:
 
 private:
 
-    std::queue<std::function<void()>>   taskQueue;          // Queue to store tasks
+    /**
+     * @brief Queues a task and wakes the worker if it sleeps.
+     */
+    void enqueue            (SmallTask task);
+
+    /**
+     * @brief Wakes the worker.
+     */
+    void wake               ();
+
+    MpscQueue<SmallTask>    taskQueue;          // Queue to store tasks
 
-    std::mutex                          queueMutex;         // Mutex to protect access to the queue
+    int                     m_eventFd;          // Wakeup eventfd the idle worker blocks on
 
-    std::condition_variable             queueCondition;     // Condition variable to notify the thread of new tasks
+    std::atomic<bool>       m_sleeping;         // true while the worker is (about to be) blocked on m_eventFd
 };
 
 #endif // QUEUE_THREAD_H
@@ -0,0 +1,242 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include "Reactor.h"
+#include "Logger.h"
+#include "TimerWheel.h"
+
+// Ready descriptors taken by one epoll_wait()
+static const int MAX_READY = 64;
+
+// epoll key of the wakeup eventfd; descriptor keys are (registration id << 32 | fd) with a non-zero id
+static const uint64_t WAKE_KEY = 0;
+
+namespace
+{
+    // Reactor whose loop runs on this thread, if any
+    thread_local const Reactor* t_loop = nullptr;
+
+    /**
+     * @brief Add one to an eventfd.
+     */
+    void signal(int fd)
+    {
+        uint64_t one = 1;
+        while (write(fd, &one, sizeof(one)) == -1 && errno == EINTR)
+        {
+        }
+    }
+}
+
+Reactor& Reactor::getInstance()
+{
+    // Constructed first, so the logger outlives handlers that log from the loop
+    Logger::getInstance();
+
+    static Reactor instance;
+    return instance;
+}
+
+Reactor::Reactor()
+    : m_nextId(1),
+      m_runningId(0),
+      m_wakePending(false)
+{
+    m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epollFd == -1)
+    {
+        throw std::runtime_error(std::string("Failed to create epoll instance: ") + strerror(errno));
+    }
+
+    m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeFd == -1)
+    {
+        int error = errno;
+        close(m_epollFd);
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(error));
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_KEY;
+    epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &event);
+
+    m_timers.reset(new TimerWheel(*this));
+    start();
+}
+
+Reactor::~Reactor()
+{
+    Stop();
+    m_timers.reset();
+    close(m_wakeFd);
+    close(m_epollFd);
+}
+
+void Reactor::Stop()
+{
+    m_running = false;
+    signal(m_wakeFd);
+    stop();
+}
+
+bool Reactor::add(int fd, uint32_t events, Handler handler)
+{
+    std::lock_guard<std::mutex> lock(m_stateMutex);
+
+    auto registration = std::make_shared<Registration>();
+    registration->id = m_nextId++;
+    registration->handler = std::move(handler);
+    if (m_nextId == 0)
+    {
+        m_nextId = 1;
+    }
+
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.u64 = static_cast<uint64_t>(registration->id) << 32 | static_cast<uint32_t>(fd);
+
+    // A descriptor closed without remove() left epoll on its own: its number may be registered again
+    if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+    {
+        return false;
+    }
+    m_handlers[fd] = std::move(registration);
+    return true;
+}
+
+bool Reactor::modify(int fd, uint32_t events)
+{
+    std::lock_guard<std::mutex> lock(m_stateMutex);
+    auto it = m_handlers.find(fd);
+    if (it == m_handlers.end())
+    {
+        errno = ENOENT;
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = events;
+    event.data.u64 = static_cast<uint64_t>(it->second->id) << 32 | static_cast<uint32_t>(fd);
+    return epoll_ctl(m_epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void Reactor::remove(int fd)
+{
+    std::unique_lock<std::mutex> lock(m_stateMutex);
+    auto it = m_handlers.find(fd);
+    if (it == m_handlers.end())
+    {
+        return;
+    }
+    uint32_t id = it->second->id;
+    m_handlers.erase(it);
+
+    // Fails harmlessly if the descriptor was closed already
+    epoll_ctl(m_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+
+    // A handler removing a descriptor is the only one running: nothing to wait for
+    if (!inLoopThread())
+    {
+        m_idle.wait(lock, [this, id]() { return m_runningId != id; });
+    }
+}
+
+bool Reactor::inLoopThread() const
+{
+    return t_loop == this;
+}
+
+void Reactor::enqueue(SmallTask task)
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        m_tasks.push_back(std::move(task));
+
+        // One write per batch of posts: the loop takes every queued task when it wakes
+        wake = !m_wakePending;
+        m_wakePending = true;
+    }
+    if (wake)
+    {
+        signal(m_wakeFd);
+    }
+}
+
+void Reactor::runTasks()
+{
+    uint64_t count;
+    while (read(m_wakeFd, &count, sizeof(count)) == -1 && errno == EINTR)
+    {
+    }
+
+    std::vector<SmallTask> tasks;
+    {
+        std::lock_guard<std::mutex> lock(m_stateMutex);
+        tasks.swap(m_tasks);
+        m_wakePending = false;
+    }
+    for (SmallTask& task : tasks)
+    {
+        task();
+    }
+}
+
+void Reactor::thread()
+{
+    t_loop = this;
+
+    struct epoll_event ready[MAX_READY];
+    while (m_running)
+    {
+        int count = epoll_wait(m_epollFd, ready, MAX_READY, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "epoll_wait failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        for (int i = 0; i < count && m_running; ++i)
+        {
+            if (ready[i].data.u64 == WAKE_KEY)
+            {
+                runTasks();
+                continue;
+            }
+
+            int fd = static_cast<int>(static_cast<uint32_t>(ready[i].data.u64));
+            uint32_t id = static_cast<uint32_t>(ready[i].data.u64 >> 32);
+            std::shared_ptr<Registration> registration;
+            {
+                // Skip descriptors removed by an earlier handler of this batch
+                std::lock_guard<std::mutex> lock(m_stateMutex);
+                auto it = m_handlers.find(fd);
+                if (it == m_handlers.end() || it->second->id != id)
+                {
+                    continue;
+                }
+                registration = it->second;
+                m_runningId = id;
+            }
+
+            registration->handler(ready[i].events);
+
+            {
+                std::lock_guard<std::mutex> lock(m_stateMutex);
+                m_runningId = 0;
+            }
+            m_idle.notify_all();
+        }
+    }
+
+    t_loop = nullptr;
+}
@@ -0,0 +1,158 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "threadBase.h"
+#include "SmallTask.h"
+
+class TimerWheel;
+
+/**
+ * @class Reactor
+ * @brief Event loop running handlers of file descriptors on one thread, built on epoll.
+ *
+ * Components register their file descriptors (inotify, timerfd, sockets, ...)
+ * with add() and a handler, which the loop thread calls whenever the
+ * descriptor is ready. Other threads hand work to the loop with post(),
+ * which wakes it through an eventfd. The loop blocks in epoll_wait() without
+ * a timeout: an idle process does not wake up until something happens.
+ *
+ * Handlers run one at a time and must not block for long, as every
+ * component on the loop waits for them. Descriptors are level-triggered.
+ * Each reactor carries a TimerWheel (timers()) whose callbacks run on the
+ * loop too, so components needing many timers share a single timerfd.
+ */
+class Reactor : public ThreadBase
+{
+
+public:
+
+    /**
+     * @brief Handler of a ready descriptor.
+     *
+     * @param events Ready events (EPOLLIN, EPOLLOUT, EPOLLERR, EPOLLHUP, ...).
+     */
+    using Handler = std::function<void(uint32_t events)>;
+
+    /**
+     * @brief The process-wide loop shared by the components of the client, started on first use.
+     */
+    static Reactor& getInstance ();
+
+    /**
+     * @brief Constructor; creates the epoll instance and starts the loop thread.
+     */
+    Reactor                     ();
+
+    /**
+     * @brief Destructor; stops the loop, discarding tasks not run yet.
+     */
+    ~Reactor                    ();
+
+    Reactor                     (const Reactor&) = delete;
+    Reactor& operator=          (const Reactor&) = delete;
+
+    /**
+     * @brief Register a descriptor (thread-safe).
+     *
+     * @param fd Descriptor; must stay open until remove().
+     * @param events Events to wait for (EPOLLIN, EPOLLOUT, ...).
+     * @param handler Called on the loop thread whenever fd is ready.
+     * @return false, with errno set, if epoll rejects the descriptor.
+     */
+    bool add                    (int fd, uint32_t events, Handler handler);
+
+    /**
+     * @brief Change the events a registered descriptor waits for (thread-safe).
+     *
+     * @return false, with errno set, if epoll rejects the change.
+     */
+    bool modify                 (int fd, uint32_t events);
+
+    /**
+     * @brief Unregister a descriptor (thread-safe); call before closing it.
+     *
+     * Once this returns, the handler is not running and is not called again,
+     * unless remove() was called from a handler.
+     *
+     * @param fd Descriptor passed to add(); unknown descriptors are ignored.
+     */
+    void remove                 (int fd);
+
+    /**
+     * @brief Run a task on the loop thread (thread-safe).
+     *
+     * @param task Any void() callable; tasks run in the order they were posted.
+     */
+    template <typename F>
+    void post                   (F&& task)
+    {
+        enqueue(SmallTask(std::forward<F>(task)));
+    }
+
+    /**
+     * @brief true if called from a handler or task of this reactor.
+     */
+    bool inLoopThread           () const;
+
+    /**
+     * @brief One-shot timers run on the loop thread.
+     */
+    TimerWheel& timers          () { return *m_timers; }
+
+    /**
+     * @brief Stop the loop and wait for the handler or task running, if any.
+     */
+    void Stop                   ();
+
+protected:
+
+    /**
+     * @brief The loop: waits for ready descriptors and calls their handlers.
+     */
+    void thread                 () override;
+
+private:
+
+    /**
+     * @struct Registration
+     * @brief A registered descriptor and its handler.
+     */
+    struct Registration
+    {
+        uint32_t    id;         // Tells a new registration of a reused fd from the removed one
+        Handler     handler;    // Called when the descriptor is ready
+    };
+
+    /**
+     * @brief Queue a task and wake the loop.
+     */
+    void enqueue                (SmallTask task);
+
+    /**
+     * @brief Run the tasks posted so far.
+     */
+    void runTasks               ();
+
+    int                         m_epollFd;      // epoll instance
+    int                         m_wakeFd;       // eventfd written by post() and Stop()
+
+    std::mutex                  m_stateMutex;   // Protects the members below
+    std::condition_variable     m_idle;         // Signals the end of a handler, for remove()
+    std::unordered_map<int, std::shared_ptr<Registration>> m_handlers; // Registrations by descriptor
+    uint32_t                    m_nextId;       // Id of the next registration
+    uint32_t                    m_runningId;    // Registration whose handler is running, 0 if none
+    std::vector<SmallTask>      m_tasks;        // Posted tasks not run yet
+    bool                        m_wakePending;  // m_wakeFd was written and not read yet
+
+    std::unique_ptr<TimerWheel> m_timers;       // Timers of the components on this loop
+};
+
+#endif // REACTOR_H
@@ -0,0 +1,162 @@
+#ifndef SMALL_PATH_H
+#define SMALL_PATH_H
+
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @class SmallPath
+ * @brief Path string stored inline up to INLINE_SIZE bytes, on the heap beyond.
+ *
+ * Relative paths reported by the monitor are almost always short, so a
+ * SmallPath holding one is built, copied and moved with a memcpy, without
+ * heap allocation or atomic operation; events carrying a path can then be
+ * copied freely between queues and threads. Longer paths fall back to a heap
+ * buffer. Converting to std::string is explicit (str()), so no copy happens
+ * unnoticed; std::string_view conversion is implicit and free.
+ */
+class SmallPath
+{
+
+public:
+
+    static const size_t INLINE_SIZE = 111;  // Longest path stored inline, so that sizeof(SmallPath) is 128
+
+    SmallPath               () : m_size(0), m_heap(nullptr) { m_inline[0] = '\0'; }
+
+    /**
+     * @brief Copies a path; implicit, so a path can be assigned directly.
+     */
+    SmallPath               (std::string_view path) : SmallPath() { assign(path); }
+    SmallPath               (const std::string& path) : SmallPath(std::string_view(path)) {}
+    SmallPath               (const char* path) : SmallPath(std::string_view(path)) {}
+
+    SmallPath               (const SmallPath& other) : SmallPath() { assign(other.view()); }
+
+    SmallPath               (SmallPath&& other) noexcept : m_heap(nullptr)
+    {
+        steal(other);
+    }
+
+    SmallPath& operator=    (const SmallPath& other)
+    {
+        if (this != &other)
+        {
+            assign(other.view());
+        }
+        return *this;
+    }
+
+    SmallPath& operator=    (SmallPath&& other) noexcept
+    {
+        if (this != &other)
+        {
+            delete[] m_heap;
+            steal(other);
+        }
+        return *this;
+    }
+
+    ~SmallPath              ()
+    {
+        delete[] m_heap;
+    }
+
+    /**
+     * @brief Replace the path, reusing the current buffer if it is large enough.
+     */
+    SmallPath& assign       (std::string_view path)
+    {
+        m_size = 0;
+        return append(path);
+    }
+
+    /**
+     * @brief Append to the path, e.g. a file name to its directory.
+     */
+    SmallPath& append       (std::string_view part)
+    {
+        size_t size = m_size + part.size();
+        if (size > capacity())
+        {
+            // part may point into the current buffer: copy it before freeing that
+            char* heap = new char[size + 1];
+            std::memcpy(heap, data(), m_size);
+            std::memcpy(heap + m_size, part.data(), part.size());
+            delete[] m_heap;
+            m_heap = heap;
+            m_capacity = size;
+        }
+        else
+        {
+            std::memmove(buffer() + m_size, part.data(), part.size());
+        }
+        buffer()[size] = '\0';
+        m_size = size;
+        return *this;
+    }
+
+    const char* data        () const { return m_heap ? m_heap : m_inline; }
+    const char* c_str       () const { return data(); }
+    size_t size             () const { return m_size; }
+    bool empty              () const { return 0 == m_size; }
+
+    std::string_view view   () const { return std::string_view(data(), m_size); }
+    operator std::string_view() const { return view(); }
+
+    /**
+     * @brief Copy of the path as a std::string.
+     */
+    std::string str         () const { return std::string(data(), m_size); }
+
+    bool operator==         (const SmallPath& other) const { return view() == other.view(); }
+    bool operator!=         (const SmallPath& other) const { return view() != other.view(); }
+
+private:
+
+    size_t capacity         () const { return m_heap ? m_capacity : INLINE_SIZE; }
+
+    char* buffer            () { return m_heap ? m_heap : m_inline; }
+
+    /**
+     * @brief Take the path of another SmallPath, leaving it empty; m_heap must be free.
+     */
+    void steal              (SmallPath& other)
+    {
+        m_size = other.m_size;
+        m_heap = other.m_heap;
+        if (m_heap)
+        {
+            m_capacity = other.m_capacity;
+        }
+        else
+        {
+            std::memcpy(m_inline, other.m_inline, m_size + 1);
+        }
+        other.m_size = 0;
+        other.m_heap = nullptr;
+        other.m_inline[0] = '\0';
+    }
+
+    size_t                  m_size;                     // Length, without the terminating NUL
+    char*                   m_heap;                     // Heap buffer of long paths, or nullptr
+    union
+    {
+        char                m_inline[INLINE_SIZE + 1];  // NUL-terminated path, if m_heap is nullptr
+        size_t              m_capacity;                 // Heap buffer size without the NUL, otherwise
+    };
+};
+
+namespace std
+{
+    template <>
+    struct hash<SmallPath>
+    {
+        size_t operator()(const SmallPath& path) const { return hash<string_view>()(path.view()); }
+    };
+}
+
+#endif // SMALL_PATH_H
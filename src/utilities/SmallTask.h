@@ -0,0 +1,150 @@
+#ifndef SMALL_TASK_H
+#define SMALL_TASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @class SmallTask
+ * @brief Move-only void() callable that stores small callables inline.
+ *
+ * Like std::function<void()>, but callables of up to INLINE_SIZE bytes (a
+ * lambda capturing a pointer and a std::string, or a whole std::function)
+ * are kept inside the object, so queueing one costs no heap allocation.
+ * Larger callables fall back to the heap.
+ */
+class SmallTask
+{
+
+public:
+
+    static const size_t INLINE_SIZE = 64;   // Bytes of inline callable storage
+
+    SmallTask               () = default;
+
+    /**
+     * @brief Wraps a callable.
+     *
+     * @param fn Callable invocable as fn().
+     */
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, SmallTask>::value>::type>
+    SmallTask               (F&& fn)
+    {
+        using Fn = typename std::decay<F>::type;
+        if constexpr (sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+                      std::is_nothrow_move_constructible<Fn>::value)
+        {
+            new (m_storage) Fn(std::forward<F>(fn));
+            m_ops = &inlineOps<Fn>;
+        }
+        else
+        {
+            *reinterpret_cast<Fn**>(m_storage) = new Fn(std::forward<F>(fn));
+            m_ops = &heapOps<Fn>;
+        }
+    }
+
+    SmallTask               (SmallTask&& other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    SmallTask& operator=    (SmallTask&& other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    SmallTask               (const SmallTask&) = delete;
+    SmallTask& operator=    (const SmallTask&) = delete;
+
+    ~SmallTask              ()
+    {
+        reset();
+    }
+
+    /**
+     * @brief Invokes the callable.
+     */
+    void operator()         ()
+    {
+        m_ops->invoke(m_storage);
+    }
+
+    /**
+     * @brief true if a callable is held.
+     */
+    explicit operator bool  () const { return m_ops != nullptr; }
+
+    /**
+     * @brief Destroys the held callable.
+     */
+    void reset              ()
+    {
+        if (m_ops)
+        {
+            m_ops->destroy(m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+
+    struct Ops
+    {
+        void (*invoke)(void* storage);
+        void (*move)(void* from, void* to);         // Move-construct into to and destroy from
+        void (*destroy)(void* storage);
+    };
+
+    template <typename Fn>
+    static void inlineInvoke(void* storage) { (*static_cast<Fn*>(storage))(); }
+
+    template <typename Fn>
+    static void inlineMove(void* from, void* to)
+    {
+        new (to) Fn(std::move(*static_cast<Fn*>(from)));
+        static_cast<Fn*>(from)->~Fn();
+    }
+
+    template <typename Fn>
+    static void inlineDestroy(void* storage) { static_cast<Fn*>(storage)->~Fn(); }
+
+    template <typename Fn>
+    static void heapInvoke(void* storage) { (**static_cast<Fn**>(storage))(); }
+
+    template <typename Fn>
+    static void heapMove(void* from, void* to) { *static_cast<Fn**>(to) = *static_cast<Fn**>(from); }
+
+    template <typename Fn>
+    static void heapDestroy(void* storage) { delete *static_cast<Fn**>(storage); }
+
+    template <typename Fn>
+    static constexpr Ops inlineOps = {&inlineInvoke<Fn>, &inlineMove<Fn>, &inlineDestroy<Fn>};
+
+    template <typename Fn>
+    static constexpr Ops heapOps = {&heapInvoke<Fn>, &heapMove<Fn>, &heapDestroy<Fn>};
+
+    void moveFrom           (SmallTask& other)
+    {
+        m_ops = other.m_ops;
+        if (m_ops)
+        {
+            m_ops->move(other.m_storage, m_storage);
+            other.m_ops = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char m_storage[INLINE_SIZE];     // Inline callable or heap pointer
+
+    const Ops*                              m_ops = nullptr;            // Operations of the held callable type
+};
+
+#endif // SMALL_TASK_H
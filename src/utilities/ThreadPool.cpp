@@ -0,0 +1,114 @@
+#include "ThreadPool.h"
+#include <algorithm>
+
+// Pool and worker index of the calling thread, if it is a pool worker
+static thread_local ThreadPool* tl_pool = nullptr;
+static thread_local size_t      tl_index = 0;
+
+ThreadPool::ThreadPool(size_t threads)
+    : m_running(true),
+      m_queued(0),
+      m_next(0)
+{
+    if (threads == 0)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; ++i)
+    {
+        m_workers.emplace_back(new Worker());
+    }
+
+    // Start only once every deque exists, workers steal from all of them
+    for (size_t i = 0; i < threads; ++i)
+    {
+        m_workers[i]->thread = std::thread(&ThreadPool::run, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        m_running = false;
+    }
+
+    m_idleCondition.notify_all();
+
+    for (auto& worker : m_workers)
+    {
+        if (worker->thread.joinable())
+        {
+            worker->thread.join();
+        }
+    }
+}
+
+void ThreadPool::put(std::function<void()> task)
+{
+    // A worker keeps its own follow-up tasks local, others are spread round-robin
+    size_t index = (tl_pool == this) ? tl_index : m_next++ % m_workers.size();
+
+    // Counted before it is visible so m_queued never undercounts a takeable task
+    ++m_queued;
+    {
+        std::lock_guard<std::mutex> lock(m_workers[index]->mutex);
+        m_workers[index]->tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+    }
+    m_idleCondition.notify_one();
+}
+
+bool ThreadPool::take(size_t index, std::function<void()>& task)
+{
+    {
+        Worker& own = *m_workers[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            --m_queued;
+            return true;
+        }
+    }
+
+    // Steal from the back of the other deques, oldest work stays with its owner
+    for (size_t i = 1; i < m_workers.size(); ++i)
+    {
+        Worker& victim = *m_workers[(index + i) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            --m_queued;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::run(size_t index)
+{
+    tl_pool = this;
+    tl_index = index;
+
+    while (m_running)
+    {
+        std::function<void()> task;
+        if (take(index, task))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_idleMutex);
+        m_idleCondition.wait(lock, [this] { return !m_running || m_queued.load() > 0; });
+    }
+}
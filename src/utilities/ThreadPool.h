@@ -0,0 +1,92 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ThreadPool
+ * @brief A pool of worker threads with per-worker task deques and work stealing.
+ *
+ * Drop-in alternative to QueueThread when tasks may block (sleeps, disk or
+ * network I/O) and should not hold up each other. Every worker owns a deque:
+ * tasks put() from a worker go to that worker's own deque, tasks put() from
+ * other threads are spread round-robin. A worker takes tasks from the front of
+ * its own deque and, when it runs dry, steals from the back of the others'
+ * before going to sleep.
+ *
+ * @note Tasks may run concurrently and in any order; callers must protect
+ *       shared state and serialize dependent tasks themselves.
+ */
+class ThreadPool
+{
+
+public:
+
+    /**
+     * @brief Constructor for ThreadPool. Starts the workers.
+     *
+     * @param threads Number of worker threads (0 = hardware concurrency).
+     */
+    explicit ThreadPool     (size_t threads = 0);
+
+    /**
+     * @brief Destructor for ThreadPool.
+     * Lets running tasks finish, discards queued ones and joins the workers.
+     */
+    ~ThreadPool             ();
+
+    /**
+     * @brief Adds a task to the pool.
+     *
+     * @param task The task to be run by one of the workers.
+     */
+    void put                (std::function<void()> task);
+
+    /**
+     * @brief Number of worker threads.
+     */
+    size_t size             () const { return m_workers.size(); }
+
+private:
+
+    /**
+     * @brief Deque of one worker.
+     */
+    struct Worker
+    {
+        std::mutex                          mutex;          // Protects tasks
+        std::deque<std::function<void()>>   tasks;          // Front: owner, back: thieves
+        std::thread                         thread;         // The worker thread
+    };
+
+    /**
+     * @brief Main loop of worker index.
+     */
+    void run                (size_t index);
+
+    /**
+     * @brief Take a task from the worker's own deque or steal one.
+     */
+    bool take               (size_t index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>>    m_workers;      // Worker threads and their deques
+
+    std::atomic<bool>                       m_running;      // Flag to control worker execution
+
+    std::atomic<size_t>                     m_queued;       // Tasks waiting in any deque
+
+    std::atomic<size_t>                     m_next;         // Round-robin cursor for external put()
+
+    std::mutex                              m_idleMutex;    // Mutex for idle workers
+
+    std::condition_variable                 m_idleCondition; // Wakes idle workers on new tasks
+};
+
+#endif // THREAD_POOL_H
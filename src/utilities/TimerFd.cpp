@@ -1,11 +1,9 @@
+#include <sys/epoll.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 #include <stdexcept>
 #include <iostream>
-#include <thread>
 #include <cstring> // Include this header for strerror
-#include <atomic> // Include for std::atomic
-#include <poll.h> // For poll(), struct pollfd, and POLLIN
 
 #include "TimerFd.h"
 
@@ -13,7 +11,10 @@ using namespace std::chrono;
 
 
 
-TimerFd::TimerFd() : m_timer_fd(timerfd_create(CLOCK_REALTIME, 0))
+TimerFd::TimerFd(Reactor& reactor)
+    : m_reactor(reactor),
+      m_timer_fd(timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC)),
+      m_started(false)
 {
     if(-1 == m_timer_fd)
     {
@@ -56,89 +57,48 @@ long TimerFd::GetTimer()
 void TimerFd::Start()
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    start();
+    if (m_started)
+    {
+        return;
+    }
+    if (!m_reactor.add(m_timer_fd, EPOLLIN, [this](uint32_t) { onReadable(); }))
+    {
+        throw std::runtime_error("Failed to register timer: " + std::string(strerror(errno)));
+    }
+    m_started = true;
 }
 
 void TimerFd::Stop()
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Disable the timer so it does not stay armed for a later Start()
+    struct itimerspec disable_timer = {};
+    if (timerfd_settime(m_timer_fd, 0, &disable_timer, NULL) == -1)
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-        // Set the running flag to false first
-        m_running = false;
-        
-        // Disable the timer to unblock any read operations
-        struct itimerspec disable_timer = {};
-        if (timerfd_settime(m_timer_fd, 0, &disable_timer, NULL) == -1) {
-            std::cerr << "Failed to disable timer: " << std::string(strerror(errno)) << std::endl;
-        }
-        
-        // Force unblock by writing to the timer file descriptor
-        uint64_t val = 1;
-        if (write(m_timer_fd, &val, sizeof(val)) == -1) {
-            std::cerr << "Failed to write to timer fd: " << std::string(strerror(errno)) << std::endl;
-        }
+        std::cerr << "Failed to disable timer: " << std::string(strerror(errno)) << std::endl;
     }
-    
-    // Now close the fd and recreate it to ensure cleanup
-    close(m_timer_fd);
-    m_timer_fd = timerfd_create(CLOCK_REALTIME, 0);
-    if (m_timer_fd == -1) {
-        std::cerr << "Failed to recreate timer fd: " << std::string(strerror(errno)) << std::endl;
+
+    // Waits for a running onTimeout(), which never takes m_mutex
+    if (m_started)
+    {
+        m_reactor.remove(m_timer_fd);
+        m_started = false;
     }
-    
-    // Call the base class stop() to join the thread
-    stop();
 }
 
-void TimerFd::thread()
+void TimerFd::onReadable()
 {
-    while (m_running)
+    // Expirations since the last read; one onTimeout() covers them all, as before
+    uint64_t expirations;
+    if (read(m_timer_fd, &expirations, sizeof(expirations)) < 0)
     {
-        uint64_t buffer;
-        size_t return_size = sizeof(buffer);
-
-        // Set up polling to check m_running periodically
-        struct pollfd pfd;
-        pfd.fd = m_timer_fd;
-        pfd.events = POLLIN;
-        pfd.revents = 0;
-        
-        // Poll with a short timeout to check m_running periodically
-        int poll_result = poll(&pfd, 1, 50); // 50ms timeout for quicker response
-        
-        // Check if we should exit
-        if (!m_running) break;
-        
-        if (poll_result < 0)
+        if (errno != EAGAIN && errno != EINTR)
         {
-            if (errno == EINTR) continue; // Interrupted, retry
-            if (!m_running) break;
-            std::cerr << "Poll error: " << std::string(strerror(errno)) << std::endl;
-            break;
-        }
-        else if (poll_result == 0)
-        {
-            // Timeout, check m_running again
-            continue;
-        }
-        
-        // Check if there's data to read
-        if (pfd.revents & POLLIN)
-        {
-            int result = read(m_timer_fd, &buffer, return_size);
-            if (result < 0)
-            {
-                if (errno == EINTR) continue;
-                if (!m_running) break;
-                std::cerr << "Read error: " << std::string(strerror(errno)) << std::endl;
-                break;
-            }
-            
-            // Only call onTimeout if still running
-            if (m_running)
-            {
-                onTimeout();
-            }
+            std::cerr << "Read error: " << std::string(strerror(errno)) << std::endl;
         }
+        return;
     }
+
+    onTimeout();
 }
@@ -5,7 +5,7 @@
 #include <functional>
 #include <atomic>
 #include <mutex>
-#include "threadBase.h"
+#include "Reactor.h"
 
 static const int SEC_TO_MILI    = 1000;      // Conversion factor from seconds to milliseconds
 static const int MILI_TO_NANO   = 1000000;   // Conversion factor from milliseconds to nanoseconds
@@ -14,10 +14,13 @@ static const int MILI_TO_NANO   = 1000000;   // Conversion factor from milliseco
  * @class TimerFd
  * @brief A class that provides timer functionality using file descriptors.
  * 
- * TimerFd is derived from ThreadBase and provides methods to set, start, and stop a timer.
- * Derived classes must implement the onTimeout() method to define the timeout action.
+ * TimerFd provides methods to set, start, and stop a timer. The timer file
+ * descriptor is registered on a Reactor while started, so timers share the
+ * reactor's thread instead of owning one each.
+ * Derived classes must implement the onTimeout() method to define the timeout action;
+ * it runs on the reactor thread.
  */
-class TimerFd : public ThreadBase
+class TimerFd
 {
 
 public:
@@ -25,14 +28,16 @@ public:
     /**
      * @brief Constructor for TimerFd.
      * Initializes the timer file descriptor.
+     *
+     * @param reactor Loop running onTimeout(); the process-wide one by default.
      */
-    TimerFd                     ();
+    explicit TimerFd            (Reactor& reactor = Reactor::getInstance());
 
     /**
      * @brief Destructor for TimerFd.
      * Cleans up the timer file descriptor.
      */
-    ~TimerFd                    ();
+    virtual ~TimerFd            ();
 
     /**
      * @brief Sets the timer with a delay and an optional interval.
@@ -56,18 +61,13 @@ public:
     void Start                  ();
 
     /**
-     * @brief Stops the timer.
+     * @brief Stops the timer; once this returns, onTimeout() is not running
+     * (unless Stop() was called from it) and is not called again.
      */
     void Stop                   ();
 
 protected:
 
-    /**
-     * @brief The thread function that handles the timer expiration.
-     * This function is called internally by the ThreadBase class.
-     */
-    void thread                 () override;
-
     /**
      * @brief Pure virtual function to be implemented by derived classes.
      * This function is called when the timer expires.
@@ -76,10 +76,18 @@ protected:
 
 private:
 
+    /**
+     * @brief Reactor handler: consumes the expirations and calls onTimeout().
+     */
+    void onReadable             ();
+
+    Reactor& m_reactor; ///< Loop the timer is registered on while started.
+
     int m_timer_fd; ///< The file descriptor for the timer.
 
+    bool m_started; ///< Whether m_timer_fd is registered on m_reactor.
+
     std::mutex m_mutex; ///< Mutex to protect access to the timer.
-    // Remove the shadowed m_running declaration since it's already in ThreadBase
 };
 
 
@@ -0,0 +1,403 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "TimerWheel.h"
+#include "Reactor.h"
+
+namespace
+{
+    /**
+     * @brief CLOCK_MONOTONIC in nanoseconds, the clock the timerfd is armed on.
+     */
+    int64_t monotonicNs()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    /**
+     * @brief Distance from start to the first set bit of a 256-bit map, wrapping around, or -1 if none.
+     */
+    int firstSet(const uint64_t bits[4], unsigned start)
+    {
+        unsigned word = (start >> 6) & 3;
+        uint64_t masked = bits[word] & (~0ULL << (start & 63));
+        for (unsigned i = 0; i < 5; ++i)
+        {
+            if (masked != 0)
+            {
+                unsigned slot = (word << 6) | static_cast<unsigned>(__builtin_ctzll(masked));
+                return static_cast<int>((slot - start) & 255);
+            }
+            word = (word + 1) & 3;
+            masked = bits[word];
+        }
+        return -1;
+    }
+}
+
+TimerWheel::TimerWheel(Reactor& reactor, std::chrono::nanoseconds tick)
+    : m_reactor(reactor),
+      m_startNs(monotonicNs()),
+      m_tickNs(std::max<int64_t>(1, tick.count())),
+      m_free(NIL),
+      m_capacity(0),
+      m_now(0),
+      m_armed(UINT64_MAX),
+      m_pending(0),
+      m_running(0)
+{
+    std::fill(std::begin(m_heads), std::end(m_heads), NIL);
+    std::memset(m_occupied, 0, sizeof(m_occupied));
+
+    m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerFd == -1)
+    {
+        throw std::runtime_error(std::string("Failed to create timer: ") + strerror(errno));
+    }
+    if (!m_reactor.add(m_timerFd, EPOLLIN, [this](uint32_t) { onReadable(); }))
+    {
+        int error = errno;
+        close(m_timerFd);
+        throw std::runtime_error(std::string("Failed to register timer: ") + strerror(error));
+    }
+}
+
+TimerWheel::~TimerWheel()
+{
+    m_reactor.remove(m_timerFd);
+    close(m_timerFd);
+}
+
+TimerWheel::TimerId TimerWheel::add(std::chrono::nanoseconds delay, SmallTask callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Rounded up: a timer never fires early
+    int64_t due = monotonicNs() - m_startNs + std::max<int64_t>(0, delay.count());
+    uint64_t expiry = static_cast<uint64_t>((due + m_tickNs - 1) / m_tickNs);
+    expiry = std::max(expiry, m_now + 1);
+
+    uint32_t index = allocate();
+    Node& n = node(index);
+    n.expiry = expiry;
+    n.state = State::PENDING;
+    n.callback = std::move(callback);
+    insert(index);
+    ++m_pending;
+
+    // The timerfd fires no later than every pending expiry: only an earlier one needs it moved
+    if (expiry < m_armed)
+    {
+        rearm();
+    }
+    return static_cast<TimerId>(n.generation) << 32 | index;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    uint32_t index = static_cast<uint32_t>(id);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+
+    // Destroyed after the lock is released, in case its captures cancel timers themselves
+    SmallTask dropped;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (id != 0 && id == m_running)
+    {
+        if (!m_reactor.inLoopThread())
+        {
+            m_idle.wait(lock, [this, id]() { return m_running != id; });
+        }
+        return false;
+    }
+    if (index >= m_capacity || node(index).generation != generation)
+    {
+        return false;
+    }
+
+    Node& n = node(index);
+    switch (n.state)
+    {
+        case State::PENDING:
+            // Left armed: an early wakeup finds nothing due and arms for the next timer
+            unlink(index);
+            --m_pending;
+            dropped = std::move(n.callback);
+            release(index);
+            return true;
+        case State::EXPIRED:
+            // Already taken out by the reactor thread, which releases the node
+            n.state = State::CANCELLED;
+            dropped = std::move(n.callback);
+            return true;
+        default:
+            return false;
+    }
+}
+
+size_t TimerWheel::size() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+uint32_t TimerWheel::allocate()
+{
+    if (m_free == NIL)
+    {
+        const uint32_t chunkSize = 1u << CHUNK_BITS;
+        std::unique_ptr<Node[]> chunk(new Node[chunkSize]);
+        for (uint32_t i = 0; i < chunkSize; ++i)
+        {
+            chunk[i].generation = 1;
+            chunk[i].state = State::FREE;
+            chunk[i].next = i + 1 < chunkSize ? m_capacity + i + 1 : NIL;
+        }
+        m_chunks.push_back(std::move(chunk));
+        m_free = m_capacity;
+        m_capacity += chunkSize;
+    }
+
+    uint32_t index = m_free;
+    m_free = node(index).next;
+    return index;
+}
+
+void TimerWheel::release(uint32_t index)
+{
+    Node& n = node(index);
+    n.callback = SmallTask();
+    n.state = State::FREE;
+
+    // Generation 0 would let an id of 0 be valid
+    if (++n.generation == 0)
+    {
+        n.generation = 1;
+    }
+    n.next = m_free;
+    m_free = index;
+}
+
+void TimerWheel::insert(uint32_t index)
+{
+    Node& n = node(index);
+    uint64_t delta = n.expiry > m_now ? n.expiry - m_now : 0;
+
+    unsigned level = 0;
+    unsigned slot;
+    if (delta < SLOTS)
+    {
+        slot = static_cast<unsigned>(n.expiry) & (SLOTS - 1);
+    }
+    else if (delta >> (SLOT_BITS * LEVELS) != 0)
+    {
+        // Beyond the top level: its farthest slot, moved down when time gets there
+        level = LEVELS - 1;
+        slot = static_cast<unsigned>((m_now >> (SLOT_BITS * level)) + SLOTS - 1) & (SLOTS - 1);
+    }
+    else
+    {
+        level = 1;
+        while (delta >> (SLOT_BITS * (level + 1)) != 0)
+        {
+            ++level;
+        }
+        slot = static_cast<unsigned>(n.expiry >> (SLOT_BITS * level)) & (SLOTS - 1);
+    }
+
+    unsigned flat = level * SLOTS + slot;
+    n.slot = static_cast<uint16_t>(flat);
+    n.prev = NIL;
+    n.next = m_heads[flat];
+    if (n.next != NIL)
+    {
+        node(n.next).prev = index;
+    }
+    m_heads[flat] = index;
+    m_occupied[level][slot >> 6] |= 1ULL << (slot & 63);
+}
+
+void TimerWheel::unlink(uint32_t index)
+{
+    Node& n = node(index);
+    unsigned flat = n.slot;
+    if (n.prev != NIL)
+    {
+        node(n.prev).next = n.next;
+    }
+    else
+    {
+        m_heads[flat] = n.next;
+    }
+    if (n.next != NIL)
+    {
+        node(n.next).prev = n.prev;
+    }
+    if (m_heads[flat] == NIL)
+    {
+        unsigned slot = flat & (SLOTS - 1);
+        m_occupied[flat / SLOTS][slot >> 6] &= ~(1ULL << (slot & 63));
+    }
+}
+
+void TimerWheel::advance(uint64_t target)
+{
+    while (m_now < target)
+    {
+        // Skip empty level-0 slots up to the end of the rotation, where upper levels move down
+        uint64_t boundary = (m_now | (SLOTS - 1)) + 1;
+        uint64_t stop = std::min(boundary, target);
+        uint64_t from = m_now + 1;
+        uint64_t next = stop;
+        if (from < stop)
+        {
+            unsigned first = static_cast<unsigned>(from) & (SLOTS - 1);
+            int distance = firstSet(m_occupied[0], first);
+            if (distance >= 0 && from + static_cast<unsigned>(distance) < stop)
+            {
+                next = from + static_cast<unsigned>(distance);
+            }
+        }
+        m_now = next;
+
+        if ((m_now & (SLOTS - 1)) == 0)
+        {
+            for (unsigned level = LEVELS - 1; level > 0; --level)
+            {
+                if ((m_now & ((1ULL << (SLOT_BITS * level)) - 1)) != 0)
+                {
+                    continue;
+                }
+                unsigned slot = static_cast<unsigned>(m_now >> (SLOT_BITS * level)) & (SLOTS - 1);
+                unsigned flat = level * SLOTS + slot;
+                uint32_t index = m_heads[flat];
+                m_heads[flat] = NIL;
+                m_occupied[level][slot >> 6] &= ~(1ULL << (slot & 63));
+                while (index != NIL)
+                {
+                    uint32_t following = node(index).next;
+                    insert(index);
+                    index = following;
+                }
+            }
+        }
+
+        unsigned slot = static_cast<unsigned>(m_now) & (SLOTS - 1);
+        uint32_t index = m_heads[slot];
+        if (index == NIL)
+        {
+            continue;
+        }
+        m_heads[slot] = NIL;
+        m_occupied[0][slot >> 6] &= ~(1ULL << (slot & 63));
+        while (index != NIL)
+        {
+            Node& n = node(index);
+            n.state = State::EXPIRED;
+            m_expired.push_back(index);
+            --m_pending;
+            index = n.next;
+        }
+    }
+}
+
+uint64_t TimerWheel::nextEvent() const
+{
+    uint64_t next = UINT64_MAX;
+
+    int distance = firstSet(m_occupied[0], static_cast<unsigned>(m_now + 1) & (SLOTS - 1));
+    if (distance >= 0)
+    {
+        next = m_now + 1 + static_cast<unsigned>(distance);
+    }
+
+    // An upper slot needs attention when time reaches its start; its own index is a full turn away
+    for (unsigned level = 1; level < LEVELS; ++level)
+    {
+        uint64_t turn = m_now >> (SLOT_BITS * level);
+        distance = firstSet(m_occupied[level], static_cast<unsigned>(turn + 1) & (SLOTS - 1));
+        if (distance >= 0)
+        {
+            next = std::min(next, (turn + 1 + static_cast<unsigned>(distance)) << (SLOT_BITS * level));
+        }
+    }
+    return next;
+}
+
+void TimerWheel::rearm()
+{
+    uint64_t next = nextEvent();
+    if (next == m_armed)
+    {
+        return;
+    }
+    m_armed = next;
+
+    struct itimerspec spec = {};
+    if (next != UINT64_MAX)
+    {
+        int64_t at = m_startNs + static_cast<int64_t>(next) * m_tickNs;
+        spec.it_value.tv_sec = at / 1000000000;
+        spec.it_value.tv_nsec = at % 1000000000;
+    }
+    timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+uint64_t TimerWheel::currentTick() const
+{
+    return static_cast<uint64_t>((monotonicNs() - m_startNs) / m_tickNs);
+}
+
+void TimerWheel::onReadable()
+{
+    uint64_t expirations;
+    while (read(m_timerFd, &expirations, sizeof(expirations)) == -1 && errno == EINTR)
+    {
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // A one-shot timerfd that fired is disarmed
+        m_armed = UINT64_MAX;
+        advance(std::max(currentTick(), m_now));
+        rearm();
+    }
+
+    // Only this thread fills m_expired; cancel() may still mark its nodes meanwhile
+    for (uint32_t index : m_expired)
+    {
+        SmallTask callback;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Node& n = node(index);
+            if (n.state == State::EXPIRED)
+            {
+                m_running = static_cast<TimerId>(n.generation) << 32 | index;
+                callback = std::move(n.callback);
+            }
+            release(index);
+        }
+        if (!callback)
+        {
+            continue;
+        }
+
+        callback();
+        callback = SmallTask();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = 0;
+        }
+        m_idle.notify_all();
+    }
+    m_expired.clear();
+}
@@ -0,0 +1,201 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "SmallTask.h"
+
+class Reactor;
+
+/**
+ * @class TimerWheel
+ * @brief Any number of one-shot timers on a single timerfd, in a hierarchical timing wheel.
+ *
+ * Time is counted in ticks (1 ms by default). A timer lives in one of four
+ * levels of 256 slots: level 0 holds timers due within 256 ticks, each
+ * higher level covers 256 times the span of the one below. When time
+ * reaches a slot of an upper level, its timers are moved down a level, so
+ * a timer is touched at most once per level. Timers due after the top
+ * level's span (about 49 days at 1 ms) wait in its farthest slot.
+ *
+ * schedule() and cancel() are O(1): timers are nodes in per-slot intrusive
+ * lists, kept in chunked storage with a free list, and a timer id carries
+ * the node index. The timerfd is armed for the next tick with work (found
+ * with per-level occupancy bitmaps), not for every tick, and disarmed when
+ * no timer is pending, so an idle wheel causes no wakeups.
+ *
+ * Callbacks run on the reactor thread, at most one tick late unless the
+ * reactor is busy. They may schedule and cancel timers.
+ */
+class TimerWheel
+{
+
+public:
+
+    /**
+     * @brief Identifies a scheduled timer; 0 is never a valid id.
+     */
+    using TimerId = uint64_t;
+
+    /**
+     * @brief Constructor; registers the wheel's timerfd on the reactor.
+     *
+     * @param reactor Loop running the callbacks.
+     * @param tick Resolution; delays are rounded up to whole ticks.
+     */
+    explicit TimerWheel         (Reactor& reactor, std::chrono::nanoseconds tick = std::chrono::milliseconds(1));
+
+    /**
+     * @brief Destructor; pending timers are dropped without running.
+     */
+    ~TimerWheel                 ();
+
+    TimerWheel                  (const TimerWheel&) = delete;
+    TimerWheel& operator=       (const TimerWheel&) = delete;
+
+    /**
+     * @brief Run a callback once after a delay (thread-safe).
+     *
+     * @param delay Time to wait; zero or negative runs it on the next tick.
+     * @param callback Any void() callable; runs on the reactor thread.
+     * @return Id for cancel().
+     */
+    template <typename F>
+    TimerId schedule            (std::chrono::nanoseconds delay, F&& callback)
+    {
+        return add(delay, SmallTask(std::forward<F>(callback)));
+    }
+
+    /**
+     * @brief Cancel a timer (thread-safe).
+     *
+     * If the callback is running, waits for it to return, unless called
+     * from the reactor thread.
+     *
+     * @param id Id returned by schedule(); ids of timers that fired or were
+     *           cancelled already are ignored.
+     * @return true if the callback will not run, false if it ran or is running.
+     */
+    bool cancel                 (TimerId id);
+
+    /**
+     * @brief Number of timers waiting to fire.
+     */
+    size_t size                 () const;
+
+private:
+
+    static constexpr unsigned   LEVELS = 4;             // Levels of the wheel
+    static constexpr unsigned   SLOT_BITS = 8;          // log2 of the slots per level
+    static constexpr unsigned   SLOTS = 1u << SLOT_BITS;
+    static constexpr uint32_t   NIL = UINT32_MAX;       // No node
+    static constexpr size_t     CHUNK_BITS = 12;        // log2 of the nodes per storage chunk
+
+    /** Where a node is */
+    enum class State : uint8_t
+    {
+        FREE,       // On the free list
+        PENDING,    // In a slot
+        EXPIRED,    // Taken out of its slot to be run
+        CANCELLED   // Expired, then cancelled before running
+    };
+
+    /**
+     * @struct Node
+     * @brief One timer.
+     */
+    struct Node
+    {
+        uint64_t    expiry;         // Tick the timer is due
+        uint32_t    prev;           // Previous node of the slot list, or of the free list
+        uint32_t    next;           // Next node of the slot list, or of the free list
+        uint32_t    generation;     // Bumped on every reuse, so stale ids miss
+        uint16_t    slot;           // Level * SLOTS + slot index while PENDING
+        State       state;          // Where the node is
+        SmallTask   callback;       // What to run
+    };
+
+    /**
+     * @brief Schedule a wrapped callback.
+     */
+    TimerId add                 (std::chrono::nanoseconds delay, SmallTask callback);
+
+    /**
+     * @brief Node by index.
+     */
+    Node& node                  (uint32_t index)
+    {
+        return m_chunks[index >> CHUNK_BITS][index & ((1u << CHUNK_BITS) - 1)];
+    }
+
+    /**
+     * @brief Take a node off the free list, growing the storage if needed.
+     */
+    uint32_t allocate           ();
+
+    /**
+     * @brief Return a node to the free list.
+     */
+    void release                (uint32_t index);
+
+    /**
+     * @brief Link a node into the slot covering its expiry, relative to m_now.
+     */
+    void insert                 (uint32_t index);
+
+    /**
+     * @brief Unlink a pending node from its slot.
+     */
+    void unlink                 (uint32_t index);
+
+    /**
+     * @brief Advance m_now to target, moving timers down and collecting expired ones into m_expired.
+     */
+    void advance                (uint64_t target);
+
+    /**
+     * @brief First tick after m_now with work (an expiry or a cascade), or UINT64_MAX if none.
+     */
+    uint64_t nextEvent          () const;
+
+    /**
+     * @brief Arm the timerfd for the next tick with work, unless it is armed for it already.
+     */
+    void rearm                  ();
+
+    /**
+     * @brief Current tick by the clock.
+     */
+    uint64_t currentTick        () const;
+
+    /**
+     * @brief Reactor handler: advance the wheel and run the expired callbacks.
+     */
+    void onReadable             ();
+
+    Reactor&                                m_reactor;      // Loop the timerfd is registered on
+    int                                     m_timerFd;      // Armed for the next tick with work
+    const int64_t                           m_startNs;      // CLOCK_MONOTONIC time of tick 0
+    const int64_t                           m_tickNs;       // Tick length
+
+    mutable std::mutex                      m_mutex;        // Protects the members below
+    std::condition_variable                 m_idle;         // Signals the end of a callback, for cancel()
+    std::vector<std::unique_ptr<Node[]>>    m_chunks;       // Node storage; nodes never move
+    uint32_t                                m_free;         // Head of the free list
+    uint32_t                                m_capacity;     // Nodes in m_chunks
+    uint32_t                                m_heads[LEVELS * SLOTS]; // First node of each slot
+    uint64_t                                m_occupied[LEVELS][SLOTS / 64]; // Non-empty slots of each level
+    uint64_t                                m_now;          // Last tick handled
+    uint64_t                                m_armed;        // Tick the timerfd is armed for, UINT64_MAX if disarmed
+    size_t                                  m_pending;      // Nodes in slots
+    std::vector<uint32_t>                   m_expired;      // Nodes taken out to be run (reactor thread)
+    TimerId                                 m_running;      // Timer whose callback runs, 0 if none
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,280 @@
+#include "UringFileLoader.h"
+#include "IoUring.h"
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// user_data of the wake-up read; jobs are tagged with their (aligned) address
+static const uint64_t WAKE_TAG = 1;
+
+// user_data of fire-and-forget closes, whose completions are ignored
+static const uint64_t CLOSE_TAG = 0;
+
+struct UringFileLoader::Job
+{
+    enum class Step { STAT, OPEN, READ };
+
+    LoadedFile      file;
+    Callback        callback;
+    Step            step = Step::STAT;
+    int             fd = -1;
+    struct statx    stx;
+};
+
+UringFileLoader::UringFileLoader(uint64_t maxFileSize, unsigned maxInFlight)
+    : m_wakeValue(0),
+      m_maxFileSize(maxFileSize),
+      m_maxInFlight(maxInFlight ? maxInFlight : 1),
+      m_inFlight(0)
+{
+    // Every job has one step in flight, plus its close and the wake-up read
+    itsRing = new IoUring(m_maxInFlight * 2 + 1);
+
+    m_eventFd = eventfd(0, EFD_CLOEXEC);
+    if (m_eventFd == -1)
+    {
+        delete itsRing;
+        throw std::runtime_error(std::string("Failed to create eventfd: ") + strerror(errno));
+    }
+
+    start();
+}
+
+UringFileLoader::~UringFileLoader()
+{
+    m_running = false;
+
+    // Complete the wake-up read so the loader drains and exits
+    uint64_t one = 1;
+    while (write(m_eventFd, &one, sizeof(one)) == -1 && errno == EINTR)
+    {
+    }
+    stop();
+
+    for (Job* job : m_queued)
+    {
+        delete job;
+    }
+    delete itsRing;
+    close(m_eventFd);
+}
+
+void UringFileLoader::load(const std::string& path, Callback callback)
+{
+    Job* job = new Job();
+    job->file.path = path;
+    job->callback = std::move(callback);
+
+    bool wasEmpty;
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        wasEmpty = m_queued.empty();
+        m_queued.push_back(job);
+    }
+
+    // The loader takes the whole queue at once, so only the first job of a batch wakes it
+    if (wasEmpty)
+    {
+        uint64_t one = 1;
+        while (write(m_eventFd, &one, sizeof(one)) == -1 && errno == EINTR)
+        {
+        }
+    }
+}
+
+/**
+ * @brief Next free SQE, flushing the submission queue to the kernel if it is full.
+ */
+static io_uring_sqe* nextSqe(IoUring* ring)
+{
+    io_uring_sqe* sqe = ring->getSqe();
+    if (!sqe)
+    {
+        ring->submit();
+        sqe = ring->getSqe();
+    }
+    return sqe;
+}
+
+bool UringFileLoader::armWakeup()
+{
+    io_uring_sqe* sqe = nextSqe(itsRing);
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = m_eventFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_wakeValue);
+    sqe->len = sizeof(m_wakeValue);
+    sqe->user_data = WAKE_TAG;
+    return true;
+}
+
+bool UringFileLoader::startJob(Job* job)
+{
+    io_uring_sqe* sqe = nextSqe(itsRing);
+    if (!sqe)
+    {
+        return false;
+    }
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(job->file.path.c_str());
+    sqe->len = STATX_TYPE | STATX_MODE | STATX_INO | STATX_SIZE | STATX_MTIME;
+    sqe->off = reinterpret_cast<uint64_t>(&job->stx);
+    sqe->statx_flags = AT_STATX_SYNC_AS_STAT;
+    sqe->user_data = reinterpret_cast<uint64_t>(job);
+    job->step = Job::Step::STAT;
+    ++m_inFlight;
+    return true;
+}
+
+void UringFileLoader::onCompletion(Job* job, int result)
+{
+    LoadedFile& file = job->file;
+
+    if (result < 0)
+    {
+        file.error = -result;
+        finish(job);
+        return;
+    }
+
+    io_uring_sqe* sqe = nullptr;
+    switch (job->step)
+    {
+        case Job::Step::STAT:
+            file.size = job->stx.stx_size;
+            file.mtimeNs = static_cast<int64_t>(job->stx.stx_mtime.tv_sec) * 1000000000LL + job->stx.stx_mtime.tv_nsec;
+            file.inode = job->stx.stx_ino;
+            file.regular = S_ISREG(job->stx.stx_mode);
+
+            // Only small regular files are read; the caller streams the rest itself
+            if (!file.regular || file.size > m_maxFileSize)
+            {
+                finish(job);
+                return;
+            }
+            if (file.size == 0)
+            {
+                file.loaded = true;
+                finish(job);
+                return;
+            }
+
+            sqe = nextSqe(itsRing);
+            sqe->opcode = IORING_OP_OPENAT;
+            sqe->fd = AT_FDCWD;
+            sqe->addr = reinterpret_cast<uint64_t>(file.path.c_str());
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            sqe->user_data = reinterpret_cast<uint64_t>(job);
+            job->step = Job::Step::OPEN;
+            break;
+
+        case Job::Step::OPEN:
+            job->fd = result;
+
+            // One byte more than statx reported tells whether the file grew since
+            file.data.resize(file.size + 1);
+            sqe = nextSqe(itsRing);
+            sqe->opcode = IORING_OP_READ;
+            sqe->fd = job->fd;
+            sqe->addr = reinterpret_cast<uint64_t>(&file.data[0]);
+            sqe->len = static_cast<uint32_t>(file.data.size());
+            sqe->off = 0;
+            sqe->user_data = reinterpret_cast<uint64_t>(job);
+            job->step = Job::Step::READ;
+            break;
+
+        case Job::Step::READ:
+            // A short or long read means the file changed under us; report it unloaded
+            file.loaded = static_cast<uint64_t>(result) == file.size;
+            file.data.resize(file.loaded ? file.size : 0);
+            finish(job);
+            break;
+    }
+}
+
+void UringFileLoader::finish(Job* job)
+{
+    if (job->fd != -1)
+    {
+        io_uring_sqe* sqe = nextSqe(itsRing);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = job->fd;
+        sqe->user_data = CLOSE_TAG;
+    }
+
+    --m_inFlight;
+    if (m_running)
+    {
+        job->callback(job->file);
+    }
+    delete job;
+}
+
+void UringFileLoader::thread()
+{
+    std::deque<Job*> waiting;
+    bool wakeArmed = armWakeup();
+
+    // After stop, keep reaping until the kernel no longer references any job or m_wakeValue
+    while (m_running || m_inFlight > 0 || wakeArmed)
+    {
+        if (m_running)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_queueMutex);
+                waiting.insert(waiting.end(), m_queued.begin(), m_queued.end());
+                m_queued.clear();
+            }
+            while (m_inFlight < m_maxInFlight && !waiting.empty() && startJob(waiting.front()))
+            {
+                waiting.pop_front();
+            }
+            if (!wakeArmed)
+            {
+                wakeArmed = armWakeup();
+            }
+        }
+        else
+        {
+            for (Job* job : waiting)
+            {
+                delete job;
+            }
+            waiting.clear();
+        }
+
+        int rc = itsRing->submit(1);
+        if (rc < 0 && rc != -EBUSY)
+        {
+            std::cerr << "io_uring_enter failed: " << strerror(-rc) << std::endl;
+            break;
+        }
+
+        io_uring_cqe cqe;
+        while (itsRing->popCompletion(cqe))
+        {
+            if (cqe.user_data == WAKE_TAG)
+            {
+                wakeArmed = false;
+            }
+            else if (cqe.user_data != CLOSE_TAG)
+            {
+                onCompletion(reinterpret_cast<Job*>(cqe.user_data), cqe.res);
+            }
+        }
+    }
+
+    for (Job* job : waiting)
+    {
+        delete job;
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef URING_FILE_LOADER_H
+#define URING_FILE_LOADER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "threadBase.h"
+
+class IoUring;
+
+/**
+ * @class UringFileLoader
+ * @brief Loads the metadata and contents of many small files through one io_uring.
+ *
+ * Every load() is a small state machine (statx, openat, read, close) whose
+ * steps are queued on a single ring and submitted together, so thousands of
+ * files are stat'ed and read with a handful of system calls on one thread
+ * instead of one blocking thread per file. Files larger than maxFileSize, or
+ * that are not regular files, are only stat'ed; the caller reads them the
+ * usual way.
+ *
+ * Callbacks run on the loader thread in completion order and should not block.
+ */
+class UringFileLoader : public ThreadBase
+{
+
+public:
+
+    /**
+     * @struct LoadedFile
+     * @brief Result of one load().
+     */
+    struct LoadedFile
+    {
+        std::string path;           // Path passed to load()
+        int         error = 0;      // errno of the failed step, 0 on success
+        uint64_t    size = 0;       // File size from statx
+        int64_t     mtimeNs = 0;    // Modification time in nanoseconds since the epoch
+        uint64_t    inode = 0;      // Inode number
+        bool        regular = false;// true if the path is a regular file
+        bool        loaded = false; // true if data holds exactly size bytes of content
+        std::string data;           // File content when loaded
+    };
+
+    using Callback = std::function<void(LoadedFile& file)>;
+
+    /**
+     * @brief Constructor for UringFileLoader. Starts the loader thread.
+     *
+     * @param maxFileSize Largest file whose contents are read.
+     * @param maxInFlight Maximum number of files being loaded at once.
+     * @throw std::runtime_error if io_uring or the wake-up eventfd is unavailable.
+     */
+    explicit UringFileLoader    (uint64_t maxFileSize = 64 * 1024, unsigned maxInFlight = 256);
+
+    /**
+     * @brief Destructor for UringFileLoader. Loads not finished yet are dropped without a callback.
+     */
+    ~UringFileLoader            ();
+
+    /**
+     * @brief Queue a file for loading (thread-safe).
+     *
+     * @param path Path of the file.
+     * @param callback Invoked on the loader thread with the result.
+     */
+    void load                   (const std::string& path, Callback callback);
+
+    /**
+     * @brief Largest file whose contents are read.
+     */
+    uint64_t maxFileSize        () const { return m_maxFileSize; }
+
+protected:
+
+    /**
+     * @brief Loader thread: feeds the ring and dispatches completions.
+     */
+    void thread                 () override;
+
+private:
+
+    struct Job;
+
+    /**
+     * @brief Queue the statx of a job.
+     */
+    bool startJob               (Job* job);
+
+    /**
+     * @brief Advance a job after one of its steps completed.
+     */
+    void onCompletion           (Job* job, int result);
+
+    /**
+     * @brief Report a job to its callback and free it.
+     */
+    void finish                 (Job* job);
+
+    /**
+     * @brief Queue the persistent read of the wake-up eventfd.
+     */
+    bool armWakeup              ();
+
+    IoUring*            itsRing;        // Ring owned by the loader thread
+
+    int                 m_eventFd;      // Wakes the loader when jobs are queued or on stop
+
+    uint64_t            m_wakeValue;    // Target of the eventfd read
+
+    uint64_t            m_maxFileSize;  // Largest file whose contents are read
+
+    unsigned            m_maxInFlight;  // Limit on concurrently loading files
+
+    unsigned            m_inFlight;     // Jobs started and not finished (loader thread only)
+
+    std::mutex          m_queueMutex;   // Protects m_queued
+
+    std::vector<Job*>   m_queued;       // Jobs waiting for the loader thread
+};
+
+#endif // URING_FILE_LOADER_H
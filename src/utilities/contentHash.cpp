@@ -0,0 +1,179 @@
+#include "contentHash.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+// Read size used by hashFile()
+const size_t READ_BLOCK = 1 << 20;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t read64(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t read32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 31);
+    return acc * PRIME1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t val)
+{
+    acc ^= round(0, val);
+    return acc * PRIME1 + PRIME4;
+}
+
+// Consume whole 32-byte stripes, returning the first unconsumed byte
+inline const uint8_t* consumeStripes(uint64_t v[4], const uint8_t* p, const uint8_t* end)
+{
+    uint64_t v1 = v[0], v2 = v[1], v3 = v[2], v4 = v[3];
+    while (end - p >= 32) {
+        v1 = round(v1, read64(p));
+        v2 = round(v2, read64(p + 8));
+        v3 = round(v3, read64(p + 16));
+        v4 = round(v4, read64(p + 24));
+        p += 32;
+    }
+    v[0] = v1; v[1] = v2; v[2] = v3; v[3] = v4;
+    return p;
+}
+
+} // namespace
+
+namespace contentHash {
+
+Hasher::Hasher(uint64_t seed)
+    : m_total(0),
+      m_seed(seed),
+      m_v{seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1},
+      m_bufLen(0)
+{
+}
+
+void Hasher::update(const void* data, size_t len)
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    const uint8_t* const end = p + len;
+    m_total += len;
+
+    if (m_bufLen > 0) {
+        size_t fill = std::min(len, sizeof(m_buf) - m_bufLen);
+        memcpy(m_buf + m_bufLen, p, fill);
+        m_bufLen += fill;
+        p += fill;
+        if (m_bufLen < sizeof(m_buf)) {
+            return;
+        }
+        consumeStripes(m_v, m_buf, m_buf + sizeof(m_buf));
+        m_bufLen = 0;
+    }
+
+    p = consumeStripes(m_v, p, end);
+
+    m_bufLen = static_cast<size_t>(end - p);
+    memcpy(m_buf, p, m_bufLen);
+}
+
+uint64_t Hasher::digest() const
+{
+    uint64_t h;
+
+    if (m_total >= 32) {
+        h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+        h = mergeRound(h, m_v[0]);
+        h = mergeRound(h, m_v[1]);
+        h = mergeRound(h, m_v[2]);
+        h = mergeRound(h, m_v[3]);
+    } else {
+        h = m_seed + PRIME5;
+    }
+
+    h += m_total;
+
+    const uint8_t* p = m_buf;
+    const uint8_t* const end = m_buf + m_bufLen;
+
+    while (p + 8 <= end) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * PRIME1 + PRIME4;
+        p += 8;
+    }
+
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        h = rotl(h, 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+
+    while (p < end) {
+        h ^= (*p) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+        ++p;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t hash64(const void* data, size_t len, uint64_t seed)
+{
+    Hasher hasher(seed);
+    hasher.update(data, len);
+    return hasher.digest();
+}
+
+bool hashFile(const std::string& path, uint64_t& out)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[READ_BLOCK]);
+    Hasher hasher;
+    ssize_t n;
+    while ((n = read(fd, buffer.get(), READ_BLOCK)) > 0) {
+        hasher.update(buffer.get(), static_cast<size_t>(n));
+    }
+    close(fd);
+
+    if (n < 0) {
+        return false;
+    }
+
+    out = hasher.digest();
+    return true;
+}
+
+} // namespace contentHash